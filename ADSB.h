@@ -2,27 +2,123 @@
 
 #include "ADSBListener.h"
 #include "AircraftImpl.h"
+#include "GainController.h"
 #include "RTLSDR.hpp"
+#include "UpdateStream.h"
 
 namespace ADSB
 {
 
+enum class SquelchMode : uint8_t
+{
+    Off,
+    Fast,      // Skip blocks whose largest |I| or |Q| is below the threshold
+    Strict,    // Never skip a sample whose magnitude is at or above the threshold
+};
+
+// A frame as it leaves the demodulator, before tracking
+struct DemodulatedFrame
+{
+    uint64_t                 sample{};    // Counted from the first sample handled. For 978 the start of the block dump978 found it in
+    std::span<uint8_t const> bytes;       // Error corrected
+    uint32_t                 addr{};      // ICAO address, recovered from the AP field for 1090 replies. 0 for uplinks
+    float                    signalLevel{};    // dBFS, 1090 only
+    float                    noiseLevel{};
+    int                      corrected{};    // Bits (1090) or Reed-Solomon symbols (978) fixed
+    bool                     uplink{};       // 978 ground uplink
+};
+
+// Takes the frames of a handler (HandlerConfig::frameTap) instead of the tracker, so that parts of a capture
+// can be demodulated independently and tracked in order afterwards (BulkDecoder.h).
+// Called on the data handler thread, bytes are only valid during the call
+struct IFrameTap
+{
+    IFrameTap()          = default;
+    virtual ~IFrameTap() = default;
+    CLASS_DEFAULT_COPY_AND_MOVE(IFrameTap);
+
+    virtual void OnFrame(DemodulatedFrame const& frame) = 0;
+};
+
+// Implemented by both handlers. Runs a tapped frame through the tracker as if it had just been demodulated,
+// at captureStart plus frame.sample at the handler's sample rate. Messages for IMessageListener subscribers
+// are passed on a full batch at a time; FlushFrames passes the rest and what the tracker holds back, like
+// the end of a buffer does
+struct IFrameTracker
+{
+    using time_point = IAirCraft::time_point;
+
+    IFrameTracker()          = default;
+    virtual ~IFrameTracker() = default;
+    CLASS_DEFAULT_COPY_AND_MOVE(IFrameTracker);
+
+    virtual void TrackFrame(DemodulatedFrame const& frame, time_point captureStart) = 0;
+    virtual void FlushFrames()                                                      = 0;
+
+    [[nodiscard]] static time_point FrameTime(time_point captureStart, uint64_t sample, uint32_t sampleRate)
+    {
+        auto seconds = std::chrono::duration<double>(static_cast<double>(sample) / static_cast<double>(sampleRate));
+        return captureStart + std::chrono::duration_cast<time_point::duration>(seconds);
+    }
+};
+
+// Settings shared by the 1090 and 978 handlers.
+// Frequency and sample rate are filled in with the band defaults when left at zero
+struct HandlerConfig
+{
+    RTLSDR::Config device{};
+
+    // 1090 only. Preamble search is skipped on blocks with nothing above squelchFactor times the noise floor
+    SquelchMode squelch       = SquelchMode::Off;
+    double      squelchFactor = 5.0;
+
+    // 1090 only. Steps the tuner gain while running, starting from device.gain, to get the most
+    // messages through without overloading. Needs a device with manual gain steps
+    bool                   adaptiveGain = false;
+    GainController::Config gainControl{};
+
+    // Demodulated frames go here instead of the tracker when set
+    IFrameTap* frameTap = nullptr;
+};
+
 std::unique_ptr<ADSB::IDataProvider> TryCreateUAT978Handler(std::shared_ptr<ADSB::TrafficManager> const& trafficManager,
                                                             RTLSDR::IDeviceSelector const*               selector,
-                                                            Source                                       sourceId);
+                                                            Source                                       sourceId,
+                                                            HandlerConfig const&                         config);
 std::unique_ptr<ADSB::IDataProvider> TryCreateADSB1090Handler(std::shared_ptr<ADSB::TrafficManager> const& trafficManager,
                                                               RTLSDR::IDeviceSelector const*               selector,
-                                                              Source                                       sourceId);
+                                                              Source                                       sourceId,
+                                                              HandlerConfig const&                         config);
 TrafficManager**                     GetThreadLocalTrafficManager();
+
+// Receives the frames dump978 demodulates on the current thread
+struct IUATFrameSink
+{
+    IUATFrameSink()          = default;
+    virtual ~IUATFrameSink() = default;
+    CLASS_DEFAULT_COPY_AND_MOVE(IUATFrameSink);
+
+    virtual void OnUplinkFrame(std::span<uint8_t const> const& frame, int rsErrors) = 0;
+
+    // Returns false when the frame was tapped (HandlerConfig::frameTap) and must not be tracked
+    virtual bool OnDownlinkFrame(std::span<uint8_t const> const& frame, int rsErrors) = 0;
+};
+
+IUATFrameSink** GetThreadLocalUATFrameSink();
+
+std::unique_ptr<IDataProvider> CreateADSB1090Provider(HandlerConfig const& config);
+std::unique_ptr<IDataProvider> CreateUAT978Provider(HandlerConfig const& config);
 }    // namespace ADSB
 
 namespace ADSB::test
 {
 std::unique_ptr<RTLSDR::IDataHandler> TryCreateUAT978Handler(std::shared_ptr<ADSB::TrafficManager> const& trafficManager,
                                                              RTLSDR::IDeviceSelector const*               selector,
-                                                             Source                                       sourceId);
+                                                             Source                                       sourceId,
+                                                             HandlerConfig const&                         config = {});
 std::unique_ptr<RTLSDR::IDataHandler> TryCreateADSB1090Handler(std::shared_ptr<ADSB::TrafficManager> const& trafficManager,
                                                                RTLSDR::IDeviceSelector const*               selector,
-                                                               Source                                       sourceId);
+                                                               Source                                       sourceId,
+                                                               HandlerConfig const&                         config = {});
 
 }    // namespace ADSB::test
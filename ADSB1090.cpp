@@ -1,4 +1,4 @@
-#include "ADSB.h"
+#include "ADSB1090Handler.h"
 
 SUPPRESS_WARNINGS_START
 SUPPRESS_STL_WARNINGS
@@ -23,226 +23,10 @@ SUPPRESS_WARNINGS_END
 // #define MODES_DEBUG_NOPREAMBLE (1 << 4)
 // #define MODES_DEBUG_NET (1 << 5)
 // #define MODES_DEBUG_JS (1 << 6)
-using time_point = std::chrono::time_point<std::chrono::system_clock>;
 /* When debug is set to MODES_DEBUG_NOPREAMBLE, the first sample must be
  * at least greater than a given level for us to dump the signal. */
 // #define MODES_DEBUG_NOPREAMBLE_LEVEL 25
 
-/* The struct we use to store information about a decoded message. */
-struct Message
-{
-    static constexpr size_t LongMessageBits  = 112;
-    static constexpr size_t LongMessageBytes = LongMessageBits / 8;
-
-    static constexpr size_t ShortMessageBits = 56;
-    // static constexpr size_t ShortMessageBytes = ShortMessageBits / 8;
-
-    enum class ModeSUnit : uint8_t
-    {
-        Feet   = 0,
-        Meters = 1
-    };
-
-    // #define MODES_DEBUG_DEMOD (1 << 0)
-    // enum class
-    //{
-    //    ModesDebugDemoderr = (1 << 1)
-    //};
-
-    /* Generic fields */
-    std::array<uint8_t, LongMessageBytes> msg; /* Binary message. */
-
-    size_t   msgbits;       /* Number of bits in message */
-    int      msgtype;       /* Downlink format # */
-    int      crcok;         /* True if CRC was valid */
-    uint32_t crc;           /* Message CRC */
-    int      errorbit;      /* Bit corrected. -1 if no bit corrected. */
-    int      aa1, aa2, aa3; /* ICAO Address bytes 1 2 and 3 */
-                            //    int      phaseCorrected; /* True if phase correction was applied. */
-
-    /* DF 11 */
-    int ca; /* Responder capabilities. */
-
-    /* DF 17 */
-    int metype; /* Extended squitter message type. */
-    int mesub;  /* Extended squitter message subtype. */
-    // int headingIsValid;
-    int heading;
-    // int aircraftType;
-    int fflag; /* 1 = Odd, 0 = Even CPR message. */
-    // int tflag;        /* UTC synchronized? */
-    int rawLatitude;  /* Non decoded latitude */
-    int rawLongitude; /* Non decoded longitude */
-
-    std::array<char, 8> flight; /* 8 chars flight number. */
-
-    int ewDir;      /* 0 = East, 1 = West. */
-    int ewVelocity; /* E/W velocity. */
-    int nsDir;      /* 0 = North, 1 = South. */
-    int nsVelocity; /* N/S velocity. */
-    // int vertRateSource; /* Vertical rate source. */
-    // int vertRateSign;   /* Vertical rate sign. */
-    // int vertRate;       /* Vertical rate. */
-    int velocity; /* Computed from EW and NS velocity. */
-
-    /* DF4, DF5, DF20, DF21 */
-    int fs;       /* Flight status for DF4,5,20,21 */
-    int dr;       /* Request extraction of downlink request. */
-    int um;       /* Request extraction of downlink request. */
-    int identity; /* 13 bits identity (Squawk). */
-
-    /* Fields used by multiple message types. */
-    int       altitude;
-    ModeSUnit unit;
-};
-
-struct ADSB1090Handler : RTLSDR::IDataHandler, ADSB::IDataProvider
-{
-    static constexpr size_t PreambleUS = 8; /*microseconds*/
-
-    static constexpr size_t LongMessageBits  = 112;
-    static constexpr size_t ShortMessageBits = 56;
-    static constexpr size_t FullLength       = PreambleUS + LongMessageBits;
-    static constexpr size_t LongMessageBytes = LongMessageBits / 8;
-    // static constexpr size_t ShortMessageBytes = ShortMessageBits / 8;
-
-    static constexpr size_t BufferLength = (RTLSDR::BufferCount * RTLSDR::BufferLength) + ((FullLength - 1) * 4);
-
-    struct Config
-    {
-
-        bool fixErrors = true;
-        bool checkCRC  = true;
-        bool raw       = false;
-        // bool onlyaddr    = false;
-        bool debug       = false;
-        bool interactive = false;
-        bool aggressive  = false;
-        bool loop        = false;
-    };
-    struct DeviceSelector : RTLSDR::IDeviceSelector
-    {
-        [[nodiscard]] bool SelectDevice(RTLSDR::DeviceInfo const& d) const override
-        {
-            return std::string_view(d.serial).find("1090") != std::string_view::npos;
-        }
-    };
-
-    static std::vector<uint16_t> CreateLUT()
-    {
-        std::vector<uint16_t> lut(static_cast<size_t>(129u * 129u * 2u));
-        for (uint8_t i = 0; i <= 128; i++)
-        {
-            for (uint8_t q = 0; q <= 128; q++)
-            {
-                lut[(i * 129u) + q] = static_cast<uint16_t>(std::round(std::sqrt((i * i) + (q * q)) * 360));
-            }
-        }
-        return lut;
-    }
-
-    ADSB1090Handler(std::shared_ptr<ADSB::TrafficManager> trafficManagerIn,
-                    RTLSDR::IDeviceSelector const*        selectorIn,
-                    ADSB::Source                          sourceIdIn) :
-        trafficManager(std::move(trafficManagerIn)),
-        listener1090{selectorIn, RTLSDR::Config{.frequency = 1090000000, .sampleRate = 2000000}},
-        sourceId(sourceIdIn)
-    {
-        std::cout << "ADSB Tracker Initializing" << '\n';
-    }
-
-    ~ADSB1090Handler() override = default;
-
-    CLASS_DELETE_COPY_AND_MOVE(ADSB1090Handler);
-
-    void HandleData(std::span<uint8_t const> const& data) override
-    {
-        uint16_t* m = magnitudeVector.data();
-        auto*     p = data.data();
-
-        /* Compute the magnitudo vector. It's just SQRT(I^2 + Q^2), but
-         * we rescale to the 0-255 range to exploit the full resolution. */
-        for (uint32_t j = 0; j < data.size(); j += 2)
-        {
-            int i = p[j] - 127;
-            int q = p[j + 1] - 127;
-
-            if (i < 0) i = -i;
-            if (q < 0) q = -q;
-            m[j / 2] = magnitudesLookupTable[static_cast<size_t>(i * 129 + q)];
-        }
-        DetectModeS({m, static_cast<uint32_t>(data.size() / 2)});
-    }
-
-    void OnDeviceStatusChanged(bool available) override { listener->OnDeviceStatusChanged(sourceId, available); }
-
-    void Start(ADSB::IListener& listenerIn) override
-    {
-        listener = &listenerIn;
-        listener1090.Start(this);
-    }
-    void Stop() override
-    {
-        //listener = nullptr;
-        listener1090.Stop();
-    }
-
-    void NotifySelfLocation(ADSB::IAirCraft const& /*unused*/) override {}
-
-    /* Add the specified entry to the cache of recently seen ICAO addresses.
-     * Note that we also add a timestamp so that we can make sure that the
-     * entry is only valid for MODES_ICAO_CACHE_TTL seconds. */
-    void AddRecentlySeenIcaoAddr(uint32_t addr) { icaoTimestamps[addr] = std::chrono::system_clock::now(); }
-
-    /* Returns 1 if the specified ICAO address was seen in a DF format with
-     * proper checksum (not xored with address) no more than * MODES_ICAO_CACHE_TTL
-     * seconds ago. Otherwise returns 0. */
-    bool IcaoAddressWasRecentlySeen(uint32_t addr)
-    {
-        static constexpr long ModesIcaoCacheTtlInSecs = 60;
-
-        auto it = icaoTimestamps.find(addr);
-        return it != icaoTimestamps.end()
-               && (std::chrono::system_clock::now() - it->second) <= std::chrono::seconds{ModesIcaoCacheTtlInSecs};
-    }
-
-    bool                BruteForceAp(std::array<uint8_t, Message::LongMessageBytes> const& msg, Message& mm);
-    Message             DecodeModesMessage(std::array<uint8_t, Message::LongMessageBytes> const& msgIn);
-    void                DetectModeS(std::span<uint16_t> const& m);
-    ADSB::AirCraftImpl& InteractiveReceiveData(Message const& mm);
-    ADSB::AirCraftImpl& InteractiveFindOrCreateAircraft(uint32_t addr);
-    void                UseModesMessage(Message const& mm);
-    // void                ModesSendSbsOutput(Message const& mm, ADSB::AirCraftImpl& a);
-
-    std::unordered_map<uint32_t, std::chrono::system_clock::time_point> icaoTimestamps;
-
-    Config                config{};
-    std::vector<uint16_t> magnitudesLookupTable = CreateLUT();
-    // std::vector<uint8_t>  data;
-    std::vector<uint16_t> magnitudeVector = std::vector<uint16_t>(BufferLength, 0xffff);
-
-    std::shared_ptr<ADSB::TrafficManager> trafficManager;
-
-    // DataRecorder<AirCraftImpl> _recorder;
-    ADSB::IListener* listener{nullptr};
-
-    std::mutex        mutex;
-    std::atomic<bool> stopRequested{false};
-    DeviceSelector    selector;
-    RTLSDR            listener1090;
-    ADSB::Source      sourceId{ADSB::Source::ADSB1090};
-    /* Statistics */
-    long long statValidPreamble{};
-    long long statDemodulated{};
-    long long statGoodcrc{};
-    long long statBadcrc{};
-    long long statFixed{};
-    long long statSingleBitFix{};
-    long long statTwoBitsFix{};
-    long long statSbsConnections{};
-    long long statOutOfPhase{};
-};
-
 /* ===================== Mode S detection and decoding  ===================== */
 
 /* Parity table for MODE S Messages.
@@ -274,7 +58,7 @@ static constexpr auto ModesChecksumTable = std::array<uint32_t, 112>{
     0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000,
     0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000};
 
-static uint32_t ModesChecksum(std::array<uint8_t, Message::LongMessageBytes> const& msg, size_t bits)
+uint32_t ModesChecksum(std::array<uint8_t, Message::LongMessageBytes> const& msg, size_t bits)
 {
     uint32_t crc    = 0;
     size_t   offset = (bits == 112) ? 0u : (112u - 56u);
@@ -294,14 +78,13 @@ static uint32_t ModesChecksum(std::array<uint8_t, Message::LongMessageBytes> con
  * in bits. */
 static size_t ModesMessageLenByType(int type)
 {
-    if (type == 16 || type == 17 || type == 19 || type == 20 || type == 21) { return Message::LongMessageBits; }
-    return Message::ShortMessageBits;
+    return Message::BitsForDf(static_cast<uint32_t>(type));
 }
 
 /* Try to fix single bit errors using the checksum. On success modifies
  * the original buffer with the fixed version, and returns the position
  * of the error bit. Otherwise if fixing failed -1 is returned. */
-static int FixSingleBitErrors(std::array<uint8_t, Message::LongMessageBytes>& msg, size_t bits)
+int FixSingleBitErrors(std::array<uint8_t, Message::LongMessageBytes>& msg, size_t bits)
 {
     std::array<uint8_t, Message::LongMessageBytes> aux;    // NOLINT
 
@@ -334,7 +117,7 @@ static int FixSingleBitErrors(std::array<uint8_t, Message::LongMessageBytes>& ms
 /* Similar to fixSingleBitErrors() but try every possible two bit combination.
  * This is very slow and should be tried only against DF17 messages that
  * don't pass the checksum, and only in Aggressive Mode. */
-static inline int FixTwoBitsErrors(std::array<uint8_t, Message::LongMessageBytes>& msg, size_t bits)
+int FixTwoBitsErrors(std::array<uint8_t, Message::LongMessageBytes>& msg, size_t bits)
 {
     size_t j = 0;
     size_t i = 0;
@@ -385,11 +168,8 @@ static inline int FixTwoBitsErrors(std::array<uint8_t, Message::LongMessageBytes
  * the address XOR checksum field in the message. This will recover the
  * address: if we found it in our cache, we can assume the message is ok.
  *
- * This function expects mm.msgtype and mm.msgbits to be correctly
- * populated by the caller.
- *
  * On success the correct ICAO address is stored in the modesMessage
- * structure in the aa3, aa2, and aa1 fiedls.
+ * structure in the addr field.
  *
  * If the function successfully recovers a message with a correct checksum
  * it returns 1. Otherwise 0 is returned. */
@@ -397,8 +177,8 @@ inline bool ADSB1090Handler::BruteForceAp(std::array<uint8_t, Message::LongMessa
 {
     std::array<uint8_t, Message::LongMessageBytes> aux{};
 
-    int  msgtype = mm.msgtype;
-    auto msgbits = mm.msgbits;
+    uint32_t msgtype = mm.Df();
+    size_t   msgbits = mm.Bits();
 
     if (msgtype == 0 ||  /* Short air surveillance */
         msgtype == 4 ||  /* Surveillance, altitude reply */
@@ -425,9 +205,7 @@ inline bool ADSB1090Handler::BruteForceAp(std::array<uint8_t, Message::LongMessa
         uint32_t addr = uint32_t{aux[lastbyte]} | (uint32_t{aux[lastbyte - 1]} << 8) | (uint32_t{aux[lastbyte - 2]} << 16);
         if (IcaoAddressWasRecentlySeen(addr))
         {
-            mm.aa1 = aux[lastbyte - 2];
-            mm.aa2 = aux[lastbyte - 1];
-            mm.aa3 = aux[lastbyte];
+            mm.addr = addr;
             return 1;
         }
     }
@@ -435,16 +213,14 @@ inline bool ADSB1090Handler::BruteForceAp(std::array<uint8_t, Message::LongMessa
 }
 
 /* Decode the 13 bit AC altitude field (in DF 20 and others).
- * Returns the altitude, and set 'unit' to either MODES_UNIT_METERS
- * or MDOES_UNIT_FEETS. */
-static inline int DecodeAC13Field(std::array<uint8_t, Message::LongMessageBytes> const& msg, Message::ModeSUnit& unit)
+ * Returns the altitude, the unit (M bit) is read by Message::AltitudeUnit(). */
+static inline int DecodeAC13Field(std::array<uint8_t, Message::LongMessageBytes> const& msg)
 {
     int mBit = msg[3] & (1 << 6);
     int qBit = msg[3] & (1 << 4);
 
     if (mBit == 0)
     {
-        unit = Message::ModeSUnit::Feet;
         if (qBit != 0)
         {
             /* N is the 11 bit integer resulting from the removal of bit
@@ -457,17 +233,13 @@ static inline int DecodeAC13Field(std::array<uint8_t, Message::LongMessageBytes>
 
         /* TODO: Implement altitude where Q=0 and M=0 */
     }
-    else
-    {
-        unit = Message::ModeSUnit::Meters;
-        /* TODO: Implement altitude when meter unit is selected. */
-    }
+    /* TODO: Implement altitude when meter unit is selected. */
     return 0;
 }
 
 /* Decode the 12 bit AC altitude field (in DF 17 and others).
  * Returns the altitude or 0 if it can't be decoded. */
-static inline int DecodeAC12Field(std::array<uint8_t, Message::LongMessageBytes> const& msg, Message::ModeSUnit& unit)
+static inline int DecodeAC12Field(std::array<uint8_t, Message::LongMessageBytes> const& msg)
 {
     int qBit = msg[5] & 1;
 
@@ -475,7 +247,6 @@ static inline int DecodeAC12Field(std::array<uint8_t, Message::LongMessageBytes>
     {
         /* N is the 11 bit integer resulting from the removal of bit
          * Q */
-        unit  = Message::ModeSUnit::Feet;
         int n = ((msg[5] >> 1) << 4) | ((msg[6] & 0xF0) >> 4);
         /* The final altitude is due to the resulting number multiplied
          * by 25, minus 1000. */
@@ -490,187 +261,126 @@ static inline int DecodeAC12Field(std::array<uint8_t, Message::LongMessageBytes>
  * structure. */
 inline Message ADSB1090Handler::DecodeModesMessage(std::array<uint8_t, Message::LongMessageBytes> const& msgIn)
 {
-    Message  mm{};
-    uint32_t crc2{}; /* Computed CRC, used to verify the message CRC. */
+    Message mm{};
 
     /* Work on our local copy */
     mm.msg = msgIn;
 
     /* Get the message type ASAP as other operations depend on this */
-    mm.msgtype = mm.msg[0] >> 3; /* Downlink Format */
-    mm.msgbits = ModesMessageLenByType(mm.msgtype);
-
-    /* CRC is always the last three bytes. */
-    mm.crc = (uint32_t{mm.msg[(mm.msgbits / 8) - 3]} << 16) | (uint32_t{mm.msg[(mm.msgbits / 8) - 2]} << 8)
-             | uint32_t{mm.msg[(mm.msgbits / 8) - 1]};
-    crc2 = ModesChecksum(mm.msg, mm.msgbits);
+    uint32_t msgtype = mm.Df(); /* Downlink Format */
+    size_t   msgbits = mm.Bits();
 
     /* Check CRC and fix single bit errors using the CRC when
-     * possible (DF 11 and 17). */
+     * possible (DF 11 and 17). The CRC is always the last three bytes. */
     mm.errorbit = -1; /* No error */
-    mm.crcok    = static_cast<int>(mm.crc == crc2);
+    mm.crcok    = static_cast<uint8_t>(mm.Crc() == ModesChecksum(mm.msg, msgbits));
 
-    if ((mm.crcok == 0) && config.fixErrors && (mm.msgtype == 11 || mm.msgtype == 17))
+    if ((mm.crcok == 0) && config.fixErrors && (msgtype == 11 || msgtype == 17))
     {
-        if ((mm.errorbit = FixSingleBitErrors(mm.msg, mm.msgbits)) != -1)    // NOLINT
-        {                                                                    // NOLINT
-            mm.crc   = ModesChecksum(mm.msg, mm.msgbits);
-            mm.crcok = 1;
-        }
-        else if (config.aggressive && mm.msgtype == 17 && (mm.errorbit = FixTwoBitsErrors(mm.msg, mm.msgbits)) != -1)    // NOLINT
+        int errorbit = FixSingleBitErrors(mm.msg, msgbits);
+        if (errorbit == -1 && config.aggressive && msgtype == 17) { errorbit = FixTwoBitsErrors(mm.msg, msgbits); }
+        if (errorbit != -1)
         {
-            mm.crc   = ModesChecksum(mm.msg, mm.msgbits);
-            mm.crcok = 1;
+            mm.errorbit = static_cast<int16_t>(errorbit);
+            mm.crcok    = 1;
         }
     }
 
-    /* Note that most of the other computation happens *after* we fix
+    /* Note that the computation of the other fields happens *after* we fix
      * the single bit errors, otherwise we would need to recompute the
-     * fields again. */
-    mm.ca = mm.msg[0] & 7; /* Responder capabilities. */
+     * fields again. The ones that are a shift away (CA, FS, DR, UM, identity,
+     * ME type, CPR coordinates) are read from the bytes when accessed. */
 
     /* ICAO address */
-    mm.aa1 = mm.msg[1];
-    mm.aa2 = mm.msg[2];
-    mm.aa3 = mm.msg[3];
-
-    /* DF 17 type (assuming this is a DF17, otherwise not used) */
-    mm.metype = mm.msg[4] >> 3; /* Extended squitter message type. */
-    mm.mesub  = mm.msg[4] & 7;  /* Extended squitter message subtype. */
-
-    /* Fields for DF4,5,20,21 */
-    mm.fs = mm.msg[0] & 7;           /* Flight status for DF4,5,20,21 */
-    mm.dr = mm.msg[1] >> 3 & 31;     /* Request extraction of downlink request. */
-    mm.um = ((mm.msg[1] & 7) << 3) | /* Request extraction of downlink request. */
-            mm.msg[2] >> 5;
-
-    /* In the squawk (identity) field bits are interleaved like that
-     * (message bit 20 to bit 32):
-     *
-     * C1-A1-C2-A2-C4-A4-ZERO-B1-D1-B2-D2-B4-D4
-     *
-     * So every group of three bits A, B, C, D represent an integer
-     * from 0 to 7.
-     *
-     * The actual meaning is just 4 octal numbers, but we convert it
-     * into a base ten number tha happens to represent the four
-     * octal numbers.
-     *
-     * For more info: http://en.wikipedia.org/wiki/Gillham_code */
-    {
-        int a       = ((mm.msg[3] & 0x80) >> 5) | ((mm.msg[2] & 0x02) >> 0) | ((mm.msg[2] & 0x08) >> 3);
-        int b       = ((mm.msg[3] & 0x02) << 1) | ((mm.msg[3] & 0x08) >> 2) | ((mm.msg[3] & 0x20) >> 5);
-        int c       = ((mm.msg[2] & 0x01) << 2) | ((mm.msg[2] & 0x04) >> 1) | ((mm.msg[2] & 0x10) >> 4);
-        int d       = ((mm.msg[3] & 0x01) << 2) | ((mm.msg[3] & 0x04) >> 1) | ((mm.msg[3] & 0x10) >> 4);
-        mm.identity = (a * 1000) + (b * 100) + (c * 10) + d;
-    }
+    mm.addr = (uint32_t{mm.msg[1]} << 16) | (uint32_t{mm.msg[2]} << 8) | uint32_t{mm.msg[3]};
 
     /* DF 11 & 17: try to populate our ICAO addresses whitelist.
      * DFs with an AP field (xored addr and crc), try to decode it. */
-    if (mm.msgtype != 11 && mm.msgtype != 17)
+    if (msgtype != 11 && msgtype != 17)
     {
         /* Check if we can check the checksum for the Downlink Formats where
          * the checksum is xored with the AirCraftImpl ICAO address. We try to
-         * brute force it using a list of recently seen AirCraftImpl addresses. */
-        if (BruteForceAp(mm.msg, mm) != 0)
-        {
-            /* We recovered the message, mark the checksum as valid. */
-            mm.crcok = 1;
-        }
-        else
-        {
-            mm.crcok = 0;
-        }
+         * brute force it using a list of recently seen AirCraftImpl addresses.
+         * If we recovered the message, mark the checksum as valid. */
+        mm.crcok = static_cast<uint8_t>(BruteForceAp(mm.msg, mm));
     }
     else
     {
         /* If this is DF 11 or DF 17 and the checksum was ok,
          * we can add this address to the list of recently seen
          * addresses. */
-        if ((mm.crcok != 0) && mm.errorbit == -1)
-        {
-            uint32_t addr = (static_cast<uint32_t>(mm.aa1) << 16) | (static_cast<uint32_t>(mm.aa2) << 8) | static_cast<uint32_t>(mm.aa3);
-            AddRecentlySeenIcaoAddr(addr);
-        }
+        if ((mm.crcok != 0) && mm.errorbit == -1) { AddRecentlySeenIcaoAddr(mm.addr); }
     }
 
     /* Decode 13 bit altitude for DF0, DF4, DF16, DF20 */
-    if (mm.msgtype == 0 || mm.msgtype == 4 || mm.msgtype == 16 || mm.msgtype == 20) { mm.altitude = DecodeAC13Field(mm.msg, mm.unit); }
+    if (msgtype == 0 || msgtype == 4 || msgtype == 16 || msgtype == 20)
+    {
+        mm.payload         = Message::Payload::Altitude;
+        mm.fields.altitude = DecodeAC13Field(mm.msg);
+    }
 
     /* Decode extended squitter specific stuff. */
-    if (mm.msgtype == 17)
+    if (msgtype == 17)
     {
         /* Decode the extended squitter message. */
-
-        if (mm.metype >= 1 && mm.metype <= 4)
+        uint32_t metype = mm.MeType();
+        uint32_t mesub  = mm.MeSub();
+        if (metype >= 1 && metype <= 4)
         {
             /* AirCraftImpl Identification and Category */
             static constexpr std::string_view AisCharset = "?ABCDEFGHIJKLMNOPQRSTUVWXYZ????? ???????????????0123456789??????";
             // the bit arrangement is
             // 66777777-55556666-44444455-22333333-11112222-00000011
             // Unfortunately its hard to extract this as a bit-field
-            mm.flight[0] = AisCharset[mm.msg[5] >> 2];
-            mm.flight[1] = AisCharset[((mm.msg[5] & 3u) << 4u) | (mm.msg[6] >> 4u)];     // NOLINT
-            mm.flight[2] = AisCharset[((mm.msg[6] & 15u) << 2u) | (mm.msg[7] >> 6u)];    // NOLINT
-            mm.flight[3] = AisCharset[mm.msg[7] & 63];
-            mm.flight[4] = AisCharset[mm.msg[8] >> 2];
-            mm.flight[5] = AisCharset[((mm.msg[8] & 3u) << 4u) | (mm.msg[9] >> 4u)];      // NOLINT
-            mm.flight[6] = AisCharset[((mm.msg[9] & 15u) << 2u) | (mm.msg[10] >> 6u)];    // NOLINT
-            mm.flight[7] = AisCharset[mm.msg[10] & 63];
-            // mm.flight[8] = '\0';
+            auto& flight = mm.fields.flight;
+            mm.payload   = Message::Payload::Identification;
+            flight[0]    = AisCharset[mm.msg[5] >> 2];
+            flight[1]    = AisCharset[((mm.msg[5] & 3u) << 4u) | (mm.msg[6] >> 4u)];     // NOLINT
+            flight[2]    = AisCharset[((mm.msg[6] & 15u) << 2u) | (mm.msg[7] >> 6u)];    // NOLINT
+            flight[3]    = AisCharset[mm.msg[7] & 63];
+            flight[4]    = AisCharset[mm.msg[8] >> 2];
+            flight[5]    = AisCharset[((mm.msg[8] & 3u) << 4u) | (mm.msg[9] >> 4u)];      // NOLINT
+            flight[6]    = AisCharset[((mm.msg[9] & 15u) << 2u) | (mm.msg[10] >> 6u)];    // NOLINT
+            flight[7]    = AisCharset[mm.msg[10] & 63];
         }
-        else if (mm.metype >= 9 && mm.metype <= 18)
+        else if (metype >= 9 && metype <= 18)
         {
-            /* Airborne position Message */
-            mm.fflag = mm.msg[6] & (1 << 2);
-            // mm.tflag        = mm.msg[6] & (1 << 3);
-            mm.altitude     = DecodeAC12Field(mm.msg, mm.unit);
-            mm.rawLatitude  = ((mm.msg[6] & 3) << 15) | (mm.msg[7] << 7) | (mm.msg[8] >> 1);
-            mm.rawLongitude = ((mm.msg[8] & 1) << 16) | (mm.msg[9] << 8) | mm.msg[10];
+            /* Airborne position Message, the CPR coordinates are read from the bytes */
+            mm.payload         = Message::Payload::Altitude;
+            mm.fields.altitude = DecodeAC12Field(mm.msg);
         }
-        else if (mm.metype == 19 && mm.mesub >= 1 && mm.mesub <= 4)
+        else if (metype == 19 && mesub >= 1 && mesub <= 4)
         {
             /* Airborne Velocity Message */
-            if (mm.mesub == 1 || mm.mesub == 2)
+            mm.payload         = Message::Payload::Velocity;
+            mm.fields.velocity = {};
+            if (mesub == 1 || mesub == 2)
             {
-                mm.ewDir      = (mm.msg[5] & 4) >> 2;
-                mm.ewVelocity = ((mm.msg[5] & 3) << 8) | mm.msg[6];
-                mm.nsDir      = (mm.msg[7] & 0x80) >> 7;
-                mm.nsVelocity = ((mm.msg[7] & 0x7f) << 3) | ((mm.msg[8] & 0xe0) >> 5);
-                // mm.vertRateSource = (mm.msg[8] & 0x10) >> 4;
-                // mm.vertRateSign   = (mm.msg[8] & 0x8) >> 3;
-                // mm.vertRate       = ((mm.msg[8] & 7) << 6) | ((mm.msg[9] & 0xfc) >> 2);
                 /* Compute velocity and angle from the two speed
                  * components. */
-                mm.velocity = static_cast<int>(sqrt((mm.nsVelocity * mm.nsVelocity) + (mm.ewVelocity * mm.ewVelocity)));
-                if (mm.velocity != 0)
+                auto ewv      = static_cast<int>(mm.EwVelocity());
+                auto nsv      = static_cast<int>(mm.NsVelocity());
+                auto velocity = static_cast<int>(sqrt((nsv * nsv) + (ewv * ewv)));
+                int  heading  = 0;
+                if (velocity != 0)
                 {
-                    int    ewv     = mm.ewVelocity;
-                    int    nsv     = mm.nsVelocity;
-                    double heading = 0;
-
-                    if (mm.ewDir != 0) { ewv *= -1; }
-                    if (mm.nsDir != 0) { nsv *= -1; }
-                    heading = atan2(ewv, nsv);
+                    if (mm.West()) { ewv *= -1; }
+                    if (mm.South()) { nsv *= -1; }
 
                     /* Convert to degrees. */
-                    mm.heading = static_cast<int>(heading * 360 / (M_PI * 2));
+                    heading = static_cast<int>(atan2(ewv, nsv) * 360 / (M_PI * 2));
                     /* We don't want negative values but a 0-360 scale. */
-                    if (mm.heading < 0) { mm.heading += 360; }
-                }
-                else
-                {
-                    mm.heading = 0;
+                    if (heading < 0) { heading += 360; }
                 }
+                mm.fields.velocity = {.speed = static_cast<int16_t>(velocity), .heading = static_cast<int16_t>(heading)};
             }
-            else if (mm.mesub == 3 || mm.mesub == 4)
+            else if (mesub == 3 || mesub == 4)
             {
-                // mm.headingIsValid = mm.msg[5] & (1 << 2);
-                mm.heading = static_cast<int>((360.0 / 128) * (((mm.msg[5] & 3) << 5) | (mm.msg[6] >> 3)));
+                auto heading               = static_cast<int>((360.0 / 128) * (((mm.msg[5] & 3) << 5) | (mm.msg[6] >> 3)));
+                mm.fields.velocity.heading = static_cast<int16_t>(heading);
             }
         }
     }
-    // mm.phaseCorrected = 0; /* Set to 1 by the caller if needed. */
     return mm;
 }
 
@@ -738,8 +448,9 @@ static inline void ApplyPhaseCorrection(uint16_t* m)
 /* Detect a Mode S messages inside the magnitude buffer pointed by 'm' and of
  * size 'mlen' bytes. Every detected Mode S message is convert it into a
  * stream of bits and passed to the function to display it. */
-void ADSB1090Handler::DetectModeS(std::span<uint16_t> const& m)
+size_t ADSB1090Handler::DetectModeS(std::span<uint16_t> const& m, size_t start)
 {
+    ADSB_TRACE_SCOPE("ADSB1090::DetectModeS");
     std::array<uint8_t, Message::LongMessageBits>      bits{};
     std::array<uint8_t, Message::LongMessageBytes>     msg{};
     std::array<uint16_t, Message::LongMessageBits * 2> aux{};
@@ -769,7 +480,8 @@ void ADSB1090Handler::DetectModeS(std::span<uint16_t> const& m)
      * 8   --
      * 9   -------------------
      */
-    for (uint32_t j = 0; j < m.size() - FullLength * 2; j++)
+    size_t j = start;
+    for (; j < m.size() - FullLength * 2; j++)
     {
         int low, high, delta, errors;
         int goodMessage = 0;
@@ -811,6 +523,12 @@ void ADSB1090Handler::DetectModeS(std::span<uint16_t> const& m)
         }
         statValidPreamble++;
 
+        /* Samples 4, 5 and 11-14 were just checked to be quiet, they are a free noise estimate. */
+        {
+            double gap = (m[j + 4] + m[j + 5] + m[j + 11] + m[j + 12] + m[j + 13] + m[j + 14]) / 6.0;
+            noiseMagnitude = noiseMagnitude == 0 ? gap : noiseMagnitude + ((gap - noiseMagnitude) * NoiseLevelAlpha);
+        }
+
     good_preamble:
         /* If the previous attempt with this message failed, retry using
          * magnitude correction. */
@@ -867,8 +585,15 @@ void ADSB1090Handler::DetectModeS(std::span<uint16_t> const& m)
 
         /* Last check, high and low bits are different enough in magnitude
          * to mark this as real message and not just noise? */
-        delta = 0;
-        for (size_t i = 0; i < msglen * 8 * 2; i += 2) { delta += abs(m[j + i + PreambleUS * 2] - m[j + i + PreambleUS * 2 + 1]); }
+        delta      = 0;
+        int signal = 0;
+        for (size_t i = 0; i < msglen * 8 * 2; i += 2)
+        {
+            low     = m[j + i + PreambleUS * 2];
+            high    = m[j + i + PreambleUS * 2 + 1];
+            delta  += abs(low - high);
+            signal += std::max(low, high);
+        }
         delta /= msglen * 4;
 
         /* Filter for an average delta of three is small enough to let almost
@@ -885,7 +610,13 @@ void ADSB1090Handler::DetectModeS(std::span<uint16_t> const& m)
          * and CRC may not be correct. This is handled by the next layer. */
         if (errors == 0 || (config.aggressive && errors < 3))
         {
-            Message mm = DecodeModesMessage(msg);
+            LatencyTimer decodeTimer(Latency(ADSB::LatencyStage::Decode), &scanNestedTime);
+            Message      mm = DecodeModesMessage(msg);
+            decodeTimer.Stop();
+            mm.signalLevel = MagnitudeToDbfs(static_cast<double>(signal) / (msglen * 8));
+            mm.noiseLevel  = MagnitudeToDbfs(noiseMagnitude);
+            mm.sample      = statSamples.Load() + j - OverlapSamples;
+            mm.time        = trafficManager->bufferTime;
 
             /* Decode the received message and update statistics */
 
@@ -956,6 +687,82 @@ void ADSB1090Handler::DetectModeS(std::span<uint16_t> const& m)
             useCorrection = false;
         }
     }
+    return j;
+}
+
+/* Same as running ComputeMagnitudes + DetectModeS over the buffer except that blocks
+ * without energy above the squelch threshold are not searched for a preamble.
+ * Magnitudes are computed only around busy blocks (the message may run into the
+ * next block and phase correction looks one sample back) and for the tail that is
+ * carried over to the next buffer.
+ *
+ * In strict mode a block is busy when its peak I^2 + Q^2 reaches the threshold squared,
+ * so no preamble whose first pulse is at or above the threshold is ever skipped.
+ * Fast mode compares max(|I|, |Q|), which is cheaper to reason about but lets pulses up
+ * to sqrt(2) times the threshold through unnoticed. */
+size_t ADSB1090Handler::DetectModeSSquelched(std::span<uint8_t const> const& data)
+{
+    auto  n       = data.size() / 2;
+    auto  samples = OverlapSamples + n;
+    auto  blocks  = (n + SquelchBlockSamples - 1) / SquelchBlockSamples;
+    auto* m       = magnitudeVector.data() + OverlapSamples;
+
+    LatencyTimer magnitudeTimer(Latency(ADSB::LatencyStage::Magnitude));
+    squelchHot.assign(blocks, 0);
+    for (size_t b = 0; b < blocks; b++)
+    {
+        auto count = std::min(SquelchBlockSamples, n - (b * SquelchBlockSamples));
+        auto level = MeasureBlock(data.subspan(b * SquelchBlockSamples * 2, count * 2));
+
+        noiseFloor += ((static_cast<double>(level.sum) / static_cast<double>(count * 2)) - noiseFloor) * NoiseFloorAlpha;
+
+        double threshold = std::max(MinimumSquelchLevel, squelchFactor * noiseFloor);
+        bool   busy      = squelchMode == ADSB::SquelchMode::Strict ? level.peakPower >= threshold * threshold : level.peak >= threshold;
+        squelchHot[b]    = busy ? 1 : 0;
+        statSquelchBlocks++;
+        statClippedSamples += level.clipped;
+        if (squelchHot[b] == 0) { statSquelchedBlocks++; }
+    }
+
+    // Blocks whose start positions are carried over to the next buffer
+    size_t tailBlock = n > OverlapSamples ? (n - OverlapSamples) / SquelchBlockSamples : 0;
+    for (size_t b = 0; b < blocks; b++)
+    {
+        bool needed = squelchHot[b] != 0 || (b > 0 && squelchHot[b - 1] != 0) || (b + 1 < blocks && squelchHot[b + 1] != 0)
+                      || (b == 0 && squelchCarryHot) || b >= tailBlock;
+        if (!needed) { continue; }
+        auto count = std::min(SquelchBlockSamples, n - (b * SquelchBlockSamples));
+        ComputeMagnitudes(data.subspan(b * SquelchBlockSamples * 2, count * 2), m + (b * SquelchBlockSamples));
+    }
+
+    magnitudeTimer.Stop();
+
+    LatencyTimer scanTimer(Latency(ADSB::LatencyStage::PreambleScan));
+    size_t       next = resumeOffset;
+    auto         scan = [&](size_t begin, size_t end) {
+        begin = std::max(begin, next);
+        if (begin >= end) { return; }
+        next = DetectModeS({magnitudeVector.data(), std::min(samples, end + (FullLength * 2))}, begin);
+    };
+    if (squelchCarryHot) { scan(0, OverlapSamples); }
+    for (size_t b = 0; b < blocks;)
+    {
+        if (squelchHot[b] == 0)
+        {
+            b++;
+            continue;
+        }
+        size_t e = b;
+        while (e < blocks && squelchHot[e] != 0) { e++; }
+        scan(OverlapSamples + (b * SquelchBlockSamples), OverlapSamples + std::min(e * SquelchBlockSamples, n));
+        b = e;
+    }
+
+    scanTimer.Exclude(TakeNestedTime());
+
+    squelchCarryHot = false;
+    for (size_t b = tailBlock; b < blocks; b++) { squelchCarryHot = squelchCarryHot || squelchHot[b] != 0; }
+    return std::max(next, samples - OverlapSamples);
 }
 
 /* When a new message is available, because it was decoded from the
@@ -968,9 +775,20 @@ void ADSB1090Handler::DetectModeS(std::span<uint16_t> const& m)
 void ADSB1090Handler::UseModesMessage(Message const& mm)
 {
     if (config.checkCRC && mm.crcok == 0) { return; }
-    InteractiveReceiveData(mm);
-    // uint32_t addr = (static_cast<uint32_t>(mm.aa1) << 16) | (static_cast<uint32_t>(mm.aa2) << 8) | static_cast<uint32_t>(mm.aa3);
-    //_modesSendSBSOutput(mm, _interactiveFindOrCreateAircraft(addr)); /* Feed SBS output clients. */
+    if (frameTap != nullptr)
+    {
+        frameTap->OnFrame({.sample      = mm.sample,
+                           .bytes       = std::span(mm.msg).first(mm.Bytes()),
+                           .addr        = mm.addr,
+                           .signalLevel = mm.signalLevel,
+                           .noiseLevel  = mm.noiseLevel,
+                           .corrected   = mm.Corrected()});
+        return;
+    }
+    // Without checkCRC bad messages are still tracked, subscribers only get the ones that passed
+    if (messages.Wanted() && mm.crcok != 0) { messages.Add(mm); }
+    if (trackAircraft) { InteractiveReceiveData(mm); }
+    //_modesSendSBSOutput(mm, _interactiveFindOrCreateAircraft(mm.addr)); /* Feed SBS output clients. */
 }
 
 /* ========================= Interactive mode =============================== */
@@ -1076,7 +894,8 @@ static double CprDlonFunction(double lat, int isodd)
  *    seconds.
  */
 
-static void DecodeCpr(ADSB::AirCraftImpl& a)
+// Returns false when the two frames are in different latitude zones
+bool DecodeCpr(ADSB::AirCraftImpl& a)
 {
     double       airDlat0 = 360.0 / 60;
     double const airDlat1 = 360.0 / 59;
@@ -1094,7 +913,7 @@ static void DecodeCpr(ADSB::AirCraftImpl& a)
     if (rlat1 >= 270) { rlat1 -= 360; }
 
     /* Check that both are in the same latitude zone, or abort. */
-    if (CprNlFunction(rlat0) != CprNlFunction(rlat1)) { return; }
+    if (CprNlFunction(rlat0) != CprNlFunction(rlat1)) { return false; }
 
     double lat1E7 = 0.;
     double lon1E7 = 0.;
@@ -1118,58 +937,66 @@ static void DecodeCpr(ADSB::AirCraftImpl& a)
     if (lon1E7 > 180 * 10000000) { lon1E7 -= 3600000000; }
     a.lat1E7 = static_cast<int32_t>(lat1E7);
     a.lon1E7 = static_cast<int32_t>(lon1E7);
+    return true;
 }
 
 /* Receive new messages and populate the interactive mode with more info. */
 inline ADSB::AirCraftImpl& ADSB1090Handler::InteractiveReceiveData(Message const& mm)
 {
-    auto addr = static_cast<uint32_t>((mm.aa1 << 16) | (mm.aa2 << 8) | mm.aa3);
-
-    auto  now  = std::chrono::system_clock::now();
-    auto& a    = InteractiveFindOrCreateAircraft(addr);
-    a.sourceId = sourceId;
-    if (mm.msgtype == 0 || mm.msgtype == 4 || mm.msgtype == 20)
+    LatencyTimer timer(Latency(ADSB::LatencyStage::Tracker), &scanNestedTime);
+
+    auto  now     = std::chrono::system_clock::now();
+    auto& a       = InteractiveFindOrCreateAircraft(mm.addr);
+    auto  msgtype = mm.Df();
+    a.sourceId    = sourceId;
+    a.UpdateSignal(mm.signalLevel, mm.noiseLevel);
+    if (msgtype == 0 || msgtype == 4 || msgtype == 20)
     {
-        a.altitude = (static_cast<int32_t>(mm.altitude));
+        a.altitude = mm.Altitude();
 
         // locctx.set_altitude(int32_t{mm.altitude});
     }
-    else if (mm.msgtype == 17)
+    else if (msgtype == 17)
     {
-        if (mm.metype >= 1 && mm.metype <= 4)
+        auto metype = mm.MeType();
+        if (metype >= 1 && metype <= 4)
         {
-            std::ranges::copy(mm.flight, std::begin(a.callsign));
+            std::ranges::copy(mm.Flight(), std::begin(a.callsign));
             //    memcpy(a.flight().data(), mm.flight, a.flight().size());
         }
-        else if (mm.metype >= 9 && mm.metype <= 18)
+        else if (metype >= 9 && metype <= 18)
         {
-            a.altitude = (static_cast<int32_t>(mm.altitude));
-            if (mm.fflag != 0)
+            a.altitude = mm.Altitude();
+            if (mm.OddCpr())
             {
-                a.cprOddLat  = (int32_t{mm.rawLatitude});
-                a.cprOddLon  = (int32_t{mm.rawLongitude});
+                a.cprOddLat  = mm.RawLatitude();
+                a.cprOddLon  = mm.RawLongitude();
                 a.cprOddTime = (decltype(now){now});
             }
             else
             {
-                a.cprEvenLat  = (int32_t{mm.rawLatitude});
-                a.cprEvenLon  = (int32_t{mm.rawLongitude});
+                a.cprEvenLat  = mm.RawLatitude();
+                a.cprEvenLon  = mm.RawLongitude();
                 a.cprEvenTime = (decltype(now){now});
             }
             /* If the two data is less than 10 seconds apart, compute
              * the position. */
-            if (std::abs(std::chrono::duration_cast<std::chrono::seconds>(a.cprEvenTime - a.cprOddTime).count()) <= 10) { DecodeCpr(a); }
+            if (std::abs(std::chrono::duration_cast<std::chrono::seconds>(a.cprEvenTime - a.cprOddTime).count()) <= 10 && DecodeCpr(a))
+            {
+                trafficManager->UpdatePosition(a);
+            }
         }
-        else if (mm.metype == 19)
+        else if (metype == 19)
         {
-            if (mm.mesub == 1 || mm.mesub == 2)
+            if (mm.MeSub() == 1 || mm.MeSub() == 2)
             {
-                a.speed = static_cast<uint32_t>(mm.velocity);
-                a.track = static_cast<uint32_t>(mm.heading);
+                a.speed = static_cast<uint32_t>(mm.Speed());
+                a.track = static_cast<uint32_t>(mm.Heading());
             }
         }
     }
 
+    timer.Stop();
     trafficManager->NotifyChanged(a);
     return a;
 }
@@ -1252,16 +1079,18 @@ void ADSB1090Handler::ModesSendSBSOutput(Message const& mm, AirCraftImpl const&
 // NOLINTEND
 std::unique_ptr<ADSB::IDataProvider> ADSB::TryCreateADSB1090Handler(std::shared_ptr<ADSB::TrafficManager> const& trafficManager,
                                                                     RTLSDR::IDeviceSelector const*               selectorIn,
-                                                                    ADSB::Source                                 sourceId)
+                                                                    ADSB::Source                                 sourceId,
+                                                                    ADSB::HandlerConfig const&                   config)
 {
-    return std::make_unique<ADSB1090Handler>(trafficManager, selectorIn, sourceId);
+    return std::make_unique<ADSB1090Handler>(trafficManager, selectorIn, sourceId, config);
 }
 
 std::unique_ptr<RTLSDR::IDataHandler> ADSB::test::TryCreateADSB1090Handler(std::shared_ptr<ADSB::TrafficManager> const& trafficManager,
                                                                            RTLSDR::IDeviceSelector const*               selectorIn,
-                                                                           ADSB::Source                                 sourceId)
+                                                                           ADSB::Source                                 sourceId,
+                                                                           ADSB::HandlerConfig const&                   config)
 {
-    return std::make_unique<ADSB1090Handler>(trafficManager, selectorIn, sourceId);
+    return std::make_unique<ADSB1090Handler>(trafficManager, selectorIn, sourceId, config);
 }
 
 #ifdef __ANDROID__
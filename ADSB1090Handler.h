@@ -0,0 +1,461 @@
+#pragma once
+#include "ADSB.h"
+#include "MessageBatch.h"
+#include "ModeSMessage.h"
+#include "StatCounter.h"
+#include "TraceEvents.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+// Internal to the library: the 1090 handler and the decode stages it is built from, for ADSB1090.cpp and
+// the benchmark. Applications create the handler through TryCreateADSB1090Handler
+// NOLINTBEGIN
+
+// NOLINTBEGIN(readability-magic-numbers)
+// NOLINTBEGIN(cppcoreguidelines-pro-bounds-constant-array-index)
+
+using time_point = std::chrono::time_point<std::chrono::system_clock>;
+
+/* Decoded messages are compact (one cache line) and read most fields from the raw bytes on access. */
+using Message = ADSB::ModeSMessage;
+
+struct ADSB1090Handler : RTLSDR::IDataHandler, ADSB::IDataProvider, ADSB::IFrameTracker
+{
+    static constexpr size_t PreambleUS = 8; /*microseconds*/
+
+    static constexpr size_t LongMessageBits  = 112;
+    static constexpr size_t ShortMessageBits = 56;
+    static constexpr size_t FullLength       = PreambleUS + LongMessageBits;
+    static constexpr size_t LongMessageBytes = LongMessageBits / 8;
+    // static constexpr size_t ShortMessageBytes = ShortMessageBits / 8;
+
+    // Magnitude samples carried over from the previous buffer so that messages straddling
+    // two device buffers are still detected
+    static constexpr size_t OverlapSamples = FullLength * 2;
+
+    static constexpr uint32_t DefaultFrequency  = 1090000000;
+    static constexpr uint32_t DefaultSampleRate = 2000000;
+
+    // Squelch works on blocks of raw samples. A block must be at least as long as a message so that
+    // converting the block after a busy one is enough to demodulate anything starting in it
+    static constexpr size_t SquelchBlockSamples = 256;
+    static_assert(SquelchBlockSamples >= OverlapSamples);
+    // DetectModeS drops candidates whose bits differ by less than 10*255 on average (~7 in I/Q units)
+    static constexpr double MinimumSquelchLevel = 7.0;
+    static constexpr double NoiseFloorAlpha     = 1.0 / 1024;    // ~0.13s at 2 MS/s
+
+    // The demodulator's noise level follows the gaps of every preamble that passes the first checks
+    static constexpr double NoiseLevelAlpha = 1.0 / 64;
+    static constexpr double FullScale       = 65535.0;    // Magnitudes are scaled to 16 bits
+
+    struct Config
+    {
+
+        bool fixErrors = true;
+        bool checkCRC  = true;
+        bool raw       = false;
+        // bool onlyaddr    = false;
+        bool debug       = false;
+        bool interactive = false;
+        bool aggressive  = false;
+        bool loop        = false;
+    };
+    struct DeviceSelector : RTLSDR::IDeviceSelector
+    {
+        [[nodiscard]] bool SelectDevice(RTLSDR::DeviceInfo const& d) const override
+        {
+            return std::string_view(d.serial).find("1090") != std::string_view::npos;
+        }
+    };
+
+    static std::vector<uint16_t> CreateLUT()
+    {
+        std::vector<uint16_t> lut(static_cast<size_t>(129u * 129u * 2u));
+        for (uint8_t i = 0; i <= 128; i++)
+        {
+            for (uint8_t q = 0; q <= 128; q++)
+            {
+                lut[(i * 129u) + q] = static_cast<uint16_t>(std::round(std::sqrt((i * i) + (q * q)) * 360));
+            }
+        }
+        return lut;
+    }
+
+    static RTLSDR::Config DeviceConfig(ADSB::HandlerConfig const& config)
+    {
+        auto device = config.device;
+        if (device.frequency == RTLSDR::CenterFrequency) { device.frequency = DefaultFrequency; }
+        if (device.sampleRate == RTLSDR::SampleRate) { device.sampleRate = DefaultSampleRate; }
+        return device;
+    }
+
+    ADSB1090Handler(std::shared_ptr<ADSB::TrafficManager> trafficManagerIn,
+                    RTLSDR::IDeviceSelector const*        selectorIn,
+                    ADSB::Source                          sourceIdIn,
+                    ADSB::HandlerConfig const&            configIn) :
+        magnitudeVector(OverlapSamples + (configIn.device.bufferLength / 2), 0),
+        squelchMode(configIn.squelch),
+        squelchFactor(configIn.squelchFactor),
+        adaptiveGain(configIn.adaptiveGain),
+        gainControl(configIn.gainControl),
+        gainWindowSamples(DeviceConfig(configIn).sampleRate),
+        sampleRate(DeviceConfig(configIn).sampleRate),
+        trafficManager(std::move(trafficManagerIn)),
+        frameTap(configIn.frameTap),
+        messages(sourceIdIn),
+        listener1090{selectorIn, DeviceConfig(configIn)},
+        sourceId(sourceIdIn)
+    {
+        std::cout << "ADSB Tracker Initializing" << '\n';
+    }
+
+    ~ADSB1090Handler() override = default;
+
+    CLASS_DELETE_COPY_AND_MOVE(ADSB1090Handler);
+
+    void HandleData(std::span<uint8_t const> const& data) override
+    {
+        ADSB_TRACE_SCOPE("ADSB1090::HandleData");
+        // Buffers larger than the configured geometry (e.g. whole trace files) grow the vector once
+        if (magnitudeVector.size() < OverlapSamples + (data.size() / 2)) { magnitudeVector.resize(OverlapSamples + (data.size() / 2)); }
+
+        // Scan the carried over tail of the previous buffer followed by this one, then keep
+        // our own tail (and how far into it the last message reached) for the next call
+        auto   samples = OverlapSamples + (data.size() / 2);
+        size_t stop    = 0;
+        trafficManager->bufferTime = listener1090.CurrentBufferTime();
+        UpdateTracking();
+        if (squelchMode == ADSB::SquelchMode::Off)
+        {
+            {
+                LatencyTimer timer(Latency(ADSB::LatencyStage::Magnitude));
+                statClippedSamples += ComputeMagnitudes(data, magnitudeVector.data() + OverlapSamples);
+            }
+            LatencyTimer timer(Latency(ADSB::LatencyStage::PreambleScan));
+            stop = DetectModeS({magnitudeVector.data(), samples}, resumeOffset);
+            timer.Exclude(TakeNestedTime());
+        }
+        else
+        {
+            stop = DetectModeSSquelched(data);
+        }
+        resumeOffset = stop - (samples - OverlapSamples);
+        std::copy_n(magnitudeVector.data() + samples - OverlapSamples, OverlapSamples, magnitudeVector.data());
+
+        statBuffers++;
+        statSamples += data.size() / 2;
+        messages.Flush();
+        trafficManager->Flush();
+        if (adaptiveGain) { UpdateGain(); }
+    }
+
+    // Inherited via IFrameTracker. The frame passed the CRC (or AP) check already, the address is taken
+    // from it because this handler's cache of recently seen addresses may not have it
+    void TrackFrame(ADSB::DemodulatedFrame const& frame, ADSB::IFrameTracker::time_point captureStart) override
+    {
+        trafficManager->bufferTime = FrameTime(captureStart, frame.sample, sampleRate);
+        std::array<uint8_t, LongMessageBytes> msg{};
+        std::copy_n(frame.bytes.begin(), std::min(frame.bytes.size(), msg.size()), msg.begin());
+        Message mm     = DecodeModesMessage(msg);
+        mm.addr        = frame.addr;
+        mm.signalLevel = frame.signalLevel;
+        mm.noiseLevel  = frame.noiseLevel;
+        mm.sample      = frame.sample;
+        mm.time        = trafficManager->bufferTime;
+        mm.crcok       = 1;
+        UpdateTracking();
+        if (messages.Wanted()) { messages.Add(mm); }
+        if (trackAircraft) { InteractiveReceiveData(mm); }
+    }
+
+    void FlushFrames() override
+    {
+        messages.Flush();
+        trafficManager->Flush();
+    }
+
+    // Messages only subscribers skip tracking unless something else takes the aircraft, see SubscribeMessages
+    void UpdateTracking() { trackAircraft = messages.TrackAircraft() || trafficManager->HasConsumers(); }
+
+    LatencyHistogram& Latency(ADSB::LatencyStage stage) { return latency.at(static_cast<size_t>(stage)); }
+
+    // Time spent in stages nested in the preamble scan (decode, tracker and dispatch) since the last call
+    LatencyTimer::clock::duration TakeNestedTime()
+    {
+        return std::exchange(scanNestedTime, {}) + std::exchange(trafficManager->dispatchTime, {});
+    }
+
+    // Runs on the data handler thread, the gain change itself is a control transfer that doesn't
+    // disturb the streaming transfers
+    void UpdateGain()
+    {
+        if (statSamples.Load() - gainWindowStart.samples < gainWindowSamples) { return; }
+
+        GainController::Window totals{.samples        = statSamples.Load(),
+                                      .clippedSamples = statClippedSamples.Load(),
+                                      .validPreambles = statValidPreamble.Load(),
+                                      .goodCrc        = statGoodcrc.Load(),
+                                      .badCrc         = statBadcrc.Load()};
+        GainController::Window window{.samples        = totals.samples - gainWindowStart.samples,
+                                      .clippedSamples = totals.clippedSamples - gainWindowStart.clippedSamples,
+                                      .validPreambles = totals.validPreambles - gainWindowStart.validPreambles,
+                                      .goodCrc        = totals.goodCrc - gainWindowStart.goodCrc,
+                                      .badCrc         = totals.badCrc - gainWindowStart.badCrc};
+        gainWindowStart = totals;
+
+        // A replugged dongle may have a different tuner
+        if (gainDeviceChanged.exchange(false)) { gainController.reset(); }
+        if (!gainController)
+        {
+            auto gains = listener1090.GetTunerGains();
+            if (gains.empty()) { return; }    // No device, e.g. replaying a capture
+            gainController.emplace(std::move(gains), listener1090.GetGain(), gainControl);
+            return;
+        }
+        auto gain = gainController->Update(window);
+        if (gain != listener1090.GetGain()) { listener1090.SetGain(gain); }
+    }
+
+    // 1 for a raw sample of 0 or 255. Centred on 127 the rails are 127 below and 128 above, so 254 isn't one
+    static uint32_t AtRail_(uint8_t raw) { return static_cast<uint32_t>(static_cast<uint8_t>(raw + 1) <= 1); }
+
+    /* Compute the magnitudo vector. It's just SQRT(I^2 + Q^2), but
+     * we rescale to the 0-255 range to exploit the full resolution. */
+    /* Returns the number of samples clipped at the ADC rails (I or Q at 0 or 255). */
+    uint32_t ComputeMagnitudes(std::span<uint8_t const> const& data, uint16_t* m) const
+    {
+        auto*    p       = data.data();
+        uint32_t clipped = 0;
+        for (uint32_t j = 0; j < data.size(); j += 2)
+        {
+            int i = p[j] - 127;
+            int q = p[j + 1] - 127;
+
+            if (i < 0) i = -i;
+            if (q < 0) q = -q;
+            m[j / 2] = magnitudesLookupTable[static_cast<size_t>(i * 129 + q)];
+            clipped += AtRail_(p[j]) | AtRail_(p[j + 1]);
+        }
+        return clipped;
+    }
+
+    // Magnitudes below 1 are clamped, so the lowest level reported is about -96 dBFS
+    static float MagnitudeToDbfs(double magnitude) { return static_cast<float>(20 * std::log10(std::max(magnitude, 1.0) / FullScale)); }
+
+    struct BlockLevel
+    {
+        uint32_t sum;          // Sum of |I| + |Q|
+        uint32_t peak;         // max(|I|, |Q|)
+        uint32_t peakPower;    // max(I^2 + Q^2), the exact peak magnitude squared
+        uint32_t clipped;      // Samples with I or Q at 0 or 255
+    };
+
+    // Kept branch free so that it vectorizes. Fast mode only needs sum and peak but computing
+    // peakPower in the same pass is nearly free once the samples are in registers
+    static BlockLevel MeasureBlock(std::span<uint8_t const> const& block)
+    {
+        BlockLevel level{};
+        auto*      p = block.data();
+        for (size_t j = 0; j + 1 < block.size(); j += 2)
+        {
+            int i = p[j] - 127;
+            int q = p[j + 1] - 127;
+
+            auto ai = static_cast<uint32_t>(i < 0 ? -i : i);
+            auto aq = static_cast<uint32_t>(q < 0 ? -q : q);
+            level.sum      += ai + aq;
+            level.peak      = std::max(level.peak, std::max(ai, aq));
+            level.peakPower = std::max(level.peakPower, (ai * ai) + (aq * aq));
+            level.clipped  += AtRail_(p[j]) | AtRail_(p[j + 1]);
+        }
+        return level;
+    }
+
+    // Returns where the scan stopped, like DetectModeS
+    size_t DetectModeSSquelched(std::span<uint8_t const> const& data);
+
+    void OnDeviceStatusChanged(bool available) override
+    {
+        if (available) { gainDeviceChanged = true; }
+        trafficManager->NotifyDeviceStatus(sourceId, available);
+    }
+
+    void OnDataGap(RTLSDR::DataGap const& gap) override
+    {
+        // The carried over tail is no longer contiguous with the next buffer
+        std::fill_n(magnitudeVector.begin(), OverlapSamples, uint16_t{0});
+        resumeOffset    = 0;
+        squelchCarryHot = false;
+        trafficManager->NotifyDataLost(sourceId, gap.droppedSamples);
+    }
+
+    void Start(ADSB::IListener& listenerIn) override
+    {
+        trafficManager->SetListener(&listenerIn);
+        listener1090.Start(this);
+    }
+    void Stop() override
+    {
+        //listener = nullptr;
+        listener1090.Stop();
+    }
+
+    void NotifySelfLocation(ADSB::IAirCraft const& ownship) override { trafficManager->proximity.SetOwnship(ownship); }
+    void SetProximity(ADSB::ProximityConfig const& config) override { trafficManager->proximity.SetConfig(config); }
+
+    void SetFilter(ADSB::SubscriptionFilter const& filter) override { trafficManager->SetFilter(filter); }
+    void AddListener(ADSB::IListener& listenerIn, ADSB::ListenerOptions const& options) override
+    {
+        trafficManager->AddListener(listenerIn, options);
+    }
+    void RemoveListener(ADSB::IListener& listenerIn) override { trafficManager->RemoveListener(listenerIn); }
+    [[nodiscard]] ADSB::SpatialIndex const& Positions() const override { return trafficManager->positions; }
+    void SetTrackHistory(size_t bytesPerAircraft) override { trafficManager->history.Configure(bytesPerAircraft); }
+    [[nodiscard]] ADSB::TrackHistory const& History() const override { return trafficManager->history; }
+    std::unique_ptr<ADSB::UpdateStream> OpenStream(ADSB::StreamOptions const& options) override
+    {
+        return std::make_unique<ADSB::UpdateStream>(trafficManager, options);
+    }
+
+    // No FIS-B on 1090
+    void SubscribeFISB(uint16_t /*productId*/, ADSB::FISB::IProductListener& /*listener*/) override {}
+    void UnsubscribeFISB(ADSB::FISB::IProductListener& /*listener*/) override {}
+
+    void SubscribeMessages(ADSB::IMessageListener& listenerIn, bool trackAircraft) override
+    {
+        messages.Subscribe(listenerIn, trackAircraft, trafficManager->HasConsumers());
+    }
+    void UnsubscribeMessages(ADSB::IMessageListener& listenerIn) override { messages.Unsubscribe(listenerIn); }
+
+    [[nodiscard]] ADSB::DataProviderStats GetStats() const override
+    {
+        auto                    overflow = listener1090.GetOverflowStats();
+        ADSB::DataProviderStats stats{.time             = ADSB::DataProviderStats::clock::now(),
+                                      .buffers          = statBuffers.Load(),
+                                      .samples          = statSamples.Load(),
+                                      .overruns         = overflow.overruns,
+                                      .droppedSamples   = overflow.droppedSamples,
+                                      .clippedSamples   = statClippedSamples.Load(),
+                                      .gain             = listener1090.GetGain(),
+                                      .validPreambles   = statValidPreamble.Load(),
+                                      .demodulated      = statDemodulated.Load(),
+                                      .goodCrc          = statGoodcrc.Load(),
+                                      .badCrc           = statBadcrc.Load(),
+                                      .fixed            = statFixed.Load(),
+                                      .singleBitFix     = statSingleBitFix.Load(),
+                                      .twoBitsFix       = statTwoBitsFix.Load(),
+                                      .outOfPhase       = statOutOfPhase.Load(),
+                                      .squelchBlocks    = statSquelchBlocks.Load(),
+                                      .squelchedBlocks  = statSquelchedBlocks.Load(),
+                                      .coalescedUpdates = trafficManager->statCoalesced.Load()};
+        for (auto stage :
+             {ADSB::LatencyStage::Magnitude, ADSB::LatencyStage::PreambleScan, ADSB::LatencyStage::Decode, ADSB::LatencyStage::Tracker})
+        {
+            stats.latency.at(static_cast<size_t>(stage)) = latency.at(static_cast<size_t>(stage)).Take();
+        }
+        stats.latency.at(static_cast<size_t>(ADSB::LatencyStage::QueueWait)) = listener1090.GetQueueWaitLatency();
+        stats.latency.at(static_cast<size_t>(ADSB::LatencyStage::Dispatch))  = trafficManager->dispatchLatency.Take();
+        stats.latency.at(static_cast<size_t>(ADSB::LatencyStage::EndToEnd))  = trafficManager->endToEndLatency.Take();
+        return stats;
+    }
+
+    /* Add the specified entry to the cache of recently seen ICAO addresses.
+     * Note that we also add a timestamp so that we can make sure that the
+     * entry is only valid for MODES_ICAO_CACHE_TTL seconds. */
+    void AddRecentlySeenIcaoAddr(uint32_t addr) { icaoTimestamps[addr] = std::chrono::system_clock::now(); }
+
+    /* Returns 1 if the specified ICAO address was seen in a DF format with
+     * proper checksum (not xored with address) no more than * MODES_ICAO_CACHE_TTL
+     * seconds ago. Otherwise returns 0. */
+    bool IcaoAddressWasRecentlySeen(uint32_t addr)
+    {
+        static constexpr long ModesIcaoCacheTtlInSecs = 60;
+
+        auto it = icaoTimestamps.find(addr);
+        return it != icaoTimestamps.end()
+               && (std::chrono::system_clock::now() - it->second) <= std::chrono::seconds{ModesIcaoCacheTtlInSecs};
+    }
+
+    bool                BruteForceAp(std::array<uint8_t, Message::LongMessageBytes> const& msg, Message& mm);
+    Message             DecodeModesMessage(std::array<uint8_t, Message::LongMessageBytes> const& msgIn);
+    size_t              DetectModeS(std::span<uint16_t> const& m, size_t start);
+    ADSB::AirCraftImpl& InteractiveReceiveData(Message const& mm);
+    ADSB::AirCraftImpl& InteractiveFindOrCreateAircraft(uint32_t addr);
+    void                UseModesMessage(Message const& mm);
+    // void                ModesSendSbsOutput(Message const& mm, ADSB::AirCraftImpl& a);
+
+    std::unordered_map<uint32_t, std::chrono::system_clock::time_point> icaoTimestamps;
+
+    Config                config{};
+    std::vector<uint16_t> magnitudesLookupTable = CreateLUT();
+    // std::vector<uint8_t>  data;
+    std::vector<uint16_t> magnitudeVector;
+    size_t                resumeOffset{0};
+    double                noiseMagnitude{};    // Rolling mean of the quiet samples between preamble pulses
+
+    ADSB::SquelchMode    squelchMode{ADSB::SquelchMode::Off};
+    double               squelchFactor{};
+    double               noiseFloor{};    // Mean |I| / |Q| deviation, tracked while squelch is on
+    bool                 squelchCarryHot{false};
+    std::vector<uint8_t> squelchHot;
+
+    bool                          adaptiveGain{false};
+    GainController::Config        gainControl{};
+    uint64_t                      gainWindowSamples{};
+    GainController::Window        gainWindowStart{};
+    std::optional<GainController> gainController;
+    std::atomic_bool              gainDeviceChanged{false};
+
+    std::array<LatencyHistogram, ADSB::LatencyStageCount> latency;    // Stages timed by this handler, see GetStats
+    LatencyTimer::clock::duration                         scanNestedTime{};
+
+    uint32_t                              sampleRate{};    // TrackFrame times frames by it
+    std::shared_ptr<ADSB::TrafficManager> trafficManager;
+    ADSB::IFrameTap*                      frameTap{nullptr};
+    ADSB::MessageBatch<Message>           messages;
+    bool                                  trackAircraft{true};    // Per buffer or tracked frame, see UpdateTracking
+
+    // DataRecorder<AirCraftImpl> _recorder;
+
+    std::mutex        mutex;
+    std::atomic<bool> stopRequested{false};
+    DeviceSelector    selector;
+    RTLSDR            listener1090;
+    ADSB::Source      sourceId{ADSB::Source::ADSB1090};
+    /* Statistics. Written by the data handler thread only, see GetStats */
+    StatCounter statValidPreamble;
+    StatCounter statDemodulated;
+    StatCounter statGoodcrc;
+    StatCounter statBadcrc;
+    StatCounter statFixed;
+    StatCounter statSingleBitFix;
+    StatCounter statTwoBitsFix;
+    StatCounter statOutOfPhase;
+    StatCounter statSquelchBlocks;
+    StatCounter statSquelchedBlocks;
+    StatCounter statBuffers;
+    StatCounter statSamples;
+    StatCounter statClippedSamples;
+};
+
+/* Decode stages, defined in ADSB1090.cpp */
+uint32_t ModesChecksum(std::array<uint8_t, Message::LongMessageBytes> const& msg, size_t bits);
+int      FixSingleBitErrors(std::array<uint8_t, Message::LongMessageBytes>& msg, size_t bits);
+int      FixTwoBitsErrors(std::array<uint8_t, Message::LongMessageBytes>& msg, size_t bits);
+bool     DecodeCpr(ADSB::AirCraftImpl& a);
+
+// NOLINTEND(cppcoreguidelines-pro-bounds-constant-array-index)
+// NOLINTEND(readability-magic-numbers)
+
+// NOLINTEND
@@ -1,5 +1,8 @@
 #include "ADSB.h"
 
+#include <iomanip>
+#include <ostream>
+
 struct DataProviderImpl : ADSB::IDataProvider
 {
     struct DeviceSerialNameSelector : RTLSDR::IDeviceSelector
@@ -15,8 +18,8 @@ struct DataProviderImpl : ADSB::IDataProvider
     };
 
     template <typename TFunc>
-    DataProviderImpl(TFunc func, ADSB::Source source, std::string_view selectorName) :
-        rtlsdr(selectorName), handler(func(trafficManager, &rtlsdr, source))
+    DataProviderImpl(TFunc func, ADSB::Source source, std::string_view selectorName, ADSB::HandlerConfig const& config) :
+        rtlsdr(selectorName), handler(func(trafficManager, &rtlsdr, source, config))
     {}
 
     ~DataProviderImpl() override = default;
@@ -30,19 +33,103 @@ struct DataProviderImpl : ADSB::IDataProvider
 
     void Stop() override { handler->Stop(); }
 
-    void NotifySelfLocation(ADSB::IAirCraft const& /*selfLoc*/) override {}
+    void NotifySelfLocation(ADSB::IAirCraft const& ownship) override { handler->NotifySelfLocation(ownship); }
+    void SetProximity(ADSB::ProximityConfig const& config) override { handler->SetProximity(config); }
+
+    void SetFilter(ADSB::SubscriptionFilter const& filter) override { handler->SetFilter(filter); }
+    void AddListener(ADSB::IListener& listener, ADSB::ListenerOptions const& options) override { handler->AddListener(listener, options); }
+    void RemoveListener(ADSB::IListener& listener) override { handler->RemoveListener(listener); }
+    [[nodiscard]] ADSB::SpatialIndex const& Positions() const override { return handler->Positions(); }
+    void SetTrackHistory(size_t bytesPerAircraft) override { handler->SetTrackHistory(bytesPerAircraft); }
+    [[nodiscard]] ADSB::TrackHistory const& History() const override { return handler->History(); }
+    std::unique_ptr<ADSB::UpdateStream> OpenStream(ADSB::StreamOptions const& options) override { return handler->OpenStream(options); }
+
+    void SubscribeFISB(uint16_t productId, ADSB::FISB::IProductListener& listener) override { handler->SubscribeFISB(productId, listener); }
+    void UnsubscribeFISB(ADSB::FISB::IProductListener& listener) override { handler->UnsubscribeFISB(listener); }
+
+    void SubscribeMessages(ADSB::IMessageListener& listener, bool trackAircraft) override
+    {
+        handler->SubscribeMessages(listener, trackAircraft);
+    }
+    void UnsubscribeMessages(ADSB::IMessageListener& listener) override { handler->UnsubscribeMessages(listener); }
+
+    [[nodiscard]] ADSB::DataProviderStats GetStats() const override { return handler->GetStats(); }
 
     std::shared_ptr<ADSB::TrafficManager> trafficManager = std::make_shared<ADSB::TrafficManager>();
     DeviceSerialNameSelector              rtlsdr;
     std::unique_ptr<ADSB::IDataProvider>  handler;
 };
 
+std::unique_ptr<ADSB::UpdateStream> ADSB::IDataProvider::OpenStream(StreamOptions const& /* options */)
+{
+    return nullptr;
+}
+
+ADSB::SpatialIndex const& ADSB::IDataProvider::Positions() const
+{
+    SUPPRESS_WARNINGS_START
+    SUPPRESS_CLANG_WARNING("-Wexit-time-destructors")
+    static SpatialIndex const empty;
+    SUPPRESS_WARNINGS_END
+    return empty;
+}
+
+ADSB::TrackHistory const& ADSB::IDataProvider::History() const
+{
+    SUPPRESS_WARNINGS_START
+    SUPPRESS_CLANG_WARNING("-Wexit-time-destructors")
+    static TrackHistory const empty;
+    SUPPRESS_WARNINGS_END
+    return empty;
+}
+
+ADSB::DataProviderStats ADSB::IDataProvider::GetStats() const
+{
+    return {.time = DataProviderStats::clock::now()};
+}
+
+void ADSB::DataProviderStats::DumpLatency(std::ostream& out) const
+{
+    static constexpr std::array<char const*, LatencyStageCount> Names
+        = {"QueueWait", "Magnitude", "PreambleScan", "Decode", "Tracker", "Dispatch", "EndToEnd"};
+
+    auto us = [](uint64_t ns) { return static_cast<double>(ns) / 1000.0; };
+    out << std::fixed << std::setprecision(1);
+    for (size_t stage = 0; stage < LatencyStageCount; stage++)
+    {
+        auto const& h = latency.at(stage);
+        out << std::left << std::setw(14) << Names.at(stage) << std::right << " count " << h.count << " mean " << h.MeanNs() / 1000.0
+            << "us p50 " << us(h.PercentileNs(0.5)) << "us p90 " << us(h.PercentileNs(0.9)) << "us p99 " << us(h.PercentileNs(0.99))
+            << "us p99.9 " << us(h.PercentileNs(0.999)) << "us max " << us(h.maxNs) << "us\n";
+    }
+    for (size_t stage = 0; stage < LatencyStageCount; stage++)
+    {
+        auto const& h = latency.at(stage);
+        if (h.count == 0) { continue; }
+        out << Names.at(stage) << " buckets (upper bound us: count)\n";
+        for (size_t i = 0; i < LatencyHistogram::BucketCount; i++)
+        {
+            if (h.buckets.at(i) != 0) { out << "  " << us(LatencyHistogram::BucketUpperNs(i)) << ": " << h.buckets.at(i) << '\n'; }
+        }
+    }
+}
+
 std::unique_ptr<ADSB::IDataProvider> ADSB::CreateADSB1090Provider()
 {
-    return std::make_unique<DataProviderImpl>(ADSB::TryCreateADSB1090Handler, ADSB::Source::ADSB1090, "1090");
+    return CreateADSB1090Provider(HandlerConfig{});
 }
 
 std::unique_ptr<ADSB::IDataProvider> ADSB::CreateUAT978Provider()
 {
-    return std::make_unique<DataProviderImpl>(ADSB::TryCreateUAT978Handler, ADSB::Source::UAT978, "978");
+    return CreateUAT978Provider(HandlerConfig{});
+}
+
+std::unique_ptr<ADSB::IDataProvider> ADSB::CreateADSB1090Provider(HandlerConfig const& config)
+{
+    return std::make_unique<DataProviderImpl>(ADSB::TryCreateADSB1090Handler, ADSB::Source::ADSB1090, "1090", config);
+}
+
+std::unique_ptr<ADSB::IDataProvider> ADSB::CreateUAT978Provider(HandlerConfig const& config)
+{
+    return std::make_unique<DataProviderImpl>(ADSB::TryCreateUAT978Handler, ADSB::Source::UAT978, "978", config);
 }
@@ -1,9 +1,26 @@
 #pragma once
 #include "CommonMacros.h"
+#include "FISB.h"
+#include "LatencyHistogram.h"
+#include "ModeSMessage.h"
+#include "UATMessage.h"
 
 SUPPRESS_WARNINGS_START
 SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
+#include <coroutine>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <limits>
+#include <numbers>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
 SUPPRESS_WARNINGS_END
 
 #include <memory>
@@ -47,6 +64,41 @@ struct IAirCraft
     [[nodiscard]] virtual int32_t          Climb() const        = 0;
     [[nodiscard]] virtual int32_t          Lat1E7() const       = 0;
     [[nodiscard]] virtual int32_t          Lon1E7() const       = 0;
+
+    // dBFS, averaged over recent messages. Zero when the source doesn't measure it (UAT, FlightRadar24)
+    [[nodiscard]] virtual float SignalLevel() const { return 0; }
+    [[nodiscard]] virtual float NoiseLevel() const { return 0; }
+};
+
+// How close an aircraft is to ownship (IDataProvider::NotifySelfLocation), see ProximityConfig
+enum class ProximityLevel : uint8_t
+{
+    None,
+    Proximate,    // Within proximateNm / proximateFt now
+    Conflict,     // Projected to come within horizontalNm and verticalFt in the lookahead
+};
+
+struct ProximityAlert
+{
+    uint32_t       addr{};
+    Source         sourceId{};
+    ProximityLevel level{};               // None: a previous alert is over
+    double         rangeNm{};             // Now
+    int32_t        altitudeDiffFt{};      // Aircraft above ownship, now
+    double         cpaNm{};               // At the closest point of approach
+    int32_t        cpaAltitudeDiffFt{};
+    double         timeToCpaSeconds{};    // 0 when diverging
+};
+
+// Thresholds of the proximity alerts. The defaults follow TCAS traffic advisories
+struct ProximityConfig
+{
+    double               horizontalNm = 1.0;
+    int32_t              verticalFt   = 600;
+    std::chrono::seconds lookahead{40};    // Tracks are projected in a straight line at constant climb this far
+    double               proximateNm  = 6.0;
+    int32_t              proximateFt  = 1200;
+    std::chrono::seconds stale{20};    // An alert is cleared once its aircraft hasn't been heard from this long
 };
 
 struct IListener
@@ -57,6 +109,173 @@ struct IListener
 
     virtual void OnChanged(IAirCraft const&)                            = 0;
     virtual void OnDeviceStatusChanged(Source sourceId, bool available) = 0;
+    // The receiver could not keep up and droppedSamples I/Q samples were discarded (see RTLSDR::OverflowPolicy)
+    virtual void OnDataLost(Source /* sourceId */, uint64_t /* droppedSamples */) {}
+    // An aircraft's ProximityLevel changed after one of its updates or a new ownship fix, once ownship is
+    // known. Aircraft without altitude or velocity yet are left out. Not filtered
+    virtual void OnProximity(ProximityAlert const& /* alert */) {}
+};
+
+// Which aircraft updates reach the listener. Evaluated by the tracker before IListener::OnChanged, so a
+// consumer that only cares about part of the traffic doesn't take a virtual call for the rest.
+// The defaults let everything through
+struct SubscriptionFilter
+{
+    // In 1E7 degrees, inclusive. minLon1E7 > maxLon1E7 crosses the antimeridian
+    struct BoundingBox
+    {
+        int32_t minLat1E7{};
+        int32_t maxLat1E7{};
+        int32_t minLon1E7{};
+        int32_t maxLon1E7{};
+
+        // Covers a circle of radiusNm nautical miles around a point. A circle over a pole takes every longitude,
+        // otherwise the widest point of the circle is asin(sin(radius) / cos(lat)) away in longitude
+        static BoundingBox Around(double lat, double lon, double radiusNm)
+        {
+            constexpr double Rad    = std::numbers::pi / 180;
+            auto             degLat = radiusNm / 60;
+            auto             sinLon = std::sin(std::min(degLat, 90.) * Rad) / std::cos(lat * Rad);
+            auto             wrap   = [](double x) { return x > 180 ? x - 360 : (x < -180 ? x + 360 : x); };
+            auto             e7     = [](double x) { return static_cast<int32_t>(std::lround(x * IAirCraft::LatLonPrecision)); };
+            if (std::abs(lat) + degLat >= 90 || sinLon >= 1)
+            {
+                return {e7(std::max(lat - degLat, -90.)), e7(std::min(lat + degLat, 90.)), e7(-180), e7(180)};
+            }
+            auto degLon = std::asin(sinLon) / Rad;
+            return {e7(std::max(lat - degLat, -90.)), e7(std::min(lat + degLat, 90.)), e7(wrap(lon - degLon)), e7(wrap(lon + degLon))};
+        }
+    };
+
+    std::vector<uint32_t>      allow{};                                               // ICAO addresses. Empty: any
+    std::vector<uint32_t>      deny{};
+    std::optional<BoundingBox> box{};                                                 // Aircraft without a position are left out
+    int32_t                    minAltitude = std::numeric_limits<int32_t>::min();    // Feet
+    int32_t                    maxAltitude = std::numeric_limits<int32_t>::max();
+    uint8_t                    sources     = 0xff;                                    // Source values or-ed together
+    std::chrono::milliseconds  minInterval{};    // Per aircraft. Updates closer than this to the last one delivered are dropped
+};
+
+// How IDataProvider::AddListener delivers to a listener
+struct ListenerOptions
+{
+    enum class Delivery : uint8_t
+    {
+        Synchronous,    // On the data handler thread, in line with decoding. For listeners that return quickly
+        Queued,         // On a thread of the listener's own, through a bounded queue
+    };
+
+    // Queued: when the listener falls behind and the queue is full, an aircraft's update waiting for room
+    // is replaced by its newer state (see DataProviderStats::coalescedUpdates), decoding never waits
+    Delivery           delivery      = Delivery::Synchronous;
+    size_t             queueCapacity = 1024;    // Queued: events, rounded up to a power of two
+    SubscriptionFilter filter{};
+};
+
+// How IDataProvider::OpenStream fills an UpdateStream
+struct StreamOptions
+{
+    size_t             queueCapacity = 1024;    // Updates, rounded up to a power of two
+    SubscriptionFilter filter{};
+
+    // Resumes a coroutine suspended in UpdateStream::Read, called on the data handler thread: post it to the
+    // event loop. Empty: the coroutine resumes right there, on the data handler thread with no lock of the
+    // tracker held, or on the thread that destroys the provider, which closes the stream
+    std::function<void(std::coroutine_handle<>)> schedule{};
+};
+
+struct SpatialIndex;
+struct TrackHistory;
+struct UpdateStream;
+
+// Decoded messages, for consumers that forward raw traffic instead of (or as well as) aircraft state.
+// Called on the data handler thread with the messages of a device buffer, or fewer when a batch fills up.
+// Messages passed the CRC (Mode S) or Reed-Solomon (UAT) check and are only valid during the call
+struct IMessageListener
+{
+    IMessageListener()          = default;
+    virtual ~IMessageListener() = default;
+    CLASS_DEFAULT_COPY_AND_MOVE(IMessageListener);
+
+    virtual void OnModeSMessages(Source sourceId, std::span<ModeSMessage const> messages) = 0;
+    virtual void OnUATMessages(Source sourceId, std::span<UATMessage const> messages)     = 0;
+};
+
+// Where the time goes between a buffer arriving from the device and the listener hearing about it
+enum class LatencyStage : uint8_t
+{
+    QueueWait,       // Buffer queued in the ring until the data handler picks it up
+    Magnitude,       // I/Q to magnitude (1090) or phase (978) conversion, per buffer
+    PreambleScan,    // Preamble search and bit slicing per buffer, without Decode/Tracker/Dispatch. 978: all of dump978
+    Decode,          // Message decode and CRC / error correction, per message
+    Tracker,         // Aircraft state update, per message, without Dispatch
+    Dispatch,        // IListener::OnChanged
+    EndToEnd,        // Buffer arrival to IListener::OnChanged
+};
+inline constexpr size_t LatencyStageCount = 7;
+
+// Counters of a data provider since it was created. Snapshots are taken without locks, so counters
+// of one snapshot may be a few increments apart. Rates come from the difference of two snapshots
+struct DataProviderStats
+{
+    using clock = std::chrono::steady_clock;
+
+    struct Rates
+    {
+        double samples{};           // Per second. Falls short of the sample rate when the device stalls
+        double messages{};          // Good CRC messages / frames per second
+        double droppedSamples{};    // Per second
+        double goodRatio{};         // Good / (good + bad) CRC, a failing antenna or overload drags this down
+    };
+
+    clock::time_point time{};
+
+    // Device and ring buffer
+    uint64_t buffers{};
+    uint64_t samples{};
+    uint64_t overruns{};
+    uint64_t droppedSamples{};
+    uint64_t clippedSamples{};    // 1090 only. I or Q at 0 or 255
+    int      gain{};              // Tenths of a dB, 0 until a device is open
+
+    // Demodulator. For UAT 978 a frame that passed Reed-Solomon counts as a good CRC
+    uint64_t validPreambles{};
+    uint64_t demodulated{};
+    uint64_t goodCrc{};
+    uint64_t badCrc{};
+    uint64_t fixed{};    // Good after error correction
+    uint64_t singleBitFix{};
+    uint64_t twoBitsFix{};
+    uint64_t outOfPhase{};
+    uint64_t squelchBlocks{};
+    uint64_t squelchedBlocks{};
+
+    // UAT 978 only
+    uint64_t downlinkFrames{};
+    uint64_t uplinkFrames{};
+
+    // Listeners with ListenerOptions::Delivery::Queued
+    uint64_t coalescedUpdates{};
+
+    // Indexed by LatencyStage. Empty when built without latency histograms
+    std::array<LatencyHistogram::Snapshot, LatencyStageCount> latency{};
+
+    [[nodiscard]] LatencyHistogram::Snapshot const& Latency(LatencyStage stage) const { return latency.at(static_cast<size_t>(stage)); }
+
+    // Percentiles of every stage followed by the non empty buckets, for humans
+    void DumpLatency(std::ostream& out) const;
+
+    [[nodiscard]] Rates RatesSince(DataProviderStats const& earlier) const
+    {
+        auto seconds = std::chrono::duration<double>(time - earlier.time).count();
+        if (!(seconds > 0)) { return {}; }
+        auto good    = static_cast<double>(goodCrc - earlier.goodCrc);
+        auto checked = good + static_cast<double>(badCrc - earlier.badCrc);
+        return {.samples        = static_cast<double>(samples - earlier.samples) / seconds,
+                .messages       = good / seconds,
+                .droppedSamples = static_cast<double>(droppedSamples - earlier.droppedSamples) / seconds,
+                .goodRatio      = checked > 0 ? good / checked : 0};
+    }
 };
 
 struct IDataProvider
@@ -68,7 +287,51 @@ struct IDataProvider
     virtual void Start(IListener& listener) = 0;
     virtual void Stop()                     = 0;
 
+    // Ownship, from any thread. Each aircraft update is checked against it, see IListener::OnProximity
     virtual void NotifySelfLocation(IAirCraft const&) = 0;
+    virtual void SetProximity(ProximityConfig const& /* config */) {}
+
+    // Applies to the listener passed to Start. Takes effect from the next update, callable from any thread.
+    // A provider without filtering ignores it
+    virtual void SetFilter(SubscriptionFilter const& /* filter */) {}
+
+    // Listeners besides the one passed to Start, each with its own filter and delivery. Callable from any
+    // thread but not from a listener callback. RemoveListener returns once the listener is no longer called.
+    // A provider without fan out throws std::logic_error
+    virtual void AddListener(IListener& /* listener */, ListenerOptions const& /* options */)
+    {
+        throw std::logic_error("This provider has a single listener");
+    }
+    virtual void RemoveListener(IListener& /* listener */) {}
+
+    // Updates to pull instead of a listener, see UpdateStream.h. Callable from any thread, the stream
+    // stops with the provider or when closed. nullptr from a provider without streams
+    virtual std::unique_ptr<UpdateStream> OpenStream(StreamOptions const& options);
+
+    // Tracked aircraft by position for radius, bounding box and nearest queries, see SpatialIndex.h.
+    // Queries are callable from any thread. Always empty for a provider without an index
+    [[nodiscard]] virtual SpatialIndex const& Positions() const;
+
+    // Recent positions of each aircraft for trails, see TrackHistory.h. Off until SetTrackHistory, which
+    // drops what was recorded. Callable from any thread. Always empty for a provider without one
+    virtual void                              SetTrackHistory(size_t /* bytesPerAircraft */) {}
+    [[nodiscard]] virtual TrackHistory const& History() const;
+
+    // FIS-B uplink products (UAT 978 only). Payloads are decoded only for subscribed products, a provider
+    // without uplinks ignores subscriptions
+    virtual void SubscribeFISB(uint16_t /* productId */, FISB::IProductListener& /* listener */) {}
+    virtual void UnsubscribeFISB(FISB::IProductListener& /* listener */) {}
+
+    // Decoded messages (UAT 978: downlink frames only, uplinks go to SubscribeFISB). While every subscriber
+    // has trackAircraft false and nothing else takes the aircraft (AddListener, OpenStream, SetTrackHistory,
+    // NotifySelfLocation), messages are not tracked and the Start listener's OnChanged is not called.
+    // trackAircraft false with one of those attached throws std::logic_error. A provider that doesn't
+    // decode messages itself ignores subscriptions
+    virtual void SubscribeMessages(IMessageListener& /* listener */, bool /* trackAircraft */) {}
+    virtual void UnsubscribeMessages(IMessageListener& /* listener */) {}
+
+    // Lock free, callable from any thread at any time. Only the time from a provider without statistics
+    [[nodiscard]] virtual DataProviderStats GetStats() const;
 };
 
 std::unique_ptr<IDataProvider> CreateADSB1090Provider();
@@ -0,0 +1,114 @@
+#pragma once
+#include "ADSBListener.h"
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+namespace ADSB
+{
+
+// ICAO addresses as a 64 Kbit bitset of their low 16 bits in front of a sorted vector, so that most
+// addresses outside the set are rejected by one bit test
+struct AddressSet
+{
+    static constexpr size_t BucketBits = 16;
+
+    AddressSet() = default;
+    explicit AddressSet(std::span<uint32_t const> addresses) : _addresses(addresses.begin(), addresses.end())
+    {
+        std::ranges::sort(_addresses);
+        auto last = std::ranges::unique(_addresses);
+        _addresses.erase(last.begin(), last.end());
+        if (!_addresses.empty()) { _bits.resize((size_t{1} << BucketBits) / 64); }
+        for (auto addr : _addresses) { _bits[Bucket_(addr) / 64] |= uint64_t{1} << (Bucket_(addr) % 64); }
+    }
+
+    [[nodiscard]] bool Empty() const { return _addresses.empty(); }
+    [[nodiscard]] bool Contains(uint32_t addr) const
+    {
+        if (_bits.empty() || (_bits[Bucket_(addr) / 64] & (uint64_t{1} << (Bucket_(addr) % 64))) == 0) { return false; }
+        return std::ranges::binary_search(_addresses, addr);
+    }
+
+    private:
+    static size_t Bucket_(uint32_t addr) { return addr & ((uint32_t{1} << BucketBits) - 1); }
+
+    std::vector<uint64_t> _bits;
+    std::vector<uint32_t> _addresses;
+};
+
+// A SubscriptionFilter compiled for the tracker. The configured checks are kept as bits of one mask and
+// the rest is integer compares on the aircraft's fields
+struct AircraftFilter
+{
+    using duration = std::chrono::system_clock::duration;
+
+    AircraftFilter() = default;
+    explicit AircraftFilter(SubscriptionFilter const& filter) :
+        _allow(filter.allow),
+        _deny(filter.deny),
+        _minAltitude(filter.minAltitude),
+        _maxAltitude(filter.maxAltitude),
+        _sources(filter.sources),
+        _minInterval(std::chrono::duration_cast<duration>(filter.minInterval))
+    {
+        if (!_allow.Empty()) { _checks |= Allow; }
+        if (!_deny.Empty()) { _checks |= Deny; }
+        if (filter.box.has_value())
+        {
+            _checks |= Box;
+            _box    = *filter.box;
+        }
+        if (_minAltitude != SubscriptionFilter{}.minAltitude || _maxAltitude != SubscriptionFilter{}.maxAltitude) { _checks |= Altitude; }
+        if (_sources != SubscriptionFilter{}.sources) { _checks |= Sources; }
+    }
+
+    [[nodiscard]] bool     PassesAll() const { return _checks == 0 && _minInterval == duration{}; }
+    [[nodiscard]] duration MinInterval() const { return _minInterval; }
+
+    // Position (0, 0) is taken for no position
+    [[nodiscard]] bool Matches(uint32_t addr, Source source, int32_t altitude, int32_t lat1E7, int32_t lon1E7) const
+    {
+        if (_checks == 0) { return true; }
+        if ((_checks & Sources) != 0 && (_sources & static_cast<uint8_t>(source)) == 0) { return false; }
+        if ((_checks & Altitude) != 0 && (altitude < _minAltitude || altitude > _maxAltitude)) { return false; }
+        if ((_checks & Box) != 0)
+        {
+            if ((lat1E7 == 0 && lon1E7 == 0) || lat1E7 < _box.minLat1E7 || lat1E7 > _box.maxLat1E7) { return false; }
+            bool inLon = _box.minLon1E7 <= _box.maxLon1E7 ? (lon1E7 >= _box.minLon1E7 && lon1E7 <= _box.maxLon1E7)
+                                                          : (lon1E7 >= _box.minLon1E7 || lon1E7 <= _box.maxLon1E7);
+            if (!inLon) { return false; }
+        }
+        if ((_checks & Deny) != 0 && _deny.Contains(addr)) { return false; }
+        return (_checks & Allow) == 0 || _allow.Contains(addr);
+    }
+
+    private:
+    enum Check : uint8_t
+    {
+        Allow    = 1u << 0u,
+        Deny     = 1u << 1u,
+        Box      = 1u << 2u,
+        Altitude = 1u << 3u,
+        Sources  = 1u << 4u,
+    };
+
+    uint8_t                         _checks{};
+    AddressSet                      _allow;
+    AddressSet                      _deny;
+    SubscriptionFilter::BoundingBox _box{};
+    int32_t                         _minAltitude{};
+    int32_t                         _maxAltitude{};
+    uint8_t                         _sources{};
+    duration                        _minInterval{};
+};
+
+}    // namespace ADSB
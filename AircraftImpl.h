@@ -1,8 +1,26 @@
 #pragma once
 #include "ADSBListener.h"
+#include "AircraftFilter.h"
+#include "CoalescingQueue.h"
+#include "ProximityEngine.h"
+#include "SetThreadName.h"
+#include "SpatialIndex.h"
+#include "StatCounter.h"
+#include "TrackHistory.h"
+#include "TraceEvents.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <iterator>
 #include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 namespace ADSB
 {
 
@@ -24,6 +42,22 @@ struct AirCraftImpl : ADSB::IAirCraft
     //    10000000.0); }
     [[nodiscard]] int32_t Lat1E7() const override { return lat1E7; }
     [[nodiscard]] int32_t Lon1E7() const override { return lon1E7; }
+    [[nodiscard]] float   SignalLevel() const override { return signalLevel; }
+    [[nodiscard]] float   NoiseLevel() const override { return noiseLevel; }
+
+    // Averages the last few receptions so that a single fade or collision doesn't swing the level
+    void UpdateSignal(float signal, float noise)
+    {
+        static constexpr float Alpha = 1.0f / 8;
+        if (signalCount++ == 0)
+        {
+            signalLevel = signal;
+            noiseLevel  = noise;
+            return;
+        }
+        signalLevel += (signal - signalLevel) * Alpha;
+        noiseLevel  += (noise - noiseLevel) * Alpha;
+    }
 
     uint32_t            addr{0};
     std::array<char, 8> callsign{};
@@ -35,6 +69,9 @@ struct AirCraftImpl : ADSB::IAirCraft
     int32_t             vertRate{};
     int32_t             lat1E7{};
     int32_t             lon1E7{};
+    float               signalLevel{};
+    float               noiseLevel{};
+    uint32_t            signalCount{};
 
     // Used for 1090 ADSB Decoding
     double     cprOddLat{};
@@ -46,8 +83,50 @@ struct AirCraftImpl : ADSB::IAirCraft
     Source     sourceId{};
 };
 
+// A listener call, copied into the queue of a listener with ListenerOptions::Delivery::Queued or of an
+// UpdateStream. The aircraft is a snapshot so that the tracker can go on updating its own
+struct ListenerEvent
+{
+    enum class Kind : uint8_t
+    {
+        Changed,
+        DeviceStatus,
+        DataLost,
+        Proximity,
+    };
+
+    void DeliverTo(IListener& listener) const
+    {
+        switch (kind)
+        {
+        case Kind::Changed: listener.OnChanged(aircraft); break;
+        case Kind::DeviceStatus: listener.OnDeviceStatusChanged(sourceId, available); break;
+        case Kind::DataLost: listener.OnDataLost(sourceId, droppedSamples); break;
+        case Kind::Proximity: listener.OnProximity(alert); break;
+        }
+    }
+
+    // Waiting in a full queue, with the same key. Lost samples add up, everything else is a newer state
+    void Coalesce(ListenerEvent const& newer)
+    {
+        auto dropped = droppedSamples;
+        *this        = newer;
+        if (kind == Kind::DataLost) { droppedSamples += dropped; }
+    }
+
+    Kind           kind{Kind::Changed};
+    Source         sourceId{};
+    bool           available{};
+    uint64_t       droppedSamples{};
+    AirCraftImpl   aircraft{};
+    ProximityAlert alert{};
+};
+
 struct TrafficManager : std::enable_shared_from_this<TrafficManager>
 {
+    using time_point = IAirCraft::time_point;
+    using EventQueue = CoalescingQueue<ListenerEvent>;
+
     AirCraftImpl& FindOrCreate(uint32_t addr)
     {
         auto it = aircrafts.find(addr);
@@ -60,10 +139,292 @@ struct TrafficManager : std::enable_shared_from_this<TrafficManager>
         return a;
     }
 
-    void SetListener(ADSB::IListener* l) { listener = l; }
-    void NotifyChanged(AirCraftImpl const& a) const { listener->OnChanged(a); }
+    // The listener passed to IDataProvider::Start, called synchronously with the filter from SetFilter.
+    // Returns once the previous listener is no longer called
+    void SetListener(ADSB::IListener* l)
+    {
+        auto slot      = std::make_shared<ListenerSlot>();
+        slot->listener = l;
+        std::shared_ptr<ListenerSlot> previous;
+        {
+            std::scoped_lock lock(listenersMutex);
+            slot->filter = primary->filter;
+            previous     = std::exchange(primary, std::move(slot));
+            slotsVersion++;
+        }
+        Retire_(*previous);
+    }
+
+    // Called from any thread, takes effect from the next update
+    void SetFilter(SubscriptionFilter const& f)
+    {
+        auto             compiled = std::make_shared<AircraftFilter const>(f);
+        std::scoped_lock lock(listenersMutex);
+        primary->filter = std::move(compiled);
+        slotsVersion++;
+    }
+
+    // Called from any thread but not from a listener callback
+    void AddListener(IListener& l, ListenerOptions const& options)
+    {
+        auto slot      = std::make_shared<ListenerSlot>();
+        slot->listener = &l;
+        slot->filter   = std::make_shared<AircraftFilter const>(options.filter);
+        if (options.delivery == ListenerOptions::Delivery::Queued)
+        {
+            slot->queue  = std::make_shared<EventQueue>(options.queueCapacity);
+            slot->thread = std::thread([queue = slot->queue.get(), &l]() {
+                SetThreadName("ADSB::Listener");
+                std::array<ListenerEvent, 16> batch;
+                while (queue->Wait())
+                {
+                    for (auto const& event : std::span(batch).first(queue->Read(batch))) { event.DeliverTo(l); }
+                }
+            });
+        }
+        std::scoped_lock lock(listenersMutex);
+        listeners.push_back(std::move(slot));
+        slotsVersion++;
+    }
+
+    // The producer side of an UpdateStream. The slot goes with the next Flush once the stream closes the queue
+    void AddStream(std::shared_ptr<EventQueue> queue, SubscriptionFilter const& filter)
+    {
+        auto slot    = std::make_shared<ListenerSlot>();
+        slot->filter = std::make_shared<AircraftFilter const>(filter);
+        slot->queue  = std::move(queue);
+        std::scoped_lock lock(listenersMutex);
+        listeners.push_back(std::move(slot));
+        slotsVersion++;
+    }
+
+    // Anything besides the listener passed to Start that takes the tracked aircraft: an added listener or
+    // stream, the track history or ownship for proximity alerts. Callable from any thread
+    [[nodiscard]] bool HasConsumers()
+    {
+        {
+            std::scoped_lock lock(listenersMutex);
+            if (!listeners.empty()) { return true; }
+        }
+        return history.Enabled() || proximity.HasOwnship();
+    }
+
+    // Returns once the listener is no longer called. A queued listener's thread is joined outside the lock
+    void RemoveListener(IListener& l)
+    {
+        std::vector<std::shared_ptr<ListenerSlot>> removed;
+        {
+            std::scoped_lock lock(listenersMutex);
+            auto             it = std::ranges::partition(listeners, [&](auto const& slot) { return slot->listener != &l; });
+            std::ranges::move(it, std::back_inserter(removed));
+            listeners.erase(it.begin(), it.end());
+            slotsVersion++;
+        }
+        for (auto const& slot : removed) { Retire_(*slot); }
+    }
+
+    // The filters run first, on the data handler thread's copy of the listeners, so an update nobody wants
+    // costs neither the trace, the latency records nor a lock
+    void NotifyChanged(AirCraftImpl& a)
+    {
+        auto alert = proximity.Evaluate(a, bufferTime);
+        RefreshRoutes_();
+        accepted.clear();
+        for (auto& route : routes)
+        {
+            if (Accepts_(route, a)) { accepted.push_back(route.slot.get()); }
+        }
+        if (accepted.empty() && !alert.has_value()) { return; }
+
+        ADSB_TRACE_SCOPE("Listener::OnChanged");
+        LatencyTimer timer(dispatchLatency, &dispatchTime);
+        if constexpr (LatencyHistogram::Enabled)
+        {
+            if (!accepted.empty() && bufferTime != time_point{}) { endToEndLatency.Record(std::chrono::system_clock::now() - bufferTime); }
+        }
+        for (auto* slot : accepted)
+        {
+            if (slot->queue == nullptr) { Call_(*slot, [&](IListener& l) { l.OnChanged(a); }); }
+            else if (!slot->queue->Push({.kind = ListenerEvent::Kind::Changed, .aircraft = a}, Key_(a))) { statCoalesced++; }
+        }
+        if (alert.has_value()) { Broadcast_({.kind = ListenerEvent::Kind::Proximity, .sourceId = a.sourceId, .alert = *alert}); }
+    }
+
+    // Device status, data lost and proximity alerts go to every listener, unfiltered. In a full queue they
+    // coalesce per source, and proximity alerts per aircraft
+    void NotifyDeviceStatus(Source sourceId, bool available)
+    {
+        Broadcast_({.kind = ListenerEvent::Kind::DeviceStatus, .sourceId = sourceId, .available = available});
+    }
+    void NotifyDataLost(Source sourceId, uint64_t droppedSamples)
+    {
+        Broadcast_({.kind = ListenerEvent::Kind::DataLost, .sourceId = sourceId, .droppedSamples = droppedSamples});
+    }
+
+    // Called by the data handler after each buffer, so that updates held back by a full queue don't wait
+    // for the next update to go out and proximity alerts of silent traffic or a moved ownship are revisited
+    void Flush()
+    {
+        proximity.Review(
+            bufferTime,
+            [&](uint32_t addr) -> IAirCraft const* {
+                auto it = aircrafts.find(addr);
+                return it != aircrafts.end() ? it->second.get() : nullptr;
+            },
+            [&](ProximityAlert const& alert) {
+                Broadcast_({.kind = ListenerEvent::Kind::Proximity, .sourceId = alert.sourceId, .alert = alert});
+            });
+        RefreshRoutes_();
+        bool closed = false;
+        for (auto const& route : routes)
+        {
+            if (route.slot->queue == nullptr) { continue; }
+            route.slot->queue->Drain();
+            closed = closed || (route.slot->listener == nullptr && route.slot->queue->Closed());
+        }
+        if (!closed) { return; }
+        std::scoped_lock lock(listenersMutex);
+        std::erase_if(listeners, [](auto const& slot) { return slot->listener == nullptr && slot->queue->Closed(); });
+        slotsVersion++;
+    }
+
+    // After the data handler decoded a new position into a
+    void UpdatePosition(AirCraftImpl const& a)
+    {
+        auto seen = bufferTime != time_point{} ? bufferTime : std::chrono::system_clock::now();
+        positions.Update(a.addr, a.lat1E7, a.lon1E7, seen);
+        history.Record(a.addr, {.time = seen, .lat1E7 = a.lat1E7, .lon1E7 = a.lon1E7, .altitude = a.altitude});
+    }
 
     std::unordered_map<uint32_t, std::unique_ptr<AirCraftImpl>> aircrafts;
-    ADSB::IListener*                                            listener{nullptr};
+    SpatialIndex                                                positions;    // Aircraft with a position
+    ProximityEngine                                             proximity;    // Against ownship, once known
+    TrackHistory                                                history;      // Off until configured
+
+    // Updates of a queued listener or stream replaced by a newer one of the same aircraft while its queue was full
+    StatCounter statCoalesced;
+
+    // Written by the data handler thread. bufferTime is the arrival of the buffer being decoded,
+    // left at the epoch when not fed by a device. dispatchTime totals OnChanged for stages that exclude it
+    time_point                    bufferTime{};
+    LatencyHistogram              dispatchLatency;
+    LatencyHistogram              endToEndLatency;
+    LatencyTimer::clock::duration dispatchTime{};
+
+    private:
+    // A synchronous listener, a queued listener with its thread, or a stream (queue without listener)
+    struct ListenerSlot
+    {
+        ListenerSlot() = default;
+
+        // A stream's queue is closed too, so that a Read awaiting it returns 0 once the tracker is gone
+        ~ListenerSlot()
+        {
+            if (queue != nullptr) { queue->Close(); }
+            if (thread.joinable()) { thread.join(); }
+        }
+        CLASS_DELETE_COPY_AND_MOVE(ListenerSlot);
+
+        IListener*                            listener{nullptr};
+        std::shared_ptr<AircraftFilter const> filter{std::make_shared<AircraftFilter const>()};    // Replaced under listenersMutex
+        std::shared_ptr<EventQueue>           queue;                                               // Null for synchronous delivery
+        std::thread                           thread;
+        std::mutex                            callMutex;    // Held while a synchronous listener is called
+        bool                                  retired{};    // Under callMutex, the listener must not be called anymore
+    };
+
+    // The data handler thread's copy of a slot and its filter
+    struct Route
+    {
+        std::shared_ptr<ListenerSlot>            slot;
+        std::shared_ptr<AircraftFilter const>    filter;
+        std::unordered_map<uint32_t, time_point> notified;    // Last update delivered, with a minimum interval only
+    };
+
+    static uint64_t Key_(AirCraftImpl const& a) { return (uint64_t{static_cast<uint8_t>(a.sourceId)} << 32u) | a.addr; }
+
+    // Apart from the updates (Changed, 0) by the kind: per source, proximity alerts per aircraft
+    static uint64_t Key_(ListenerEvent const& event)
+    {
+        auto key = (uint64_t{static_cast<uint8_t>(event.kind)} << 40u) | (uint64_t{static_cast<uint8_t>(event.sourceId)} << 32u);
+        return event.kind == ListenerEvent::Kind::Proximity ? key | event.alert.addr : key;
+    }
+
+    static bool Accepts_(Route& route, AirCraftImpl const& a)
+    {
+        if (route.slot->listener == nullptr && route.slot->queue == nullptr) { return false; }
+        if (!route.filter->Matches(a.addr, a.sourceId, a.altitude, a.lat1E7, a.lon1E7)) { return false; }
+        if (route.filter->MinInterval() == AircraftFilter::duration{}) { return true; }
+        auto  now  = std::chrono::system_clock::now();
+        auto& last = route.notified[a.addr];
+        if (now - last < route.filter->MinInterval()) { return false; }
+        last = now;
+        return true;
+    }
+
+    template <typename TCall> static void Call_(ListenerSlot& slot, TCall&& call)
+    {
+        std::scoped_lock lock(slot.callMutex);
+        if (!slot.retired) { call(*slot.listener); }
+    }
+
+    // Waits for a call in progress, and a queued listener's thread, to finish. Not under listenersMutex
+    static void Retire_(ListenerSlot& slot)
+    {
+        if (slot.thread.joinable())
+        {
+            slot.queue->Close();
+            slot.thread.join();
+        }
+        std::scoped_lock lock(slot.callMutex);
+        slot.retired = true;
+    }
+
+    // Data handler thread. Copies the slots again after they changed, a route keeps its minimum interval
+    // bookkeeping while its filter stays the same
+    void RefreshRoutes_()
+    {
+        if (slotsVersion.load(std::memory_order_acquire) == routesVersion) { return; }
+        std::vector<Route> refreshed;
+        std::scoped_lock   lock(listenersMutex);
+        auto               add = [&](std::shared_ptr<ListenerSlot> const& slot) {
+            auto& route = refreshed.emplace_back(Route{.slot = slot, .filter = slot->filter, .notified = {}});
+            auto  it    = std::ranges::find_if(routes, [&](Route const& r) { return r.slot == slot && r.filter == slot->filter; });
+            if (it != routes.end()) { route.notified = std::move(it->notified); }
+        };
+        add(primary);
+        for (auto const& slot : listeners) { add(slot); }
+        routes        = std::move(refreshed);
+        routesVersion = slotsVersion.load(std::memory_order_relaxed);
+    }
+
+    // From any thread. The slots are copied under listenersMutex and called outside it
+    void Broadcast_(ListenerEvent const& event)
+    {
+        std::vector<std::shared_ptr<ListenerSlot>> slots;
+        {
+            std::scoped_lock lock(listenersMutex);
+            slots.reserve(listeners.size() + 1);
+            slots.push_back(primary);
+            slots.insert(slots.end(), listeners.begin(), listeners.end());
+        }
+        for (auto const& slot : slots)
+        {
+            if (slot->queue != nullptr) { slot->queue->Push(event, Key_(event)); }
+            else if (slot->listener != nullptr) { Call_(*slot, [&](IListener& l) { event.DeliverTo(l); }); }
+        }
+    }
+
+    // Only taken to change the listeners and to copy them, never while a listener is called. Synchronous
+    // listeners are called under their slot's callMutex instead
+    std::mutex                                 listenersMutex;
+    std::shared_ptr<ListenerSlot>              primary{std::make_shared<ListenerSlot>()};
+    std::vector<std::shared_ptr<ListenerSlot>> listeners;
+    std::atomic<uint64_t>                      slotsVersion{1};    // Bumped under listenersMutex when the slots change
+
+    // Data handler thread only
+    std::vector<Route>         routes;
+    uint64_t                   routesVersion{};
+    std::vector<ListenerSlot*> accepted;
 };
 }    // namespace ADSB
@@ -0,0 +1,386 @@
+#pragma once
+#include "ADSB.h"
+#include "CommonMacros.h"
+#include "IQFileSource.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+// Decodes a whole capture on every core, for re-decoding archives after a decoder change.
+//
+// The capture is cut into chunks that are demodulated in parallel, each by its own handler with its
+// frames tapped before tracking (ADSB::IFrameTap). A chunk is decoded from marginSamples before its
+// start, so that the noise estimate and the 1090 cache of recently seen addresses (needed to accept
+// DF0/4/5/16/20/21 replies) are warmed up, to a little past its end so that frames straddling it are
+// complete. It keeps the frames that start inside it. The chunks are decoded by a fixed pool of threads,
+// then merged in sample order and run through a single tracking handler (ADSB::IFrameTracker) on the
+// calling thread while the next chunks are still being demodulated. Only a few chunks are in memory at
+// a time.
+//
+// 978 frame positions are only known to the dump978 block they were found in, so 978 chunks also keep
+// frames that start shortly before them, drop those identical to one the previous chunk kept and merge
+// the rest with the end of the previous chunk by sample.
+//
+// Differences from a serial replay: replies from aircraft that were last seen more than marginSamples
+// before a chunk starts are rejected at the start of the chunk.
+//
+//  BulkDecoder decoder({.band = BulkDecoder::Band::ADSB1090});
+//  IQFileSource source(path, {});
+//  auto totals = decoder.Run(source, trafficManager);
+struct BulkDecoder
+{
+    enum class Band : uint8_t
+    {
+        ADSB1090,
+        UAT978
+    };
+
+    struct Config
+    {
+        Band                band          = Band::ADSB1090;
+        size_t              chunkSamples  = size_t{1} << 25;    // ~16 s at 2 MS/s
+        size_t              marginSamples = size_t{1} << 21;    // ~1 s
+        unsigned            threads       = 0;                  // 0: one per core
+        ADSB::HandlerConfig handler{};                          // For every handler. frameTap is set by the decoder
+
+        // Wall clock time of the first sample, tracked frames are stamped from it. Epoch: when Run is called
+        std::chrono::system_clock::time_point start{};
+    };
+
+    struct Totals
+    {
+        size_t                   chunks{};
+        uint64_t                 samples{};
+        uint64_t                 frames{};
+        uint64_t                 duplicates{};    // 978 frames decoded by two chunks
+        std::chrono::nanoseconds elapsed{};
+    };
+
+    explicit BulkDecoder(Config const& config) : _config(config)
+    {
+        if (_config.chunkSamples == 0) { throw std::invalid_argument("Chunks must not be empty"); }
+        if (_config.threads == 0) { _config.threads = std::max(1u, std::thread::hardware_concurrency()); }
+    }
+
+    // Passes every frame of the capture to callback(ADSB::DemodulatedFrame const&) in sample order, on the
+    // calling thread. Samples count from the start of the capture
+    template <typename TCallback> Totals Decode(IQFileSource const& source, TCallback&& callback) const
+    {
+        auto   start = std::chrono::steady_clock::now();
+        Totals totals{};
+        totals.samples = SampleCount_(source);
+        totals.chunks  = static_cast<size_t>((totals.samples + _config.chunkSamples - 1) / _config.chunkSamples);
+
+        // The last window samples of a chunk can interleave with the frames the next one keeps before its start
+        auto  window = std::min(_config.band == Band::UAT978 ? DuplicateWindow978 : 0, _config.chunkSamples);
+        auto  emit   = [&](Chunk const& chunk, StoredFrame const& frame) {
+            callback(chunk.Frame(frame));
+            totals.frames++;
+        };
+        Chunk  previous;
+        size_t held = 0;    // previous.frames from here on are not passed on yet
+        Workers_(source, totals.chunks, [&](Chunk chunk) {
+            std::ranges::stable_sort(chunk.frames, {}, &StoredFrame::sample);
+            totals.duplicates
+                += std::erase_if(chunk.frames, [&](StoredFrame const& frame) { return IsDuplicate_(frame, chunk, previous); });
+            auto   cutoff = chunk.begin + _config.chunkSamples - window;
+            size_t next   = 0;
+            for (; next < chunk.frames.size() && chunk.frames[next].sample < cutoff; next++)
+            {
+                for (; held < previous.frames.size() && previous.frames[held].sample <= chunk.frames[next].sample; held++)
+                {
+                    emit(previous, previous.frames[held]);
+                }
+                emit(chunk, chunk.frames[next]);
+            }
+            for (; held < previous.frames.size(); held++) { emit(previous, previous.frames[held]); }
+            previous = std::move(chunk);
+            held     = next;
+        });
+        for (; held < previous.frames.size(); held++) { emit(previous, previous.frames[held]); }
+        totals.elapsed = std::chrono::steady_clock::now() - start;
+        return totals;
+    }
+
+    // Decodes the capture and tracks it into trafficManager, whose listener sees the updates in capture order.
+    // observer(ADSB::DemodulatedFrame const&) sees every frame before it is tracked. The tracker is flushed
+    // every FeedSamples of the capture, as a handler fed by a device is after each buffer
+    template <typename TObserver>
+    Totals Run(IQFileSource const& source, std::shared_ptr<ADSB::TrafficManager> const& trafficManager, TObserver&& observer) const
+    {
+        auto     handler = CreateHandler_(trafficManager, nullptr);
+        auto&    tracker = dynamic_cast<ADSB::IFrameTracker&>(*handler);
+        auto     start   = _config.start != ADSB::IFrameTracker::time_point{} ? _config.start : std::chrono::system_clock::now();
+        uint64_t flushed = 0;
+        auto     totals  = Decode(source, [&](ADSB::DemodulatedFrame const& frame) {
+            if (frame.sample >= flushed + FeedSamples)
+            {
+                tracker.FlushFrames();
+                flushed = frame.sample - (frame.sample % FeedSamples);
+            }
+            observer(frame);
+            tracker.TrackFrame(frame, start);
+        });
+        tracker.FlushFrames();
+        return totals;
+    }
+
+    Totals Run(IQFileSource const& source, std::shared_ptr<ADSB::TrafficManager> const& trafficManager) const
+    {
+        return Run(source, trafficManager, [](ADSB::DemodulatedFrame const& /* frame */) {});
+    }
+
+    private:
+    static constexpr size_t FeedSamples = size_t{1} << 16;    // Per HandleData call
+
+    // Fed past the end of a chunk. Both handlers hold back the last message length of every buffer
+    // (dump978 an uplink frame of 4452 bits) and need the whole message in before they decode it
+    static constexpr size_t TailSamples1090 = 1024;
+    static constexpr size_t TailSamples978  = 4 * 4452;
+
+    // 978 frame positions are off by up to a dump978 block (the handler's buffer) plus the samples held
+    // back. A transmitter sends once a second, so identical frames this close are the same frame
+    static constexpr size_t DuplicateWindow978 = size_t{1} << 18;
+
+    struct NoDevice : RTLSDR::IDeviceSelector
+    {
+        [[nodiscard]] bool SelectDevice(RTLSDR::DeviceInfo const& /* d */) const override { return false; }
+    };
+
+    struct StoredFrame
+    {
+        uint64_t sample{};
+        uint32_t addr{};
+        uint32_t offset{};    // Into Chunk::bytes
+        uint16_t length{};
+        int16_t  corrected{};
+        float    signalLevel{};
+        float    noiseLevel{};
+        bool     uplink{};
+    };
+
+    // Frames of one chunk, their bytes are packed into one vector
+    struct Chunk
+    {
+        uint64_t                 begin{};
+        std::vector<StoredFrame> frames;
+        std::vector<uint8_t>     bytes;
+
+        [[nodiscard]] std::span<uint8_t const> Bytes(StoredFrame const& f) const { return std::span(bytes).subspan(f.offset, f.length); }
+        [[nodiscard]] ADSB::DemodulatedFrame   Frame(StoredFrame const& f) const
+        {
+            return {.sample      = f.sample,
+                    .bytes       = Bytes(f),
+                    .addr        = f.addr,
+                    .signalLevel = f.signalLevel,
+                    .noiseLevel  = f.noiseLevel,
+                    .corrected   = f.corrected,
+                    .uplink      = f.uplink};
+        }
+    };
+
+    // Keeps the frames of a handler fed from sample base that start in [begin, end)
+    struct Tap : ADSB::IFrameTap
+    {
+        Tap(Chunk& chunkIn, uint64_t baseIn, uint64_t beginIn, uint64_t endIn) : chunk(chunkIn), base(baseIn), begin(beginIn), end(endIn)
+        {}
+
+        void OnFrame(ADSB::DemodulatedFrame const& frame) override
+        {
+            auto sample = base + frame.sample;
+            if (sample < begin || sample >= end) { return; }
+            chunk.frames.push_back({.sample      = sample,
+                                    .addr        = frame.addr,
+                                    .offset      = static_cast<uint32_t>(chunk.bytes.size()),
+                                    .length      = static_cast<uint16_t>(frame.bytes.size()),
+                                    .corrected   = static_cast<int16_t>(frame.corrected),
+                                    .signalLevel = frame.signalLevel,
+                                    .noiseLevel  = frame.noiseLevel,
+                                    .uplink      = frame.uplink});
+            chunk.bytes.insert(chunk.bytes.end(), frame.bytes.begin(), frame.bytes.end());
+        }
+
+        Chunk&   chunk;
+        uint64_t base;
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    [[nodiscard]] std::unique_ptr<ADSB::IDataProvider> CreateHandler_(std::shared_ptr<ADSB::TrafficManager> const& trafficManager,
+                                                                      ADSB::IFrameTap*                             tap) const
+    {
+        auto config     = _config.handler;
+        config.frameTap = tap;
+        if (_config.band == Band::UAT978) { return ADSB::TryCreateUAT978Handler(trafficManager, &_noDevice, ADSB::Source::UAT978, config); }
+        return ADSB::TryCreateADSB1090Handler(trafficManager, &_noDevice, ADSB::Source::ADSB1090, config);
+    }
+
+    [[nodiscard]] static uint64_t SampleCount_(IQFileSource const& source)
+    {
+        if (!source.IsCompressed()) { return source.Data().size() / 2; }
+        uint64_t bytes = 0;
+        for (auto const& chunk : source.Chunks()) { bytes += chunk.header.rawBytes; }
+        return bytes / 2;
+    }
+
+    // Raw I/Q of samples [begin, end). Maps the file directly, compressed captures are decoded chunk by chunk
+    [[nodiscard]] static std::vector<uint8_t> ReadCompressed_(IQFileSource const& source, uint64_t begin, uint64_t end)
+    {
+        std::vector<uint8_t> out;
+        out.reserve(static_cast<size_t>((end - begin) * 2));
+        uint64_t position = 0;    // Byte offset of the capture chunk
+        for (size_t i = 0; i < source.Chunks().size() && position < end * 2; i++)
+        {
+            uint64_t size = source.Chunks()[i].header.rawBytes;
+            if (position + size > begin * 2)
+            {
+                auto raw   = source.DecodeChunk(i);
+                auto first = static_cast<size_t>(std::max(begin * 2, position) - position);
+                auto last  = static_cast<size_t>(std::min(end * 2, position + size) - position);
+                out.insert(out.end(), raw.begin() + static_cast<std::ptrdiff_t>(first), raw.begin() + static_cast<std::ptrdiff_t>(last));
+            }
+            position += size;
+        }
+        return out;
+    }
+
+    Chunk DecodeChunk_(IQFileSource const& source, size_t index) const
+    {
+        auto total     = SampleCount_(source);
+        auto tail      = _config.band == Band::UAT978 ? TailSamples978 : TailSamples1090;
+        auto slack     = _config.band == Band::UAT978 ? DuplicateWindow978 : 0;
+        auto begin     = uint64_t{index} * _config.chunkSamples;
+        auto end       = std::min(total, begin + _config.chunkSamples);
+        auto feedBegin = begin > _config.marginSamples + slack ? begin - _config.marginSamples - slack : 0;
+        auto feedEnd   = std::min(total, end + tail);
+
+        std::vector<uint8_t>     decompressed;
+        std::span<uint8_t const> iq;
+        if (source.IsCompressed())
+        {
+            decompressed = ReadCompressed_(source, feedBegin, feedEnd);
+            iq           = decompressed;
+        }
+        else
+        {
+            iq = source.Data().subspan(static_cast<size_t>(feedBegin * 2), static_cast<size_t>((feedEnd - feedBegin) * 2));
+        }
+
+        Chunk chunk;
+        chunk.begin = begin;
+
+        Tap   tap(chunk, feedBegin, begin > slack ? begin - slack : 0, end);
+        auto  handler = CreateHandler_(std::make_shared<ADSB::TrafficManager>(), &tap);
+        auto& data    = dynamic_cast<RTLSDR::IDataHandler&>(*handler);
+        for (size_t offset = 0; offset < iq.size(); offset += FeedSamples * 2)
+        {
+            data.HandleData(iq.subspan(offset, std::min(FeedSamples * 2, iq.size() - offset)));
+        }
+        return chunk;
+    }
+
+    // Decodes the chunks on _config.threads threads, at most two per thread ahead of the one being
+    // visited, and calls visit(Chunk) with each of them in order on the calling thread
+    template <typename TVisit> void Workers_(IQFileSource const& source, size_t count, TVisit&& visit) const
+    {
+        struct Shared
+        {
+            std::mutex               mutex;
+            std::condition_variable  cv;
+            std::map<size_t, Chunk>  decoded;
+            std::exception_ptr       error;
+            size_t                   next{};
+            size_t                   visited{};
+            bool                     stop{};
+        } shared;
+        auto ahead = size_t{_config.threads} * 2;
+
+        auto work = [&]() {
+            while (true)
+            {
+                size_t index = 0;
+                {
+                    std::unique_lock lock(shared.mutex);
+                    shared.cv.wait(lock, [&]() { return shared.stop || shared.next >= count || shared.next < shared.visited + ahead; });
+                    if (shared.stop || shared.next >= count) { return; }
+                    index = shared.next++;
+                }
+                try
+                {
+                    auto             chunk = DecodeChunk_(source, index);
+                    std::scoped_lock lock(shared.mutex);
+                    shared.decoded.emplace(index, std::move(chunk));
+                } catch (...)
+                {
+                    std::scoped_lock lock(shared.mutex);
+                    shared.error = std::current_exception();
+                    shared.stop  = true;
+                }
+                shared.cv.notify_all();
+            }
+        };
+        auto stop = [&]() {
+            {
+                std::scoped_lock lock(shared.mutex);
+                shared.stop = true;
+            }
+            shared.cv.notify_all();
+        };
+
+        std::vector<std::thread> threads;
+        try
+        {
+            for (unsigned i = 0; i < std::min<size_t>(_config.threads, count); i++) { threads.emplace_back(work); }
+            for (size_t index = 0; index < count; index++)
+            {
+                Chunk chunk;
+                {
+                    std::unique_lock lock(shared.mutex);
+                    shared.cv.wait(lock, [&]() { return shared.error != nullptr || shared.decoded.contains(index); });
+                    if (shared.error != nullptr) { std::rethrow_exception(shared.error); }
+                    chunk = std::move(shared.decoded.extract(index).mapped());
+                    shared.visited++;
+                }
+                shared.cv.notify_all();
+                visit(std::move(chunk));
+            }
+        } catch (...)
+        {
+            stop();
+            for (auto& thread : threads) { thread.join(); }
+            throw;
+        }
+        for (auto& thread : threads) { thread.join(); }
+    }
+
+    // The previous chunk kept every 978 frame it saw starting before this chunk, anything this chunk found
+    // again just before or after its start is one of those
+    [[nodiscard]] bool IsDuplicate_(StoredFrame const& frame, Chunk const& chunk, Chunk const& previous) const
+    {
+        if (_config.band != Band::UAT978 || frame.sample >= chunk.begin + DuplicateWindow978) { return false; }
+        auto bytes = chunk.Bytes(frame);
+        for (auto it = previous.frames.rbegin(); it != previous.frames.rend(); ++it)
+        {
+            if (it->sample + (2 * DuplicateWindow978) < frame.sample) { break; }
+            if (std::ranges::equal(previous.Bytes(*it), bytes)) { return true; }
+        }
+        return false;
+    }
+
+    Config   _config;
+    NoDevice _noDevice;
+};
@@ -0,0 +1,218 @@
+#pragma once
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+namespace ADSB
+{
+
+// Hands events from a producer that must never block (the data handler) to a consumer on another thread,
+// a thread of its own (Wait) or a coroutine on an event loop (Suspend).
+//
+// Events go through a bounded single producer / single consumer ring. When the consumer falls behind and
+// the ring is full they wait in an overflow list on the producer side, where an event replaces the waiting
+// one with the same key (the older state of the same aircraft), or is merged into it by the waiting event's
+// Coalesce(newer) where TEvent has one. The overflow list is bounded by the number of keys plus the keyless
+// events, and is moved into the ring by the next Push or Drain.
+// Push and Drain may be called from several threads, producers take turns on a mutex of their own
+template <typename TEvent> struct CoalescingQueue
+{
+    using Schedule = std::function<void(std::coroutine_handle<>)>;
+
+    static constexpr uint64_t NoKey = ~uint64_t{0};    // Never coalesced
+
+    // schedule resumes a suspended consumer, called by the producer. Empty: resumed on the producer's thread
+    explicit CoalescingQueue(size_t capacity, Schedule schedule = {}) :
+        _ring(std::bit_ceil(std::max(capacity, size_t{2}))), _mask(_ring.size() - 1), _schedule(std::move(schedule))
+    {}
+    ~CoalescingQueue() = default;
+    CLASS_DELETE_COPY_AND_MOVE(CoalescingQueue);
+
+    /* Producer */
+
+    // Returns false when the event replaced (or merged into) one waiting for room
+    bool Push(TEvent const& event, uint64_t key)
+    {
+        auto added = Push_(event, key);
+        Resume_();
+        return added;
+    }
+
+    // Moves waiting events into the ring as far as there is room
+    void Drain()
+    {
+        {
+            std::scoped_lock lock(_producerMutex);
+            Drain_();
+        }
+        Resume_();
+    }
+
+    // Events waiting for room
+    [[nodiscard]] size_t Waiting() const
+    {
+        std::scoped_lock lock(_producerMutex);
+        return _overflow.size();
+    }
+
+    /* Either side */
+
+    // Wakes the consumer for good. Read still returns what is in the ring, Wait and Suspend stop waiting
+    void Close()
+    {
+        _closed.store(true, std::memory_order_seq_cst);
+        Notify_();
+        Resume_();
+    }
+    [[nodiscard]] bool Closed() const { return _closed.load(std::memory_order_acquire); }
+
+    /* Consumer */
+
+    [[nodiscard]] bool Empty() const { return _head.load(std::memory_order_relaxed) == _tail.load(std::memory_order_seq_cst); }
+
+    // Moves up to events.size() events out without blocking, returns how many
+    size_t Read(std::span<TEvent> events)
+    {
+        auto head  = _head.load(std::memory_order_relaxed);
+        auto count = std::min<size_t>(events.size(), _tail.load(std::memory_order_acquire) - head);
+        for (size_t i = 0; i < count; i++) { events[i] = std::move(_ring[(head + i) & _mask]); }
+        _head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // Blocks until there is an event to read, false once closed
+    bool Wait()
+    {
+        while (true)
+        {
+            auto signal = _signal.load(std::memory_order_acquire);
+            if (Closed()) { return false; }
+            if (!Empty()) { return true; }
+            _signal.wait(signal, std::memory_order_acquire);
+        }
+    }
+
+    // For an awaiter's await_suspend. False when an event came in (or the queue closed) meanwhile and the
+    // consumer should go on, otherwise the producer hands the consumer to the schedule once there is one
+    bool Suspend(std::coroutine_handle<> consumer)
+    {
+        _suspended.store(consumer.address(), std::memory_order_seq_cst);
+        if (Empty() && !Closed()) { return true; }
+        return _suspended.exchange(nullptr, std::memory_order_seq_cst) == nullptr;    // Unless the producer took it
+    }
+
+    private:
+    bool Push_(TEvent const& event, uint64_t key)
+    {
+        std::scoped_lock lock(_producerMutex);
+        Drain_();
+        if (_overflow.empty() && TryPush_(event)) { return true; }
+        if (key != NoKey)
+        {
+            auto [it, added] = _overflowIndex.try_emplace(key, _overflowBase + _overflow.size());
+            if (!added)
+            {
+                auto& waiting = _overflow[static_cast<size_t>(it->second - _overflowBase)].event;
+                if constexpr (requires { waiting.Coalesce(event); }) { waiting.Coalesce(event); }
+                else { waiting = event; }
+                return false;
+            }
+        }
+        _overflow.push_back({.key = key, .event = event});
+        return true;
+    }
+
+    void Drain_()
+    {
+        while (!_overflow.empty() && TryPush_(_overflow.front().event))
+        {
+            if (_overflow.front().key != NoKey) { _overflowIndex.erase(_overflow.front().key); }
+            _overflow.pop_front();
+            _overflowBase++;
+        }
+    }
+
+    bool TryPush_(TEvent const& event)
+    {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) == _ring.size()) { return false; }
+        _ring[tail & _mask] = event;
+        _tail.store(tail + 1, std::memory_order_seq_cst);
+        Notify_();
+        return true;
+    }
+
+    // Wakes a consumer blocked in Wait
+    void Notify_()
+    {
+        _signal.fetch_add(1, std::memory_order_release);
+        _signal.notify_one();
+    }
+
+    // Hands a consumer suspended while the ring was empty to the schedule. Called once _producerMutex is
+    // released, so that a consumer resumed right here can't run into it
+    void Resume_()
+    {
+        while (_suspended.load(std::memory_order_seq_cst) != nullptr && Ready_())
+        {
+            auto* address = _suspended.exchange(nullptr, std::memory_order_seq_cst);
+            if (address == nullptr) { return; }
+            // The consumer may have read what was pushed and suspended again before this took it; hand it back
+            if (!Ready_())
+            {
+                _suspended.store(address, std::memory_order_seq_cst);
+                continue;
+            }
+            auto consumer = std::coroutine_handle<>::from_address(address);
+            if (_schedule) { _schedule(consumer); }
+            else { consumer.resume(); }
+            return;
+        }
+    }
+
+    // Something for a resumed consumer to read, or the end of the stream
+    [[nodiscard]] bool Ready_() const
+    {
+        return Closed() || _head.load(std::memory_order_seq_cst) != _tail.load(std::memory_order_seq_cst);
+    }
+
+    std::vector<TEvent> _ring;
+    size_t              _mask;
+    Schedule            _schedule;
+
+    alignas(64) std::atomic<uint64_t> _head{0};    // Consumer
+    alignas(64) std::atomic<uint64_t> _tail{0};    // Producer
+    std::atomic<uint32_t> _signal{0};
+    std::atomic<void*>    _suspended{nullptr};
+    std::atomic<bool>     _closed{false};
+
+    struct WaitingEvent
+    {
+        uint64_t key;
+        TEvent   event;
+    };
+
+    // Producer only, under _producerMutex. An event leaves the overflow list, and its key the index, once
+    // it is in the ring
+    mutable std::mutex                     _producerMutex;
+    std::deque<WaitingEvent>               _overflow;
+    uint64_t                               _overflowBase{0};    // Number of events that left the overflow list
+    std::unordered_map<uint64_t, uint64_t> _overflowIndex;      // Key to the position of its waiting event
+};
+
+}    // namespace ADSB
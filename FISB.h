@@ -0,0 +1,84 @@
+#pragma once
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string_view>
+SUPPRESS_WARNINGS_END
+
+// FIS-B (Flight Information Service - Broadcast) products carried on UAT 978 ground uplink frames
+namespace ADSB::FISB
+{
+
+// Product identifiers from DO-358 that the uplink decoder knows how to decode.
+// Any other product is still delivered as a raw APDU to its subscribers
+struct ProductId
+{
+    static constexpr uint16_t NOTAM          = 8;
+    static constexpr uint16_t AIRMET         = 11;
+    static constexpr uint16_t SIGMET         = 12;
+    static constexpr uint16_t NexradRegional = 63;
+    static constexpr uint16_t NexradCONUS    = 64;
+    static constexpr uint16_t GenericText    = 413;    // METAR, TAF, PIREP, Winds aloft (DLAC encoded)
+
+    static constexpr uint16_t Max         = 2047;      // 11 bit field
+    static constexpr uint16_t AllProducts = 0xffff;    // Subscribe to every product
+};
+
+// Application Protocol Data Unit header along with the ground station that sent it
+struct Apdu
+{
+    uint16_t productId{};
+    bool     aFlag{};
+    bool     gFlag{};
+    bool     pFlag{};
+    bool     sFlag{};
+    bool     monthDayValid{};
+    bool     secondsValid{};
+    uint8_t  month{};
+    uint8_t  day{};
+    uint8_t  hours{};
+    uint8_t  minutes{};
+    uint8_t  seconds{};
+
+    // Ground station
+    int32_t stationLat1E7{};
+    int32_t stationLon1E7{};
+    bool    stationPositionValid{};
+    uint8_t tisbSiteId{};
+    int     rsErrors{};
+
+    std::span<uint8_t const> payload;    // Valid only for the duration of the callback
+};
+
+// A single NEXRAD block of 32 x 4 bins
+struct NexradBlock
+{
+    static constexpr size_t BinCount = 128;
+
+    uint32_t blockNumber{};
+    uint8_t  scaleFactor{};
+    bool     southern{};
+    bool     runLengthEncoded{};
+
+    std::array<uint8_t, BinCount> intensity{};    // 0 - 7. Populated for run length encoded blocks
+    std::span<uint8_t const>      emptyBlocks;    // Bitmap of empty blocks when not run length encoded
+};
+
+struct IProductListener
+{
+    IProductListener()          = default;
+    virtual ~IProductListener() = default;
+    CLASS_DEFAULT_COPY_AND_MOVE(IProductListener);
+
+    virtual void OnNexradBlock(Apdu const& apdu, NexradBlock const& block) = 0;
+    // Called once per record. METAR and TAF reports are one record each
+    virtual void OnText(Apdu const& apdu, std::string_view const& text) = 0;
+    // Products that are not decoded further
+    virtual void OnApdu(Apdu const& apdu) = 0;
+};
+
+}    // namespace ADSB::FISB
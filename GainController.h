@@ -0,0 +1,127 @@
+#pragma once
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+// Closed loop tuner gain selection from demodulator statistics.
+// Every window (about a second of samples) the controller
+//  - steps down while too many raw samples sit at the ADC rails (overload from nearby transmitters),
+//  - otherwise hill climbs on the rate of good CRC messages: each gain step keeps a smoothed score and
+//    the controller moves to a neighbour that scores better by more than the hysteresis,
+//  - periodically probes a neighbour so that scores follow the traffic.
+// Without traffic there is nothing to compare and it holds still, unless the gain is so low that
+// no preamble candidates show up at all
+struct GainController
+{
+    struct Config
+    {
+        double   maxClipFraction = 1e-4;    // Clipped samples per sample above which gain is reduced
+        double   hysteresis      = 0.10;    // A neighbour must decode this much more to be preferred
+        uint32_t probeWindows    = 30;      // Windows without a move before a neighbour is tried
+    };
+
+    // Counter deltas over one window
+    struct Window
+    {
+        uint64_t samples{};
+        uint64_t clippedSamples{};    // I or Q at 0 or 255
+        uint64_t validPreambles{};
+        uint64_t goodCrc{};
+        uint64_t badCrc{};
+    };
+
+    // gains are the tuner steps in tenths of a dB, ascending. Starts at the step nearest to gain
+    GainController(std::vector<int> gains, int gain, Config const& config) : _config(config), _gains(std::move(gains))
+    {
+        if (_gains.empty()) { throw std::invalid_argument("Gain table is empty"); }
+        _index  = Nearest_(gain);
+        _scores = std::vector<Score>(_gains.size());
+    }
+
+    [[nodiscard]] int Gain() const { return _gains[_index]; }
+
+    // Returns the gain to use from now on
+    int Update(Window const& window)
+    {
+        if (window.samples == 0) { return Gain(); }
+        // Buffers queued before the last change were captured at the old gain
+        if (_settling)
+        {
+            _settling = false;
+            return Gain();
+        }
+
+        auto clip = static_cast<double>(window.clippedSamples) / static_cast<double>(window.samples);
+        if (clip > _config.maxClipFraction && _index > 0) { return Step_(-1); }
+
+        // Decoded messages per million samples. Bad CRCs that got through are mostly overlapping
+        // replies, they count against the score so that a gain that turns noise into garbage isn't preferred
+        auto rate = (static_cast<double>(window.goodCrc) - (static_cast<double>(window.badCrc) / 2))
+                    * 1e6 / static_cast<double>(window.samples);
+        auto& current = _scores[_index];
+        current.value = current.known ? current.value + ((rate - current.value) * ScoreAlpha) : rate;
+        current.known = true;
+
+        bool canRaise = _index + 1 < _gains.size() && clip <= _config.maxClipFraction / 4;
+        if (window.goodCrc == 0)
+        {
+            // Not even noise shaped like a preamble gets through, the front end is deaf
+            if (window.validPreambles == 0 && canRaise) { return Step_(+1); }
+            return Gain();
+        }
+        if (_index > 0 && Better_(_index - 1)) { return Step_(-1); }
+        if (canRaise && Better_(_index + 1)) { return Step_(+1); }
+
+        if (++_windowsSinceMove < _config.probeWindows) { return Gain(); }
+        _probeUp = !_probeUp;
+        if (_probeUp && canRaise) { return Step_(+1); }
+        if (_index > 0) { return Step_(-1); }
+        return canRaise ? Step_(+1) : Gain();
+    }
+
+    private:
+    static constexpr double ScoreAlpha = 0.5;
+
+    struct Score
+    {
+        double value{};
+        bool   known{false};
+    };
+
+    [[nodiscard]] bool Better_(size_t index) const
+    {
+        return _scores[index].known && _scores[index].value > _scores[_index].value * (1 + _config.hysteresis);
+    }
+
+    int Step_(int direction)
+    {
+        _index            = static_cast<size_t>(static_cast<std::ptrdiff_t>(_index) + direction);
+        _windowsSinceMove = 0;
+        _settling         = true;
+        return Gain();
+    }
+
+    [[nodiscard]] size_t Nearest_(int gain) const
+    {
+        auto it = std::ranges::min_element(_gains, [gain](int a, int b) { return std::abs(a - gain) < std::abs(b - gain); });
+        return static_cast<size_t>(std::distance(_gains.begin(), it));
+    }
+
+    Config             _config;
+    std::vector<int>   _gains;
+    std::vector<Score> _scores;
+    size_t             _index{0};
+    uint32_t           _windowsSinceMove{0};
+    bool               _settling{false};
+    bool               _probeUp{false};
+};
@@ -0,0 +1,203 @@
+#pragma once
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+// Chunked, seekable and losslessly compressed container for 8 bit I/Q captures (.iqz)
+//
+// File    : FileMagic followed by chunks
+// Chunk   : ChunkHeader followed by payloadBytes of payload. Chunks decode independently
+// Payload : I and Q planes are split into blocks of BlockSamples values. Each block is one
+//           header byte (predictor << 4 | bit width) followed by the zigzag coded residuals
+//           packed at that width, LSB first. The predictor is either the centre (127/128),
+//           which suits near-noise samples, or the previous value of the plane, which suits
+//           strong signals. A block of pure noise costs 2-4 bits per value instead of 8
+//
+// Integers are little endian
+struct IQCapture
+{
+    static constexpr std::array<char, 8> FileMagic    = {'L', 'A', 'D', 'S', 'B', 'I', 'Q', '1'};
+    static constexpr uint32_t            ChunkMagic   = 0x4b434951;    // "IQCK"
+    static constexpr size_t              BlockSamples = 64;
+    static constexpr uint8_t             Center       = 128;
+
+    enum Predictor : uint8_t
+    {
+        Centered = 0,
+        Previous = 1,
+    };
+
+    struct ChunkHeader
+    {
+        uint32_t magic = ChunkMagic;
+        uint32_t sampleRate{};
+        uint32_t frequency{};
+        uint32_t rawBytes{};
+        uint64_t timestampNs{};    // Monotonic (steady clock) time of the first sample
+        uint64_t firstSample{};    // Sample index since the recording started. Jumps mark dropped data
+        uint32_t payloadBytes{};
+        uint32_t reserved{};
+    };
+    static_assert(sizeof(ChunkHeader) == 40);
+    static_assert(std::endian::native == std::endian::little, "Big endian hosts need byte swapping here");
+
+    struct ChunkInfo
+    {
+        ChunkHeader header;
+        size_t      payloadOffset{};
+    };
+
+    [[nodiscard]] static bool IsCapture(std::span<uint8_t const> const& file)
+    {
+        return file.size() >= FileMagic.size() && std::memcmp(file.data(), FileMagic.data(), FileMagic.size()) == 0;
+    }
+
+    // Walks the chunk headers. Cheap enough to seek by timestamp or sample index afterwards.
+    // A truncated trailing chunk (e.g. power loss while recording) is ignored
+    [[nodiscard]] static std::vector<ChunkInfo> Index(std::span<uint8_t const> const& file)
+    {
+        if (!IsCapture(file)) { throw std::runtime_error("Not an IQ capture"); }
+        std::vector<ChunkInfo> chunks;
+        size_t                 offset = FileMagic.size();
+        while (offset + sizeof(ChunkHeader) <= file.size())
+        {
+            ChunkInfo info{};
+            std::memcpy(&info.header, file.data() + offset, sizeof(ChunkHeader));
+            if (info.header.magic != ChunkMagic) { throw std::runtime_error("Corrupt IQ capture chunk header"); }
+            info.payloadOffset = offset + sizeof(ChunkHeader);
+            if (info.payloadOffset + info.header.payloadBytes > file.size()) { break; }
+            offset = info.payloadOffset + info.header.payloadBytes;
+            chunks.push_back(info);
+        }
+        return chunks;
+    }
+
+    // Appends header and compressed payload of raw to out. header.rawBytes/payloadBytes are filled in
+    static void EncodeChunk(ChunkHeader header, std::span<uint8_t const> const& raw, std::vector<uint8_t>& out)
+    {
+        if (raw.size() % 2 != 0) { throw std::invalid_argument("IQ chunks must hold whole samples"); }
+        auto headerOffset = out.size();
+        out.resize(headerOffset + sizeof(ChunkHeader));
+        auto samples = raw.size() / 2;
+        for (size_t plane = 0; plane < 2; plane++)
+        {
+            uint8_t previous = Center;
+            for (size_t i = 0; i < samples; i += BlockSamples)
+            {
+                auto count = std::min(BlockSamples, samples - i);
+                EncodeBlock_(raw.subspan((i * 2) + plane), count, previous, out);
+                previous = raw[((i + count - 1) * 2) + plane];
+            }
+        }
+        header.rawBytes     = static_cast<uint32_t>(raw.size());
+        header.payloadBytes = static_cast<uint32_t>(out.size() - headerOffset - sizeof(ChunkHeader));
+        std::memcpy(out.data() + headerOffset, &header, sizeof(ChunkHeader));
+    }
+
+    // raw must be header.rawBytes long
+    static void DecodeChunk(std::span<uint8_t const> payload, std::span<uint8_t> const& raw)
+    {
+        if (raw.size() % 2 != 0) { throw std::invalid_argument("IQ chunks must hold whole samples"); }
+        auto samples = raw.size() / 2;
+        for (size_t plane = 0; plane < 2; plane++)
+        {
+            uint8_t previous = Center;
+            for (size_t i = 0; i < samples; i += BlockSamples)
+            {
+                auto count = std::min(BlockSamples, samples - i);
+                payload    = DecodeBlock_(payload, raw.subspan((i * 2) + plane), count, previous);
+                previous   = raw[((i + count - 1) * 2) + plane];
+            }
+        }
+        if (!payload.empty()) { throw std::runtime_error("Corrupt IQ capture chunk"); }
+    }
+
+    private:
+    static uint8_t ZigZag_(uint8_t residual)
+    {
+        auto v = static_cast<int8_t>(residual);
+        return static_cast<uint8_t>((static_cast<unsigned>(v) << 1u) ^ static_cast<unsigned>(v >> 7));
+    }
+
+    static uint8_t UnZigZag_(uint8_t z) { return static_cast<uint8_t>((z >> 1u) ^ (0u - (z & 1u))); }
+
+    // values are interleaved, every other byte belongs to this plane
+    static void EncodeBlock_(std::span<uint8_t const> const& values, size_t count, uint8_t previous, std::vector<uint8_t>& out)
+    {
+        std::array<std::array<uint8_t, BlockSamples>, 2> residuals{};
+        std::array<uint8_t, 2>                           widest{};
+        for (size_t i = 0; i < count; i++)
+        {
+            uint8_t v = values[i * 2];
+
+            residuals[Centered][i] = ZigZag_(static_cast<uint8_t>(v - Center));
+            residuals[Previous][i] = ZigZag_(static_cast<uint8_t>(v - previous));
+            widest[Centered]      |= residuals[Centered][i];
+            widest[Previous]      |= residuals[Previous][i];
+            previous               = v;
+        }
+        auto predictor = widest[Previous] < widest[Centered] ? Previous : Centered;
+        auto width     = static_cast<unsigned>(std::bit_width(widest[predictor]));
+        out.push_back(static_cast<uint8_t>((predictor << 4u) | width));
+        if (width == 0) { return; }
+
+        uint32_t acc  = 0;
+        unsigned bits = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            acc  |= static_cast<uint32_t>(residuals[predictor][i]) << bits;
+            bits += width;
+            while (bits >= 8)
+            {
+                out.push_back(static_cast<uint8_t>(acc));
+                acc >>= 8u;
+                bits -= 8;
+            }
+        }
+        if (bits > 0) { out.push_back(static_cast<uint8_t>(acc)); }
+    }
+
+    static std::span<uint8_t const> DecodeBlock_(std::span<uint8_t const>  payload,
+                                                 std::span<uint8_t> const& values,
+                                                 size_t                    count,
+                                                 uint8_t                   previous)
+    {
+        if (payload.empty()) { throw std::runtime_error("Corrupt IQ capture chunk"); }
+        auto predictor = static_cast<unsigned>(payload[0] >> 4u);
+        auto width     = static_cast<unsigned>(payload[0] & 0x0fu);
+        auto bytes     = ((count * width) + 7) / 8;
+        if (predictor > Previous || width > 8 || payload.size() < 1 + bytes) { throw std::runtime_error("Corrupt IQ capture chunk"); }
+
+        uint8_t const* in   = payload.data() + 1;
+        uint32_t       acc  = 0;
+        unsigned       bits = 0;
+        uint32_t       mask = (1u << width) - 1u;
+        for (size_t i = 0; i < count; i++)
+        {
+            while (bits < width)
+            {
+                acc  |= static_cast<uint32_t>(*in++) << bits;    // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+                bits += 8;
+            }
+            auto residual = UnZigZag_(static_cast<uint8_t>(acc & mask));
+            acc >>= width;
+            bits -= width;
+
+            uint8_t v     = static_cast<uint8_t>((predictor == Centered ? Center : previous) + residual);
+            values[i * 2] = v;
+            previous      = v;
+        }
+        return payload.subspan(1 + bytes);
+    }
+};
@@ -0,0 +1,264 @@
+#pragma once
+#include "CommonMacros.h"
+#include "IQCapture.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+SUPPRESS_WARNINGS_END
+
+// Replays a raw 8 bit I/Q capture (as written by rtl_sdr) from a memory mapped file.
+// Buffers handed out are spans into the mapping, nothing is copied or read ahead by us.
+// Multi GB captures are fine as long as the address space is 64 bit.
+// Compressed captures (IQCapture) are detected by their magic. Their chunks are decompressed
+// ahead of the consumer on worker threads and the sample rate recorded in them is used for pacing
+struct IQFileSource
+{
+    enum class Pacing : uint8_t
+    {
+        MaxSpeed,    // As fast as the consumer takes it
+        RealTime,    // At sampleRate * speed samples per second
+    };
+
+    struct Config
+    {
+        size_t   bufferLength = size_t{65536u} * 4u;    // Bytes per buffer. A trailing partial buffer is not delivered
+        uint32_t sampleRate   = 2000000;
+        Pacing   pacing       = Pacing::MaxSpeed;
+        double   speed        = 1.0;      // Real time multiplier, 4 replays a 1 hour capture in 15 minutes
+        bool     loop         = false;    // Rewind at EOF instead of stopping
+    };
+
+    IQFileSource(std::filesystem::path const& path, Config const& config) : _config(config)
+    {
+        if (_config.bufferLength == 0 || (_config.bufferLength % 2) != 0)
+        {
+            throw std::invalid_argument("Buffer length must hold whole I/Q samples");
+        }
+        Map_(path);
+        _rawSize = _size;
+        try
+        {
+            if (IQCapture::IsCapture(Data()))
+            {
+                _chunks     = IQCapture::Index(Data());
+                _compressed = true;
+                _rawSize    = 0;
+                for (auto const& chunk : _chunks) { _rawSize += chunk.header.rawBytes; }
+                if (!_chunks.empty() && _chunks.front().header.sampleRate != 0) { _config.sampleRate = _chunks.front().header.sampleRate; }
+            }
+            if (_config.pacing == Pacing::RealTime && (_config.sampleRate == 0 || !(_config.speed > 0)))
+            {
+                throw std::invalid_argument("Real time pacing needs a sample rate and a positive speed");
+            }
+        } catch (...)
+        {
+            Unmap_();
+            throw;
+        }
+    }
+
+    ~IQFileSource() { Unmap_(); }
+    CLASS_DELETE_COPY_AND_MOVE(IQFileSource);
+
+    // The file as stored
+    [[nodiscard]] std::span<uint8_t const> Data() const { return {_data, _size}; }
+    [[nodiscard]] bool                     IsCompressed() const { return _compressed; }
+    [[nodiscard]] uint32_t                 SampleRate() const { return _config.sampleRate; }
+    [[nodiscard]] size_t                   BufferCount() const { return _rawSize / _config.bufferLength; }
+
+    // Raw captures only
+    [[nodiscard]] std::span<uint8_t const> Buffer(size_t index) const
+    {
+        if (_compressed) { throw std::logic_error("Compressed captures have no raw buffers to map"); }
+        return Data().subspan(index * _config.bufferLength, _config.bufferLength);
+    }
+
+    // Compressed captures only. Chunk headers carry time stamps and sample indices for seeking
+    [[nodiscard]] std::span<IQCapture::ChunkInfo const> Chunks() const { return _chunks; }
+    [[nodiscard]] std::vector<uint8_t>                  DecodeChunk(size_t index) const
+    {
+        auto const&          chunk = _chunks.at(index);
+        std::vector<uint8_t> raw(chunk.header.rawBytes);
+        IQCapture::DecodeChunk(Data().subspan(chunk.payloadOffset, chunk.header.payloadBytes), raw);
+        return raw;
+    }
+
+    // Calls callback(std::span<uint8_t const>) for every whole buffer in the file, on the calling thread.
+    // Returns the number of buffers delivered once EOF is reached (never with loop unless stopped)
+    template <typename TCallback> size_t Replay(TCallback&& callback, std::atomic_bool const& stopRequested = NeverStop())
+    {
+        auto start = clock::now();
+        if (_compressed) { return ReplayCompressed_(callback, stopRequested, start); }
+
+        size_t delivered = 0;
+        auto   count     = BufferCount();
+        while (count > 0 && !stopRequested)
+        {
+            for (size_t i = 0; i < count && !stopRequested; i++)
+            {
+                Pace_(start, delivered);
+                callback(Buffer(i));
+                delivered++;
+            }
+            if (!_config.loop) { break; }
+        }
+        return delivered;
+    }
+
+    private:
+    using clock = std::chrono::steady_clock;
+
+    template <typename TCallback>
+    size_t ReplayCompressed_(TCallback& callback, std::atomic_bool const& stopRequested, clock::time_point start)
+    {
+        if (_chunks.empty()) { return 0; }
+
+        // Enough chunks in flight to keep every core busy while the consumer works through one
+        auto const                                    workers = std::max(2u, std::thread::hardware_concurrency());
+        std::deque<std::future<std::vector<uint8_t>>> decoding;
+        std::vector<uint8_t>                          pending;    // Decoded but not yet delivered, chunks need not align with buffers
+        size_t                                        next      = 0;
+        size_t                                        delivered = 0;
+        while (!stopRequested)
+        {
+            while (decoding.size() < workers && (next < _chunks.size() || _config.loop))
+            {
+                if (next == _chunks.size()) { next = 0; }
+                decoding.push_back(std::async(std::launch::async, [this, index = next]() { return DecodeChunk(index); }));
+                next++;
+            }
+            if (decoding.empty()) { break; }
+
+            auto chunk = decoding.front().get();
+            decoding.pop_front();
+            pending.insert(pending.end(), chunk.begin(), chunk.end());
+            size_t offset = 0;
+            for (; pending.size() - offset >= _config.bufferLength && !stopRequested; offset += _config.bufferLength)
+            {
+                Pace_(start, delivered);
+                callback(std::span<uint8_t const>(pending).subspan(offset, _config.bufferLength));
+                delivered++;
+            }
+            pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(offset));
+        }
+        return delivered;
+    }
+
+    void Pace_(clock::time_point start, size_t delivered) const
+    {
+        if (_config.pacing != Pacing::RealTime) { return; }
+        // Deadlines are absolute so that slow callbacks don't accumulate drift
+        auto bufferDuration = std::chrono::duration<double>(static_cast<double>(_config.bufferLength / 2)
+                                                            / (static_cast<double>(_config.sampleRate) * _config.speed));
+        auto due = start + std::chrono::duration_cast<clock::duration>(bufferDuration * static_cast<double>(delivered + 1));
+        std::this_thread::sleep_until(due);
+    }
+
+    static std::atomic_bool const& NeverStop()
+    {
+        static std::atomic_bool const never{false};
+        return never;
+    }
+
+#ifdef _WIN32
+    void Map_(std::filesystem::path const& path)
+    {
+        _file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (_file == INVALID_HANDLE_VALUE) { throw std::runtime_error("Cannot open IQ file: " + path.string()); }
+        LARGE_INTEGER size{};
+        GetFileSizeEx(_file, &size);
+        _size = static_cast<size_t>(size.QuadPart);
+        if (_size == 0) { return; }
+        _mapping = CreateFileMappingW(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (_mapping == nullptr)
+        {
+            Unmap_();
+            throw std::runtime_error("Cannot map IQ file: " + path.string());
+        }
+        _data = static_cast<uint8_t const*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (_data == nullptr)
+        {
+            Unmap_();
+            throw std::runtime_error("Cannot map IQ file: " + path.string());
+        }
+    }
+
+    void Unmap_()
+    {
+        if (_data != nullptr) { UnmapViewOfFile(_data); }
+        if (_mapping != nullptr) { CloseHandle(_mapping); }
+        if (_file != INVALID_HANDLE_VALUE) { CloseHandle(_file); }
+        _data    = nullptr;
+        _mapping = nullptr;
+        _file    = INVALID_HANDLE_VALUE;
+    }
+
+    HANDLE _file{INVALID_HANDLE_VALUE};
+    HANDLE _mapping{nullptr};
+#else
+    void Map_(std::filesystem::path const& path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);    // NOLINT
+        if (fd < 0) { throw std::runtime_error("Cannot open IQ file: " + path.string()); }
+        struct stat st{};
+        if (::fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            throw std::runtime_error("Cannot stat IQ file: " + path.string());
+        }
+        _size = static_cast<size_t>(st.st_size);
+        if (_size > 0)
+        {
+            void* addr = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED)    // NOLINT
+            {
+                ::close(fd);
+                throw std::runtime_error("Cannot map IQ file: " + path.string());
+            }
+            // Replay is a single forward pass
+            ::madvise(addr, _size, MADV_SEQUENTIAL);
+            _data = static_cast<uint8_t const*>(addr);
+        }
+        // The mapping keeps the file referenced
+        ::close(fd);
+    }
+
+    void Unmap_()
+    {
+        if (_data != nullptr) { ::munmap(const_cast<uint8_t*>(_data), _size); }    // NOLINT
+        _data = nullptr;
+    }
+#endif
+
+    Config         _config;
+    uint8_t const* _data{nullptr};
+    size_t         _size{0};
+
+    bool                              _compressed{false};
+    size_t                            _rawSize{0};    // Decompressed size
+    std::vector<IQCapture::ChunkInfo> _chunks;
+};
@@ -0,0 +1,396 @@
+#pragma once
+#include "CommonMacros.h"
+#include "IQCapture.h"
+#include "SetThreadName.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#define IQRECORDER_POSIX_IO 1
+#endif
+SUPPRESS_WARNINGS_END
+
+// Records raw 8 bit I/Q buffers (rtl_sdr format, replayable with IQFileSource) from a dedicated writer thread.
+// Record() copies into a preallocated slot and returns. When the writer cannot keep up the buffer is
+// dropped and accounted for as disk lag, the caller (the decode path) never waits on the disk.
+// Slots are coalesced into large aligned writes, with O_DIRECT on linux when the filesystem supports it.
+// Files are named <prefix>_<MHz>_<YYYY-mm-dd-HH-MM-SS>.dat like collect978.sh and rotated by size and/or age.
+// With compress set every buffer becomes an IQCapture chunk and files get the .iqz extension
+struct IQRecorder
+{
+    static constexpr size_t IOAlignment  = 4096;
+    static constexpr size_t StagingBytes = size_t{4u} * 1024u * 1024u;
+
+    struct Config
+    {
+        std::filesystem::path directory = ".";
+        std::string           prefix    = "rtlsdr";
+        uint32_t              frequency{};
+        size_t                bufferLength = size_t{65536u} * 4u;    // Largest buffer passed to Record()
+        size_t                queueLength  = 64;                     // Buffers in flight before dropping (~16MB at the default length)
+        uint64_t              maxFileBytes = uint64_t{1u} << 30u;    // 0: no size based rotation
+        std::chrono::seconds  maxFileAge{0};                         // 0: no time based rotation
+        bool                  directIO = true;
+        bool                  compress = false;
+        uint32_t              sampleRate{};    // Recorded in compressed chunk headers
+    };
+
+    struct Stats
+    {
+        uint64_t buffersWritten{};
+        uint64_t bytesWritten{};
+        uint64_t droppedBuffers{};    // Disk lag
+        uint64_t droppedBytes{};
+        uint64_t filesCreated{};
+        uint64_t writeErrors{};
+    };
+
+    explicit IQRecorder(Config const& config) : _config(config)
+    {
+        if (_config.queueLength == 0 || _config.bufferLength == 0) { throw std::invalid_argument("Recorder queue cannot be empty"); }
+        std::filesystem::create_directories(_config.directory);
+        _slots.reserve(_config.queueLength);
+        for (size_t i = 0; i < _config.queueLength; i++)
+        {
+            _slots.push_back(Slot{.data = AllocateAligned_(_config.bufferLength), .size = 0});
+            _free.push_back(&_slots.back());
+        }
+        _staging    = AllocateAligned_(StagingBytes);
+        _writerThrd = std::thread([this]() {
+            SetThreadName("IQRecorder::Writer");
+            WriterThreadLoop_();
+        });
+    }
+
+    ~IQRecorder()
+    {
+        {
+            std::scoped_lock lock(_mutex);
+            _stopRequested = true;
+        }
+        _cvQueued.notify_one();
+        if (_writerThrd.joinable()) { _writerThrd.join(); }
+    }
+
+    CLASS_DELETE_COPY_AND_MOVE(IQRecorder);
+
+    // Never blocks on I/O. Returns false if the buffer was dropped
+    bool Record(std::span<uint8_t const> const& data)
+    {
+        if (data.size() > _config.bufferLength) { throw std::invalid_argument("Buffer larger than the recorder slots"); }
+        auto  firstSample = _samplesSeen.fetch_add(data.size() / 2, std::memory_order_relaxed);
+        Slot* slot        = nullptr;
+        {
+            std::scoped_lock lock(_mutex);
+            if (!_free.empty())
+            {
+                slot = _free.back();
+                _free.pop_back();
+            }
+        }
+        if (slot == nullptr)
+        {
+            _droppedBuffers.fetch_add(1, std::memory_order_relaxed);
+            _droppedBytes.fetch_add(data.size(), std::memory_order_relaxed);
+            return false;
+        }
+        std::memcpy(slot->data.get(), data.data(), data.size());
+        slot->size        = data.size();
+        slot->firstSample = firstSample;
+        slot->timestampNs = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        {
+            std::scoped_lock lock(_mutex);
+            _queued.push_back(slot);
+        }
+        _cvQueued.notify_one();
+        return true;
+    }
+
+    [[nodiscard]] Stats GetStats() const
+    {
+        return {.buffersWritten = _buffersWritten.load(std::memory_order_relaxed),
+                .bytesWritten   = _bytesWritten.load(std::memory_order_relaxed),
+                .droppedBuffers = _droppedBuffers.load(std::memory_order_relaxed),
+                .droppedBytes   = _droppedBytes.load(std::memory_order_relaxed),
+                .filesCreated   = _filesCreated.load(std::memory_order_relaxed),
+                .writeErrors    = _writeErrors.load(std::memory_order_relaxed)};
+    }
+
+    // File currently being written. Empty before the first buffer arrives
+    [[nodiscard]] std::filesystem::path CurrentFile() const
+    {
+        std::scoped_lock lock(_mutex);
+        return _currentPath;
+    }
+
+    private:
+    struct AlignedDeleter
+    {
+        void operator()(uint8_t* ptr) const { ::operator delete[](ptr, std::align_val_t{IOAlignment}); }
+    };
+    using AlignedBuffer = std::unique_ptr<uint8_t[], AlignedDeleter>;    // NOLINT(cppcoreguidelines-avoid-c-arrays)
+
+    struct Slot
+    {
+        AlignedBuffer data;
+        size_t        size{};
+        uint64_t      firstSample{};
+        uint64_t      timestampNs{};
+    };
+
+    static AlignedBuffer AllocateAligned_(size_t size)
+    {
+        size = ((size + IOAlignment - 1) / IOAlignment) * IOAlignment;
+        return AlignedBuffer(static_cast<uint8_t*>(::operator new[](size, std::align_val_t{IOAlignment})));
+    }
+
+    void WriterThreadLoop_()
+    {
+        std::vector<Slot*> batch;
+        batch.reserve(_config.queueLength);
+        for (;;)
+        {
+            {
+                std::unique_lock lock(_mutex);
+                _cvQueued.wait(lock, [this]() { return !_queued.empty() || _stopRequested; });
+                if (_queued.empty() && _stopRequested) { break; }
+                batch.assign(_queued.begin(), _queued.end());
+                _queued.clear();
+            }
+            for (auto* slot : batch) { Append_(*slot); }
+            {
+                std::scoped_lock lock(_mutex);
+                _free.insert(_free.end(), batch.begin(), batch.end());
+            }
+        }
+        CloseFile_();
+    }
+
+    void Append_(Slot const& slot)
+    {
+        std::span<uint8_t const> data{slot.data.get(), slot.size};
+        if (_config.compress)
+        {
+            _encoded.clear();
+            IQCapture::EncodeChunk({.sampleRate  = _config.sampleRate,
+                                    .frequency   = _config.frequency,
+                                    .timestampNs = slot.timestampNs,
+                                    .firstSample = slot.firstSample},
+                                   data,
+                                   _encoded);
+            data = _encoded;
+        }
+
+        auto now = std::chrono::system_clock::now();
+        if (!IsOpen_() || NeedsRotation_(data.size(), now))
+        {
+            CloseFile_();
+            OpenFile_(now);
+            if (_config.compress)
+            {
+                Stage_({reinterpret_cast<uint8_t const*>(IQCapture::FileMagic.data()), IQCapture::FileMagic.size()});    // NOLINT
+            }
+        }
+        Stage_(data);
+        _buffersWritten.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Stage_(std::span<uint8_t const> data)
+    {
+        _fileBytes += data.size();
+        while (!data.empty())
+        {
+            auto count = std::min(data.size(), StagingBytes - _stagingUsed);
+            std::memcpy(_staging.get() + _stagingUsed, data.data(), count);
+            _stagingUsed += count;
+            data = data.subspan(count);
+            if (_stagingUsed == StagingBytes) { FlushStaging_(); }
+        }
+    }
+
+    [[nodiscard]] bool NeedsRotation_(size_t incoming, std::chrono::system_clock::time_point now) const
+    {
+        if (_config.maxFileBytes != 0 && _fileBytes > 0 && _fileBytes + incoming > _config.maxFileBytes) { return true; }
+        return _config.maxFileAge.count() != 0 && now - _fileOpened >= _config.maxFileAge;
+    }
+
+    void OpenFile_(std::chrono::system_clock::time_point now)
+    {
+        auto tt = std::chrono::system_clock::to_time_t(now);
+        std::tm tm{};
+#ifdef _WIN32
+        localtime_s(&tm, &tt);
+#else
+        localtime_r(&tt, &tm);
+#endif
+        std::array<char, 32> stamp{};
+        std::strftime(stamp.data(), stamp.size(), "%Y-%m-%d-%H-%M-%S", &tm);
+        auto name = _config.prefix + "_" + std::to_string(_config.frequency / 1000000u) + "_" + stamp.data();
+        auto ext  = std::string(_config.compress ? ".iqz" : ".dat");
+        auto path = _config.directory / (name + ext);
+        // Rotating more than once a second must not overwrite the previous file
+        for (unsigned suffix = 1; std::filesystem::exists(path); suffix++)
+        {
+            path = _config.directory / (name + "_" + std::to_string(suffix) + ext);
+        }
+
+#ifdef IQRECORDER_POSIX_IO
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;    // NOLINT(hicpp-signed-bitwise)
+#ifdef O_DIRECT
+        if (_config.directIO)
+        {
+            // Not every filesystem (e.g. tmpfs) accepts O_DIRECT
+            _fd     = ::open(path.c_str(), flags | O_DIRECT, 0644);    // NOLINT
+            _direct = _fd >= 0;
+        }
+#endif
+        if (_fd < 0) { _fd = ::open(path.c_str(), flags, 0644); }    // NOLINT
+        if (_fd < 0)
+        {
+            _writeErrors.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "IQRecorder: cannot create " << path << ": " << std::strerror(errno) << '\n';
+            return;
+        }
+#else
+        _file = std::fopen(path.string().c_str(), "wb");    // NOLINT
+        if (_file == nullptr)
+        {
+            _writeErrors.fetch_add(1, std::memory_order_relaxed);
+            std::cerr << "IQRecorder: cannot create " << path << '\n';
+            return;
+        }
+        std::setvbuf(_file, nullptr, _IONBF, 0);    // We already do our own staging
+#endif
+        _fileOpened = now;
+        _fileBytes  = 0;
+        _filesCreated.fetch_add(1, std::memory_order_relaxed);
+        std::scoped_lock lock(_mutex);
+        _currentPath = path;
+    }
+
+    void FlushStaging_()
+    {
+        if (_stagingUsed == 0) { return; }
+        if (IsOpen_())
+        {
+#ifdef IQRECORDER_POSIX_IO
+            size_t aligned = _direct ? (_stagingUsed / IOAlignment) * IOAlignment : _stagingUsed;
+            Write_({_staging.get(), aligned});
+            if (aligned != _stagingUsed)
+            {
+                // Unaligned tail, only happens when closing the file
+#ifdef O_DIRECT
+                ::fcntl(_fd, F_SETFL, ::fcntl(_fd, F_GETFL) & ~O_DIRECT);    // NOLINT
+#endif
+                _direct = false;
+                Write_({_staging.get() + aligned, _stagingUsed - aligned});
+            }
+#else
+            Write_({_staging.get(), _stagingUsed});
+#endif
+        }
+        _stagingUsed = 0;
+    }
+
+    void Write_(std::span<uint8_t const> data)
+    {
+        while (!data.empty())
+        {
+#ifdef IQRECORDER_POSIX_IO
+            auto written = ::write(_fd, data.data(), data.size());
+            if (written < 0 && errno == EINTR) { continue; }
+            if (written <= 0)
+#else
+            auto written = std::fwrite(data.data(), 1, data.size(), _file);
+            if (written == 0)
+#endif
+            {
+                _writeErrors.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            _bytesWritten.fetch_add(static_cast<uint64_t>(written), std::memory_order_relaxed);
+            data = data.subspan(static_cast<size_t>(written));
+        }
+    }
+
+    void CloseFile_()
+    {
+        FlushStaging_();
+#ifdef IQRECORDER_POSIX_IO
+        if (_fd >= 0) { ::close(_fd); }
+        _fd     = -1;
+        _direct = false;
+#else
+        if (_file != nullptr) { std::fclose(_file); }
+        _file = nullptr;
+#endif
+    }
+
+    [[nodiscard]] bool IsOpen_() const
+    {
+#ifdef IQRECORDER_POSIX_IO
+        return _fd >= 0;
+#else
+        return _file != nullptr;
+#endif
+    }
+
+    Config _config;
+
+    std::vector<Slot>  _slots;
+    std::vector<Slot*> _free;
+    std::deque<Slot*>  _queued;
+
+    mutable std::mutex      _mutex;
+    std::condition_variable _cvQueued;
+    bool                    _stopRequested{false};
+    std::thread             _writerThrd;
+
+    // Writer thread only
+    AlignedBuffer                         _staging;
+    size_t                                _stagingUsed{0};
+    std::vector<uint8_t>                  _encoded;
+    uint64_t                              _fileBytes{0};
+    std::chrono::system_clock::time_point _fileOpened;
+    std::filesystem::path                 _currentPath;    // Also read by CurrentFile() under _mutex
+#ifdef IQRECORDER_POSIX_IO
+    int  _fd{-1};
+    bool _direct{false};
+#else
+    std::FILE* _file{nullptr};
+#endif
+
+    std::atomic<uint64_t> _samplesSeen{0};    // Including dropped ones, so chunk sample indices show the gaps
+    std::atomic<uint64_t> _buffersWritten{0};
+    std::atomic<uint64_t> _bytesWritten{0};
+    std::atomic<uint64_t> _droppedBuffers{0};
+    std::atomic<uint64_t> _droppedBytes{0};
+    std::atomic<uint64_t> _filesCreated{0};
+    std::atomic<uint64_t> _writeErrors{0};
+};
@@ -0,0 +1,148 @@
+#pragma once
+#include "CommonMacros.h"
+#include "StatCounter.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+SUPPRESS_WARNINGS_END
+
+// Set to 0 (cmake -Dlibadsb_LATENCY_HISTOGRAMS=OFF) to compile the timers out. Histograms and
+// snapshots still exist so that the stats API is unchanged, they just stay empty
+#ifndef ADSB_LATENCY_HISTOGRAMS
+#define ADSB_LATENCY_HISTOGRAMS 1
+#endif
+
+// Fixed bucket log-linear (HDR style) histogram of durations in nanoseconds.
+// Every power of two range is split into SubBuckets linear buckets, so any recorded value is off by
+// at most 1/SubBuckets (12.5%). Values from 0 to ~68s are kept, anything longer lands in the last bucket.
+// Single writer (the thread that owns the stage), lock free readers
+struct LatencyHistogram
+{
+    static constexpr bool     Enabled       = ADSB_LATENCY_HISTOGRAMS != 0;
+    static constexpr unsigned SubBucketBits = 3;
+    static constexpr unsigned SubBuckets    = 1u << SubBucketBits;
+    static constexpr unsigned MaxBits       = 36;    // 2^36ns ~ 68s
+    static constexpr size_t   BucketCount   = ((MaxBits - SubBucketBits + 1) * SubBuckets);
+
+    using duration = std::chrono::nanoseconds;
+
+    struct Snapshot
+    {
+        std::array<uint64_t, BucketCount> buckets{};
+        uint64_t                          count{};
+        uint64_t                          sumNs{};
+        uint64_t                          maxNs{};
+
+        [[nodiscard]] double MeanNs() const { return count == 0 ? 0 : static_cast<double>(sumNs) / static_cast<double>(count); }
+
+        // Upper bound of the bucket holding the q-th quantile (0..1), capped at the largest value seen
+        [[nodiscard]] uint64_t PercentileNs(double q) const
+        {
+            if (count == 0) { return 0; }
+            auto     rank = static_cast<uint64_t>(std::max(1.0, q * static_cast<double>(count) + 0.5));
+            uint64_t seen = 0;
+            for (size_t i = 0; i < BucketCount; i++)
+            {
+                seen += buckets[i];
+                if (seen >= rank) { return std::min(BucketUpperNs(i), maxNs); }
+            }
+            return maxNs;
+        }
+    };
+
+    LatencyHistogram() = default;
+    CLASS_DELETE_COPY_AND_MOVE(LatencyHistogram);
+
+    void Record(duration elapsed)
+    {
+        auto ns = static_cast<uint64_t>(std::max(elapsed.count(), duration::rep{0}));
+        _buckets[BucketIndex(ns)]++;
+        _count++;
+        _sum += ns;
+        if (ns > _max.load(std::memory_order_relaxed)) { _max.store(ns, std::memory_order_relaxed); }
+    }
+
+    [[nodiscard]] Snapshot Take() const
+    {
+        Snapshot snapshot;
+        for (size_t i = 0; i < BucketCount; i++) { snapshot.buckets[i] = _buckets[i].Load(); }
+        snapshot.count = _count.Load();
+        snapshot.sumNs = _sum.Load();
+        snapshot.maxNs = _max.load(std::memory_order_relaxed);
+        return snapshot;
+    }
+
+    // Values below SubBuckets get a bucket each, above that the top SubBucketBits + 1 bits pick the bucket
+    static constexpr size_t BucketIndex(uint64_t ns)
+    {
+        if (ns < SubBuckets) { return static_cast<size_t>(ns); }
+        auto magnitude = static_cast<unsigned>(std::bit_width(ns)) - 1;    // >= SubBucketBits
+        if (magnitude >= MaxBits) { return BucketCount - 1; }
+        auto sub = static_cast<size_t>((ns >> (magnitude - SubBucketBits)) & (SubBuckets - 1));
+        return ((magnitude - SubBucketBits + 1) * SubBuckets) + sub;
+    }
+
+    static constexpr uint64_t BucketUpperNs(size_t index)
+    {
+        if (index < SubBuckets) { return index; }
+        auto magnitude = static_cast<unsigned>(index / SubBuckets) + SubBucketBits - 1;
+        auto sub       = static_cast<uint64_t>(index % SubBuckets);
+        auto width     = uint64_t{1} << (magnitude - SubBucketBits);
+        return (uint64_t{1} << magnitude) + ((sub + 1) * width) - 1;
+    }
+
+    private:
+    std::array<StatCounter, BucketCount> _buckets;
+    StatCounter                          _count;
+    StatCounter                          _sum;
+    std::atomic<uint64_t>                _max{0};
+};
+
+// Records the lifetime of the scope (or up to Stop), less any time excluded for nested stages.
+// The full elapsed time is also added to *total so that an enclosing stage can exclude it.
+// Empty when histograms are compiled out
+#if ADSB_LATENCY_HISTOGRAMS
+struct LatencyTimer
+{
+    using clock = std::chrono::steady_clock;
+
+    explicit LatencyTimer(LatencyHistogram& histogram, clock::duration* total = nullptr) :
+        _histogram(&histogram), _total(total), _start(clock::now())
+    {}
+    ~LatencyTimer() { Stop(); }
+    CLASS_DELETE_COPY_AND_MOVE(LatencyTimer);
+
+    void Exclude(clock::duration nested) { _excluded += nested; }
+
+    void Stop()
+    {
+        if (_histogram == nullptr) { return; }
+        auto elapsed = clock::now() - _start;
+        _histogram->Record(elapsed - _excluded);
+        if (_total != nullptr) { *_total += elapsed; }
+        _histogram = nullptr;
+    }
+
+    private:
+    LatencyHistogram* _histogram;
+    clock::duration*  _total;
+    clock::time_point _start;
+    clock::duration   _excluded{};
+};
+#else
+struct LatencyTimer
+{
+    using clock = std::chrono::steady_clock;
+
+    explicit LatencyTimer(LatencyHistogram& /*histogram*/, clock::duration* /*total*/ = nullptr) {}
+    void Exclude(clock::duration /*nested*/) {}
+    void Stop() {}
+};
+#endif
@@ -0,0 +1,93 @@
+#pragma once
+#include "ADSBListener.h"
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+namespace ADSB
+{
+
+// Collects the decoded messages of a handler for its IMessageListener subscribers and hands them over a
+// batch at a time, from a vector allocated once. Add and Flush are called by the data handler thread,
+// Subscribe and Unsubscribe from any thread but not from a callback. Handlers skip Add without subscribers
+template <typename TMessage> struct MessageBatch
+{
+    static constexpr size_t Capacity = 256;
+
+    explicit MessageBatch(Source sourceId) : _sourceId(sourceId) { _messages.reserve(Capacity); }
+    ~MessageBatch() = default;
+    CLASS_DELETE_COPY_AND_MOVE(MessageBatch);
+
+    // consumers: something besides the subscribers takes the tracked aircraft, a subscriber for messages
+    // only would leave it without updates and is refused
+    void Subscribe(IMessageListener& listener, bool trackAircraft, bool consumers)
+    {
+        if (!trackAircraft && consumers)
+        {
+            throw std::logic_error("Messages only would stop the updates of the listeners, streams, history or ownship attached");
+        }
+        std::scoped_lock lock(_mutex);
+        _subscriptions.emplace_back(&listener, trackAircraft);
+        Update_();
+    }
+
+    void Unsubscribe(IMessageListener& listener)
+    {
+        std::scoped_lock lock(_mutex);
+        std::erase_if(_subscriptions, [&](auto const& s) { return s.first == &listener; });
+        Update_();
+    }
+
+    [[nodiscard]] bool Wanted() const { return _wanted.load(std::memory_order_acquire); }
+
+    // False while every subscriber asked for messages only. The handler still tracks when something else
+    // takes the aircraft (TrafficManager::HasConsumers)
+    [[nodiscard]] bool TrackAircraft() const { return _track.load(std::memory_order_relaxed); }
+
+    void Add(TMessage const& message)
+    {
+        _messages.push_back(message);
+        if (_messages.size() == Capacity) { Flush(); }
+    }
+
+    void Flush()
+    {
+        if (_messages.empty()) { return; }
+        {
+            std::scoped_lock lock(_mutex);
+            for (auto const& [listener, track] : _subscriptions)
+            {
+                if constexpr (std::is_same_v<TMessage, ModeSMessage>) { listener->OnModeSMessages(_sourceId, _messages); }
+                else { listener->OnUATMessages(_sourceId, _messages); }
+            }
+        }
+        _messages.clear();
+    }
+
+    private:
+    void Update_()
+    {
+        auto track = _subscriptions.empty() || std::ranges::any_of(_subscriptions, [](auto const& s) { return s.second; });
+        _track.store(track, std::memory_order_relaxed);
+        _wanted.store(!_subscriptions.empty(), std::memory_order_release);
+    }
+
+    Source                                          _sourceId;
+    std::vector<TMessage>                           _messages;    // Data handler thread only
+    std::mutex                                      _mutex;
+    std::vector<std::pair<IMessageListener*, bool>> _subscriptions;
+    std::atomic<bool>                               _wanted{false};
+    std::atomic<bool>                               _track{true};
+};
+
+}    // namespace ADSB
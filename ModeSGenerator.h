@@ -0,0 +1,400 @@
+#pragma once
+#include "CommonMacros.h"
+#include "SyntheticIQ.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <numbers>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+// Deterministic 1090 MHz capture of a simulated fleet, for load testing the demodulator without hardware.
+// Aircraft fly straight lines and send DF11 all call replies and DF17 extended squitters (identification,
+// airborne position with alternating even/odd CPR, airborne velocity) at random times. Each message is
+// PPM modulated with a random carrier phase at any sample rate from 2 MS/s (2.4 MS/s like dump1090's
+// oversampling works too); pulses are box filtered so that fractional start times (phase offsets) spread
+// over neighbouring samples the way a real receiver sees them.
+// Every transmission is listed with its exact bytes in Transmissions() so that decoders can be scored
+struct ModeSGenerator
+{
+    static constexpr uint32_t MinSampleRate = 2000000;
+    static constexpr size_t   LongBits      = 112;
+    static constexpr size_t   ShortBits     = 56;
+    static constexpr double   PreambleUs    = 8;
+
+    using Frame = std::array<uint8_t, LongBits / 8>;
+
+    struct Config
+    {
+        uint32_t sampleRate         = 2000000;
+        double   seconds            = 1.0;
+        uint32_t aircraft           = 50;
+        double   messagesPerSecond  = 1000;     // Mean over the fleet, arrivals are Poisson
+        double   df11Fraction       = 0.3;      // The rest are DF17
+        double   snrDb              = 20;       // Pulse power over noise power
+        double   snrSpreadDb        = 6;        // Each aircraft is +-spread/2 around snrDb
+        double   noiseSigma         = 3;        // Per I/Q component, in ADC units
+        double   overlapRate        = 0;        // Messages forced to start inside the previous one
+        double   maxPhaseOffset     = 0;        // Random fractional start of every message, in samples [0, 1)
+        double   singleBitErrorRate = 0;        // Messages with one flipped bit
+        double   twoBitErrorRate    = 0;        // Messages with two flipped bits
+        double   latitude           = 47.45;    // Centre of the fleet
+        double   longitude          = -122.31;
+        double   radiusDeg          = 2;
+        uint32_t seed               = 1;
+    };
+
+    // Ground truth for one message on the air
+    struct Transmission
+    {
+        double   sample{};    // Start of the preamble in output samples
+        Frame    frame{};     // As transmitted, bit errors included
+        uint32_t addr{};
+        uint8_t  df{};
+        uint8_t  bits{};
+        uint8_t  bitErrors{};
+        bool     overlapped{};    // Shares air time with another message
+        float    snrDb{};
+        float    phase{};    // Carrier phase, radians
+    };
+
+    struct Aircraft
+    {
+        uint32_t            addr{};
+        std::array<char, 8> callsign{};
+        double              latitude{};
+        double              longitude{};
+        int32_t             altitude{};    // Feet
+        double              speed{};       // Knots
+        double              heading{};     // Degrees
+        float               snrDb{};
+        double              updated{};    // Seconds
+        bool                odd{};        // Next position message uses the odd CPR format
+    };
+
+    explicit ModeSGenerator(Config const& config) : _config(config), _random(config.seed)
+    {
+        if (_config.sampleRate < MinSampleRate) { throw std::invalid_argument("Sample rate must be at least 2 MS/s"); }
+        if (_config.aircraft == 0) { throw std::invalid_argument("Fleet is empty"); }
+        if (_config.maxPhaseOffset < 0 || _config.maxPhaseOffset >= 1) { throw std::invalid_argument("Phase offset must be in [0, 1)"); }
+        CreateFleet_();
+        Schedule_();
+    }
+
+    [[nodiscard]] std::vector<Aircraft> const&     Fleet() const { return _fleet; }
+    [[nodiscard]] std::vector<Transmission> const& Transmissions() const { return _transmissions; }
+    [[nodiscard]] size_t                           Samples() const { return _samples; }
+
+    // Renders the capture as interleaved unsigned 8 bit I/Q, passed to sink(std::span<uint8_t const>)
+    // in blocks of blockSamples. Every call produces the same bytes
+    template <typename TSink> void Generate(TSink&& sink, size_t blockSamples = size_t{65536u} * 2u) const
+    {
+        SyntheticRandom      noise(_config.seed ^ 0x9e3779b9u);
+        SyntheticIQBlock     block;
+        std::vector<uint8_t> bytes;
+        size_t               first = 0;
+        for (size_t start = 0; start < _samples; start += blockSamples)
+        {
+            auto count = std::min(blockSamples, _samples - start);
+            block.Reset(count);
+            while (first < _transmissions.size() && End_(_transmissions[first]) <= static_cast<double>(start)) { first++; }
+            for (size_t i = first; i < _transmissions.size() && _transmissions[i].sample < static_cast<double>(start + count); i++)
+            {
+                Render_(block, start, i);
+            }
+            block.AddNoise(noise, _config.noiseSigma);
+            bytes.clear();
+            block.Quantize(bytes);
+            sink(std::span<uint8_t const>(bytes));
+        }
+    }
+
+    [[nodiscard]] std::vector<uint8_t> Generate() const
+    {
+        std::vector<uint8_t> out;
+        out.reserve(_samples * 2);
+        Generate([&](std::span<uint8_t const> const& bytes) { out.insert(out.end(), bytes.begin(), bytes.end()); });
+        return out;
+    }
+
+    // sample,df,icao,hex,snr_db,bit_errors,overlapped
+    void WriteTruthCsv(std::ostream& out) const
+    {
+        out << "sample,df,icao,hex,snr_db,bit_errors,overlapped\n";
+        for (auto const& t : _transmissions)
+        {
+            out << std::fixed << std::setprecision(3) << t.sample << ',' << int{t.df} << ',' << std::hex << std::setw(6)
+                << std::setfill('0') << t.addr << ',';
+            for (size_t i = 0; i < t.bits / 8u; i++) { out << std::setw(2) << int{t.frame[i]}; }
+            out << std::dec << std::setfill(' ') << ',' << std::setprecision(1) << t.snrDb << ',' << int{t.bitErrors} << ','
+                << int{t.overlapped} << '\n';
+        }
+    }
+
+    // Parity of the first bits - 24 bits, for DF11 (interrogator 0) and DF17
+    static uint32_t Crc(Frame const& frame, size_t bits)
+    {
+        uint32_t crc = 0;
+        for (size_t i = 0; i < bits - 24; i++)
+        {
+            auto bit = static_cast<uint32_t>(frame[i / 8] >> (7 - (i % 8))) & 1u;
+            auto top = (crc >> 23) & 1u;
+            crc      = (crc << 1) & 0xffffffu;
+            if ((top ^ bit) != 0) { crc ^= 0xfff409u; }
+        }
+        return crc;
+    }
+
+    // Number of longitude zones at a latitude (1090-WP-9-14 closed form)
+    static int CprNL(double lat)
+    {
+        lat = std::abs(lat);
+        if (lat < 1e-9) { return 59; }
+        if (lat > 87) { return 1; }
+        if (std::abs(lat - 87) < 1e-9) { return 2; }
+        auto a = 1 - std::cos(std::numbers::pi / (2 * 15));
+        auto b = std::cos(std::numbers::pi / 180 * lat);
+        return static_cast<int>(std::floor(2 * std::numbers::pi / std::acos(1 - (a / (b * b)))));
+    }
+
+    // Airborne CPR encoding, returns the 17 bit latitude and longitude
+    static std::array<uint32_t, 2> CprEncode(double lat, double lon, bool odd)
+    {
+        static constexpr double Scale = 131072;
+        auto mod  = [](double x, double y) { return x - (y * std::floor(x / y)); };
+        auto i    = odd ? 1 : 0;
+        auto dlat = 360.0 / (60 - i);
+        auto yz   = std::floor((Scale * mod(lat, dlat) / dlat) + 0.5);
+        auto rlat = dlat * ((yz / Scale) + std::floor(lat / dlat));
+        auto dlon = 360.0 / std::max(CprNL(rlat) - i, 1);
+        auto xz   = std::floor((Scale * mod(lon, dlon) / dlon) + 0.5);
+        return {static_cast<uint32_t>(yz) & 0x1ffffu, static_cast<uint32_t>(xz) & 0x1ffffu};
+    }
+
+    static Frame EncodeAllCallReply(uint32_t addr)
+    {
+        Frame frame{};
+        frame[0] = (11 << 3) | 5;    // CA 5: level 2 transponder, airborne
+        SetAddress_(frame, addr);
+        SetParity_(frame, ShortBits);
+        return frame;
+    }
+
+    static Frame EncodeIdentification(Aircraft const& a)
+    {
+        static constexpr std::string_view AisCharset = "@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_ !\"#$%&'()*+,-./0123456789:;<=>?";
+        uint64_t me = uint64_t{4} << 51;    // TC 4, category set A
+        for (size_t i = 0; i < a.callsign.size(); i++)
+        {
+            auto index = AisCharset.find(a.callsign[i]);
+            me |= static_cast<uint64_t>(index == std::string_view::npos ? 32 : index) << (42 - (6 * i));
+        }
+        return EncodeSquitter_(a.addr, me);
+    }
+
+    static Frame EncodePosition(Aircraft const& a)
+    {
+        auto     n   = static_cast<uint64_t>(std::clamp((a.altitude + 1000) / 25, 0, 0x7ff));
+        auto     alt = ((n >> 4) << 5) | (uint64_t{1} << 4) | (n & 0xf);    // Q bit set, 25ft steps
+        auto     cpr = CprEncode(a.latitude, a.longitude, a.odd);
+        uint64_t me  = (uint64_t{11} << 51) | (alt << 36) | (uint64_t{a.odd} << 34) | (uint64_t{cpr[0]} << 17) | cpr[1];
+        return EncodeSquitter_(a.addr, me);
+    }
+
+    static Frame EncodeVelocity(Aircraft const& a)
+    {
+        auto     rad  = a.heading * std::numbers::pi / 180;
+        auto     ew   = a.speed * std::sin(rad);
+        auto     ns   = a.speed * std::cos(rad);
+        auto     vew  = static_cast<uint64_t>(std::min(std::lround(std::abs(ew)) + 1, 1023l));
+        auto     vns  = static_cast<uint64_t>(std::min(std::lround(std::abs(ns)) + 1, 1023l));
+        uint64_t me   = (uint64_t{19} << 51) | (uint64_t{1} << 48);    // Subtype 1: ground speed, subsonic
+        me           |= (uint64_t{ew < 0} << 42) | (vew << 32) | (uint64_t{ns < 0} << 31) | (vns << 21);
+        me           |= uint64_t{1} << 10;    // Vertical rate 0, no information
+        return EncodeSquitter_(a.addr, me);
+    }
+
+    private:
+    static void SetAddress_(Frame& frame, uint32_t addr)
+    {
+        frame[1] = static_cast<uint8_t>(addr >> 16);
+        frame[2] = static_cast<uint8_t>(addr >> 8);
+        frame[3] = static_cast<uint8_t>(addr);
+    }
+
+    static void SetParity_(Frame& frame, size_t bits)
+    {
+        auto crc              = Crc(frame, bits);
+        frame[(bits / 8) - 3] = static_cast<uint8_t>(crc >> 16);
+        frame[(bits / 8) - 2] = static_cast<uint8_t>(crc >> 8);
+        frame[(bits / 8) - 1] = static_cast<uint8_t>(crc);
+    }
+
+    // DF17 with the 56 bit ME field
+    static Frame EncodeSquitter_(uint32_t addr, uint64_t me)
+    {
+        Frame frame{};
+        frame[0] = (17 << 3) | 5;
+        SetAddress_(frame, addr);
+        for (size_t i = 0; i < 7; i++) { frame[4 + i] = static_cast<uint8_t>(me >> (48 - (8 * i))); }
+        SetParity_(frame, LongBits);
+        return frame;
+    }
+
+    [[nodiscard]] double SamplesPerUs_() const { return static_cast<double>(_config.sampleRate) / 1e6; }
+    [[nodiscard]] double End_(Transmission const& t) const { return t.sample + ((PreambleUs + t.bits) * SamplesPerUs_()) + 1; }
+
+    void CreateFleet_()
+    {
+        std::unordered_set<uint32_t> used;
+        for (uint32_t n = 0; n < _config.aircraft; n++)
+        {
+            Aircraft a;
+            do {
+                a.addr = _random.Next() & 0xffffffu;
+            } while (a.addr == 0 || !used.insert(a.addr).second);
+            for (size_t i = 0; i < 3; i++) { a.callsign[i] = static_cast<char>('A' + _random.Below(26)); }
+            for (size_t i = 3; i < 7; i++) { a.callsign[i] = static_cast<char>('0' + _random.Below(10)); }
+            a.callsign[7] = ' ';
+            auto bearing  = _random.Uniform(0, 2 * std::numbers::pi);
+            auto distance = _config.radiusDeg * std::sqrt(_random.Uniform());
+            a.latitude    = _config.latitude + (distance * std::cos(bearing));
+            a.longitude   = _config.longitude + (distance * std::sin(bearing) / std::cos(_config.latitude * std::numbers::pi / 180));
+            a.altitude    = static_cast<int32_t>(1000 + (25 * _random.Below(1560)));    // Up to 40000ft
+            a.speed       = _random.Uniform(150, 500);
+            a.heading     = _random.Uniform(0, 360);
+            a.snrDb       = static_cast<float>(_config.snrDb + _random.Uniform(-_config.snrSpreadDb / 2, _config.snrSpreadDb / 2));
+            a.odd         = _random.Chance(0.5);
+            _fleet.push_back(a);
+        }
+    }
+
+    // Straight and level since the last message
+    void Fly_(Aircraft& a, double time) const
+    {
+        auto hours    = (time - a.updated) / 3600;
+        auto rad      = a.heading * std::numbers::pi / 180;
+        auto nm       = a.speed * hours;
+        a.latitude   += nm * std::cos(rad) / 60;
+        a.longitude  += nm * std::sin(rad) / (60 * std::cos(a.latitude * std::numbers::pi / 180));
+        a.updated     = time;
+    }
+
+    Frame NextFrame_(Aircraft& a)
+    {
+        if (_random.Chance(_config.df11Fraction)) { return EncodeAllCallReply(a.addr); }
+        auto kind = _random.Uniform();
+        if (kind < 0.5)
+        {
+            auto frame = EncodePosition(a);
+            a.odd      = !a.odd;
+            return frame;
+        }
+        return kind < 0.8 ? EncodeVelocity(a) : EncodeIdentification(a);
+    }
+
+    void FlipBits_(Transmission& t, size_t count)
+    {
+        auto first  = _random.Below(t.bits);
+        auto second = (first + 1 + _random.Below(t.bits - 1u)) % t.bits;    // Never the same bit twice
+        for (auto bit : {first, second})
+        {
+            if (t.bitErrors == count) { break; }
+            t.frame[bit / 8] ^= static_cast<uint8_t>(1u << (7 - (bit % 8)));
+            t.bitErrors++;
+        }
+    }
+
+    void Schedule_()
+    {
+        auto   spus    = SamplesPerUs_();
+        auto   longest = (PreambleUs + LongBits) * spus;
+        auto   meanGap = _config.messagesPerSecond > 0 ? static_cast<double>(_config.sampleRate) / _config.messagesPerSecond : 0;
+        double sample  = 0;
+        _samples       = static_cast<size_t>(_config.seconds * _config.sampleRate);
+        while (meanGap > 0)
+        {
+            if (!_transmissions.empty() && _random.Chance(_config.overlapRate))
+            {
+                // Garble: start somewhere after the previous preamble but before it ends
+                auto const& previous = _transmissions.back();
+                sample               = previous.sample + _random.Uniform(PreambleUs * spus, (PreambleUs + previous.bits) * spus);
+            }
+            else
+            {
+                sample += _random.Exponential(meanGap);
+            }
+            sample = std::floor(sample) + _random.Uniform(0, _config.maxPhaseOffset);
+            if (sample + longest + 1 >= static_cast<double>(_samples)) { break; }
+
+            auto& a = _fleet[_random.Below(static_cast<uint32_t>(_fleet.size()))];
+            Fly_(a, sample / _config.sampleRate);
+            Transmission t{.sample = sample, .frame = NextFrame_(a), .addr = a.addr, .snrDb = a.snrDb};
+            t.df        = static_cast<uint8_t>(t.frame[0] >> 3);
+            t.bits      = static_cast<uint8_t>(t.df == 17 ? LongBits : ShortBits);
+            t.phase     = static_cast<float>(_random.Uniform(0, 2 * std::numbers::pi));
+            auto errors = _random.Uniform();
+            if (errors < _config.twoBitErrorRate) { FlipBits_(t, 2); }
+            else if (errors < _config.twoBitErrorRate + _config.singleBitErrorRate) { FlipBits_(t, 1); }
+            _transmissions.push_back(t);
+        }
+
+        // Overlaps from the forced ones and from chance arrivals
+        std::ranges::sort(_transmissions, {}, &Transmission::sample);
+        for (size_t i = 1; i < _transmissions.size(); i++)
+        {
+            for (size_t j = i; j-- > 0 && _transmissions[j].sample + longest + 1 > _transmissions[i].sample;)
+            {
+                if (End_(_transmissions[j]) <= _transmissions[i].sample) { continue; }
+                _transmissions[i].overlapped = true;
+                _transmissions[j].overlapped = true;
+            }
+        }
+    }
+
+    // Adds the pulses of transmission index that fall into the block starting at sample start
+    void Render_(SyntheticIQBlock& block, size_t start, size_t index) const
+    {
+        // Without noise the amplitude is still relative to the default sigma
+        auto const& t       = _transmissions[index];
+        auto        spus    = SamplesPerUs_();
+        auto        sigma   = _config.noiseSigma > 0 ? _config.noiseSigma : Config{}.noiseSigma;
+        auto        amp     = sigma * std::sqrt(2.0) * std::pow(10.0, t.snrDb / 20);
+        auto        carrier = std::polar(static_cast<float>(amp), t.phase);
+
+        auto pulse = [&](double fromUs, double toUs) {
+            auto from = t.sample + (fromUs * spus) - static_cast<double>(start);
+            auto to   = t.sample + (toUs * spus) - static_cast<double>(start);
+            auto last = std::min(static_cast<double>(block.Size()), std::ceil(to));
+            for (auto k = std::max(0.0, std::floor(from)); k < last; k++)
+            {
+                auto covered = std::min(to, k + 1) - std::max(from, k);
+                if (covered > 0) { block[static_cast<size_t>(k)] += carrier * static_cast<float>(covered); }
+            }
+        };
+        for (double p : {0.0, 1.0, 3.5, 4.5}) { pulse(p, p + 0.5); }
+        for (size_t i = 0; i < t.bits; i++)
+        {
+            auto one = ((t.frame[i / 8] >> (7 - (i % 8))) & 1) != 0;
+            auto at  = PreambleUs + static_cast<double>(i) + (one ? 0 : 0.5);
+            pulse(at, at + 0.5);
+        }
+    }
+
+    Config                    _config;
+    SyntheticRandom           _random;
+    std::vector<Aircraft>     _fleet;
+    std::vector<Transmission> _transmissions;
+    size_t                    _samples{};
+};
@@ -0,0 +1,129 @@
+#pragma once
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+SUPPRESS_WARNINGS_END
+
+namespace ADSB
+{
+
+// A decoded Mode S message in 56 bytes, so that it fits a cache line and is cheap to copy between stages.
+// The raw (error corrected) bytes are kept and fields that are a shift and a mask away are read from them
+// on access. What the decoder had to compute (callsign characters, altitude, velocity) is stored in a
+// union whose member is given by payload
+struct ModeSMessage
+{
+    using time_point = std::chrono::time_point<std::chrono::system_clock>;
+
+    static constexpr size_t LongMessageBits  = 112;
+    static constexpr size_t LongMessageBytes = LongMessageBits / 8;
+    static constexpr size_t ShortMessageBits = 56;
+
+    enum class Unit : uint8_t
+    {
+        Feet   = 0,
+        Meters = 1
+    };
+
+    enum class Payload : uint8_t
+    {
+        None,
+        Identification,    // DF17 ME 1-4
+        Altitude,          // DF0/4/16/20, DF17 ME 9-18 (airborne position)
+        Velocity,          // DF17 ME 19 subtypes 1-4
+    };
+
+    struct Velocity
+    {
+        int16_t speed;      // Knots, ground speed for subtypes 1 and 2, 0 for airspeed subtypes
+        int16_t heading;    // Degrees 0-359, track or heading
+    };
+
+    union Fields
+    {
+        std::array<char, 8> flight;
+        int32_t             altitude;
+        Velocity            velocity;
+    };
+
+    static constexpr size_t BitsForDf(uint32_t df)
+    {
+        return (df == 16 || df == 17 || df == 19 || df == 20 || df == 21) ? LongMessageBits : ShortMessageBits;
+    }
+
+    /* Header, always valid */
+    [[nodiscard]] uint32_t Df() const { return msg[0] >> 3u; }
+    [[nodiscard]] size_t   Bits() const { return BitsForDf(Df()); }
+    [[nodiscard]] size_t   Bytes() const { return Bits() / 8; }
+    [[nodiscard]] uint32_t Crc() const
+    {
+        auto n = Bytes();
+        return (uint32_t{msg[n - 3]} << 16u) | (uint32_t{msg[n - 2]} << 8u) | uint32_t{msg[n - 1]};
+    }
+    [[nodiscard]] bool CrcOk() const { return crcok != 0; }
+    // Bits fixed by the CRC: 0, 1 or 2
+    [[nodiscard]] int Corrected() const { return errorbit == -1 ? 0 : (errorbit < static_cast<int>(LongMessageBits) ? 1 : 2); }
+
+    /* DF11 and DF17 */
+    [[nodiscard]] uint32_t Ca() const { return msg[0] & 7u; }
+    [[nodiscard]] uint32_t MeType() const { return msg[4] >> 3u; }
+    [[nodiscard]] uint32_t MeSub() const { return msg[4] & 7u; }
+
+    /* DF4, DF5, DF20, DF21 */
+    [[nodiscard]] uint32_t Fs() const { return msg[0] & 7u; }
+    [[nodiscard]] uint32_t Dr() const { return (msg[1] >> 3u) & 31u; }
+    [[nodiscard]] uint32_t Um() const { return ((msg[1] & 7u) << 3u) | (msg[2] >> 5u); }
+
+    /* Squawk as 4 octal digits in a decimal number. The bits are interleaved C1-A1-C2-A2-C4-A4-ZERO-B1-D1-B2-D2-B4-D4,
+     * see http://en.wikipedia.org/wiki/Gillham_code */
+    [[nodiscard]] uint32_t Identity() const
+    {
+        uint32_t a = ((msg[3] & 0x80u) >> 5u) | ((msg[2] & 0x02u) >> 0u) | ((msg[2] & 0x08u) >> 3u);
+        uint32_t b = ((msg[3] & 0x02u) << 1u) | ((msg[3] & 0x08u) >> 2u) | ((msg[3] & 0x20u) >> 5u);
+        uint32_t c = ((msg[2] & 0x01u) << 2u) | ((msg[2] & 0x04u) >> 1u) | ((msg[2] & 0x10u) >> 4u);
+        uint32_t d = ((msg[3] & 0x01u) << 2u) | ((msg[3] & 0x04u) >> 1u) | ((msg[3] & 0x10u) >> 4u);
+        return (a * 1000) + (b * 100) + (c * 10) + d;
+    }
+
+    /* DF17 airborne position. 17 bit CPR coordinates, odd or even frame */
+    [[nodiscard]] bool    OddCpr() const { return (msg[6] & (1u << 2u)) != 0; }
+    [[nodiscard]] int32_t RawLatitude() const { return static_cast<int32_t>(((msg[6] & 3u) << 15u) | (msg[7] << 7u) | (msg[8] >> 1u)); }
+    [[nodiscard]] int32_t RawLongitude() const { return static_cast<int32_t>(((msg[8] & 1u) << 16u) | (msg[9] << 8u) | msg[10]); }
+
+    /* DF17 airborne velocity subtypes 1 and 2 */
+    [[nodiscard]] bool     West() const { return (msg[5] & 4u) != 0; }
+    [[nodiscard]] uint32_t EwVelocity() const { return ((msg[5] & 3u) << 8u) | msg[6]; }
+    [[nodiscard]] bool     South() const { return (msg[7] & 0x80u) != 0; }
+    [[nodiscard]] uint32_t NsVelocity() const { return ((msg[7] & 0x7fu) << 3u) | ((msg[8] & 0xe0u) >> 5u); }
+
+    /* Decoded, 0 or empty when the message doesn't carry them. The unit is only meaningful with an altitude */
+    [[nodiscard]] int32_t Altitude() const { return payload == Payload::Altitude ? fields.altitude : 0; }
+    [[nodiscard]] Unit    AltitudeUnit() const { return Df() != 17 && (msg[3] & (1u << 6u)) != 0 ? Unit::Meters : Unit::Feet; }
+    [[nodiscard]] std::string_view Flight() const
+    {
+        return payload == Payload::Identification ? std::string_view(fields.flight.data(), fields.flight.size()) : std::string_view();
+    }
+    [[nodiscard]] int32_t Speed() const { return payload == Payload::Velocity ? fields.velocity.speed : 0; }
+    [[nodiscard]] int32_t Heading() const { return payload == Payload::Velocity ? fields.velocity.heading : 0; }
+
+    std::array<uint8_t, LongMessageBytes> msg{};            // Binary message, error corrected
+    uint8_t                               crcok{};
+    Payload                               payload{Payload::None};
+    int16_t                               errorbit{-1};     // Bit corrected, second bit << 8 for two. -1 if none
+    uint32_t                              addr{};           // ICAO address, recovered from the AP field for DF0/4/5/16/20/21/24
+    float                                 signalLevel{};    // dBFS, mean level of the message's pulses
+    float                                 noiseLevel{};     // dBFS, rolling noise floor when the message was received
+    uint64_t                              sample{};         // Preamble position, counted from the first sample handled
+    time_point                            time{};           // Arrival of the buffer it was decoded from
+    Fields                                fields{};
+};
+
+static_assert(sizeof(ModeSMessage) <= 64, "A message must fit in a cache line");
+
+}    // namespace ADSB
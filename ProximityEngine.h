@@ -0,0 +1,200 @@
+#pragma once
+#include "ADSBListener.h"
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <numbers>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+SUPPRESS_WARNINGS_END
+
+namespace ADSB
+{
+
+// Ownship relative traffic awareness. An updated aircraft and ownship are projected in a straight line
+// (flat earth around ownship, constant climb) and the closest point of approach classified against the
+// ProximityConfig thresholds. Only the aircraft that changed is looked at, so the cost per update doesn't
+// grow with the table, and after each buffer the few with an alert out. Ownship and the thresholds are set
+// from any thread and picked up by the data handler thread on its next update or buffer
+struct ProximityEngine
+{
+    using time_point = IAirCraft::time_point;
+
+    ProximityEngine()  = default;
+    ~ProximityEngine() = default;
+    CLASS_DELETE_COPY_AND_MOVE(ProximityEngine);
+
+    // A fix without a time (LastSeen at the epoch) is taken as of now
+    void SetOwnship(IAirCraft const& ownship)
+    {
+        Track track{.lat      = ownship.Lat1E7() / IAirCraft::LatLonPrecision,
+                    .lon      = ownship.Lon1E7() / IAirCraft::LatLonPrecision,
+                    .altitude = ownship.Altitude(),
+                    .climb    = ownship.Climb(),
+                    .speed    = ownship.Speed(),
+                    .track    = ownship.Heading(),
+                    .time     = ownship.LastSeen() != time_point{} ? ownship.LastSeen() : std::chrono::system_clock::now()};
+        std::scoped_lock lock(_mutex);
+        _pending.ownship = track;
+        _changed.store(true, std::memory_order_release);
+    }
+
+    void SetConfig(ProximityConfig const& config)
+    {
+        std::scoped_lock lock(_mutex);
+        _pending.config = config;
+        _changed.store(true, std::memory_order_release);
+    }
+
+    // Once SetOwnship was called, from any thread
+    [[nodiscard]] bool HasOwnship()
+    {
+        std::scoped_lock lock(_mutex);
+        return _pending.ownship.has_value();
+    }
+
+    // Data handler thread. An alert comes back when the aircraft's level changes. now is the time the
+    // update is for, the epoch for the clock
+    std::optional<ProximityAlert> Evaluate(IAirCraft const& a, time_point now)
+    {
+        Apply_();
+        if (!_current.ownship.has_value() || !Known_(a)) { return std::nullopt; }
+        now = Now_(now);
+        return Report_(Classify_(a, now), now);
+    }
+
+    // Data handler thread, after each buffer. The aircraft with an alert out are classified again when
+    // ownship or the thresholds changed, and cleared once not heard from for ProximityConfig::stale or
+    // no longer found. find(addr) returns the IAirCraft const* or nullptr, report(ProximityAlert const&)
+    // gets each change
+    template <typename TFind, typename TReport> void Review(time_point now, TFind&& find, TReport&& report)
+    {
+        Apply_();
+        auto reclassify = std::exchange(_reclassify, false);
+        if (_alerts.empty()) { return; }
+        now = Now_(now);
+        for (auto it = _alerts.begin(); it != _alerts.end();)
+        {
+            IAirCraft const* a     = find(it->first);
+            auto             alert = it->second.alert;
+            if (a == nullptr || now - it->second.seen > _current.config.stale) { alert.level = ProximityLevel::None; }
+            else if (reclassify) { alert = Classify_(*a, it->second.seen); }    // As of its position
+            if (alert.level == it->second.alert.level)
+            {
+                ++it;
+                continue;
+            }
+            report(static_cast<ProximityAlert const&>(alert));
+            if (alert.level == ProximityLevel::None) { it = _alerts.erase(it); }
+            else { (it++)->second.alert = alert; }
+        }
+    }
+
+    private:
+    struct Track
+    {
+        double     lat{};
+        double     lon{};
+        int32_t    altitude{};    // Feet
+        int32_t    climb{};       // Feet per minute
+        uint32_t   speed{};       // Knots over ground
+        uint32_t   track{};       // Degrees
+        time_point time{};
+    };
+
+    struct Settings
+    {
+        std::optional<Track> ownship;
+        ProximityConfig      config{};
+    };
+
+    struct Alerted
+    {
+        ProximityAlert alert{};    // Last reported, never at level None
+        time_point     seen{};     // Last update of the aircraft
+    };
+
+    void Apply_()
+    {
+        if (!_changed.load(std::memory_order_acquire)) { return; }
+        std::scoped_lock lock(_mutex);
+        _current = _pending;
+        _changed.store(false, std::memory_order_relaxed);
+        _reclassify = true;
+    }
+
+    static time_point Now_(time_point now) { return now != time_point{} ? now : std::chrono::system_clock::now(); }
+
+    // Until its position, altitude and velocity were decoded an aircraft reads 0 for them, which would put
+    // it at sea level or standing still
+    static bool Known_(IAirCraft const& a) { return (a.Lat1E7() != 0 || a.Lon1E7() != 0) && a.Altitude() != 0 && a.Speed() != 0; }
+
+    std::optional<ProximityAlert> Report_(ProximityAlert const& alert, time_point now)
+    {
+        auto it    = _alerts.find(alert.addr);
+        auto level = it != _alerts.end() ? it->second.alert.level : ProximityLevel::None;
+        if (alert.level != ProximityLevel::None) { _alerts.insert_or_assign(alert.addr, Alerted{.alert = alert, .seen = now}); }
+        else if (it != _alerts.end()) { _alerts.erase(it); }
+        if (alert.level == level) { return std::nullopt; }
+        return alert;
+    }
+
+    [[nodiscard]] ProximityAlert Classify_(IAirCraft const& a, time_point now) const
+    {
+        constexpr double Rad       = std::numbers::pi / 180;
+        auto const&      own       = *_current.ownship;
+        auto const&      config    = _current.config;
+        auto             lookahead = std::chrono::duration<double, std::ratio<3600>>(config.lookahead).count();
+
+        // Nautical miles and knots, x east and y north of where ownship is now
+        auto age     = std::clamp(std::chrono::duration<double, std::ratio<3600>>(now - own.time).count(), 0.0, lookahead);
+        auto ownVx   = own.speed * std::sin(own.track * Rad);
+        auto ownVy   = own.speed * std::cos(own.track * Rad);
+        auto dLon    = std::remainder((a.Lon1E7() / IAirCraft::LatLonPrecision) - own.lon, 360.0);
+        auto dx      = (dLon * 60 * std::cos(own.lat * Rad)) - (ownVx * age);
+        auto dy      = (((a.Lat1E7() / IAirCraft::LatLonPrecision) - own.lat) * 60) - (ownVy * age);
+        auto dz      = a.Altitude() - (own.altitude + (own.climb * age * 60));
+        auto vx      = (a.Speed() * std::sin(a.Heading() * Rad)) - ownVx;
+        auto vy      = (a.Speed() * std::cos(a.Heading() * Rad)) - ownVy;
+        auto vz      = static_cast<double>(a.Climb() - own.climb) * 60;    // Feet per hour
+        auto closing = (vx * vx) + (vy * vy);
+        auto t       = closing > 0 ? std::clamp(-((dx * vx) + (dy * vy)) / closing, 0.0, lookahead) : 0.0;
+
+        ProximityAlert alert{.addr              = a.Addr(),
+                             .sourceId          = a.SourceId(),
+                             .rangeNm           = std::hypot(dx, dy),
+                             .altitudeDiffFt    = static_cast<int32_t>(std::lround(dz)),
+                             .cpaNm             = std::hypot(dx + (vx * t), dy + (vy * t)),
+                             .cpaAltitudeDiffFt = static_cast<int32_t>(std::lround(dz + (vz * t))),
+                             .timeToCpaSeconds  = t * 3600};
+        if (alert.cpaNm <= config.horizontalNm && std::abs(alert.cpaAltitudeDiffFt) <= config.verticalFt)
+        {
+            alert.level = ProximityLevel::Conflict;
+        }
+        else if (alert.rangeNm <= config.proximateNm && std::abs(alert.altitudeDiffFt) <= config.proximateFt)
+        {
+            alert.level = ProximityLevel::Proximate;
+        }
+        return alert;
+    }
+
+    // Data handler thread only
+    Settings                              _current;
+    bool                                  _reclassify{};    // Ownship or the thresholds changed since the last Review
+    std::unordered_map<uint32_t, Alerted> _alerts;          // Aircraft with a level other than None
+
+    std::mutex        _mutex;
+    Settings          _pending;
+    std::atomic<bool> _changed{false};
+};
+
+}    // namespace ADSB
@@ -1,27 +1,36 @@
 #pragma once
 
 #include "CommonMacros.h"
+#include "IQFileSource.h"
+#include "IQRecorder.h"
+#include "LatencyHistogram.h"
 
 SUPPRESS_WARNINGS_START
 SUPPRESS_STL_WARNINGS
 
 #include "SetThreadName.h"
+#include "TraceEvents.h"
 #include <rtl-sdr.h>
+#ifndef __ANDROID__
+#include <libusb.h>
+#endif
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <condition_variable>
 #include <cstddef>
 #include <cstdint>
 #include <filesystem>
-#include <fstream>
 #include <future>
 #include <iostream>
 #include <mutex>
+#include <optional>
 #include <span>
 #include <thread>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 SUPPRESS_WARNINGS_END
@@ -32,10 +41,20 @@ SUPPRESS_WARNINGS_END
 
 struct RTLSDR
 {
-    static constexpr auto SteadyDuration = std::chrono::milliseconds{500};
+    static constexpr auto SteadyDuration        = std::chrono::milliseconds{500};
+    static constexpr auto HotplugSettleDuration = std::chrono::milliseconds{20};
+    static constexpr auto HotplugPollDuration   = std::chrono::seconds{5};
 
     using time_point = std::chrono::time_point<std::chrono::system_clock>;
 
+    // Samples lost between two consecutive buffers handed to IDataHandler::HandleData
+    struct DataGap
+    {
+        time_point time;    // Arrival of the first buffer after the gap
+        uint64_t   droppedBuffers{};
+        uint64_t   droppedSamples{};
+    };
+
     struct IDataHandler
     {
         IDataHandler() = default;
@@ -46,22 +65,53 @@ struct RTLSDR
         virtual void HandleData(std::span<uint8_t const> const& data) = 0;
 
         virtual void OnDeviceStatusChanged(bool available) = 0;
+
+        // Called on the data handler thread right before the first buffer following the gap
+        virtual void OnDataGap(DataGap const& /* gap */) {}
+    };
+
+    // What the librtlsdr callback does when the consumer has not freed a ring slot
+    enum class OverflowPolicy : uint8_t
+    {
+        Block,         // Wait for the consumer. Stalls USB transfers and the dongle drops samples unnoticed
+        DropNewest,    // Discard the incoming buffer
+        DropOldest,    // Discard the oldest queued buffer, keeps decode latency bounded
+    };
+
+    struct OverflowStats
+    {
+        uint64_t overruns{};    // Number of times the ring was found full
+        uint64_t droppedBuffers{};
+        uint64_t droppedSamples{};
     };
 
     static constexpr int      AutoGain        = -100;
     static constexpr int      MaxGain         = 999999;
+    static constexpr int      UnsetGain       = -999999;    // The handler's default, MaxGain unless it has one
     static constexpr int      CorrectionPPM   = 0;
     static constexpr uint32_t SampleRate      = 0;    // Invalid
     static constexpr size_t   BufferLength    = size_t{65536u} * 4u;
     static constexpr size_t   BufferCount     = 16;
+    static constexpr size_t   BufferAlignment = 512;    // librtlsdr requires multiples of 512 bytes
     static constexpr uint32_t CenterFrequency = 0;
 
     struct Config
     {
-        int      gain       = MaxGain;
+        int      gain       = UnsetGain;
         bool     enableAGC  = false;
         uint32_t frequency  = CenterFrequency;
         uint32_t sampleRate = SampleRate;
+
+        // Buffer geometry. Each buffer holds bufferLength / 2 I/Q samples and decoding of a buffer
+        // cannot start until it is full, so smaller buffers trade throughput for latency
+        // (256 KiB at 2 MS/s is ~65ms). The ring uses bufferCount * bufferLength bytes per device
+        size_t bufferLength = BufferLength;
+        size_t bufferCount  = BufferCount;
+
+        OverflowPolicy overflowPolicy = OverflowPolicy::Block;
+
+        // How <frequency>.test.dat is replayed when it stands in for the device. RealTime paces it at sampleRate
+        IQFileSource::Pacing pacing = IQFileSource::Pacing::MaxSpeed;
     };
 
     struct DeviceInfo
@@ -94,12 +144,15 @@ struct RTLSDR
     {
 
         std::atomic<bool> running{false};
-        rtlsdr_dev_t*     dev{nullptr};
+        rtlsdr_dev_t*     dev{nullptr};    // Written holding both MgrMutex and control
+        std::mutex        control;         // Held for control transfers made outside MgrMutex, and to close dev
     };
 
     // RTLSDR is hugely single threaded
     // Cannot open devices once a device is opened
     // A manager is required for orchestration
+    // Device arrival/removal is signalled by libusb hotplug callbacks (android: descriptor open/close)
+    // and client state changes are signalled on _cvState so nothing sleeps or spins while waiting
     struct Manager
     {
 #ifdef __ANDROID__
@@ -107,14 +160,22 @@ struct RTLSDR
 
         void AndroidUsbDescriptorOpen(int fd)
         {
-            std::scoped_lock lockGuard(MgrMutex);
-            androidDescriptors.insert(fd);
+            {
+                std::scoped_lock lockGuard(MgrMutex);
+                androidDescriptors.insert(fd);
+                _deviceEpoch++;
+            }
+            _cvState.notify_all();
         }
 
         void AndroidUsbDescriptorClose(int fd)
         {
-            std::scoped_lock lockGuard(MgrMutex);
-            androidDescriptors.erase(fd);
+            {
+                std::scoped_lock lockGuard(MgrMutex);
+                androidDescriptors.erase(fd);
+                _deviceEpoch++;
+            }
+            _cvState.notify_all();
         }
 
 #endif
@@ -138,9 +199,19 @@ struct RTLSDR
             return Instance.lock();
         }
 
-        Manager() = default;
+        Manager()
+        {
+#ifndef __ANDROID__
+            _hotplugSupported = StartHotplugMonitor_();
+#endif
+        }
 
-        ~Manager() = default;
+        ~Manager()
+        {
+#ifndef __ANDROID__
+            StopHotplugMonitor_();
+#endif
+        }
         CLASS_DELETE_COPY_AND_MOVE(Manager);
 
         // Blocking call
@@ -158,10 +229,10 @@ struct RTLSDR
                 SetThreadName("RTLSDR::ReadAsync");
 
                 rtlsdr_dev_t* dev = nullptr;
-                while (dev == nullptr)
                 {
+                    std::unique_lock<std::mutex> guard(MgrMutex);
+                    while (true)
                     {
-                        std::unique_lock<std::mutex> guard(MgrMutex);
                         if (!_clients.contains(client)) { return; }
                         RequestDevice_(guard);
                         dev = client->_mgrctx.dev;
@@ -170,16 +241,22 @@ struct RTLSDR
                             client->_mgrctx.running = true;
                             break;
                         }
+                        // Woken up when the device search assigns devices or the client is stopped
+                        _cvState.wait(guard);
                     }
-                    std::this_thread::sleep_for(SteadyDuration);
                 }
                 client->_handler->OnDeviceStatusChanged(true);
 
-                rtlsdr_read_async(dev, RTLSDR::Callback_, client, BufferCount, BufferLength);
+                rtlsdr_read_async(dev,
+                                  RTLSDR::Callback_,
+                                  client,
+                                  static_cast<uint32_t>(client->_config.bufferCount),
+                                  static_cast<uint32_t>(client->_config.bufferLength));
                 {
                     std::unique_lock<std::mutex> guard(MgrMutex);
                     client->_mgrctx.running = false;
                 }
+                _cvState.notify_all();
                 client->_handler->OnDeviceStatusChanged(false);
 
                 ResetAllClients_();
@@ -188,9 +265,35 @@ struct RTLSDR
 
         void Stop(RTLSDR* client)
         {
-            std::unique_lock<std::mutex> guard(MgrMutex);
-            ResetClient_(guard, client);
-            _clients.erase(client);
+            {
+                std::unique_lock<std::mutex> guard(MgrMutex);
+                ResetClient_(guard, client);
+                _clients.erase(client);
+            }
+            _cvState.notify_all();
+        }
+
+        std::vector<int> GetTunerGains(RTLSDR const* client) const
+        {
+            std::scoped_lock lockGuard(MgrMutex);
+            return TunerGains_(client->_mgrctx.dev);
+        }
+
+        // Safe while rtlsdr_read_async is running, it is a control transfer on the same handle.
+        // MgrMutex isn't held across the transfer so the data thread never waits on device searches
+        bool SetGain(RTLSDR* client, int gain)
+        {
+            {
+                std::scoped_lock lockGuard(MgrMutex);
+                client->_config.gain = gain;    // Used again if the device is reopened
+            }
+            std::scoped_lock control(client->_mgrctx.control);
+            auto*            dev = client->_mgrctx.dev;
+            if (dev == nullptr) { return false; }
+            rtlsdr_set_tuner_gain_mode(dev, 1);
+            if (rtlsdr_set_tuner_gain(dev, gain) != 0) { return false; }
+            client->_currentGain = rtlsdr_get_tuner_gain(dev);
+            return true;
         }
 
         private:
@@ -208,22 +311,23 @@ struct RTLSDR
         void ResetClient_(std::unique_lock<std::mutex>& guard, RTLSDR* client)
         {
             auto* dev = client->_mgrctx.dev;
-            if (dev != nullptr)
+            if (dev == nullptr) { return; }
+            rtlsdr_cancel_async(dev);
+            // The client thread signals _cvState once it is out of rtlsdr_read_async
+            _cvState.wait(guard, [&]() { return !client->_mgrctx.running || client->_mgrctx.dev != dev; });
+            if (client->_mgrctx.dev != dev)
             {
-                rtlsdr_cancel_async(dev);
-                // while (client->_mgrctx.running && rtlsdr_cancel_async(dev) != 0) {}
-                while (client->_mgrctx.running)
-                {
-                    guard.unlock();
-                    std::this_thread::yield();
-                    guard.lock();
-                }
+                return;    // Already closed by another thread while we were waiting
+            }
+            {
+                std::scoped_lock control(client->_mgrctx.control);
                 rtlsdr_close(dev);
                 client->_mgrctx.dev = nullptr;
+            }
 #if defined __ANDROID__
-                androidDescriptors.erase(client->_fdAndroid);
+            androidDescriptors.erase(client->_fdAndroid);
 #endif
-            }
+            _cvState.notify_all();
         }
 
         // Scenarios
@@ -247,7 +351,9 @@ struct RTLSDR
                     || ((client->_selector != nullptr) && client->_selector->SelectDevice(d)))
                 {
                     OpenDevice_(dev, client->_config);
-                    client->_mgrctx.dev = dev;
+                    std::scoped_lock control(client->_mgrctx.control);
+                    client->_mgrctx.dev  = dev;
+                    client->_currentGain = rtlsdr_get_tuner_gain(dev);
                     return client;
                 }
             }
@@ -284,18 +390,38 @@ struct RTLSDR
                     {
 
                         if (!this->RequestDeviceImpl_()) { break; }
-                    } catch (std::exception const& e) { std::cerr << "Error Searching for RTLSDR Device " << e.what() << "\n"; }
+                    } catch (std::exception const& e)
+                    {
+                        std::cerr << "Error Searching for RTLSDR Device " << e.what() << "\n";
+                        // Back off before retrying a failing enumeration
+                        std::this_thread::sleep_for(SteadyDuration);
+                    }
                 }
+                _cvState.notify_all();
             });
         }
 
+        [[nodiscard]] size_t DeviceCount_(std::unique_lock<std::mutex> const& /*guard*/) const
+        {
+#ifdef __ANDROID__
+            return androidDescriptors.size();
+#else
+            return rtlsdr_get_device_count();
+#endif
+        }
+
+        // Wait for a burst of hotplug events (hub reset, multiple dongles) to go quiet before enumerating
+        void WaitForDevicesToSettle_(std::unique_lock<std::mutex>& guard)
+        {
+            auto epoch = _deviceEpoch;
+            while (_cvState.wait_for(guard, HotplugSettleDuration, [&]() { return _deviceEpoch != epoch; })) { epoch = _deviceEpoch; }
+        }
+
         bool RequestDeviceImpl_()
         {
+            std::unique_lock<std::mutex> guard(MgrMutex);
             while (true)
             {
-                // Let things stabilize a little
-                std::this_thread::sleep_for(SteadyDuration);
-                std::unique_lock<std::mutex> guard(MgrMutex);
                 if (_clients.empty())
                 {
                     _deviceSearching = false;
@@ -309,58 +435,146 @@ struct RTLSDR
                     _deviceSearching = false;
                     return false;
                 }
-#ifdef __ANDROID__
-                auto deviceCount = androidDescriptors.size();
-#else
-                auto deviceCount = rtlsdr_get_device_count();
-#endif
-                if (activeCount != deviceCount)
+                // Only enumerate when something changed since the last attempt. Otherwise a dongle that
+                // no client selects would get opened and closed in a tight loop
+                EnumerationState state{.epoch = _deviceEpoch, .activeCount = activeCount, .clientCount = _clients.size()};
+                if (state != _enumerated)
+                {
+                    _enumerated = state;
+                    if (activeCount != DeviceCount_(guard))
+                    {
+                        // Just reset all clients and reassign if there's been a change in active and total sdr devices
+                        ResetAllClients_(guard);
+                        break;
+                    }
+                }
+
+                // Nothing to assign yet. Sleep until a device arrives or leaves.
+                // Without hotplug support every SteadyDuration is treated as a potential change
+                auto epoch = _deviceEpoch;
+                if (_cvState.wait_for(guard,
+                                      _hotplugSupported ? HotplugPollDuration : SteadyDuration,
+                                      [&]() { return _deviceEpoch != epoch || _clients.empty(); }))
                 {
-                    // Just reset all clients and reassign if there's been a change in active and total sdr devices
-                    ResetAllClients_(guard);
-                    // Let the devices come out of their async loop
-                    break;
-                    // Try again after a while
+                    WaitForDevicesToSettle_(guard);
                 }
+                else if (!_hotplugSupported) { _deviceEpoch++; }
             }
 
             // Wait for everyone to come out of their loop
-            while (true)
-            {
-                std::unique_lock<std::mutex> guard(MgrMutex);
-                if (std::ranges::all_of(_clients, [](auto* client) { return !client->_mgrctx.running; })) { break; }
-            }
-            {
-                std::unique_lock<std::mutex> guard(MgrMutex);
+            _cvState.wait(guard, [this]() { return std::ranges::all_of(_clients, [](auto* client) { return !client->_mgrctx.running; }); });
+
 #ifdef __ANDROID__
-                auto deviceCount = androidDescriptors.size();
-                if (deviceCount == 0) { return true; }
-                for (auto fd : androidDescriptors)
+            for (auto fd : androidDescriptors)
+            {
+                rtlsdr_dev_t* dev = nullptr;
+                if (rtlsdr_open_sys_dev(&dev, fd) != 0) { continue; }
+                auto* client = MatchDeviceToClient_(guard, dev);
+                if (client == nullptr)
                 {
-                    rtlsdr_dev_t* dev = nullptr;
-                    if (rtlsdr_open_sys_dev(&dev, fd) != 0) { continue; }
-                    auto* client = MatchDeviceToClient_(guard, dev);
-                    if (client == nullptr) { rtlsdr_close(dev); }
-                    client->_fdAndroid = fd;
+                    rtlsdr_close(dev);
+                    continue;
                 }
+                client->_fdAndroid = fd;
+            }
 #else
-                auto deviceCount = rtlsdr_get_device_count();
-                if (deviceCount == 0) { return true; }
-                for (uint32_t i = 0; i < deviceCount; i++)
-                {
-                    rtlsdr_dev_t* dev = nullptr;
-                    if (rtlsdr_open(&dev, i) != 0) { continue; }
-                    if (MatchDeviceToClient_(guard, dev == nullptr)) { rtlsdr_close(dev); }
-                }
+            auto deviceCount = rtlsdr_get_device_count();
+            for (uint32_t i = 0; i < deviceCount; i++)
+            {
+                rtlsdr_dev_t* dev = nullptr;
+                if (rtlsdr_open(&dev, i) != 0) { continue; }
+                if (MatchDeviceToClient_(guard, dev) == nullptr) { rtlsdr_close(dev); }
+            }
 #endif
-                _deviceSearching = false;
+            _enumerated = {.epoch       = _deviceEpoch,
+                           .activeCount = static_cast<size_t>(
+                               std::ranges::count_if(_clients, [](auto* client) { return client->_mgrctx.dev != nullptr; })),
+                           .clientCount = _clients.size()};
+            _deviceSearching = false;
+            return false;
+        }
+
+#ifndef __ANDROID__
+        static int LIBUSB_CALL OnUsbHotplug_(libusb_context* /*ctx*/,
+                                             libusb_device* /*device*/,
+                                             libusb_hotplug_event /*event*/,
+                                             void* userData)
+        {
+            auto* mgr = static_cast<Manager*>(userData);
+            {
+                std::scoped_lock lockGuard(MgrMutex);
+                mgr->_deviceEpoch++;
+            }
+            mgr->_cvState.notify_all();
+            return 0;    // Stay registered
+        }
+
+        bool StartHotplugMonitor_()
+        {
+            if (libusb_init(&_usbContext) != LIBUSB_SUCCESS)
+            {
+                _usbContext = nullptr;
                 return false;
             }
+            if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG) == 0
+                || libusb_hotplug_register_callback(
+                       _usbContext,
+                       static_cast<libusb_hotplug_event>(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
+                       LIBUSB_HOTPLUG_NO_FLAGS,
+                       LIBUSB_HOTPLUG_MATCH_ANY,
+                       LIBUSB_HOTPLUG_MATCH_ANY,
+                       LIBUSB_HOTPLUG_MATCH_ANY,
+                       OnUsbHotplug_,
+                       this,
+                       &_hotplugHandle)
+                       != LIBUSB_SUCCESS)
+            {
+                libusb_exit(_usbContext);
+                _usbContext = nullptr;
+                return false;
+            }
+
+            _hotplugThread = std::thread([this]() {
+                SetThreadName("RTLSDR::Hotplug");
+                while (!_hotplugStopRequested)
+                {
+                    timeval tv{.tv_sec = 1, .tv_usec = 0};
+                    libusb_handle_events_timeout_completed(_usbContext, &tv, nullptr);
+                }
+            });
+            return true;
+        }
+
+        void StopHotplugMonitor_()
+        {
+            if (_usbContext == nullptr) { return; }
+            _hotplugStopRequested = true;
+            libusb_hotplug_deregister_callback(_usbContext, _hotplugHandle);
+            libusb_interrupt_event_handler(_usbContext);
+            if (_hotplugThread.joinable()) { _hotplugThread.join(); }
+            libusb_exit(_usbContext);
+            _usbContext = nullptr;
+        }
+
+        libusb_context*                _usbContext{nullptr};
+        libusb_hotplug_callback_handle _hotplugHandle{};
+        std::thread                    _hotplugThread;
+        std::atomic_bool               _hotplugStopRequested{false};
+#endif
+
+        static std::vector<int> TunerGains_(rtlsdr_dev_t* dev)
+        {
+            if (dev == nullptr) { return {}; }
+            auto count = rtlsdr_get_tuner_gains(dev, nullptr);
+            if (count <= 0) { return {}; }
+            std::vector<int> gains(static_cast<size_t>(count));
+            rtlsdr_get_tuner_gains(dev, gains.data());
+            return gains;
         }
 
         static void OpenDevice_(rtlsdr_dev_t* dev, RTLSDR::Config const& config)
         {
-            auto gain = config.gain;
+            auto gain = config.gain == UnsetGain ? MaxGain : config.gain;
             /* Set gain, frequency, sample rate, and reset the device. */
             rtlsdr_set_tuner_gain_mode(dev, (gain == AutoGain) ? 0 : 1);
             if (gain != AutoGain)
@@ -368,9 +582,8 @@ struct RTLSDR
                 if (gain == MaxGain)
                 {
                     /* Find the maximum gain available. */
-                    std::array<int, 100> gains;    // NOLINT
-                    auto                 numgains = rtlsdr_get_tuner_gains(dev, gains.data());
-                    gain                          = gains[static_cast<size_t>(numgains - 1)];    // NOLINT
+                    auto gains = TunerGains_(dev);
+                    if (!gains.empty()) { gain = gains.back(); }
                 }
 
                 rtlsdr_set_tuner_gain(dev, gain);
@@ -381,11 +594,23 @@ struct RTLSDR
             rtlsdr_set_center_freq(dev, config.frequency);
             rtlsdr_set_sample_rate(dev, config.sampleRate);
             rtlsdr_reset_buffer(dev);
-            //_currentGain = rtlsdr_get_tuner_gain(dev) / 10;
         }
 
+        struct EnumerationState
+        {
+            uint64_t epoch{std::numeric_limits<uint64_t>::max()};
+            size_t   activeCount{0};
+            size_t   clientCount{0};
+
+            bool operator==(EnumerationState const&) const = default;
+        };
+
         bool                        _stopRequested{false};
         bool                        _deviceSearching{false};
+        bool                        _hotplugSupported{false};
+        uint64_t                    _deviceEpoch{0};
+        EnumerationState            _enumerated{};
+        std::condition_variable     _cvState;
         std::future<void>           _deviceSearchThread;
         std::unordered_set<RTLSDR*> _clients;
     };
@@ -396,13 +621,23 @@ struct RTLSDR
     RTLSDR(IDeviceSelector const* const selector, uint32_t deviceIndex, Config const& config) :
         _selector(selector), _deviceIndex(deviceIndex), _config(config)
     {
+        if (_config.bufferLength == 0 || (_config.bufferLength % BufferAlignment) != 0)
+        {
+            throw std::invalid_argument("Buffer length must be a non zero multiple of 512");
+        }
+        if (_config.bufferCount < 2) { throw std::invalid_argument("At least 2 buffers required"); }
+        _cyclicBuffer.resize(_config.bufferCount);
+        for (auto& entry : _cyclicBuffer) { entry.data.resize(_config.bufferLength); }
+
         _testDataFile = std::filesystem::absolute(std::to_string(config.frequency) + ".test.dat");
 
+        // Replay needs no device, nor libusb and the hotplug thread the manager starts
         if (std::filesystem::exists(_testDataFile))
         {
             _useTestDataFile = true;
             return;
         }
+        _device_manager = Manager::GetInstance();
         if (_deviceIndex != InvalidDeviceIndex)
         {
             //_OpenDevice(_deviceIndex);
@@ -416,29 +651,16 @@ struct RTLSDR
 
     CLASS_DELETE_COPY_AND_MOVE(RTLSDR);
 
+    // Emulates the device with the capture in <frequency>.test.dat, paced as configured (Config::pacing)
     void TestDataReadLoop()
     {
-        std::vector<std::vector<uint8_t>> buffers;
-        buffers.reserve(BufferCount);
-        for (size_t i = 0; i < BufferCount; i++) { buffers.emplace_back(BufferLength); }
-        _testDataIFS = std::ifstream(_testDataFile.string(), std::ios::binary | std::ios::in);
-        if (!_testDataIFS.good()) { throw std::runtime_error("Cannot open test data file"); }
-        size_t bufferToUse = 0;
-        while (!_stopRequested)
-        {
-            _testDataIFS.read(reinterpret_cast<char*>(buffers[bufferToUse].data()),
-                              BufferLength);    // NOLINT
-            if (!_testDataIFS.good())
-            {
-                _testDataIFS.close();
-                _testDataIFS = std::ifstream(_testDataFile.string(), std::ios::binary | std::ios::in);
-                if (!_testDataIFS.good()) { throw std::runtime_error("Cannot open test data file"); }
-                continue;
-            }
-            OnDataAvailable(buffers[bufferToUse]);
-            bufferToUse = (bufferToUse + 1) % BufferCount;
-        }
-        _testDataIFS.close();
+        IQFileSource source(_testDataFile,
+                            IQFileSource::Config{.bufferLength = _config.bufferLength,
+                                                 .sampleRate   = _config.sampleRate,
+                                                 .pacing       = _config.pacing,
+                                                 .speed        = 1.0,
+                                                 .loop         = true});
+        source.Replay([this](std::span<uint8_t const> const& buffer) { OnDataAvailable(buffer); }, _stopRequested);
     }
 
     void Start(IDataHandler* handler)
@@ -478,7 +700,7 @@ struct RTLSDR
         auto started = _started.exchange(false);
         if (!started) { return; }
         _stopRequested = true;
-        _device_manager->Stop(this);
+        if (_device_manager != nullptr) { _device_manager->Stop(this); }
         _cvDataConsumed.notify_all();
         _cvDataAvailable.notify_all();
         // Joining can cause hangs on repeat start and stop if the data thread is waiting on mutex
@@ -486,37 +708,105 @@ struct RTLSDR
         // if (_consumerThrd.joinable()) _consumerThrd.join();
     }
 
-    bool HasSlot(std::unique_lock<std::mutex> const& /*lock*/) const { return ((_tail + 1) % BufferCount) != _head; }
+    bool HasSlot(std::unique_lock<std::mutex> const& /*lock*/) const { return ((_tail + 1) % _cyclicBuffer.size()) != _head; }
 
     bool IsEmpty(std::unique_lock<std::mutex> const& /*lock*/) const { return _head == _tail; }
 
+    // Tap every buffer handed to the data handler into rotating capture files. Replaces any running recording
+    void StartRecording(IQRecorder::Config config)
+    {
+        config.frequency    = _config.frequency;
+        config.sampleRate   = _config.sampleRate;
+        config.bufferLength = _config.bufferLength;
+        auto recorder       = std::make_unique<IQRecorder>(config);
+        {
+            std::scoped_lock lock(_recorderMutex);
+            recorder.swap(_recorder);
+        }
+        // The previous recording, if any, flushes here on the caller's thread
+    }
+
+    // Pending buffers are flushed before returning, on the caller's thread
+    void StopRecording()
+    {
+        std::unique_ptr<IQRecorder> recorder;
+        {
+            std::scoped_lock lock(_recorderMutex);
+            recorder.swap(_recorder);
+        }
+    }
+
+    [[nodiscard]] std::optional<IQRecorder::Stats> GetRecordingStats() const
+    {
+        std::scoped_lock lock(_recorderMutex);
+        if (_recorder == nullptr) { return std::nullopt; }
+        return _recorder->GetStats();
+    }
+
+    // Gain steps supported by the tuner in tenths of a dB, ascending. Empty until a device is open
+    [[nodiscard]] std::vector<int> GetTunerGains() const
+    {
+        return _device_manager != nullptr ? _device_manager->GetTunerGains(this) : std::vector<int>{};
+    }
+
+    // Switches to manual gain (tenths of a dB) on the running device and keeps it across reopens.
+    // Returns false if no device is open, the gain then applies to the next one
+    bool SetGain(int gain) { return _device_manager != nullptr && _device_manager->SetGain(this, gain); }
+
+    // Tenths of a dB as reported by the tuner, 0 until a device is open
+    [[nodiscard]] int GetGain() const { return _currentGain.load(std::memory_order_relaxed); }
+
+    // Arrival time of the buffer being handled. Only meaningful on the data handler thread, inside HandleData
+    [[nodiscard]] time_point CurrentBufferTime() const { return _bufferTime; }
+
+    // Time buffers spent queued in the ring
+    [[nodiscard]] LatencyHistogram::Snapshot GetQueueWaitLatency() const { return _queueWait.Take(); }
+
+    [[nodiscard]] OverflowStats GetOverflowStats() const
+    {
+        return {.overruns       = _overruns.load(std::memory_order_relaxed),
+                .droppedBuffers = _droppedBuffers.load(std::memory_order_relaxed),
+                .droppedSamples = _droppedBuffers.load(std::memory_order_relaxed) * (_config.bufferLength / 2)};
+    }
+
     void OnDataAvailable(std::span<uint8_t const> const& data)
     {
-        if (data.size() % BufferLength != 0) { throw std::runtime_error("Data size mismatch"); }
-        for (auto it = data.begin(); it != data.end(); it += BufferLength)
+        ADSB_TRACE_SCOPE("RTLSDR::OnDataAvailable");
+        auto bufferLength = static_cast<std::ptrdiff_t>(_config.bufferLength);
+        if (data.size() % _config.bufferLength != 0) { throw std::runtime_error("Data size mismatch"); }
+        for (auto it = data.begin(); it != data.end(); it += bufferLength)
         {
             std::unique_lock lock(_mutex);
             if (!HasSlot(lock))
             {
-                _cvDataConsumed.wait(lock, [&, this]() { return HasSlot(lock) || _stopRequested; });
-                if (_stopRequested) { return; }
+                _overruns.fetch_add(1, std::memory_order_relaxed);
+                if (_config.overflowPolicy == OverflowPolicy::DropNewest)
+                {
+                    _pendingDroppedBuffers++;
+                    _droppedBuffers.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                if (_config.overflowPolicy == OverflowPolicy::DropOldest) { DropOldest_(lock); }
+                else
+                {
+                    _cvDataConsumed.wait(lock, [&, this]() { return HasSlot(lock) || _stopRequested; });
+                    if (_stopRequested) { return; }
+                }
             }
-            auto& entry = _cyclicBuffer.at(_tail);
-            entry.time  = time_point::clock::now();
-            std::copy(it, it + BufferLength, entry.data.begin());
-            _tail = (_tail + 1) % BufferCount;
+            auto& entry          = _cyclicBuffer.at(_tail);
+            entry.time           = time_point::clock::now();
+            entry.droppedBuffers = std::exchange(_pendingDroppedBuffers, 0);
+            std::copy(it, it + bufferLength, entry.data.begin());
+            _tail = (_tail + 1) % _cyclicBuffer.size();
             _cvDataAvailable.notify_one();
         }
     }
 
-    auto& GetAtHead()
-    {
-        std::unique_lock lock(_mutex);
-        return _cyclicBuffer.at(_head);
-    }
-
     void ConsumerThreadLoop()
     {
+        // The head entry is swapped out under the lock so that the producer is free to
+        // recycle ring slots (DropOldest) while the handler is busy with this one
+        Entry working{.time = {}, .droppedBuffers = 0, .data = std::vector<uint8_t>(_config.bufferLength)};
         while (!_stopRequested)
         {
             {
@@ -526,15 +816,26 @@ struct RTLSDR
                     _cvDataAvailable.wait(lock, [&, this]() { return !IsEmpty(lock) || _stopRequested; });
                     continue;
                 }
+                std::swap(working, _cyclicBuffer.at(_head));
+                _head = (_head + 1) % _cyclicBuffer.size();
+                _cvDataConsumed.notify_one();
+            }
+            ADSB_TRACE_SCOPE("RTLSDR::ConsumerThreadLoop");
+            {
+                // Never blocks on I/O. Start and stop only hold the lock to swap the recorder
+                std::scoped_lock lock(_recorderMutex);
+                if (_recorder != nullptr) { _recorder->Record(working.data); }
             }
             if (_stopRequested) { break; }
-            _handler->HandleData(GetAtHead().data);
-
+            if constexpr (LatencyHistogram::Enabled) { _queueWait.Record(time_point::clock::now() - working.time); }
+            _bufferTime = working.time;
+            if (working.droppedBuffers > 0)
             {
-                std::unique_lock lock(_mutex);
-                _head = (_head + 1) % BufferCount;
-                _cvDataConsumed.notify_one();
+                _handler->OnDataGap({.time           = working.time,
+                                     .droppedBuffers = working.droppedBuffers,
+                                     .droppedSamples = working.droppedBuffers * (_config.bufferLength / 2)});
             }
+            _handler->HandleData(working.data);
         }
     }
 
@@ -546,6 +847,19 @@ struct RTLSDR
     }
 
     private:
+    // Ring is full. The gap left by the dropped entry is charged to whichever entry becomes the oldest
+    void DropOldest_(std::unique_lock<std::mutex> const& lock)
+    {
+        auto dropped = _cyclicBuffer.at(_head).droppedBuffers + 1;
+        _head        = (_head + 1) % _cyclicBuffer.size();
+        if (IsEmpty(lock)) { _pendingDroppedBuffers += dropped; }
+        else
+        {
+            _cyclicBuffer.at(_head).droppedBuffers += dropped;
+        }
+        _droppedBuffers.fetch_add(1, std::memory_order_relaxed);
+    }
+
     static void Callback_(uint8_t* buf, uint32_t len, void* ctx) noexcept
     {
         try
@@ -554,7 +868,7 @@ struct RTLSDR
         } catch (std::exception const& ex) { std::cerr << ex.what() << '\n'; }
     }
 
-    std::shared_ptr<Manager> _device_manager = Manager::GetInstance();
+    std::shared_ptr<Manager> _device_manager;    // None when replaying a test data file
     ManagerContext           _mgrctx;
 
     IDeviceSelector const* const _selector{};
@@ -563,26 +877,37 @@ struct RTLSDR
 
     struct Entry
     {
-        time_point                        time;
-        std::array<uint8_t, BufferLength> data{};
+        time_point           time;
+        uint64_t             droppedBuffers{};    // Dropped right before this entry
+        std::vector<uint8_t> data;
     };
 
-    std::array<Entry, BufferCount> _cyclicBuffer;
+    std::vector<Entry> _cyclicBuffer;
+
+    size_t   _head{0};
+    size_t   _tail{0};
+    uint64_t _pendingDroppedBuffers{0};    // Dropped since the last entry was queued
+
+    std::atomic<uint64_t> _overruns{0};
+    std::atomic<uint64_t> _droppedBuffers{0};
+    std::atomic<int>      _currentGain{0};
+
+    LatencyHistogram _queueWait;
+    time_point       _bufferTime{};    // Data handler thread only
 
-    size_t _head{0};
-    size_t _tail{0};
+    mutable std::mutex          _recorderMutex;    // Apart from _mutex, which the librtlsdr callback takes
+    std::unique_ptr<IQRecorder> _recorder;
 
     IDataHandler*           _handler{};
     std::thread             _producerThrd;
     std::thread             _consumerThrd;
-    std::mutex              _mutex;
+    mutable std::mutex      _mutex;
     std::condition_variable _cvDataAvailable;
     std::condition_variable _cvDataConsumed;
     std::atomic_bool        _stopRequested{false};
     std::atomic_bool        _started{false};
     int                     _fdAndroid{0};
 
-    std::ifstream         _testDataIFS;
     std::filesystem::path _testDataFile;
     bool                  _useTestDataFile = false;
 };
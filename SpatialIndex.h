@@ -0,0 +1,246 @@
+#pragma once
+#include "ADSBListener.h"
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <numbers>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+namespace ADSB
+{
+
+// Positions of the tracked aircraft in a uniform lat/lon grid, so that radius, bounding box and nearest
+// queries look at the cells around the point instead of every aircraft. Cells are hashed and only exist
+// while an aircraft is in them. Updated by the data handler thread when a position is decoded, queried
+// from any thread under a shared lock. Aircraft stay in the index after they leave coverage, queries
+// skip positions older than their since argument
+struct SpatialIndex
+{
+    using time_point = IAirCraft::time_point;
+
+    static constexpr double  EarthRadiusNm = 3440.065;
+    static constexpr int64_t Precision     = static_cast<int64_t>(IAirCraft::LatLonPrecision);
+
+    struct Hit
+    {
+        uint32_t addr{};
+        int32_t  lat1E7{};
+        int32_t    lon1E7{};
+        time_point seen{};          // When the position was decoded
+        double     distanceNm{};    // From the query point, 0 for bounding box queries
+    };
+
+    // cellDegrees divides 180. 0.5 is 30 NM of latitude, a few aircraft per cell around a busy hub
+    explicit SpatialIndex(double cellDegrees = 0.5) :
+        _cell(std::max<int64_t>(1, std::llround(cellDegrees * IAirCraft::LatLonPrecision))),
+        _latCells((180 * Precision + _cell - 1) / _cell + 1),
+        _lonCells((360 * Precision + _cell - 1) / _cell)
+    {}
+    ~SpatialIndex() = default;
+    CLASS_DELETE_COPY_AND_MOVE(SpatialIndex);
+
+    void Update(uint32_t addr, int32_t lat1E7, int32_t lon1E7, time_point seen)
+    {
+        auto             key = Key_(LatCell_(lat1E7), LonCell_(lon1E7));
+        std::unique_lock lock(_mutex);
+        auto [it, added] = _cellOf.try_emplace(addr, key);
+        if (!added && it->second != key)
+        {
+            auto cell = _cells.find(it->second);
+            std::erase_if(cell->second, [&](Hit const& h) { return h.addr == addr; });
+            if (cell->second.empty()) { _cells.erase(cell); }
+            it->second = key;
+            added      = true;
+        }
+        auto& entries = _cells[key];
+        if (added)
+        {
+            entries.push_back({.addr = addr, .lat1E7 = lat1E7, .lon1E7 = lon1E7, .seen = seen});
+            return;
+        }
+        auto entry    = std::ranges::find(entries, addr, &Hit::addr);
+        entry->lat1E7 = lat1E7;
+        entry->lon1E7 = lon1E7;
+        entry->seen   = seen;
+    }
+
+    // Returns false when the aircraft wasn't indexed
+    bool Remove(uint32_t addr)
+    {
+        std::unique_lock lock(_mutex);
+        auto             it = _cellOf.find(addr);
+        if (it == _cellOf.end()) { return false; }
+        auto cell = _cells.find(it->second);
+        std::erase_if(cell->second, [&](Hit const& h) { return h.addr == addr; });
+        if (cell->second.empty()) { _cells.erase(cell); }
+        _cellOf.erase(it);
+        return true;
+    }
+
+    [[nodiscard]] size_t Size() const
+    {
+        std::shared_lock lock(_mutex);
+        return _cellOf.size();
+    }
+
+    // Aircraft inside the box, in no particular order. Returns how many, hits is overwritten.
+    // Queries only return positions decoded at or after since
+    size_t Within(SubscriptionFilter::BoundingBox const& box, std::vector<Hit>& hits, time_point since = {}) const
+    {
+        hits.clear();
+        std::shared_lock lock(_mutex);
+        auto             inside = [&](Hit const& h) {
+            if (h.seen < since || h.lat1E7 < box.minLat1E7 || h.lat1E7 > box.maxLat1E7) { return false; }
+            return box.minLon1E7 <= box.maxLon1E7 ? (h.lon1E7 >= box.minLon1E7 && h.lon1E7 <= box.maxLon1E7)
+                                                  : (h.lon1E7 >= box.minLon1E7 || h.lon1E7 <= box.maxLon1E7);
+        };
+        VisitBox_(box, [&](std::vector<Hit> const& entries) { std::ranges::copy_if(entries, std::back_inserter(hits), inside); });
+        return hits.size();
+    }
+
+    // Aircraft within radiusNm (great circle) of the point, nearest first
+    size_t Around(double lat, double lon, double radiusNm, std::vector<Hit>& hits, time_point since = {}) const
+    {
+        hits.clear();
+        std::shared_lock lock(_mutex);
+        VisitBox_(SubscriptionFilter::BoundingBox::Around(lat, lon, radiusNm), [&](std::vector<Hit> const& entries) {
+            for (auto h : entries)
+            {
+                if (h.seen < since) { continue; }
+                h.distanceNm = DistanceNm(lat, lon, h.lat1E7, h.lon1E7);
+                if (h.distanceNm <= radiusNm) { hits.push_back(h); }
+            }
+        });
+        std::ranges::sort(hits, {}, &Hit::distanceNm);
+        return hits.size();
+    }
+
+    // The k aircraft nearest to the point, nearest first. Walks rings of cells outwards until no cell
+    // further out can be closer than the k-th found
+    size_t Nearest(double lat, double lon, size_t k, std::vector<Hit>& hits, time_point since = {}) const
+    {
+        hits.clear();
+        if (k == 0) { return 0; }
+        std::shared_lock lock(_mutex);
+        auto             latCell = LatCell_(ToE7_(lat));
+        auto             lonCell = LonCell_(ToE7_(lon));
+        size_t           visited = 0;
+        for (int64_t ring = 0; visited < _cellOf.size() && ring <= std::max(_latCells, _lonCells / 2); ring++)
+        {
+            // Anything in this ring is at least ring - 1 cells away in latitude or longitude
+            if (hits.size() >= k && hits[k - 1].distanceNm < MinRingDistanceNm_(lat, ring)) { break; }
+            VisitRing_(latCell, lonCell, ring, [&](std::vector<Hit> const& entries) {
+                visited += entries.size();
+                for (auto h : entries)
+                {
+                    if (h.seen < since) { continue; }
+                    h.distanceNm = DistanceNm(lat, lon, h.lat1E7, h.lon1E7);
+                    hits.insert(std::ranges::upper_bound(hits, h.distanceNm, {}, &Hit::distanceNm), h);
+                }
+                if (hits.size() > k) { hits.resize(k); }
+            });
+        }
+        return hits.size();
+    }
+
+    static double DistanceNm(double lat, double lon, int32_t lat1E7, int32_t lon1E7)
+    {
+        constexpr double Rad  = std::numbers::pi / 180;
+        auto             lat2 = lat1E7 / IAirCraft::LatLonPrecision;
+        auto             lon2 = lon1E7 / IAirCraft::LatLonPrecision;
+        auto             sLat = std::sin((lat2 - lat) * Rad / 2);
+        auto             sLon = std::sin((lon2 - lon) * Rad / 2);
+        auto             h    = (sLat * sLat) + (std::cos(lat * Rad) * std::cos(lat2 * Rad) * sLon * sLon);
+        return 2 * EarthRadiusNm * std::asin(std::min(1.0, std::sqrt(h)));
+    }
+
+    private:
+    static int32_t ToE7_(double degrees) { return static_cast<int32_t>(std::lround(degrees * IAirCraft::LatLonPrecision)); }
+
+    [[nodiscard]] int64_t LatCell_(int32_t lat1E7) const
+    {
+        return std::clamp<int64_t>((int64_t{lat1E7} + (90 * Precision)) / _cell, 0, _latCells - 1);
+    }
+    [[nodiscard]] int64_t LonCell_(int32_t lon1E7) const
+    {
+        return std::clamp<int64_t>((int64_t{lon1E7} + (180 * Precision)) / _cell, 0, _lonCells - 1);
+    }
+    [[nodiscard]] uint64_t Key_(int64_t latCell, int64_t lonCell) const { return static_cast<uint64_t>((latCell * _lonCells) + lonCell); }
+
+    // Lower bound of the great circle distance to anything ring cells away. Such a point is ring - 1 cells
+    // off in latitude or longitude, and the longitude side is the shorter one, the more so towards the poles
+    [[nodiscard]] double MinRingDistanceNm_(double lat, int64_t ring) const
+    {
+        constexpr double Rad     = std::numbers::pi / 180;
+        auto             cellDeg = static_cast<double>(_cell) / IAirCraft::LatLonPrecision;
+        auto             dLon    = std::min(180.0, static_cast<double>(ring - 1) * cellDeg);
+        auto             maxLat  = std::min(90.0, std::abs(lat) + (static_cast<double>(ring + 1) * cellDeg));
+        if (dLon <= 0) { return 0; }
+        return 2 * EarthRadiusNm * std::asin(std::cos(maxLat * Rad) * std::sin(dLon * Rad / 2));
+    }
+
+    template <typename TVisit> void Visit_(int64_t latCell, int64_t lonCell, TVisit&& visit) const
+    {
+        auto it = _cells.find(Key_(latCell, ((lonCell % _lonCells) + _lonCells) % _lonCells));
+        if (it != _cells.end()) { visit(it->second); }
+    }
+
+    template <typename TVisit> void VisitBox_(SubscriptionFilter::BoundingBox const& box, TVisit&& visit) const
+    {
+        auto lat0 = LatCell_(box.minLat1E7);
+        auto lat1 = LatCell_(box.maxLat1E7);
+        auto lon0 = LonCell_(box.minLon1E7);
+        auto lon1 = LonCell_(box.maxLon1E7);
+        if (lon1 < lon0 || (lon1 == lon0 && box.minLon1E7 > box.maxLon1E7)) { lon1 += _lonCells; }    // Antimeridian
+        lon1 = std::min(lon1, lon0 + _lonCells - 1);
+        // A box wider than the traffic in it is cheaper to answer from the occupied cells
+        if (static_cast<size_t>((lat1 - lat0 + 1) * (lon1 - lon0 + 1)) > _cells.size())
+        {
+            for (auto const& [key, entries] : _cells) { visit(entries); }
+            return;
+        }
+        for (auto la = lat0; la <= lat1; la++)
+        {
+            for (auto lo = lon0; lo <= lon1; lo++) { Visit_(la, lo, visit); }
+        }
+    }
+
+    // The cells ring cells away (Chebyshev, longitude wrapping around), each once
+    template <typename TVisit> void VisitRing_(int64_t latCell, int64_t lonCell, int64_t ring, TVisit&& visit) const
+    {
+        for (auto la = std::max<int64_t>(0, latCell - ring); la <= std::min(_latCells - 1, latCell + ring); la++)
+        {
+            if (la == latCell - ring || la == latCell + ring)
+            {
+                auto first = 2 * ring + 1 >= _lonCells ? lonCell : lonCell - ring;
+                auto last  = 2 * ring + 1 >= _lonCells ? lonCell + _lonCells - 1 : lonCell + ring;
+                for (auto lo = first; lo <= last; lo++) { Visit_(la, lo, visit); }
+            }
+            else if (2 * ring <= _lonCells)    // Further round, the sides are nearer on the other way
+            {
+                Visit_(la, lonCell + ring, visit);
+                if (2 * ring < _lonCells && ring > 0) { Visit_(la, lonCell - ring, visit); }
+            }
+        }
+    }
+
+    int64_t _cell;        // 1E7 degrees
+    int64_t _latCells;    // Both poles included
+    int64_t _lonCells;
+
+    mutable std::shared_mutex                      _mutex;
+    std::unordered_map<uint64_t, std::vector<Hit>> _cells;
+    std::unordered_map<uint32_t, uint64_t>         _cellOf;    // Address to its cell
+};
+
+}    // namespace ADSB
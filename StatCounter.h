@@ -0,0 +1,36 @@
+#pragma once
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <atomic>
+#include <cstdint>
+SUPPRESS_WARNINGS_END
+
+// Counter written by a single thread (the data handler) and read from any.
+// A relaxed load and store instead of fetch_add keeps locked instructions out of the demodulator loops,
+// readers see a value that is at most a few increments stale
+struct StatCounter
+{
+    StatCounter() = default;
+    CLASS_DELETE_COPY_AND_MOVE(StatCounter);
+
+    StatCounter& operator++()
+    {
+        Add_(1);
+        return *this;
+    }
+    void         operator++(int) { Add_(1); }
+    StatCounter& operator+=(uint64_t n)
+    {
+        Add_(n);
+        return *this;
+    }
+
+    [[nodiscard]] uint64_t Load() const { return _value.load(std::memory_order_relaxed); }
+
+    private:
+    void Add_(uint64_t n) { _value.store(_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+    std::atomic<uint64_t> _value{0};
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <numbers>
+#include <random>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+// Building blocks of the synthetic signal generators (ModeSGenerator.h, UATGenerator.h)
+
+// Random source of the generators. The <random> distributions are implementation defined, these only
+// depend on mt19937 (which is fully specified) so a seed produces the same capture on every platform
+struct SyntheticRandom
+{
+    explicit SyntheticRandom(uint32_t seed) : _rng(seed) {}
+
+    uint32_t Next() { return static_cast<uint32_t>(_rng()); }
+
+    // [0, 1)
+    double Uniform() { return static_cast<double>(Next()) * (1.0 / 4294967296.0); }
+    double Uniform(double lo, double hi) { return lo + ((hi - lo) * Uniform()); }
+    uint32_t Below(uint32_t n) { return static_cast<uint32_t>(Uniform() * n); }
+    bool     Chance(double p) { return Uniform() < p; }
+    double   Exponential(double mean) { return -mean * std::log1p(-Uniform()); }
+
+    // Standard normal (Box-Muller, the second value of each pair is kept for the next call)
+    double Gaussian()
+    {
+        if (_hasSpare)
+        {
+            _hasSpare = false;
+            return _spare;
+        }
+        auto radius = std::sqrt(-2.0 * std::log1p(-Uniform()));
+        auto angle  = 2 * std::numbers::pi * Uniform();
+        _spare      = radius * std::sin(angle);
+        _hasSpare   = true;
+        return radius * std::cos(angle);
+    }
+
+    private:
+    std::mt19937 _rng;
+    double       _spare{};
+    bool         _hasSpare{false};
+};
+
+// Complex baseband in ADC units around the 127.5 midpoint. Signals are summed into it, then noise is
+// added and the block is quantized to interleaved unsigned 8 bit I/Q like an RTL-SDR produces
+struct SyntheticIQBlock
+{
+    using sample = std::complex<float>;
+
+    void Reset(size_t samples) { _samples.assign(samples, sample{}); }
+
+    [[nodiscard]] size_t Size() const { return _samples.size(); }
+    sample&              operator[](size_t index) { return _samples[index]; }
+
+    void AddNoise(SyntheticRandom& random, double sigma)
+    {
+        if (sigma <= 0) { return; }
+        for (auto& s : _samples)
+        {
+            auto i = static_cast<float>(random.Gaussian() * sigma);
+            auto q = static_cast<float>(random.Gaussian() * sigma);
+            s += sample{i, q};
+        }
+    }
+
+    // Appends 2 bytes per sample, values beyond the rails clip like the real ADC
+    void Quantize(std::vector<uint8_t>& out) const
+    {
+        out.reserve(out.size() + (_samples.size() * 2));
+        for (auto const& s : _samples)
+        {
+            out.push_back(ToAdc_(s.real()));
+            out.push_back(ToAdc_(s.imag()));
+        }
+    }
+
+    private:
+    static uint8_t ToAdc_(float value) { return static_cast<uint8_t>(std::clamp(std::lround(127.5f + value), 0l, 255l)); }
+
+    std::vector<sample> _samples;
+};
@@ -0,0 +1,223 @@
+#pragma once
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+SUPPRESS_WARNINGS_END
+
+// Set to 0 (cmake -Dlibadsb_TRACING=OFF) to compile the trace scopes out
+#ifndef ADSB_TRACING
+#define ADSB_TRACING 1
+#endif
+
+// Timeline of the decode pipeline in Chrome trace event format (chrome://tracing, ui.perfetto.dev).
+//
+// Every thread that records gets its own ring of events, written only by that thread, so recording
+// is a clock read and three relaxed stores. When a ring wraps the oldest events are overwritten.
+// Recording is off until Start() and costs one relaxed load per scope while off.
+// Names must be string literals (or otherwise outlive the trace).
+//
+//  TraceEvents::Start();
+//  ... reproduce the stall ...
+//  TraceEvents::Stop();
+//  std::ofstream out("adsb.trace.json");
+//  TraceEvents::WriteChromeJson(out);
+struct TraceEvents
+{
+    static constexpr bool   Enabled                = ADSB_TRACING != 0;
+    static constexpr size_t DefaultEventsPerThread = size_t{1} << 16;
+
+    // Clears previous events and drops the rings of threads that have exited. Threads that record for the
+    // first time afterwards get rings of eventsPerThread
+    static void Start(size_t eventsPerThread = DefaultEventsPerThread)
+    {
+        auto& state = State_();
+        {
+            std::scoped_lock lock(state.mutex);
+            state.eventsPerThread = eventsPerThread;
+            std::erase_if(state.rings, [](auto const& ring) { return ring->exited.load(std::memory_order_relaxed); });
+            for (auto const& ring : state.rings) { ring->head.store(0, std::memory_order_relaxed); }
+        }
+        state.epoch.store(clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        state.recording.store(true, std::memory_order_release);
+    }
+
+    static void Stop() { State_().recording.store(false, std::memory_order_release); }
+
+    [[nodiscard]] static bool IsRecording() { return State_().recording.load(std::memory_order_relaxed); }
+
+    // Complete ("X") events of every thread plus thread name metadata. Best called after Stop(),
+    // scopes still open on other threads are not included
+    static void WriteChromeJson(std::ostream& out)
+    {
+        auto&            state = State_();
+        std::scoped_lock lock(state.mutex);
+        out << R"({"displayTimeUnit":"ns","traceEvents":[)";
+        bool first = true;
+        auto comma = [&]() {
+            if (!first) { out << ",\n"; }
+            first = false;
+        };
+        for (auto const& ring : state.rings)
+        {
+            comma();
+            out << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << ring->tid << R"(,"args":{"name":")" << ring->name << R"("}})";
+            auto head  = ring->head.load(std::memory_order_acquire);
+            auto count = std::min<uint64_t>(head, ring->events.size());
+            for (auto i = head - count; i < head; i++)
+            {
+                auto const& event = ring->events[i % ring->events.size()];
+                auto const* name  = event.name.load(std::memory_order_relaxed);
+                auto        begin = event.beginNs.load(std::memory_order_relaxed);
+                auto        end   = event.endNs.load(std::memory_order_relaxed);
+                if (name == nullptr || end < begin) { continue; }
+                comma();
+                out << R"({"name":")" << name << R"(","ph":"X","pid":1,"tid":)" << ring->tid << R"(,"ts":)" << Micros_(begin)
+                    << R"(,"dur":)" << Micros_(end - begin) << '}';
+            }
+        }
+        out << "]}\n";
+    }
+
+    // Records the lifetime of the scope as one complete event on the calling thread
+    struct Scope
+    {
+        explicit Scope(char const* name) : _name(IsRecording() ? name : nullptr)
+        {
+            if (_name != nullptr) { _begin = Now_(); }
+        }
+        ~Scope()
+        {
+            if (_name != nullptr) { Record_(_name, _begin, Now_()); }
+        }
+        CLASS_DELETE_COPY_AND_MOVE(Scope);
+
+        private:
+        char const* _name;
+        uint64_t    _begin{};
+    };
+
+    private:
+    using clock = std::chrono::steady_clock;
+
+    struct Event
+    {
+        std::atomic<char const*> name{nullptr};
+        std::atomic<uint64_t>    beginNs{0};
+        std::atomic<uint64_t>    endNs{0};
+    };
+
+    struct Ring
+    {
+        explicit Ring(size_t capacity) : events(capacity) {}
+
+        std::vector<Event>    events;
+        std::atomic<uint64_t> head{0};    // Events ever written, the writer is the owning thread
+        std::atomic<bool>     exited{false};
+        uint64_t              tid{};
+        std::string           name;
+    };
+
+    struct GlobalState
+    {
+        std::mutex                         mutex;
+        std::vector<std::shared_ptr<Ring>> rings;    // Kept after their threads exit, until the next Start
+        size_t                             eventsPerThread{DefaultEventsPerThread};
+        uint64_t                           threads{};    // Ever recorded, for thread ids
+        std::atomic<bool>                  recording{false};
+        std::atomic<clock::rep>            epoch{0};
+    };
+
+    static GlobalState& State_()
+    {
+        SUPPRESS_WARNINGS_START
+        SUPPRESS_CLANG_WARNING("-Wexit-time-destructors")
+        static GlobalState state;
+        SUPPRESS_WARNINGS_END
+        return state;
+    }
+
+    static uint64_t Now_()
+    {
+        auto elapsed = clock::now().time_since_epoch().count() - State_().epoch.load(std::memory_order_relaxed);
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::duration{elapsed}).count());
+    }
+
+    static double Micros_(uint64_t ns) { return static_cast<double>(ns) / 1000.0; }
+
+    // Marks the ring of the thread as exited when the thread ends, the trace keeps the events
+    struct ThreadRing
+    {
+        ThreadRing() = default;
+        ~ThreadRing()
+        {
+            if (ring != nullptr) { ring->exited.store(true, std::memory_order_relaxed); }
+        }
+        CLASS_DELETE_COPY_AND_MOVE(ThreadRing);
+
+        std::shared_ptr<Ring> ring;
+    };
+
+    static Ring& ThisThreadRing_()
+    {
+        SUPPRESS_WARNINGS_START
+        SUPPRESS_CLANG_WARNING("-Wexit-time-destructors")
+        static thread_local ThreadRing owner;
+        SUPPRESS_WARNINGS_END
+        auto& ring = owner.ring;
+        if (ring == nullptr)
+        {
+            auto&            state = State_();
+            std::scoped_lock lock(state.mutex);
+            ring       = std::make_shared<Ring>(std::max<size_t>(state.eventsPerThread, 1));
+            ring->tid  = ++state.threads;
+            ring->name = ThreadName_(ring->tid);
+            state.rings.push_back(ring);
+        }
+        return *ring;
+    }
+
+    // Threads name themselves with SetThreadName before they record anything
+    static std::string ThreadName_(uint64_t tid)
+    {
+#if defined(__linux__) || defined(__APPLE__)
+        std::array<char, 64> name{};
+        if (pthread_getname_np(pthread_self(), name.data(), name.size()) == 0 && name[0] != '\0') { return name.data(); }
+#endif
+        return "Thread " + std::to_string(tid);
+    }
+
+    static void Record_(char const* name, uint64_t begin, uint64_t end)
+    {
+        auto& ring  = ThisThreadRing_();
+        auto  head  = ring.head.load(std::memory_order_relaxed);
+        auto& event = ring.events[head % ring.events.size()];
+        event.name.store(name, std::memory_order_relaxed);
+        event.beginNs.store(begin, std::memory_order_relaxed);
+        event.endNs.store(end, std::memory_order_relaxed);
+        ring.head.store(head + 1, std::memory_order_release);
+    }
+};
+
+#define ADSB_TRACE_CONCAT_(a, b) a##b
+#define ADSB_TRACE_NAME_(line)   ADSB_TRACE_CONCAT_(adsbTraceScope, line)
+#if ADSB_TRACING
+#define ADSB_TRACE_SCOPE(name) TraceEvents::Scope ADSB_TRACE_NAME_(__LINE__)(name)
+#else
+#define ADSB_TRACE_SCOPE(name) (void)0
+#endif
@@ -0,0 +1,199 @@
+#pragma once
+#include "ADSBListener.h"
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+namespace ADSB
+{
+
+// Recent positions of each tracked aircraft, for trails and track smoothing without a copy per update.
+//
+// Each aircraft owns a ring of blocks in one arena shared by all aircraft. A block is its used byte count,
+// one sample in full and the samples after it as zigzag varint deltas of time (ms), latitude, longitude
+// (1E7 degrees) and altitude (feet), typically 8-10 bytes a sample instead of 20. When the ring is full
+// its oldest block is reused, so memory per aircraft is fixed and a trail always starts on a full sample.
+// Off until Configure. Written by the data handler thread when a position is decoded, read from any
+// thread under a shared lock
+struct TrackHistory
+{
+    using time_point = IAirCraft::time_point;
+
+    static constexpr size_t BlockBytes = 128;
+
+    struct Sample
+    {
+        time_point time{};    // Millisecond precision
+        int32_t    lat1E7{};
+        int32_t    lon1E7{};
+        int32_t    altitude{};
+    };
+
+    TrackHistory()  = default;
+    ~TrackHistory() = default;
+    CLASS_DELETE_COPY_AND_MOVE(TrackHistory);
+
+    // Keeps bytesPerAircraft for each aircraft, rounded up to at least two blocks, 0 turns recording off.
+    // Drops what was recorded. Callable from any thread
+    void Configure(size_t bytesPerAircraft)
+    {
+        std::unique_lock lock(_mutex);
+        _ringBlocks = bytesPerAircraft == 0 ? 0 : std::max<size_t>(2, (bytesPerAircraft + BlockBytes - 1) / BlockBytes);
+        _arena.clear();
+        _tracks.clear();
+    }
+
+    void Record(uint32_t addr, Sample const& sample)
+    {
+        std::unique_lock lock(_mutex);
+        if (_ringBlocks == 0) { return; }
+        auto [it, added] = _tracks.try_emplace(addr);
+        auto& track      = it->second;
+        if (added)
+        {
+            track.first = _arena.size() / BlockBytes;
+            _arena.resize(_arena.size() + (_ringBlocks * BlockBytes));
+        }
+
+        uint8_t delta[MaxDeltaBytes];
+        size_t  size = 0;
+        if (track.blocks > 0)
+        {
+            size = PutVarint_(delta, size, Millis_(sample.time) - Millis_(track.last.time));
+            size = PutVarint_(delta, size, int64_t{sample.lat1E7} - track.last.lat1E7);
+            size = PutVarint_(delta, size, int64_t{sample.lon1E7} - track.last.lon1E7);
+            size = PutVarint_(delta, size, int64_t{sample.altitude} - track.last.altitude);
+        }
+        track.last = sample;
+
+        if (track.blocks > 0)
+        {
+            auto* block = Block_(track, track.blocks - 1);
+            if (block[0] + size <= BlockBytes)
+            {
+                std::memcpy(block + block[0], delta, size);
+                block[0] = static_cast<uint8_t>(block[0] + size);
+                return;
+            }
+        }
+        if (track.blocks < _ringBlocks) { track.blocks++; }
+        else { track.head = (track.head + 1) % _ringBlocks; }
+        auto* block  = Block_(track, track.blocks - 1);
+        auto  millis = Millis_(sample.time);
+        block[0]     = HeaderBytes;
+        std::memcpy(block + 1, &millis, sizeof(millis));
+        std::memcpy(block + 9, &sample.lat1E7, sizeof(int32_t));
+        std::memcpy(block + 13, &sample.lon1E7, sizeof(int32_t));
+        std::memcpy(block + 17, &sample.altitude, sizeof(int32_t));
+    }
+
+    // Recording, callable from any thread
+    [[nodiscard]] bool Enabled() const
+    {
+        std::shared_lock lock(_mutex);
+        return _ringBlocks != 0;
+    }
+
+    // Aircraft with a history
+    [[nodiscard]] size_t Size() const
+    {
+        std::shared_lock lock(_mutex);
+        return _tracks.size();
+    }
+
+    // Calls visit(Sample const&) for each sample of the aircraft, oldest first, decoded straight from the
+    // arena. Returns how many. visit runs under the lock and must not call back into the provider
+    template <typename TVisit> size_t Visit(uint32_t addr, TVisit&& visit) const
+    {
+        std::shared_lock lock(_mutex);
+        auto             it = _tracks.find(addr);
+        if (it == _tracks.end()) { return 0; }
+        size_t count = 0;
+        for (size_t b = 0; b < it->second.blocks; b++)
+        {
+            auto const* block  = Block_(it->second, b);
+            int64_t     millis = 0;
+            Sample      sample{};
+            std::memcpy(&millis, block + 1, sizeof(millis));
+            std::memcpy(&sample.lat1E7, block + 9, sizeof(int32_t));
+            std::memcpy(&sample.lon1E7, block + 13, sizeof(int32_t));
+            std::memcpy(&sample.altitude, block + 17, sizeof(int32_t));
+            for (size_t at = HeaderBytes;;)
+            {
+                sample.time = time_point{std::chrono::duration_cast<time_point::duration>(std::chrono::milliseconds{millis})};
+                visit(static_cast<Sample const&>(sample));
+                count++;
+                if (at >= block[0]) { break; }
+                millis          += GetVarint_(block, at);
+                sample.lat1E7   = static_cast<int32_t>(sample.lat1E7 + GetVarint_(block, at));
+                sample.lon1E7   = static_cast<int32_t>(sample.lon1E7 + GetVarint_(block, at));
+                sample.altitude = static_cast<int32_t>(sample.altitude + GetVarint_(block, at));
+            }
+        }
+        return count;
+    }
+
+    private:
+    static constexpr size_t HeaderBytes   = 21;        // Used count, time, latitude, longitude, altitude
+    static constexpr size_t MaxDeltaBytes = 4 * 10;    // Four 64 bit varints
+
+    struct Track
+    {
+        size_t first{};     // Arena block of the ring
+        size_t head{};      // Ring index of the oldest block
+        size_t blocks{};    // In use, the newest is being appended to
+        Sample last{};      // The deltas are from it
+    };
+
+    static int64_t Millis_(time_point time)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+    }
+
+    static size_t PutVarint_(uint8_t* out, size_t at, int64_t value)
+    {
+        auto zigzag = (static_cast<uint64_t>(value) << 1u) ^ static_cast<uint64_t>(value >> 63);
+        for (; zigzag >= 0x80; zigzag >>= 7u) { out[at++] = static_cast<uint8_t>(zigzag | 0x80u); }
+        out[at++] = static_cast<uint8_t>(zigzag);
+        return at;
+    }
+
+    static int64_t GetVarint_(uint8_t const* in, size_t& at)
+    {
+        uint64_t zigzag = 0;
+        for (unsigned shift = 0;; shift += 7)
+        {
+            auto byte  = in[at++];
+            zigzag    |= uint64_t{byte & 0x7fu} << shift;
+            if ((byte & 0x80u) == 0) { break; }
+        }
+        return static_cast<int64_t>((zigzag >> 1u) ^ (0 - (zigzag & 1u)));
+    }
+
+    [[nodiscard]] uint8_t* Block_(Track const& track, size_t index)
+    {
+        return _arena.data() + ((track.first + ((track.head + index) % _ringBlocks)) * BlockBytes);
+    }
+    [[nodiscard]] uint8_t const* Block_(Track const& track, size_t index) const
+    {
+        return _arena.data() + ((track.first + ((track.head + index) % _ringBlocks)) * BlockBytes);
+    }
+
+    mutable std::shared_mutex           _mutex;
+    size_t                              _ringBlocks{};    // Per aircraft, 0 when off
+    std::vector<uint8_t>                _arena;
+    std::unordered_map<uint32_t, Track> _tracks;
+};
+
+}    // namespace ADSB
@@ -1,13 +1,19 @@
 #include "ADSB.h"
+#include "MessageBatch.h"
+#include "StatCounter.h"
+#include "TraceEvents.h"
+#include "UATUplink.h"
 
 #include <algorithm>
 #include <cmath>
 #include <cstring>
+#include <utility>
 
 // NOLINTBEGIN
 
 extern "C" void init_fec();
 extern "C" int  process_buffer(uint16_t const*, int len, uint64_t c);
+extern "C" void dump_raw_message(char updown, uint8_t* data, int len, int rsErrors);
 
 ADSB::TrafficManager** ADSB::GetThreadLocalTrafficManager()
 {
@@ -18,18 +24,45 @@ ADSB::TrafficManager** ADSB::GetThreadLocalTrafficManager()
     return &TrafficManager;
 }
 
-struct UAT978Handler : RTLSDR::IDataHandler, ADSB::IDataProvider
+ADSB::IUATFrameSink** ADSB::GetThreadLocalUATFrameSink()
+{
+    SUPPRESS_WARNINGS_START
+    SUPPRESS_CLANG_WARNING("-Wunique-object-duplication")
+    static thread_local IUATFrameSink* FrameSink;
+    SUPPRESS_WARNINGS_END
+    return &FrameSink;
+}
+
+struct UAT978Handler : RTLSDR::IDataHandler, ADSB::IDataProvider, ADSB::IUATFrameSink, ADSB::IFrameTracker
 {
     friend void DumpRawMessage(char /*updown*/, uint8_t* data, int /*len*/, int /*rs_errors*/);
 
+    static constexpr int      DefaultGain         = 48;
+    static constexpr uint32_t DefaultFrequency    = 978000000;
+    static constexpr uint32_t DefaultSampleRate   = 2083334;
+    static constexpr size_t   MinimumBufferLength = size_t{256u} * 256u;    // Samples
+
+    static RTLSDR::Config DeviceConfig(ADSB::HandlerConfig const& config)
+    {
+        auto device = config.device;
+        if (device.gain == RTLSDR::UnsetGain) { device.gain = DefaultGain; }
+        if (device.frequency == RTLSDR::CenterFrequency) { device.frequency = DefaultFrequency; }
+        if (device.sampleRate == RTLSDR::SampleRate) { device.sampleRate = DefaultSampleRate; }
+        return device;
+    }
+
     UAT978Handler(std::shared_ptr<ADSB::TrafficManager> trafficManagerIn,
                   RTLSDR::IDeviceSelector const*        selectorIn,
-                  ADSB::Source                          sourceIdIn) :
+                  ADSB::Source                          sourceIdIn,
+                  ADSB::HandlerConfig const&            config) :
         trafficManager(std::move(std::move(trafficManagerIn))),
-        listener978{selectorIn, RTLSDR::Config{.gain = 48, .frequency = 978000000, .sampleRate = 2083334}},
-        sourceId(sourceIdIn)
+        listener978{selectorIn, DeviceConfig(config)},
+        buffer(std::max(config.device.bufferLength / 2, MinimumBufferLength), uint16_t{0u}),
+        sourceId(sourceIdIn),
+        sampleRate(DeviceConfig(config).sampleRate),
+        frameTap(config.frameTap),
+        messages(sourceIdIn)
     {
-        std::ranges::fill(buffer, uint16_t{0u});
         std::ranges::fill(iqphase, uint16_t{0u});
         InitATan2Table();
         init_fec();
@@ -42,28 +75,54 @@ struct UAT978Handler : RTLSDR::IDataHandler, ADSB::IDataProvider
     // Inherited via IDataHandler
     void HandleData(std::span<uint8_t const> const& dataBytes) override
     {
+        ADSB_TRACE_SCOPE("UAT978::HandleData");
         std::span<uint16_t const> data(reinterpret_cast<uint16_t const*>(dataBytes.data()), dataBytes.size() / 2);    // NOLINT
         *ADSB::GetThreadLocalTrafficManager() = this->trafficManager.get();
+        *ADSB::GetThreadLocalUATFrameSink()   = this;
+        statBuffers++;
+        statSamples += data.size();
+        trafficManager->bufferTime = listener978.CurrentBufferTime();
+        UpdateTracking();
 
         size_t j = 0;
         size_t i = used;
         while (j < data.size())
         {
-            for (i = used; i < std::size(buffer) && j < data.size(); i++, j++) { buffer[i] = iqphase[data[j]]; }
+            {
+                LatencyTimer timer(Latency(ADSB::LatencyStage::Magnitude));
+                for (i = used; i < std::size(buffer) && j < data.size(); i++, j++) { buffer[i] = iqphase[data[j]]; }
+            }
 
-            int bufferProcessed = process_buffer(buffer.data(), static_cast<int>(i), offset);
-            offset              = static_cast<uint64_t>(static_cast<int64_t>(offset) + bufferProcessed);
+            LatencyTimer timer(Latency(ADSB::LatencyStage::PreambleScan));
+            int          bufferProcessed = 0;
+            {
+                ADSB_TRACE_SCOPE("UAT978::process_buffer");
+                bufferProcessed = process_buffer(buffer.data(), static_cast<int>(i), offset);
+            }
+            timer.Exclude(std::exchange(trafficManager->dispatchTime, {}));
+            timer.Stop();
+            offset = static_cast<uint64_t>(static_cast<int64_t>(offset) + bufferProcessed);
+            used   = static_cast<size_t>(static_cast<int>(i) - bufferProcessed);
             // Move the rest of the buffer to the start
-            std::memmove(buffer.data(), buffer.data() + bufferProcessed, static_cast<size_t>(static_cast<int>(i) - bufferProcessed));
-            used = static_cast<size_t>(static_cast<int>(i) - bufferProcessed);
+            std::memmove(buffer.data(), buffer.data() + bufferProcessed, used * sizeof(uint16_t));
         }
+        messages.Flush();
+        trafficManager->Flush();
     }
 
-    void OnDeviceStatusChanged(bool available) override { listener->OnDeviceStatusChanged(sourceId, available); }
+    void OnDeviceStatusChanged(bool available) override { trafficManager->NotifyDeviceStatus(sourceId, available); }
+
+    void OnDataGap(RTLSDR::DataGap const& gap) override
+    {
+        // Discard the partial frame and keep the sample clock in step with the device
+        offset += used + gap.droppedSamples;
+        used   = 0;
+        trafficManager->NotifyDataLost(sourceId, gap.droppedSamples);
+    }
 
     void Start(ADSB::IListener& listenerIn) override
     {
-        listener = &listenerIn;
+        trafficManager->SetListener(&listenerIn);
         listener978.Start(this);
     }
     void Stop() override
@@ -71,7 +130,114 @@ struct UAT978Handler : RTLSDR::IDataHandler, ADSB::IDataProvider
         listener978.Stop();
     }
 
-    void NotifySelfLocation(ADSB::IAirCraft const& /*unused*/) override {}
+    void NotifySelfLocation(ADSB::IAirCraft const& ownship) override { trafficManager->proximity.SetOwnship(ownship); }
+    void SetProximity(ADSB::ProximityConfig const& config) override { trafficManager->proximity.SetConfig(config); }
+
+    void SetFilter(ADSB::SubscriptionFilter const& filter) override { trafficManager->SetFilter(filter); }
+    void AddListener(ADSB::IListener& listenerIn, ADSB::ListenerOptions const& options) override
+    {
+        trafficManager->AddListener(listenerIn, options);
+    }
+    void RemoveListener(ADSB::IListener& listenerIn) override { trafficManager->RemoveListener(listenerIn); }
+    [[nodiscard]] ADSB::SpatialIndex const& Positions() const override { return trafficManager->positions; }
+    void SetTrackHistory(size_t bytesPerAircraft) override { trafficManager->history.Configure(bytesPerAircraft); }
+    [[nodiscard]] ADSB::TrackHistory const& History() const override { return trafficManager->history; }
+    std::unique_ptr<ADSB::UpdateStream> OpenStream(ADSB::StreamOptions const& options) override
+    {
+        return std::make_unique<ADSB::UpdateStream>(trafficManager, options);
+    }
+
+    void SubscribeFISB(uint16_t productId, ADSB::FISB::IProductListener& listenerIn) override { uplink.Subscribe(productId, listenerIn); }
+    void UnsubscribeFISB(ADSB::FISB::IProductListener& listenerIn) override { uplink.Unsubscribe(listenerIn); }
+
+    void SubscribeMessages(ADSB::IMessageListener& listenerIn, bool trackAircraft) override
+    {
+        messages.Subscribe(listenerIn, trackAircraft, trafficManager->HasConsumers());
+    }
+    void UnsubscribeMessages(ADSB::IMessageListener& listenerIn) override { messages.Unsubscribe(listenerIn); }
+
+    [[nodiscard]] ADSB::DataProviderStats GetStats() const override
+    {
+        auto                    overflow = listener978.GetOverflowStats();
+        ADSB::DataProviderStats stats{.time             = ADSB::DataProviderStats::clock::now(),
+                                      .buffers          = statBuffers.Load(),
+                                      .samples          = statSamples.Load(),
+                                      .overruns         = overflow.overruns,
+                                      .droppedSamples   = overflow.droppedSamples,
+                                      .gain             = listener978.GetGain(),
+                                      .goodCrc          = statDownlinkFrames.Load() + statUplinkFrames.Load(),
+                                      .fixed            = statFixed.Load(),
+                                      .downlinkFrames   = statDownlinkFrames.Load(),
+                                      .uplinkFrames     = statUplinkFrames.Load(),
+                                      .coalescedUpdates = trafficManager->statCoalesced.Load()};
+        for (auto stage : {ADSB::LatencyStage::Magnitude, ADSB::LatencyStage::PreambleScan})
+        {
+            stats.latency.at(static_cast<size_t>(stage)) = latency.at(static_cast<size_t>(stage)).Take();
+        }
+        stats.latency.at(static_cast<size_t>(ADSB::LatencyStage::QueueWait)) = listener978.GetQueueWaitLatency();
+        stats.latency.at(static_cast<size_t>(ADSB::LatencyStage::Dispatch))  = trafficManager->dispatchLatency.Take();
+        stats.latency.at(static_cast<size_t>(ADSB::LatencyStage::EndToEnd))  = trafficManager->endToEndLatency.Take();
+        return stats;
+    }
+
+    LatencyHistogram& Latency(ADSB::LatencyStage stage) { return latency.at(static_cast<size_t>(stage)); }
+
+    // Inherited via IUATFrameSink. dump978 doesn't say where in the buffer a frame was, the start of the
+    // buffer being processed is the closest sample we know
+    void OnUplinkFrame(std::span<uint8_t const> const& frame, int rsErrors) override
+    {
+        statUplinkFrames++;
+        if (rsErrors > 0) { statFixed++; }
+        if (frameTap != nullptr)
+        {
+            frameTap->OnFrame({.sample = offset, .bytes = frame, .corrected = rsErrors, .uplink = true});
+            return;
+        }
+        uplink.HandleFrame(frame, rsErrors);
+    }
+    bool OnDownlinkFrame(std::span<uint8_t const> const& frame, int rsErrors) override
+    {
+        statDownlinkFrames++;
+        if (rsErrors > 0) { statFixed++; }
+        auto addr = (uint32_t{frame[1]} << 16) | (uint32_t{frame[2]} << 8) | uint32_t{frame[3]};
+        if (frameTap == nullptr)
+        {
+            if (messages.Wanted())
+            {
+                ADSB::UATMessage message{.length   = static_cast<uint8_t>(std::min(frame.size(), ADSB::UATMessage::LongBytes)),
+                                         .rsErrors = static_cast<uint8_t>(std::max(rsErrors, 0)),
+                                         .addr     = addr,
+                                         .sample   = offset,
+                                         .time     = trafficManager->bufferTime};
+                std::copy_n(frame.begin(), message.length, message.msg.begin());
+                messages.Add(message);
+            }
+            return trackAircraft;
+        }
+        frameTap->OnFrame({.sample = offset, .bytes = frame, .addr = addr, .corrected = rsErrors});
+        return false;
+    }
+
+    // Inherited via IFrameTracker
+    void TrackFrame(ADSB::DemodulatedFrame const& frame, ADSB::IFrameTracker::time_point captureStart) override
+    {
+        trafficManager->bufferTime            = FrameTime(captureStart, frame.sample, sampleRate);
+        UpdateTracking();
+        *ADSB::GetThreadLocalTrafficManager() = this->trafficManager.get();
+        *ADSB::GetThreadLocalUATFrameSink()   = this;
+        auto length = std::min(frame.bytes.size(), trackBytes.size());
+        std::copy_n(frame.bytes.begin(), length, trackBytes.begin());    // dump978 takes them mutable
+        dump_raw_message(frame.uplink ? '+' : '-', trackBytes.data(), static_cast<int>(length), frame.corrected);
+    }
+
+    void FlushFrames() override
+    {
+        messages.Flush();
+        trafficManager->Flush();
+    }
+
+    // Downlinks go untracked only while every subscriber wants messages alone and nothing else takes aircraft
+    void UpdateTracking() { trackAircraft = messages.TrackAircraft() || trafficManager->HasConsumers(); }
 
     void InitATan2Table()
     {
@@ -99,28 +265,44 @@ struct UAT978Handler : RTLSDR::IDataHandler, ADSB::IDataProvider
         }
     }
 
-    ADSB::IListener* listener{nullptr};
-
     std::shared_ptr<ADSB::TrafficManager> trafficManager;
     RTLSDR                                listener978;
+    ADSB::UATUplinkDecoder                uplink;
     size_t                                used   = 0;
     uint64_t                              offset = 0;
-    std::array<uint16_t, 256 * 256>       buffer{};
+    std::vector<uint16_t>                 buffer;
     std::array<uint16_t, 256 * 256>       iqphase{};
     ADSB::Source                          sourceId{ADSB::Source::UAT978};
+    uint32_t                              sampleRate{};    // TrackFrame times frames by it
+    ADSB::IFrameTap*                      frameTap{nullptr};
+    ADSB::MessageBatch<ADSB::UATMessage>  messages;
+    bool                                  trackAircraft{true};    // Per buffer or tracked frame, see UpdateTracking
+
+    std::array<uint8_t, ADSB::UATUplinkDecoder::FrameBytes> trackBytes{};    // TrackFrame's copy of the frame
+
+    /* Statistics. Written by the data handler thread only */
+    StatCounter statBuffers;
+    StatCounter statSamples;
+    StatCounter statDownlinkFrames;
+    StatCounter statUplinkFrames;
+    StatCounter statFixed;
+
+    std::array<LatencyHistogram, ADSB::LatencyStageCount> latency;    // Stages timed by this handler, see GetStats
 };
 // NOLINTEND
 
 std::unique_ptr<ADSB::IDataProvider> ADSB::TryCreateUAT978Handler(std::shared_ptr<ADSB::TrafficManager> const& trafficManager,
                                                                   RTLSDR::IDeviceSelector const*               selector,
-                                                                  ADSB::Source                                 sourceId)
+                                                                  ADSB::Source                                 sourceId,
+                                                                  ADSB::HandlerConfig const&                   config)
 {
-    return std::make_unique<UAT978Handler>(trafficManager, selector, sourceId);
+    return std::make_unique<UAT978Handler>(trafficManager, selector, sourceId, config);
 }
 
 std::unique_ptr<RTLSDR::IDataHandler> ADSB::test::TryCreateUAT978Handler(std::shared_ptr<ADSB::TrafficManager> const& trafficManager,
                                                                          RTLSDR::IDeviceSelector const*               selector,
-                                                                         ADSB::Source                                 sourceId)
+                                                                         ADSB::Source                                 sourceId,
+                                                                         ADSB::HandlerConfig const&                   config)
 {
-    return std::make_unique<UAT978Handler>(trafficManager, selector, sourceId);
+    return std::make_unique<UAT978Handler>(trafficManager, selector, sourceId, config);
 }
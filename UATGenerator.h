@@ -0,0 +1,459 @@
+#pragma once
+#include "CommonMacros.h"
+#include "SyntheticIQ.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <numbers>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+// Reed-Solomon encoder over GF(256) with the parameters dump978 decodes with (field polynomial 0x187,
+// first consecutive root 120, primitive element 1). Codewords are the data followed by the parity
+struct UATReedSolomon
+{
+    explicit UATReedSolomon(size_t parityBytes) : _parityBytes(parityBytes)
+    {
+        unsigned x = 1;
+        for (size_t i = 0; i < 255; i++)
+        {
+            _alpha[i] = static_cast<uint8_t>(x);
+            _index[x] = static_cast<uint8_t>(i);
+            x <<= 1;
+            if ((x & 0x100) != 0) { x ^= 0x187; }
+        }
+
+        // g(x) = (x - a^120)(x - a^121)...(x - a^(120 + parity - 1)), highest degree first
+        _generator = {1};
+        for (size_t i = 0; i < _parityBytes; i++)
+        {
+            auto                 root = _alpha[(FirstRoot + i) % 255];
+            std::vector<uint8_t> next(_generator.size() + 1, 0);
+            for (size_t j = 0; j < _generator.size(); j++)
+            {
+                next[j]     ^= _generator[j];
+                next[j + 1] ^= Multiply_(_generator[j], root);
+            }
+            _generator = std::move(next);
+        }
+    }
+
+    [[nodiscard]] size_t ParityBytes() const { return _parityBytes; }
+
+    // parity.size() == ParityBytes()
+    void Encode(std::span<uint8_t const> const& data, std::span<uint8_t> const& parity) const
+    {
+        std::ranges::fill(parity, uint8_t{0});
+        for (auto byte : data)
+        {
+            auto feedback = static_cast<uint8_t>(byte ^ parity[0]);
+            std::shift_left(parity.begin(), parity.end(), 1);
+            parity[_parityBytes - 1] = 0;
+            if (feedback == 0) { continue; }
+            for (size_t j = 0; j < _parityBytes; j++) { parity[j] ^= Multiply_(feedback, _generator[j + 1]); }
+        }
+    }
+
+    private:
+    static constexpr size_t FirstRoot = 120;
+
+    [[nodiscard]] uint8_t Multiply_(uint8_t a, uint8_t b) const
+    {
+        if (a == 0 || b == 0) { return 0; }
+        return _alpha[(size_t{_index[a]} + _index[b]) % 255];
+    }
+
+    size_t                   _parityBytes;
+    std::array<uint8_t, 256> _alpha{};
+    std::array<uint8_t, 256> _index{};
+    std::vector<uint8_t>     _generator;
+};
+
+// Deterministic 978 MHz UAT capture of a simulated fleet plus ground stations, for load testing the
+// UAT demodulator and its FEC without hardware.
+// Aircraft send basic (payload type 0, state vector) and long (payload type 1, adds callsign) ADS-B
+// frames, ground stations send uplink frames with six interleaved Reed-Solomon blocks. Frames are
+// sync word + codeword, CPFSK modulated at 1.041667 Mb/s with +-312.5 kHz deviation (modulation
+// index 0.6) and sampled at 2.083334 MS/s like UAT978Handler expects.
+// Every transmission is listed with its payload and the coded bytes as sent in Transmissions()
+struct UATGenerator
+{
+    static constexpr uint32_t SampleRate      = 2083334;
+    static constexpr double   SamplesPerBit   = 2;
+    static constexpr double   DeviationHz     = 312500;
+    static constexpr size_t   SyncBits        = 36;
+    static constexpr uint64_t DownlinkSync    = 0xEACDDA4E2;
+    static constexpr uint64_t UplinkSync      = 0x153225B1D;
+    static constexpr size_t   BasicDataBytes  = 18;
+    static constexpr size_t   BasicBytes      = 30;
+    static constexpr size_t   LongDataBytes   = 34;
+    static constexpr size_t   LongBytes       = 48;
+    static constexpr size_t   UplinkBlocks    = 6;
+    static constexpr size_t   BlockDataBytes  = 72;
+    static constexpr size_t   BlockBytes      = 92;
+    static constexpr size_t   UplinkDataBytes = UplinkBlocks * BlockDataBytes;
+    static constexpr size_t   UplinkBytes     = UplinkBlocks * BlockBytes;
+
+    enum class FrameType : uint8_t
+    {
+        Basic,
+        Long,
+        Uplink
+    };
+
+    struct Config
+    {
+        double   seconds           = 1.0;
+        uint32_t aircraft          = 50;
+        double   messagesPerSecond = 200;    // ADS-B frames over the fleet, arrivals are Poisson
+        double   longFraction      = 0.5;    // The rest are basic frames
+        double   uplinksPerSecond  = 4;      // Ground uplinks
+        double   snrDb             = 20;     // Signal power over noise power
+        double   snrSpreadDb       = 6;      // Each transmitter is +-spread/2 around snrDb
+        double   noiseSigma        = 3;      // Per I/Q component, in ADC units
+        double   frequencyOffsetHz = 0;      // Tuning error, the same for every transmitter
+        double   byteErrorRate     = 0;      // Frames with corrupted bytes
+        uint32_t maxByteErrors     = 4;      // 1..max random bytes of the codeword, FEC fixes 6 (basic), 7 (long), 10 per uplink block
+        double   latitude          = 47.45;    // Centre of the fleet and location of the ground station
+        double   longitude         = -122.31;
+        double   radiusDeg         = 2;
+        uint32_t seed              = 1;
+    };
+
+    // Ground truth for one frame on the air
+    struct Transmission
+    {
+        size_t               sample{};    // First sample of the sync word
+        FrameType            type{};
+        uint32_t             addr{};          // 0 for uplinks
+        std::vector<uint8_t> payload;         // Data bytes before FEC
+        std::vector<uint8_t> coded;           // As sent (uplink blocks interleaved), byte errors included
+        uint8_t              byteErrors{};    // Corrupted bytes in coded
+        bool                 overlapped{};    // Shares air time with another frame
+        float                snrDb{};
+        float                phase{};    // Carrier phase at the first sample, radians
+    };
+
+    struct Aircraft
+    {
+        uint32_t            addr{};
+        std::array<char, 8> callsign{};
+        double              latitude{};
+        double              longitude{};
+        int32_t             altitude{};    // Feet
+        double              speed{};       // Knots
+        double              heading{};     // Degrees
+        float               snrDb{};
+        double              updated{};    // Seconds
+    };
+
+    explicit UATGenerator(Config const& config) :
+        _config(config), _random(config.seed), _basic(BasicBytes - BasicDataBytes), _long(LongBytes - LongDataBytes),
+        _uplink(BlockBytes - BlockDataBytes)
+    {
+        if (_config.aircraft == 0) { throw std::invalid_argument("Fleet is empty"); }
+        if (_config.byteErrorRate > 0 && _config.maxByteErrors == 0) { throw std::invalid_argument("Byte errors need maxByteErrors"); }
+        CreateFleet_();
+        Schedule_();
+    }
+
+    [[nodiscard]] std::vector<Aircraft> const&     Fleet() const { return _fleet; }
+    [[nodiscard]] std::vector<Transmission> const& Transmissions() const { return _transmissions; }
+    [[nodiscard]] size_t                           Samples() const { return _samples; }
+
+    // Renders the capture as interleaved unsigned 8 bit I/Q, passed to sink(std::span<uint8_t const>)
+    // in blocks of blockSamples. Every call produces the same bytes
+    template <typename TSink> void Generate(TSink&& sink, size_t blockSamples = size_t{65536u} * 2u) const
+    {
+        SyntheticRandom      noise(_config.seed ^ 0x9e3779b9u);
+        SyntheticIQBlock     block;
+        std::vector<uint8_t> bytes;
+        size_t               first = 0;
+        for (size_t start = 0; start < _samples; start += blockSamples)
+        {
+            auto count = std::min(blockSamples, _samples - start);
+            block.Reset(count);
+            while (first < _transmissions.size() && End_(_transmissions[first]) <= start) { first++; }
+            for (size_t i = first; i < _transmissions.size() && _transmissions[i].sample < start + count; i++) { Render_(block, start, i); }
+            block.AddNoise(noise, _config.noiseSigma);
+            bytes.clear();
+            block.Quantize(bytes);
+            sink(std::span<uint8_t const>(bytes));
+        }
+    }
+
+    [[nodiscard]] std::vector<uint8_t> Generate() const
+    {
+        std::vector<uint8_t> out;
+        out.reserve(_samples * 2);
+        Generate([&](std::span<uint8_t const> const& bytes) { out.insert(out.end(), bytes.begin(), bytes.end()); });
+        return out;
+    }
+
+    // sample,type,address,payload,snr_db,byte_errors,overlapped
+    void WriteTruthCsv(std::ostream& out) const
+    {
+        static constexpr std::array<std::string_view, 3> TypeNames = {"basic", "long", "uplink"};
+        out << "sample,type,address,payload,snr_db,byte_errors,overlapped\n";
+        for (auto const& t : _transmissions)
+        {
+            out << t.sample << ',' << TypeNames.at(static_cast<size_t>(t.type)) << ',' << std::hex << std::setfill('0') << std::setw(6)
+                << t.addr << ',';
+            for (auto byte : t.payload) { out << std::setw(2) << int{byte}; }
+            out << std::dec << std::setfill(' ') << ',' << std::fixed << std::setprecision(1) << t.snrDb << ',' << int{t.byteErrors}
+                << ',' << int{t.overlapped} << '\n';
+        }
+    }
+
+    // 23 bit latitude and 24 bit longitude of the state vector and the uplink header
+    static void EncodePosition(std::span<uint8_t> const& bytes, double lat, double lon)
+    {
+        static constexpr double Scale = 16777216.0 / 360;
+        auto rawLat = static_cast<uint32_t>(std::lround((lat < 0 ? lat + 180 : lat) * Scale)) & 0x7fffffu;
+        auto rawLon = static_cast<uint32_t>(std::lround((lon < 0 ? lon + 360 : lon) * Scale)) & 0xffffffu;
+        bytes[0]    = static_cast<uint8_t>(rawLat >> 15);
+        bytes[1]    = static_cast<uint8_t>(rawLat >> 7);
+        bytes[2]    = static_cast<uint8_t>((rawLat << 1) | (rawLon >> 23));
+        bytes[3]    = static_cast<uint8_t>(rawLon >> 15);
+        bytes[4]    = static_cast<uint8_t>(rawLon >> 7);
+        bytes[5]    = static_cast<uint8_t>((rawLon << 1) & 0xfe);
+    }
+
+    // Header and state vector, plus mode status (callsign) for long frames
+    static std::vector<uint8_t> EncodeAdsb(Aircraft const& a, FrameType type)
+    {
+        std::vector<uint8_t> data(type == FrameType::Long ? LongDataBytes : BasicDataBytes, 0);
+        data[0] = static_cast<uint8_t>((type == FrameType::Long ? 1 : 0) << 3);    // Payload type, address qualifier 0 (ICAO)
+        data[1] = static_cast<uint8_t>(a.addr >> 16);
+        data[2] = static_cast<uint8_t>(a.addr >> 8);
+        data[3] = static_cast<uint8_t>(a.addr);
+        EncodePosition(std::span(data).subspan(4, 6), a.latitude, a.longitude);    // Altitude type bit left 0: barometric
+
+        auto altitude = static_cast<uint32_t>(std::clamp(((a.altitude + 1000) / 25) + 1, 1, 0xfff));
+        data[10]      = static_cast<uint8_t>(altitude >> 4);
+        data[11]      = static_cast<uint8_t>(((altitude & 0xf) << 4) | 8);    // NIC 8
+
+        // Airborne subsonic: north and east velocity, magnitude + 1 with a sign bit
+        auto rad = a.heading * std::numbers::pi / 180;
+        auto ns  = a.speed * std::cos(rad);
+        auto ew  = a.speed * std::sin(rad);
+        auto raw = [](double v) { return (v < 0 ? 0x400u : 0u) | static_cast<uint32_t>(std::min(std::lround(std::abs(v)) + 1, 1023l)); };
+        auto rawNs = raw(ns);
+        auto rawEw = raw(ew);
+        data[12]   = static_cast<uint8_t>(rawNs >> 6);    // A/G state 0
+        data[13]   = static_cast<uint8_t>(((rawNs & 0x3f) << 2) | (rawEw >> 9));
+        data[14]   = static_cast<uint8_t>(rawEw >> 1);
+        data[15]   = static_cast<uint8_t>((rawEw & 1) << 7);
+
+        if (type == FrameType::Long)
+        {
+            // Base 40 callsign, three characters per 16 bit word, the first word also carries the emitter category
+            static constexpr std::string_view Base40 = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ  ..";
+            auto code = [&](size_t i) {
+                auto index = Base40.find(a.callsign[i]);
+                return static_cast<uint32_t>(index == std::string_view::npos ? 36 : index);
+            };
+            std::array<uint32_t, 3> words = {(3 * 1600) + (code(0) * 40) + code(1),    // Category 3: large aircraft
+                                             (code(2) * 1600) + (code(3) * 40) + code(4),
+                                             (code(5) * 1600) + (code(6) * 40) + code(7)};
+            for (size_t w = 0; w < words.size(); w++)
+            {
+                data[17 + (2 * w)] = static_cast<uint8_t>(words[w] >> 8);
+                data[18 + (2 * w)] = static_cast<uint8_t>(words[w]);
+            }
+            data[26] = 0x02;    // The callsign is a callsign, not a squawk
+        }
+        return data;
+    }
+
+    // Ground station at the centre, application data valid but without information frames
+    [[nodiscard]] std::vector<uint8_t> EncodeUplinkHeader() const
+    {
+        std::vector<uint8_t> data(UplinkDataBytes, 0);
+        EncodePosition(std::span(data).subspan(0, 6), _config.latitude, _config.longitude);
+        data[5] |= 1;       // Position valid
+        data[6]  = 0xa0;    // UTC coupled, application data valid, slot 0
+        return data;
+    }
+
+    private:
+    [[nodiscard]] static size_t CodedBytes_(FrameType type)
+    {
+        return type == FrameType::Uplink ? UplinkBytes : (type == FrameType::Long ? LongBytes : BasicBytes);
+    }
+    [[nodiscard]] static size_t Length_(FrameType type)
+    {
+        return static_cast<size_t>(static_cast<double>(SyncBits + (CodedBytes_(type) * 8)) * SamplesPerBit);
+    }
+    [[nodiscard]] static size_t End_(Transmission const& t) { return t.sample + Length_(t.type); }
+
+    std::vector<uint8_t> Encode_(std::vector<uint8_t> const& payload, FrameType type) const
+    {
+        std::vector<uint8_t> coded(CodedBytes_(type));
+        if (type != FrameType::Uplink)
+        {
+            std::ranges::copy(payload, coded.begin());
+            auto const& rs = type == FrameType::Long ? _long : _basic;
+            rs.Encode(payload, std::span(coded).subspan(payload.size()));
+            return coded;
+        }
+        // Block b holds data bytes b*72.., byte i of every block is sent before byte i + 1 of any
+        std::array<uint8_t, BlockBytes> block{};
+        for (size_t b = 0; b < UplinkBlocks; b++)
+        {
+            std::copy_n(payload.begin() + static_cast<std::ptrdiff_t>(b * BlockDataBytes), BlockDataBytes, block.begin());
+            _uplink.Encode(std::span(block).first(BlockDataBytes), std::span(block).subspan(BlockDataBytes));
+            for (size_t i = 0; i < BlockBytes; i++) { coded[(i * UplinkBlocks) + b] = block[i]; }
+        }
+        return coded;
+    }
+
+    void CreateFleet_()
+    {
+        std::unordered_set<uint32_t> used;
+        for (uint32_t n = 0; n < _config.aircraft; n++)
+        {
+            Aircraft a;
+            do {
+                a.addr = _random.Next() & 0xffffffu;
+            } while (a.addr == 0 || !used.insert(a.addr).second);
+            for (size_t i = 0; i < 3; i++) { a.callsign[i] = static_cast<char>('A' + _random.Below(26)); }
+            for (size_t i = 3; i < 7; i++) { a.callsign[i] = static_cast<char>('0' + _random.Below(10)); }
+            a.callsign[7] = ' ';
+            auto bearing  = _random.Uniform(0, 2 * std::numbers::pi);
+            auto distance = _config.radiusDeg * std::sqrt(_random.Uniform());
+            a.latitude    = _config.latitude + (distance * std::cos(bearing));
+            a.longitude   = _config.longitude + (distance * std::sin(bearing) / std::cos(_config.latitude * std::numbers::pi / 180));
+            a.altitude    = static_cast<int32_t>(25 * _random.Below(720));    // General aviation, up to 18000ft
+            a.speed       = _random.Uniform(80, 300);
+            a.heading     = _random.Uniform(0, 360);
+            a.snrDb       = static_cast<float>(_config.snrDb + _random.Uniform(-_config.snrSpreadDb / 2, _config.snrSpreadDb / 2));
+            _fleet.push_back(a);
+        }
+    }
+
+    void Fly_(Aircraft& a, double time) const
+    {
+        auto hours    = (time - a.updated) / 3600;
+        auto rad      = a.heading * std::numbers::pi / 180;
+        auto nm       = a.speed * hours;
+        a.latitude   += nm * std::cos(rad) / 60;
+        a.longitude  += nm * std::sin(rad) / (60 * std::cos(a.latitude * std::numbers::pi / 180));
+        a.updated     = time;
+    }
+
+    void Corrupt_(Transmission& t)
+    {
+        auto count = 1 + _random.Below(_config.maxByteErrors);
+        std::unordered_set<uint32_t> positions;
+        while (positions.size() < std::min<size_t>(count, t.coded.size()))
+        {
+            auto position = _random.Below(static_cast<uint32_t>(t.coded.size()));
+            if (!positions.insert(position).second) { continue; }
+            t.coded[position] ^= static_cast<uint8_t>(1 + _random.Below(255));    // Never a no-op
+        }
+        t.byteErrors = static_cast<uint8_t>(positions.size());
+    }
+
+    void Add_(size_t sample, FrameType type, uint32_t addr, std::vector<uint8_t> payload, float snrDb)
+    {
+        Transmission t;
+        t.sample  = sample;
+        t.type    = type;
+        t.addr    = addr;
+        t.payload = std::move(payload);
+        t.snrDb   = snrDb;
+        t.phase   = static_cast<float>(_random.Uniform(0, 2 * std::numbers::pi));
+        t.coded = Encode_(t.payload, t.type);
+        if (_random.Chance(_config.byteErrorRate)) { Corrupt_(t); }
+        _transmissions.push_back(std::move(t));
+    }
+
+    void Schedule_()
+    {
+        _samples     = static_cast<size_t>(_config.seconds * SampleRate);
+        auto longest = Length_(FrameType::Uplink);
+        auto station = EncodeUplinkHeader();
+
+        // Downlinks and uplinks are independent Poisson streams
+        for (auto uplink : {false, true})
+        {
+            auto rate = uplink ? _config.uplinksPerSecond : _config.messagesPerSecond;
+            if (rate <= 0) { continue; }
+            double time = 0;
+            while (true)
+            {
+                time       += _random.Exponential(1 / rate);
+                auto sample = static_cast<size_t>(time * SampleRate);
+                if (sample + longest >= _samples) { break; }
+                if (uplink)
+                {
+                    Add_(sample, FrameType::Uplink, 0, station, static_cast<float>(_config.snrDb));
+                    continue;
+                }
+                auto& a    = _fleet[_random.Below(static_cast<uint32_t>(_fleet.size()))];
+                auto  type = _random.Chance(_config.longFraction) ? FrameType::Long : FrameType::Basic;
+                Fly_(a, time);
+                Add_(sample, type, a.addr, EncodeAdsb(a, type), a.snrDb);
+            }
+        }
+
+        std::ranges::sort(_transmissions, {}, &Transmission::sample);
+        for (size_t i = 1; i < _transmissions.size(); i++)
+        {
+            for (size_t j = i; j-- > 0 && _transmissions[j].sample + longest > _transmissions[i].sample;)
+            {
+                if (End_(_transmissions[j]) <= _transmissions[i].sample) { continue; }
+                _transmissions[i].overlapped = true;
+                _transmissions[j].overlapped = true;
+            }
+        }
+    }
+
+    // Adds the part of transmission index that falls into the block starting at sample start.
+    // The phase is accumulated from the first sample, each bit holds the frequency for two samples
+    void Render_(SyntheticIQBlock& block, size_t start, size_t index) const
+    {
+        auto const& t     = _transmissions[index];
+        auto        sigma = _config.noiseSigma > 0 ? _config.noiseSigma : Config{}.noiseSigma;
+        auto        amp   = static_cast<float>(sigma * std::sqrt(2.0) * std::pow(10.0, t.snrDb / 20));
+        auto        step  = 2 * std::numbers::pi / SampleRate;
+        auto        sync  = t.type == FrameType::Uplink ? UplinkSync : DownlinkSync;
+
+        auto bit = [&](size_t n) {
+            if (n < SyncBits) { return ((sync >> (SyncBits - 1 - n)) & 1) != 0; }
+            n -= SyncBits;
+            return ((t.coded[n / 8] >> (7 - (n % 8))) & 1) != 0;
+        };
+
+        double phase = t.phase;
+        auto   last  = std::min(End_(t), start + block.Size());
+        for (size_t s = t.sample; s < last; s++)
+        {
+            if (s >= start) { block[s - start] += std::polar(amp, static_cast<float>(phase)); }
+            auto one  = bit(static_cast<size_t>(static_cast<double>(s - t.sample) / SamplesPerBit));
+            phase    += step * (_config.frequencyOffsetHz + (one ? DeviationHz : -DeviationHz));
+        }
+    }
+
+    Config                    _config;
+    SyntheticRandom           _random;
+    UATReedSolomon            _basic;
+    UATReedSolomon            _long;
+    UATReedSolomon            _uplink;
+    std::vector<Aircraft>     _fleet;
+    std::vector<Transmission> _transmissions;
+    size_t                    _samples{};
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+SUPPRESS_WARNINGS_END
+
+namespace ADSB
+{
+
+// A UAT ADS-B downlink frame (DO-282B section 2.2.4.5) after Reed-Solomon correction, in 56 bytes.
+// Header fields are read from the bytes on access
+struct UATMessage
+{
+    using time_point = std::chrono::time_point<std::chrono::system_clock>;
+
+    static constexpr size_t BasicBytes = 18;
+    static constexpr size_t LongBytes  = 34;
+
+    [[nodiscard]] std::span<uint8_t const> Bytes() const { return std::span(msg).first(length); }
+
+    [[nodiscard]] uint32_t PayloadType() const { return msg[0] >> 3u; }
+    [[nodiscard]] uint32_t AddressQualifier() const { return msg[0] & 7u; }    // 0: ICAO address, 1: self assigned, ...
+
+    std::array<uint8_t, LongBytes> msg{};         // Error corrected, length bytes used
+    uint8_t                        length{};      // BasicBytes or LongBytes
+    uint8_t                        rsErrors{};    // Symbols corrected
+    uint32_t                       addr{};
+    uint64_t                       sample{};      // Start of the dump978 block the frame was found in
+    time_point                     time{};        // Arrival of the buffer it was decoded from
+};
+
+static_assert(sizeof(UATMessage) <= 64, "A message must fit in a cache line");
+
+}    // namespace ADSB
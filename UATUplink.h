@@ -0,0 +1,315 @@
+#pragma once
+#include "FISB.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+namespace ADSB
+{
+
+// NOLINTBEGIN(readability-magic-numbers)
+// NOLINTBEGIN(cppcoreguidelines-pro-bounds-constant-array-index)
+
+// Decodes UAT ground uplink frames (DO-282B section 2.2.3.2.2).
+// The frame and APDU headers are always indexed (a handful of shifts per APDU) but the
+// payloads are only decoded for products that have a subscriber.
+struct UATUplinkDecoder
+{
+    static constexpr size_t FrameBytes    = 432;
+    static constexpr size_t HeaderBytes   = 8;
+    static constexpr size_t AppDataBytes  = FrameBytes - HeaderBytes;
+    static constexpr size_t ProductWords  = (FISB::ProductId::Max + 64) / 64;
+    static constexpr char   TextSeparator = '\x1e';
+    static constexpr char   TextEnd       = '\x03';
+
+    UATUplinkDecoder()  = default;
+    ~UATUplinkDecoder() = default;
+    CLASS_DELETE_COPY_AND_MOVE(UATUplinkDecoder);
+
+    // productId is an 11 bit product id or AllProducts. Callable from any thread, listener callbacks included
+    void Subscribe(uint16_t productId, FISB::IProductListener& listener)
+    {
+        if (productId > FISB::ProductId::Max && productId != FISB::ProductId::AllProducts)
+        {
+            throw std::invalid_argument("FIS-B product ids are 11 bits");
+        }
+        std::scoped_lock lock(_mutex);
+        _subscriptions.emplace_back(productId, &listener);
+        if (productId == FISB::ProductId::AllProducts) { _wantAll.store(true, std::memory_order_relaxed); }
+        else { _wanted[productId / 64].fetch_or(uint64_t{1} << (productId % 64), std::memory_order_relaxed); }
+        _wantAny.store(true, std::memory_order_release);
+    }
+
+    // A dispatch already under way on the data handler thread may still call the listener once. The masks
+    // are rebuilt aside and stored a word at a time, so a product still subscribed is never seen as unwanted
+    void Unsubscribe(FISB::IProductListener& listener)
+    {
+        std::scoped_lock lock(_mutex);
+        std::erase_if(_subscriptions, [&](auto const& s) { return s.second == &listener; });
+        std::array<uint64_t, ProductWords> wanted{};
+        bool                               wantAll = false;
+        for (auto const& [productId, l] : _subscriptions)
+        {
+            if (productId == FISB::ProductId::AllProducts) { wantAll = true; }
+            else { wanted[productId / 64] |= uint64_t{1} << (productId % 64); }
+        }
+        for (size_t i = 0; i < ProductWords; i++) { _wanted[i].store(wanted[i], std::memory_order_relaxed); }
+        _wantAll.store(wantAll, std::memory_order_relaxed);
+        _wantAny.store(!_subscriptions.empty(), std::memory_order_release);
+    }
+
+    [[nodiscard]] bool IsWanted(uint16_t productId) const
+    {
+        return _wantAll.load(std::memory_order_relaxed)
+               || ((_wanted[productId / 64].load(std::memory_order_relaxed) >> (productId % 64)) & 1u) != 0;
+    }
+
+    void HandleFrame(std::span<uint8_t const> const& frame, int rsErrors)
+    {
+        if (!_wantAny.load(std::memory_order_acquire)) { return; }
+        if (frame.size() < FrameBytes) { return; }
+
+        bool appDataValid = (frame[6] & 0x20) != 0;
+        if (!appDataValid) { return; }
+
+        FISB::Apdu apdu{};
+        bool       headerDecoded = false;
+
+        auto data = frame.subspan(HeaderBytes, AppDataBytes);
+        while (data.size() >= 2)
+        {
+            size_t  length = (size_t{data[0]} << 1) | (data[1] >> 7);
+            uint8_t type   = data[1] & 0x0f;
+            if (length == 0 && type == 0) { break; }    // No more info frames
+            if (length + 2 > data.size()) { break; }    // Overrun
+
+            auto info = data.subspan(2, length);
+            data      = data.subspan(length + 2);
+
+            // Type 0 is FIS-B. Everything else is reserved or TIS-B/ADS-R site management
+            if (type != 0 || info.size() < 4) { continue; }
+
+            auto productId = static_cast<uint16_t>(((info[0] & 0x1fu) << 6) | (info[1] >> 2));
+            if (!IsWanted(productId)) { continue; }
+
+            if (!headerDecoded)
+            {
+                DecodeHeader_(frame, apdu);
+                apdu.rsErrors = rsErrors;
+                headerDecoded = true;
+            }
+            if (!DecodeApdu_(info, apdu)) { continue; }
+            Dispatch_(apdu);
+        }
+    }
+
+    static bool DecodeNexrad(std::span<uint8_t const> const& payload, FISB::NexradBlock& block)
+    {
+        if (payload.size() < 3) { return false; }
+        block.runLengthEncoded = (payload[0] & 0x80) != 0;
+        block.southern         = (payload[0] & 0x40) != 0;
+        block.scaleFactor      = static_cast<uint8_t>((payload[0] & 0x30) >> 4);
+        block.blockNumber      = ((uint32_t{payload[0]} & 0x0fu) << 16) | (uint32_t{payload[1]} << 8) | uint32_t{payload[2]};
+        block.emptyBlocks      = {};
+        std::ranges::fill(block.intensity, uint8_t{0});
+
+        if (!block.runLengthEncoded)
+        {
+            block.emptyBlocks = payload.subspan(3);
+            return true;
+        }
+
+        // Each byte is 5 bits of run length - 1 followed by 3 bits of intensity
+        size_t bin = 0;
+        for (auto b : payload.subspan(3))
+        {
+            auto   intensity = static_cast<uint8_t>(b & 0x07);
+            size_t run       = std::min<size_t>((b >> 3) + 1u, block.intensity.size() - bin);
+            std::fill_n(block.intensity.begin() + static_cast<std::ptrdiff_t>(bin), run, intensity);
+            bin += run;
+            if (bin == block.intensity.size()) { break; }
+        }
+        return true;
+    }
+
+    // DLAC is a 6 bit character set packed 4 characters to 3 bytes. A tab is followed by a space count
+    static void DecodeDlac(std::span<uint8_t const> const& payload, std::string& out)
+    {
+        static constexpr std::string_view DlacCharset
+            = "\x03"
+              "ABCDEFGHIJKLMNOPQRSTUVWXYZ\x1a\t\x1e\n| !\"#$%&'()*+,-./0123456789:;<=>?";
+
+        out.clear();
+        bool tab = false;
+        for (size_t i = 0, step = 0; i < payload.size(); step = (step + 1) % 4)
+        {
+            unsigned ch = 0;
+            switch (step)
+            {
+            case 0: ch = payload[i++] >> 2u; break;
+            case 1:
+                if (i >= payload.size()) { return; }
+                ch = ((payload[i - 1] & 0x03u) << 4) | (payload[i] >> 4u);
+                i++;
+                break;
+            case 2:
+                if (i >= payload.size()) { return; }
+                ch = ((payload[i - 1] & 0x0fu) << 2) | (payload[i] >> 6u);
+                break;
+            default: ch = payload[i++] & 0x3fu; break;
+            }
+
+            if (tab)
+            {
+                out.append(ch, ' ');
+                tab = false;
+            }
+            else if (DlacCharset[ch] == '\t') { tab = true; }
+            else { out.push_back(DlacCharset[ch]); }
+        }
+    }
+
+    private:
+    static void DecodeHeader_(std::span<uint8_t const> const& frame, FISB::Apdu& apdu)
+    {
+        uint32_t rawLat = (uint32_t{frame[0]} << 15) | (uint32_t{frame[1]} << 7) | (uint32_t{frame[2]} >> 1);
+        uint32_t rawLon = ((uint32_t{frame[2]} & 0x01u) << 23) | (uint32_t{frame[3]} << 15) | (uint32_t{frame[4]} << 7)
+                          | (uint32_t{frame[5]} >> 1);
+
+        double lat = rawLat * 360.0 / 16777216.0;
+        double lon = rawLon * 360.0 / 16777216.0;
+        if (lat > 90) { lat -= 180; }
+        if (lon > 180) { lon -= 360; }
+
+        apdu.stationLat1E7        = static_cast<int32_t>(lat * 10000000);
+        apdu.stationLon1E7        = static_cast<int32_t>(lon * 10000000);
+        apdu.stationPositionValid = (frame[5] & 0x01) != 0;
+        apdu.tisbSiteId           = static_cast<uint8_t>(frame[7] >> 4);
+    }
+
+    static bool DecodeApdu_(std::span<uint8_t const> const& info, FISB::Apdu& apdu)
+    {
+        unsigned timeOption = ((info[1] & 0x01u) << 1) | (info[2] >> 7);
+        size_t   headerSize = 0;
+
+        apdu.month         = 0;
+        apdu.day           = 0;
+        apdu.seconds       = 0;
+        apdu.monthDayValid = (timeOption & 2) != 0;
+        apdu.secondsValid  = (timeOption & 1) != 0;
+        switch (timeOption)
+        {
+        case 0:
+            apdu.hours   = static_cast<uint8_t>((info[2] & 0x7c) >> 2);
+            apdu.minutes = static_cast<uint8_t>(((info[2] & 0x03) << 4) | (info[3] >> 4));
+            headerSize   = 4;
+            break;
+        case 1:
+            if (info.size() < 5) { return false; }
+            apdu.hours   = static_cast<uint8_t>((info[2] & 0x7c) >> 2);
+            apdu.minutes = static_cast<uint8_t>(((info[2] & 0x03) << 4) | (info[3] >> 4));
+            apdu.seconds = static_cast<uint8_t>(((info[3] & 0x0f) << 2) | (info[4] >> 6));
+            headerSize   = 5;
+            break;
+        case 2:
+            if (info.size() < 5) { return false; }
+            apdu.month   = static_cast<uint8_t>((info[2] & 0x78) >> 3);
+            apdu.day     = static_cast<uint8_t>(((info[2] & 0x07) << 2) | (info[3] >> 6));
+            apdu.hours   = static_cast<uint8_t>((info[3] & 0x3e) >> 1);
+            apdu.minutes = static_cast<uint8_t>(((info[3] & 0x01) << 5) | (info[4] >> 3));
+            headerSize   = 5;
+            break;
+        default:
+            if (info.size() < 6) { return false; }
+            apdu.month   = static_cast<uint8_t>((info[2] & 0x78) >> 3);
+            apdu.day     = static_cast<uint8_t>(((info[2] & 0x07) << 2) | (info[3] >> 6));
+            apdu.hours   = static_cast<uint8_t>((info[3] & 0x3e) >> 1);
+            apdu.minutes = static_cast<uint8_t>(((info[3] & 0x01) << 5) | (info[4] >> 3));
+            apdu.seconds = static_cast<uint8_t>(((info[4] & 0x07) << 3) | (info[5] >> 5));
+            headerSize   = 6;
+            break;
+        }
+
+        apdu.aFlag     = (info[0] & 0x80) != 0;
+        apdu.gFlag     = (info[0] & 0x40) != 0;
+        apdu.pFlag     = (info[0] & 0x20) != 0;
+        apdu.sFlag     = (info[1] & 0x02) != 0;
+        apdu.productId = static_cast<uint16_t>(((info[0] & 0x1fu) << 6) | (info[1] >> 2));
+        apdu.payload   = info.subspan(headerSize);
+        return true;
+    }
+
+    // Listeners are called outside the lock, so that they can subscribe and unsubscribe, and once per
+    // APDU however many of their subscriptions match it
+    void Dispatch_(FISB::Apdu const& apdu)
+    {
+        _dispatch.clear();
+        {
+            std::scoped_lock lock(_mutex);
+            for (auto const& [productId, listener] : _subscriptions)
+            {
+                if (productId != apdu.productId && productId != FISB::ProductId::AllProducts) { continue; }
+                if (std::ranges::find(_dispatch, listener) == _dispatch.end()) { _dispatch.push_back(listener); }
+            }
+        }
+        bool decoded = false;
+        for (auto* listener : _dispatch)
+        {
+            switch (apdu.productId)
+            {
+            case FISB::ProductId::NexradRegional: [[fallthrough]];
+            case FISB::ProductId::NexradCONUS:
+                if (!decoded) { decoded = DecodeNexrad(apdu.payload, _nexrad); }
+                if (decoded) { listener->OnNexradBlock(apdu, _nexrad); }
+                break;
+            case FISB::ProductId::GenericText:
+                if (!decoded)
+                {
+                    DecodeDlac(apdu.payload, _text);
+                    decoded = true;
+                }
+                DispatchText_(apdu, *listener);
+                break;
+            default: listener->OnApdu(apdu); break;
+            }
+        }
+    }
+
+    void DispatchText_(FISB::Apdu const& apdu, FISB::IProductListener& listener) const
+    {
+        std::string_view text(_text);
+        text = text.substr(0, text.find(TextEnd));
+        while (!text.empty())
+        {
+            auto record = text.substr(0, text.find(TextSeparator));
+            text.remove_prefix(std::min(record.size() + 1, text.size()));
+            if (!record.empty()) { listener.OnText(apdu, record); }
+        }
+    }
+
+    std::mutex                                                _mutex;
+    std::vector<std::pair<uint16_t, FISB::IProductListener*>> _subscriptions;
+    std::array<std::atomic<uint64_t>, ProductWords>           _wanted{};
+    std::atomic<bool>                                         _wantAll{false};
+    std::atomic<bool>                                         _wantAny{false};
+    std::vector<FISB::IProductListener*>                      _dispatch;    // Data handler thread only, like the decoded payloads
+    FISB::NexradBlock                                         _nexrad{};
+    std::string                                               _text;
+};
+
+// NOLINTEND(cppcoreguidelines-pro-bounds-constant-array-index)
+// NOLINTEND(readability-magic-numbers)
+}    // namespace ADSB
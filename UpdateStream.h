@@ -0,0 +1,64 @@
+#pragma once
+#include "ADSBListener.h"
+#include "AircraftImpl.h"
+#include "CommonMacros.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+#include <span>
+SUPPRESS_WARNINGS_END
+
+namespace ADSB
+{
+
+// Aircraft updates, device status and data lost pulled by the consumer instead of pushed to an IListener,
+// for event loops that would rather not be called on the data handler thread (IDataProvider::OpenStream).
+// The tracker fills a bounded lock free queue that is read in batches, polled with TryRead or awaited
+// with co_await Read. A reader that falls behind gets the newest state of each aircraft rather than
+// every update in between (DataProviderStats::coalescedUpdates), decoding never waits for it.
+// One reader at a time
+struct UpdateStream
+{
+    using Update = ListenerEvent;
+
+    UpdateStream(std::shared_ptr<TrafficManager> const& trafficManager, StreamOptions const& options) :
+        _queue(std::make_shared<TrafficManager::EventQueue>(options.queueCapacity, options.schedule))
+    {
+        trafficManager->AddStream(_queue, options.filter);
+    }
+    ~UpdateStream() { Close(); }
+    CLASS_DELETE_COPY_AND_MOVE(UpdateStream);
+
+    // Returns the number of updates read, 0 when there are none. Never blocks
+    size_t TryRead(std::span<Update> updates) { return _queue->Read(updates); }
+
+    // size_t n = co_await stream.Read(updates). Suspends while there is nothing to read, 0 once closed and read up
+    [[nodiscard]] auto Read(std::span<Update> updates) { return ReadAwaiter{*_queue, updates}; }
+
+    // A suspended Read returns what is left, then 0. Callable from any thread
+    void               Close() { _queue->Close(); }
+    [[nodiscard]] bool Closed() const { return _queue->Closed(); }
+
+    private:
+    struct ReadAwaiter
+    {
+        bool await_ready()
+        {
+            count = queue.Read(updates);
+            return count > 0 || queue.Closed();
+        }
+        bool   await_suspend(std::coroutine_handle<> consumer) { return queue.Suspend(consumer); }
+        size_t await_resume() { return count > 0 ? count : queue.Read(updates); }
+
+        TrafficManager::EventQueue& queue;
+        std::span<Update>           updates;
+        size_t                      count{};
+    };
+
+    std::shared_ptr<TrafficManager::EventQueue> _queue;    // Shared with the tracker, which lets go once closed
+};
+
+}    // namespace ADSB
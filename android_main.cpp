@@ -50,6 +50,8 @@ struct ADSBTrackerImpl : ADSB::IListener
         std::cout << a.FlightNumber() << ":" << std::hex << a.Addr() << ":" << std::dec << " Speed:" << a.Speed() << " Alt:" << a.Altitude()
                   << " Heading:" << a.Heading() << " Climb:" << a.Climb() << " Lat:" << a.Lat1E7() << " Lon:" << a.Lon1E7() << std::endl;
     }
+    void OnDeviceStatusChanged(ADSB::Source /* source */, bool /* available */) override {}
+    void OnDataLost(ADSB::Source /* source */, uint64_t /* droppedSamples */) override {}
 
     std::unordered_map<uint32_t, std::chrono::system_clock::time_point> icaoTimestamps{};
     std::unordered_map<uint32_t, size_t>                                aircrafts{};
@@ -30,9 +30,14 @@ struct ADSBTrackerImpl : ADSB::IListener
     void OnChanged(ADSB::IAirCraft const& a) override
     {
         std::cout << a.FlightNumber() << ":" << std::hex << a.Addr() << ":" << std::dec << " Speed:" << a.Speed() << " Alt:" << a.Altitude()
-                  << " Heading:" << a.Heading() << " Climb:" << a.Climb() << " Lat:" << a.Lat1E7() << " Lon:" << a.Lon1E7() << '\n';
+                  << " Heading:" << a.Heading() << " Climb:" << a.Climb() << " Lat:" << a.Lat1E7() << " Lon:" << a.Lon1E7()
+                  << " Signal:" << a.SignalLevel() << "dBFS\n";
     }
     void OnDeviceStatusChanged(ADSB::Source /* source */, bool /* available */) override {}
+    void OnDataLost(ADSB::Source /* source */, uint64_t droppedSamples) override
+    {
+        std::cout << "Receiver overrun, dropped " << droppedSamples << " samples" << '\n';
+    }
 
     std::unordered_map<uint32_t, std::chrono::system_clock::time_point> icaoTimestamps;
     std::unordered_map<uint32_t, size_t>                                aircrafts;
@@ -0,0 +1,413 @@
+// Throughput of the 1090 and 978 decode stages.
+//
+//  bench_adsb [--filter <substring>] [--min-time <ms>] [--json <file>]
+//
+// Every benchmark is run in repetitions of at least min-time / Repetitions and the median is reported
+// as ns per iteration, samples per second (stages that consume IQ samples) and ns per message
+// (stages that produce or consume messages). --json also writes them to a file as a JSON array for scripts.
+// Captures named like the TestEnv ones (*1090*, *978*) in RTLSDR_TEST_TRACE_DIR or RTLSDR_TEST_TRACE_FILE
+// are benchmarked as well. The 978 pipeline also runs on synthetic captures (UATGenerator.h) at a realistic
+// and an extreme load, each clean and with Reed-Solomon correctable byte errors so the FEC cost shows as the
+// difference between the two, and on noise without a capture.
+
+#include "ADSB1090Handler.h"
+#include "EmbeddedResource.h"
+#include "IQFileSource.h"
+#include "UATGenerator.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+DECLARE_RESOURCE_COLLECTION(traces);
+
+namespace
+{
+using clock = std::chrono::steady_clock;
+
+constexpr size_t Repetitions  = 5;
+constexpr size_t NoiseSamples = 2083334;    // A second at the 978 sample rate
+
+// Keeps results alive so that the work producing them isn't optimized away
+volatile uint64_t Sink;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+struct Options
+{
+    std::string filter;
+    double      minTimeMs = 500;
+    std::string json;
+};
+
+// Work done by one iteration of a benchmark
+struct Work
+{
+    uint64_t samples{};
+    uint64_t messages{};
+};
+
+struct Result
+{
+    std::string name;
+    Work        work;
+    uint64_t    runs{};    // Every call including warm up and calibration
+    double      nsPerIteration{};
+
+    [[nodiscard]] double SamplesPerSec() const { return work.samples == 0 ? 0 : static_cast<double>(work.samples) * 1e9 / nsPerIteration; }
+    [[nodiscard]] double NsPerMessage() const { return work.messages == 0 ? 0 : nsPerIteration / static_cast<double>(work.messages); }
+};
+
+struct Runner
+{
+    explicit Runner(Options options) : _options(std::move(options)) {}
+
+    [[nodiscard]] bool Selected(std::string_view const& name) const
+    {
+        return _options.filter.empty() || name.find(_options.filter) != std::string_view::npos;
+    }
+
+    // Returns nullptr when filtered out
+    Result const* Run(std::string const& name, Work work, std::function<void()> const& fn)
+    {
+        if (!Selected(name)) { return nullptr; }
+        Result result{.name = name, .work = work, .runs = 0, .nsPerIteration = 0};
+        auto   timed = [&](uint64_t iterations) {
+            auto start = clock::now();
+            for (uint64_t i = 0; i < iterations; i++) { fn(); }
+            result.runs += iterations;
+            return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count());
+        };
+
+        auto once       = std::max(timed(1), 1.0);
+        auto target     = _options.minTimeMs * 1e6 / Repetitions;
+        auto iterations = static_cast<uint64_t>(std::max(1.0, target / once));
+
+        std::vector<double> perIteration;
+        for (size_t r = 0; r < Repetitions; r++) { perIteration.push_back(timed(iterations) / static_cast<double>(iterations)); }
+        std::ranges::sort(perIteration);
+        result.nsPerIteration = perIteration[Repetitions / 2];
+        return Add(std::move(result));
+    }
+
+    // For stages that can only be timed from inside a larger one
+    Result const* Add(Result result)
+    {
+        _results.push_back(std::move(result));
+        PrintRow_(_results.back());
+        return &_results.back();
+    }
+
+    // The handlers log to stdout, so the JSON goes to its own file
+    void Finish() const
+    {
+        if (_options.json.empty()) { return; }
+        std::ofstream out(_options.json);
+        if (!out) { throw std::runtime_error("Cannot write " + _options.json); }
+        out << "[\n";
+        for (size_t i = 0; i < _results.size(); i++)
+        {
+            auto const& r = _results[i];
+            out << R"(  {"name":")" << r.name << R"(","samples":)" << r.work.samples << R"(,"messages":)" << r.work.messages
+                << R"(,"ns_per_iteration":)" << r.nsPerIteration << R"(,"samples_per_sec":)" << r.SamplesPerSec() << R"(,"ns_per_message":)"
+                << r.NsPerMessage() << '}' << (i + 1 < _results.size() ? ",\n" : "\n");
+        }
+        out << "]\n";
+    }
+
+    static void PrintHeader()
+    {
+        std::cout << std::left << std::setw(40) << "benchmark" << std::right << std::setw(16) << "ns/iter" << std::setw(16)
+                  << "Msamples/s" << std::setw(14) << "ns/message" << std::setw(12) << "messages" << '\n';
+    }
+
+    private:
+    static void PrintRow_(Result const& r)
+    {
+        std::cout << std::left << std::setw(40) << r.name << std::right << std::fixed << std::setprecision(1) << std::setw(16)
+                  << r.nsPerIteration << std::setw(16) << (r.SamplesPerSec() / 1e6) << std::setw(14) << r.NsPerMessage() << std::setw(12)
+                  << r.work.messages << '\n';
+    }
+
+    Options             _options;
+    std::vector<Result> _results;
+};
+
+struct NullListener : ADSB::IListener
+{
+    void OnChanged(ADSB::IAirCraft const& /* a */) override {}
+    void OnDeviceStatusChanged(ADSB::Source /* source */, bool /* available */) override {}
+    void OnDataLost(ADSB::Source /* source */, uint64_t /* droppedSamples */) override {}
+};
+
+struct Selector : RTLSDR::IDeviceSelector
+{
+    [[nodiscard]] bool SelectDevice(RTLSDR::DeviceInfo const& /* d */) const override { return false; }
+};
+
+using Frame = std::array<uint8_t, Message::LongMessageBytes>;
+
+// DF17 frames with random payloads and a valid parity
+std::vector<Frame> MakeFrames(size_t count, std::mt19937& rng)
+{
+    std::vector<Frame> frames(count);
+    for (auto& frame : frames)
+    {
+        frame[0] = (17 << 3) | 5;
+        for (size_t i = 1; i < Message::LongMessageBytes - 3; i++) { frame[i] = static_cast<uint8_t>(rng()); }
+        auto crc  = ModesChecksum(frame, Message::LongMessageBits);
+        frame[11] = static_cast<uint8_t>(crc >> 16);
+        frame[12] = static_cast<uint8_t>(crc >> 8);
+        frame[13] = static_cast<uint8_t>(crc);
+    }
+    return frames;
+}
+
+std::vector<Frame> FlipBits(std::vector<Frame> frames, size_t bitsPerFrame, std::mt19937& rng)
+{
+    for (auto& frame : frames)
+    {
+        std::vector<size_t> bits(Message::LongMessageBits);
+        std::iota(bits.begin(), bits.end(), size_t{0});
+        std::ranges::shuffle(bits, rng);
+        for (size_t b = 0; b < bitsPerFrame; b++) { frame[bits[b] / 8] ^= static_cast<uint8_t>(1u << (7 - (bits[b] % 8))); }
+    }
+    return frames;
+}
+
+uint64_t GoodMessages(ADSB::IDataProvider const& provider)
+{
+    return provider.GetStats().goodCrc;
+}
+
+void Bench1090(Runner& runner, std::string const& label, std::span<uint8_t const> const& data)
+{
+    if (!runner.Selected("1090/HandleData/" + label) && !runner.Selected("1090/Magnitude/" + label)
+        && !runner.Selected("1090/DetectModeS/" + label))
+    {
+        return;
+    }
+    Selector     selector;
+    NullListener listener;
+    auto         trafficManager = std::make_shared<ADSB::TrafficManager>();
+    trafficManager->SetListener(&listener);
+    ADSB1090Handler handler(trafficManager, &selector, ADSB::Source::ADSB1090, {});
+    auto            samples = data.size() / 2;
+
+    // One pass to learn how many messages the trace holds
+    auto before = GoodMessages(handler);
+    handler.HandleData(data);
+    Work work{.samples = samples, .messages = GoodMessages(handler) - before};
+
+    runner.Run("1090/HandleData/" + label, work, [&]() { handler.HandleData(data); });
+
+    std::vector<uint16_t> magnitudes(samples);
+    runner.Run("1090/Magnitude/" + label, {.samples = samples, .messages = 0}, [&]() {
+        Sink = Sink + handler.ComputeMagnitudes(data, magnitudes.data());
+    });
+    runner.Run("1090/DetectModeS/" + label, work, [&]() { Sink = Sink + handler.DetectModeS(magnitudes, 0); });
+}
+
+void BenchMessages(Runner& runner)
+{
+    std::mt19937 rng(1090);    // NOLINT(cert-msc32-c, cert-msc51-cpp) Same frames every run
+    auto         frames = MakeFrames(1024, rng);
+
+    runner.Run("1090/ModesChecksum", {.samples = 0, .messages = frames.size()}, [&]() {
+        for (auto const& frame : frames) { Sink = Sink + ModesChecksum(frame, Message::LongMessageBits); }
+    });
+
+    auto singleBit = FlipBits(frames, 1, rng);
+    runner.Run("1090/FixSingleBitErrors", {.samples = 0, .messages = singleBit.size()}, [&]() {
+        for (auto frame : singleBit) { Sink = Sink + static_cast<uint64_t>(FixSingleBitErrors(frame, Message::LongMessageBits)); }
+    });
+
+    // Two bit fixes try every pair, a few frames are plenty
+    auto twoBits = FlipBits({frames.begin(), frames.begin() + 32}, 2, rng);
+    runner.Run("1090/FixTwoBitsErrors", {.samples = 0, .messages = twoBits.size()}, [&]() {
+        for (auto frame : twoBits) { Sink = Sink + static_cast<uint64_t>(FixTwoBitsErrors(frame, Message::LongMessageBits)); }
+    });
+
+    // Even/odd pairs around the example position of the CPR write up (52.257N 3.919E)
+    std::vector<ADSB::AirCraftImpl> aircrafts(256);
+    auto                            now = ADSB::AirCraftImpl::time_point::clock::now();
+    for (size_t i = 0; i < aircrafts.size(); i++)
+    {
+        auto& a       = aircrafts[i];
+        auto  jitter  = static_cast<double>(i % 64);
+        a.cprEvenLat  = 92095 + jitter;
+        a.cprEvenLon  = 39846 + jitter;
+        a.cprOddLat   = 88385 + jitter;
+        a.cprOddLon   = 125818 + jitter;
+        a.cprEvenTime = now;
+        a.cprOddTime  = (i % 2 == 0) ? now + std::chrono::seconds{1} : now - std::chrono::seconds{1};
+    }
+    runner.Run("1090/DecodeCpr", {.samples = 0, .messages = aircrafts.size()}, [&]() {
+        for (auto& a : aircrafts)
+        {
+            DecodeCpr(a);
+            Sink = Sink + static_cast<uint64_t>(a.lat1E7);
+        }
+    });
+}
+
+void BenchTracker(Runner& runner)
+{
+    // A busy sky, lookups mostly hit known aircraft
+    static constexpr size_t Aircrafts = 1000;
+    static constexpr size_t Lookups   = 4096;
+
+    std::mt19937          rng(978);    // NOLINT(cert-msc32-c, cert-msc51-cpp)
+    std::vector<uint32_t> addrs(Aircrafts);
+    for (auto& addr : addrs) { addr = rng() & 0xffffff; }
+    std::vector<uint32_t> lookups(Lookups);
+    for (auto& addr : lookups) { addr = (rng() % 16 == 0) ? (rng() & 0xffffff) : addrs[rng() % Aircrafts]; }
+
+    ADSB::TrafficManager trafficManager;
+    for (auto addr : addrs) { trafficManager.FindOrCreate(addr); }
+    runner.Run("Tracker/FindOrCreate", {.samples = 0, .messages = lookups.size()}, [&]() {
+        for (auto addr : lookups) { Sink = Sink + trafficManager.FindOrCreate(addr).addr; }
+    });
+}
+
+void Bench978(Runner& runner, std::string const& label, std::span<uint8_t const> const& data)
+{
+    auto name = "978/HandleData/" + label;
+    if (!runner.Selected(name) && !runner.Selected("978/process_buffer/" + label)) { return; }
+
+    Selector     selector;
+    NullListener listener;
+    auto         trafficManager = std::make_shared<ADSB::TrafficManager>();
+    trafficManager->SetListener(&listener);
+    auto  handler  = ADSB::test::TryCreateUAT978Handler(trafficManager, &selector, ADSB::Source::UAT978);
+    auto& provider = dynamic_cast<ADSB::IDataProvider&>(*handler);
+
+    auto before = GoodMessages(provider);
+    handler->HandleData(data);
+    Work work{.samples = data.size() / 2, .messages = GoodMessages(provider) - before};
+
+    // process_buffer lives in dump978, its share is the preamble scan stage of the handler's own timers
+    auto scanBefore = provider.GetStats().Latency(ADSB::LatencyStage::PreambleScan).sumNs;
+    auto result     = runner.Run(name, work, [&]() { handler->HandleData(data); });
+    if (result == nullptr || !LatencyHistogram::Enabled) { return; }
+    auto scanNs = provider.GetStats().Latency(ADSB::LatencyStage::PreambleScan).sumNs - scanBefore;
+    runner.Add({.name           = "978/process_buffer/" + label,
+                .work           = work,
+                .runs           = result->runs,
+                .nsPerIteration = static_cast<double>(scanNs) / static_cast<double>(result->runs)});
+}
+
+// Whole capture files are read into memory, up to a limit
+std::vector<uint8_t> LoadCapture(std::filesystem::path const& fpath)
+{
+    static constexpr size_t MaxBytes = size_t{64} << 20;
+    std::vector<uint8_t>    data;
+    IQFileSource            source(fpath, IQFileSource::Config{.bufferLength = RTLSDR::BufferLength});
+    source.Replay([&](std::span<uint8_t const> const& buf) {
+        if (data.size() < MaxBytes) { data.insert(data.end(), buf.begin(), buf.end()); }
+    });
+    return data;
+}
+
+std::vector<std::filesystem::path> Captures()
+{
+    std::vector<std::filesystem::path> captures;
+    if (auto* dir = getenv("RTLSDR_TEST_TRACE_DIR"); dir != nullptr)    // NOLINT(concurrency-mt-unsafe)
+    {
+        for (auto const& entry : std::filesystem::directory_iterator(dir))
+        {
+            if (entry.is_regular_file()) { captures.push_back(entry.path()); }
+        }
+    }
+    if (auto* file = getenv("RTLSDR_TEST_TRACE_FILE"); file != nullptr) { captures.emplace_back(file); }    // NOLINT(concurrency-mt-unsafe)
+    return captures;
+}
+
+// A second of air time. 3000 ADS-B frames is close to the 3200 message start opportunities per second,
+// 32 uplinks is every ground station slot in use
+std::vector<uint8_t> SyntheticUAT(double messagesPerSecond, double uplinksPerSecond, double byteErrorRate)
+{
+    UATGenerator::Config config;
+    config.aircraft          = 400;
+    config.messagesPerSecond = messagesPerSecond;
+    config.uplinksPerSecond  = uplinksPerSecond;
+    config.byteErrorRate     = byteErrorRate;
+    return UATGenerator(config).Generate();
+}
+
+std::vector<uint8_t> Noise(size_t samples)
+{
+    std::mt19937                   rng(0);    // NOLINT(cert-msc32-c, cert-msc51-cpp)
+    std::normal_distribution<double> dist(127.5, 3.0);
+    std::vector<uint8_t>           data(samples * 2);
+    for (auto& v : data) { v = static_cast<uint8_t>(std::clamp(dist(rng), 0.0, 255.0)); }
+    return data;
+}
+}    // namespace
+
+int main(int argc, char* argv[])
+try
+{
+    Options                        options;
+    std::vector<std::string_view> args(argv + 1, argv + argc);    // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        if (args[i] == "--json" && i + 1 < args.size()) { options.json = args[++i]; }
+        else if (args[i] == "--filter" && i + 1 < args.size()) { options.filter = args[++i]; }
+        else if (args[i] == "--min-time" && i + 1 < args.size()) { options.minTimeMs = std::stod(std::string(args[++i])); }
+        else
+        {
+            std::cerr << "Usage: bench_adsb [--filter <substring>] [--min-time <ms>] [--json <file>]\n";
+            return 1;
+        }
+    }
+
+    Runner runner(options);
+    Runner::PrintHeader();
+    for (auto const res : LOAD_RESOURCE_COLLECTION(traces))
+    {
+        Bench1090(runner, std::filesystem::path(res.name()).filename().string(), res.data<uint8_t>());
+    }
+    BenchMessages(runner);
+    BenchTracker(runner);
+
+    bool have978 = false;
+    for (auto const& fpath : Captures())
+    {
+        auto name = fpath.filename().string();
+        if (name.find("1090") != std::string::npos) { Bench1090(runner, name, LoadCapture(fpath)); }
+        else if (name.find("978") != std::string::npos)
+        {
+            Bench978(runner, name, LoadCapture(fpath));
+            have978 = true;
+        }
+    }
+    if (!have978) { Bench978(runner, "noise", Noise(NoiseSamples)); }
+    Bench978(runner, "synthetic-200", SyntheticUAT(200, 4, 0));
+    Bench978(runner, "synthetic-200-fec", SyntheticUAT(200, 4, 1));
+    Bench978(runner, "synthetic-3000", SyntheticUAT(3000, 32, 0));
+    Bench978(runner, "synthetic-3000-fec", SyntheticUAT(3000, 32, 1));
+
+    runner.Finish();
+    return 0;
+} catch (std::exception const& ex)
+{
+    std::cerr << "bench_adsb: " << ex.what() << '\n';
+    return 1;
+}
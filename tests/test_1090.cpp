@@ -1,11 +1,39 @@
 #include "ADSB.h"
+#include "AircraftFilter.h"
+#include "BulkDecoder.h"
+#include "IQFileSource.h"
+#include "IQRecorder.h"
+#include "MessageBatch.h"
+#include "ModeSGenerator.h"
+#include "ModeSMessage.h"
+#include "SpatialIndex.h"
 #include "TestUtils.h"
+#include "TrackHistory.h"
+#include "UATGenerator.h"
+#include "UATUplink.h"
 
 #include <fmt/base.h>
 #include <fmt/std.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <coroutine>
+#include <exception>
 #include <filesystem>
+#include <map>
 #include <memory>
+#include <numbers>
+#include <random>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 DECLARE_RESOURCE_COLLECTION(traces);
 DECLARE_RESOURCE_COLLECTION(testdata);
@@ -41,6 +69,7 @@ struct Listener : ADSB::IListener
         status[a.Addr()] = msg;
     }
     void OnDeviceStatusChanged(ADSB::Source /* source */, bool /* available */) override {}
+    void OnDataLost(ADSB::Source /* source */, uint64_t /* droppedSamples */) override {}
 
     size_t                                    index;
     std::vector<std::string>                  reference;
@@ -71,33 +100,1039 @@ TEST_CASE("TestEmbedded", "[1090]")
     // REQUIRE_NOTHROW(RunTest(pidlfiles));
 }
 
-template <typename TLambda> static void BufferedFileRead(std::filesystem::path const& fpath, size_t replayCount, TLambda const& callback)
+TEST_CASE("BufferGeometry", "[1090]")
 {
-    static constexpr size_t           BufferCount  = RTLSDR::BufferCount;
-    static constexpr size_t           BufferLength = RTLSDR::BufferLength;
-    std::vector<std::vector<uint8_t>> buffers;
-    buffers.reserve(BufferCount);
-    for (size_t i = 0; i < BufferCount; i++) { buffers.emplace_back(BufferLength); }
-    std::ifstream ifs(fpath, std::ios::binary | std::ios::in);
-    if (!ifs.good()) { throw std::runtime_error("Cannot open test data file"); }
-    size_t bufferToUse = 0;
+    Selector selector;
+    auto     mgr = std::make_shared<ADSB::TrafficManager>();
+
+    ADSB::HandlerConfig invalid{.device = {.bufferLength = 1000}};
+    REQUIRE_THROWS_AS(ADSB::test::TryCreateADSB1090Handler(mgr, &selector, ADSB::Source::ADSB1090, invalid), std::invalid_argument);
+    invalid.device = {.bufferCount = 1};
+    REQUIRE_THROWS_AS(ADSB::test::TryCreateADSB1090Handler(mgr, &selector, ADSB::Source::ADSB1090, invalid), std::invalid_argument);
 
-    while (ifs.good() && replayCount > 0)
+    // Small buffers must find the same aircraft as decoding each trace in one go
+    static constexpr size_t SmallBufferLength = 16384;
+    for (auto const res : LOAD_RESOURCE_COLLECTION(traces))
     {
-        ifs.read(reinterpret_cast<char*>(buffers[bufferToUse].data()), static_cast<std::streamsize>(BufferLength));    // NOLINT
-        if (!ifs.good())
+        auto data = res.data<uint8_t>();
+
+        Listener whole;
+        auto     wholeMgr = std::make_shared<ADSB::TrafficManager>();
+        wholeMgr->SetListener(&whole);
+        ADSB::test::TryCreateADSB1090Handler(wholeMgr, &selector, ADSB::Source::ADSB1090)->HandleData(data);
+
+        Listener chunked;
+        auto     chunkedMgr = std::make_shared<ADSB::TrafficManager>();
+        chunkedMgr->SetListener(&chunked);
+        auto handler = ADSB::test::TryCreateADSB1090Handler(
+            chunkedMgr, &selector, ADSB::Source::ADSB1090, ADSB::HandlerConfig{.device = {.bufferLength = SmallBufferLength}});
+        for (size_t offset = 0; offset < data.size(); offset += SmallBufferLength)
         {
-            ifs.close();
-            replayCount--;
-            if (replayCount == 0) { return; }
-            ifs = std::ifstream(fpath, std::ios::binary | std::ios::in);
-            continue;
+            handler->HandleData(data.subspan(offset, std::min(SmallBufferLength, data.size() - offset)));
+        }
+
+        REQUIRE(chunked.status.size() == whole.status.size());
+        for (auto const& [addr, msg] : whole.status) { REQUIRE(chunked.status.contains(addr)); }
+    }
+}
+
+TEST_CASE("Squelch", "[1090]")
+{
+    Selector selector;
+    for (auto const res : LOAD_RESOURCE_COLLECTION(traces))
+    {
+        auto data = res.data<uint8_t>();
+
+        Listener reference;
+        auto     referenceMgr = std::make_shared<ADSB::TrafficManager>();
+        referenceMgr->SetListener(&reference);
+        ADSB::test::TryCreateADSB1090Handler(referenceMgr, &selector, ADSB::Source::ADSB1090)->HandleData(data);
+
+        // With the threshold at the demodulator's own floor nothing decodable is squelched
+        for (auto mode : {ADSB::SquelchMode::Strict, ADSB::SquelchMode::Fast})
+        {
+            Listener squelched;
+            auto     squelchedMgr = std::make_shared<ADSB::TrafficManager>();
+            squelchedMgr->SetListener(&squelched);
+            ADSB::test::TryCreateADSB1090Handler(
+                squelchedMgr, &selector, ADSB::Source::ADSB1090, ADSB::HandlerConfig{.squelch = mode, .squelchFactor = 0})
+                ->HandleData(data);
+            REQUIRE(squelched.status.size() == reference.status.size());
+        }
+    }
+
+    // Silence is never searched while squelched, and always searched with squelch off
+    for (auto mode : {ADSB::SquelchMode::Off, ADSB::SquelchMode::Strict, ADSB::SquelchMode::Fast})
+    {
+        Listener quiet;
+        auto     quietMgr = std::make_shared<ADSB::TrafficManager>();
+        quietMgr->SetListener(&quiet);
+        auto handler
+            = ADSB::test::TryCreateADSB1090Handler(quietMgr, &selector, ADSB::Source::ADSB1090, ADSB::HandlerConfig{.squelch = mode});
+        handler->HandleData(std::vector<uint8_t>(RTLSDR::BufferLength, 127));
+        REQUIRE(quiet.messages.empty());
+        auto stats = dynamic_cast<ADSB::IDataProvider&>(*handler).GetStats();
+        if (mode == ADSB::SquelchMode::Off) { REQUIRE(stats.squelchedBlocks == 0); }
+        else
+        {
+            REQUIRE(stats.squelchBlocks > 0);
+            REQUIRE(stats.squelchedBlocks == stats.squelchBlocks);
+        }
+    }
+}
+
+TEST_CASE("SignalLevel", "[1090]")
+{
+    Selector selector;
+    for (auto const res : LOAD_RESOURCE_COLLECTION(traces))
+    {
+        Listener listener;
+        auto     trafficManager = std::make_shared<ADSB::TrafficManager>();
+        trafficManager->SetListener(&listener);
+        ADSB::test::TryCreateADSB1090Handler(trafficManager, &selector, ADSB::Source::ADSB1090)->HandleData(res.data<uint8_t>());
+        REQUIRE(!trafficManager->aircrafts.empty());
+        for (auto const& [addr, aircraft] : trafficManager->aircrafts)
+        {
+            REQUIRE(aircraft->SignalLevel() < 0);
+            REQUIRE(aircraft->SignalLevel() > aircraft->NoiseLevel());
+        }
+    }
+}
+
+TEST_CASE("Stats", "[1090]")
+{
+    Selector selector;
+    for (auto const res : LOAD_RESOURCE_COLLECTION(traces))
+    {
+        Listener listener;
+        auto     trafficManager = std::make_shared<ADSB::TrafficManager>();
+        trafficManager->SetListener(&listener);
+        auto  handler  = ADSB::test::TryCreateADSB1090Handler(trafficManager, &selector, ADSB::Source::ADSB1090);
+        auto& provider = dynamic_cast<ADSB::IDataProvider&>(*handler);
+        auto  before   = provider.GetStats();
+        handler->HandleData(res.data<uint8_t>());
+        auto after = provider.GetStats();
+
+        REQUIRE(after.buffers == 1);
+        REQUIRE(after.samples == res.data<uint8_t>().size() / 2);
+        REQUIRE(after.goodCrc > 0);
+        REQUIRE(after.validPreambles >= after.demodulated);
+        REQUIRE(after.overruns == 0);
+
+        after.time = before.time + std::chrono::seconds{2};
+        auto rates = after.RatesSince(before);
+        REQUIRE(rates.samples == static_cast<double>(after.samples) / 2);
+        REQUIRE(rates.goodRatio > 0);
+        REQUIRE(rates.goodRatio <= 1);
+
+        if constexpr (LatencyHistogram::Enabled)
+        {
+            REQUIRE(after.Latency(ADSB::LatencyStage::PreambleScan).count == 1);
+            REQUIRE(after.Latency(ADSB::LatencyStage::Decode).count > 0);
+            REQUIRE(after.Latency(ADSB::LatencyStage::Dispatch).count == after.Latency(ADSB::LatencyStage::Tracker).count);
+            REQUIRE(after.Latency(ADSB::LatencyStage::EndToEnd).count == 0);    // Not fed by a device
+        }
+    }
+}
+
+TEST_CASE("LatencyHistogram", "[1090]")
+{
+    for (size_t i = 1; i < LatencyHistogram::BucketCount; i++)
+    {
+        REQUIRE(LatencyHistogram::BucketUpperNs(i) > LatencyHistogram::BucketUpperNs(i - 1));
+        REQUIRE(LatencyHistogram::BucketIndex(LatencyHistogram::BucketUpperNs(i)) == i);
+        REQUIRE(LatencyHistogram::BucketIndex(LatencyHistogram::BucketUpperNs(i - 1) + 1) == i);
+    }
+
+    LatencyHistogram histogram;
+    for (int us = 1; us <= 1000; us++) { histogram.Record(std::chrono::microseconds{us}); }
+    auto snapshot = histogram.Take();
+    REQUIRE(snapshot.count == 1000);
+    REQUIRE(snapshot.maxNs == 1000000);
+    REQUIRE(snapshot.MeanNs() == 500500);
+    REQUIRE(snapshot.PercentileNs(0.5) >= 500000);
+    REQUIRE(snapshot.PercentileNs(0.5) <= 500000 * 9 / 8);
+    REQUIRE(snapshot.PercentileNs(1.0) == 1000000);
+}
+
+TEST_CASE("GainController", "[1090]")
+{
+    // Gain steps above 30 dB overload the front end, decodes peak at 20 dB
+    auto simulate = [](int gain, uint64_t goodCrc) {
+        return GainController::Window{.samples        = 2000000,
+                                      .clippedSamples = gain >= 300 ? 5000u : 0u,
+                                      .validPreambles = 1000,
+                                      .goodCrc        = goodCrc,
+                                      .badCrc         = 0};
+    };
+    std::map<int, uint64_t> decodes = {{0, 10}, {100, 60}, {200, 100}, {300, 40}, {400, 20}};
+
+    GainController controller({0, 100, 200, 300, 400}, RTLSDR::MaxGain, {});
+    REQUIRE(controller.Gain() == 400);
+    int gain = controller.Gain();
+    for (int i = 0; i < 10; i++) { gain = controller.Update(simulate(gain, decodes[gain])); }
+    REQUIRE(gain == 200);
+
+    // Probes the neighbours every now and then but always comes back
+    std::map<int, int> visits;
+    for (int i = 0; i < 300; i++)
+    {
+        gain = controller.Update(simulate(gain, decodes[gain]));
+        visits[gain]++;
+    }
+    REQUIRE(visits[200] > 250);
+    REQUIRE(visits[400] == 0);
+
+    // Without traffic it only moves when not even noise gets through
+    GainController quiet({0, 100, 200}, 0, {});
+    REQUIRE(quiet.Update({.samples = 2000000, .clippedSamples = 0, .validPreambles = 0, .goodCrc = 0, .badCrc = 0}) == 100);
+    REQUIRE(quiet.Update({.samples = 2000000, .clippedSamples = 0, .validPreambles = 0, .goodCrc = 0, .badCrc = 0}) == 100);
+    REQUIRE(quiet.Update({.samples = 2000000, .clippedSamples = 0, .validPreambles = 500, .goodCrc = 0, .badCrc = 0}) == 100);
+}
+
+TEST_CASE("Tracing", "[1090]")
+{
+    Selector selector;
+    Listener listener;
+    auto     trafficManager = std::make_shared<ADSB::TrafficManager>();
+    trafficManager->SetListener(&listener);
+    auto handler = ADSB::test::TryCreateADSB1090Handler(trafficManager, &selector, ADSB::Source::ADSB1090);
+    for (auto const res : LOAD_RESOURCE_COLLECTION(traces))
+    {
+        handler->HandleData(res.data<uint8_t>());    // Not recording
+        TraceEvents::Start();
+        handler->HandleData(res.data<uint8_t>());
+        TraceEvents::Stop();
+        handler->HandleData(res.data<uint8_t>());
+        break;
+    }
+
+    std::ostringstream out;
+    TraceEvents::WriteChromeJson(out);
+    auto json  = out.str();
+    auto count = [&](std::string_view text) {
+        size_t n = 0;
+        for (auto pos = json.find(text); pos != std::string::npos; pos = json.find(text, pos + 1)) { n++; }
+        return n;
+    };
+    REQUIRE(json.starts_with(R"({"displayTimeUnit":"ns","traceEvents":[)"));
+    REQUIRE(json.ends_with("]}\n"));
+    if constexpr (TraceEvents::Enabled)
+    {
+        REQUIRE(count(R"("name":"ADSB1090::HandleData","ph":"X")") == 1);
+        REQUIRE(count(R"("name":"ADSB1090::DetectModeS","ph":"X")") == 1);
+        REQUIRE(count(R"("name":"Listener::OnChanged","ph":"X")") > 0);
+        REQUIRE(count(R"("name":"thread_name","ph":"M")") >= 1);
+    }
+}
+
+TEST_CASE("ModeSGenerator", "[1090]")
+{
+    ModeSGenerator generator({.seconds = 1, .aircraft = 20, .messagesPerSecond = 300, .snrSpreadDb = 0});
+    auto           data = generator.Generate();
+    REQUIRE(data.size() == generator.Samples() * 2);
+
+    // Blocks are independent of how the capture is cut
+    std::vector<uint8_t> blocks;
+    generator.Generate([&](std::span<uint8_t const> const& bytes) { blocks.insert(blocks.end(), bytes.begin(), bytes.end()); }, 1000);
+    REQUIRE(blocks == data);
+
+    Selector selector;
+    Listener listener;
+    auto     trafficManager = std::make_shared<ADSB::TrafficManager>();
+    trafficManager->SetListener(&listener);
+    auto handler = ADSB::test::TryCreateADSB1090Handler(trafficManager, &selector, ADSB::Source::ADSB1090);
+    for (size_t offset = 0; offset < data.size(); offset += RTLSDR::BufferLength)
+    {
+        handler->HandleData(std::span<uint8_t const>(data).subspan(offset, std::min(RTLSDR::BufferLength, data.size() - offset)));
+    }
+
+    // Everything sent in the clear is decoded
+    size_t clear = 0;
+    for (auto const& t : generator.Transmissions()) { clear += t.overlapped ? 0 : 1; }
+    REQUIRE(clear > generator.Transmissions().size() / 2);
+    REQUIRE(dynamic_cast<ADSB::IDataProvider&>(*handler).GetStats().goodCrc >= clear);
+    for (auto const& t : generator.Transmissions())
+    {
+        if (t.overlapped || t.df != 17 || (t.frame[4] >> 3) != 4) { continue; }
+        auto const& fleet    = generator.Fleet();
+        auto        aircraft = std::ranges::find(fleet, t.addr, &ModeSGenerator::Aircraft::addr);
+        REQUIRE(trafficManager->aircrafts.contains(t.addr));
+        REQUIRE(trafficManager->aircrafts.at(t.addr)->callsign == aircraft->callsign);
+    }
+}
+
+TEST_CASE("ModeSMessage", "[1090]")
+{
+    STATIC_REQUIRE(sizeof(ADSB::ModeSMessage) <= 64);
+
+    ModeSGenerator::Aircraft aircraft{};
+    aircraft.addr      = 0xabc123;
+    aircraft.latitude  = 47.6;
+    aircraft.longitude = -122.3;
+    aircraft.altitude  = 12000;
+    aircraft.speed     = 300;
+    aircraft.heading   = 225;
+    aircraft.odd       = true;
+
+    ADSB::ModeSMessage mm{};
+    mm.msg = ModeSGenerator::EncodePosition(aircraft);
+    REQUIRE(mm.Df() == 17);
+    REQUIRE(mm.Bits() == ADSB::ModeSMessage::LongMessageBits);
+    REQUIRE(mm.Crc() == ModeSGenerator::Crc(mm.msg, ADSB::ModeSMessage::LongMessageBits));
+    REQUIRE(mm.MeType() == 11);
+    REQUIRE(mm.OddCpr());
+    auto cpr = ModeSGenerator::CprEncode(aircraft.latitude, aircraft.longitude, true);
+    REQUIRE(std::cmp_equal(mm.RawLatitude(), cpr[0]));
+    REQUIRE(std::cmp_equal(mm.RawLongitude(), cpr[1]));
+    REQUIRE(mm.Altitude() == 0);    // Not decoded, no payload
+    REQUIRE(mm.Flight().empty());
+
+    mm.msg = ModeSGenerator::EncodeVelocity(aircraft);
+    REQUIRE(mm.MeType() == 19);
+    REQUIRE(mm.MeSub() == 1);
+    REQUIRE(mm.West());
+    REQUIRE(mm.South());
+    REQUIRE(mm.EwVelocity() == mm.NsVelocity());
+
+    mm.msg = ModeSGenerator::EncodeAllCallReply(aircraft.addr);
+    REQUIRE(mm.Df() == 11);
+    REQUIRE(mm.Bits() == ADSB::ModeSMessage::ShortMessageBits);
+    REQUIRE(mm.Ca() == 5);
+}
+
+TEST_CASE("MessageListener", "[1090]")
+{
+    struct Messages : ADSB::IMessageListener
+    {
+        void OnModeSMessages(ADSB::Source /* source */, std::span<ADSB::ModeSMessage const> batch) override
+        {
+            batches++;
+            for (auto const& m : batch) { received.push_back(m); }
         }
-        callback(buffers[bufferToUse]);
-        bufferToUse = (bufferToUse + 1) % BufferCount;
+        void OnUATMessages(ADSB::Source /* source */, std::span<ADSB::UATMessage const> /* batch */) override { REQUIRE(false); }
+
+        size_t                          batches{};
+        std::vector<ADSB::ModeSMessage> received;
+    };
+
+    Selector selector;
+    for (auto const res : LOAD_RESOURCE_COLLECTION(traces))
+    {
+        Listener listener;
+        Messages messages;
+        auto     trafficManager = std::make_shared<ADSB::TrafficManager>();
+        trafficManager->SetListener(&listener);
+        auto  handler  = ADSB::test::TryCreateADSB1090Handler(trafficManager, &selector, ADSB::Source::ADSB1090);
+        auto& provider = dynamic_cast<ADSB::IDataProvider&>(*handler);
+        provider.SubscribeMessages(messages, false);
+        handler->HandleData(res.data<uint8_t>());
+
+        // Every good message, none of them tracked
+        auto stats = provider.GetStats();
+        REQUIRE(messages.received.size() == stats.goodCrc + stats.fixed);
+        REQUIRE(messages.batches >= messages.received.size() / ADSB::MessageBatch<ADSB::ModeSMessage>::Capacity);
+        REQUIRE(listener.messages.empty());
+        REQUIRE(trafficManager->aircrafts.empty());
+        REQUIRE(std::ranges::all_of(messages.received, &ADSB::ModeSMessage::CrcOk));
+        REQUIRE(std::ranges::is_sorted(messages.received, {}, &ADSB::ModeSMessage::sample));
+
+        provider.UnsubscribeMessages(messages);
+        handler->HandleData(res.data<uint8_t>());
+        REQUIRE(messages.received.size() == stats.goodCrc + stats.fixed);
+        REQUIRE(!listener.messages.empty());
+
+        // Messages only never leaves another consumer without updates: refused while one is attached,
+        // and tracking goes on once one is added
+        provider.SetTrackHistory(1024);
+        REQUIRE_THROWS_AS(provider.SubscribeMessages(messages, false), std::logic_error);
+        provider.SetTrackHistory(0);
+        provider.SubscribeMessages(messages, false);
+        Listener added;
+        provider.AddListener(added, {});
+        handler->HandleData(res.data<uint8_t>());
+        REQUIRE(!added.messages.empty());
+        provider.RemoveListener(added);
     }
+}
+
+TEST_CASE("SubscriptionFilter", "[1090]")
+{
+    ADSB::AircraftFilter everything(ADSB::SubscriptionFilter{});
+    REQUIRE(everything.PassesAll());
+
+    auto                     box = ADSB::SubscriptionFilter::BoundingBox::Around(47.45, -122.31, 30);
+    ADSB::SubscriptionFilter config{.deny = {0xabc123}, .box = box, .minAltitude = 1000, .maxAltitude = 20000};
+    config.sources = static_cast<uint8_t>(ADSB::Source::ADSB1090);
+    ADSB::AircraftFilter filter(config);
+    REQUIRE(filter.Matches(0x123456, ADSB::Source::ADSB1090, 5000, 474500000, -1223100000));
+    REQUIRE(!filter.Matches(0xabc123, ADSB::Source::ADSB1090, 5000, 474500000, -1223100000));
+    REQUIRE(!filter.Matches(0x123456, ADSB::Source::UAT978, 5000, 474500000, -1223100000));
+    REQUIRE(!filter.Matches(0x123456, ADSB::Source::ADSB1090, 30000, 474500000, -1223100000));
+    REQUIRE(!filter.Matches(0x123456, ADSB::Source::ADSB1090, 5000, 0, 0));
+    REQUIRE(!filter.Matches(0x123456, ADSB::Source::ADSB1090, 5000, 484500000, -1223100000));
+
+    ADSB::AircraftFilter antimeridian({.allow = {0x123456}, .box = ADSB::SubscriptionFilter::BoundingBox::Around(0, 179.9, 60)});
+    REQUIRE(antimeridian.Matches(0x123456, ADSB::Source::ADSB1090, 0, 100, -1795000000));
+    REQUIRE(!antimeridian.Matches(0x123457, ADSB::Source::ADSB1090, 0, 100, -1795000000));
+    REQUIRE(!antimeridian.Matches(0x123456, ADSB::Source::ADSB1090, 0, 100, 1780000000));
 
-    ifs.close();
+    // A circle over the pole takes every longitude. Short of the pole its widest point is further east and
+    // west than radius / cos(lat): (85.6, 60) is 520 NM from (80, 0)
+    auto polar = ADSB::SubscriptionFilter::BoundingBox::Around(89, 0, 120);
+    REQUIRE(polar.maxLat1E7 == 900000000);
+    REQUIRE(polar.minLon1E7 == -1800000000);
+    REQUIRE(polar.maxLon1E7 == 1800000000);
+    ADSB::AircraftFilter arctic({.box = ADSB::SubscriptionFilter::BoundingBox::Around(80, 0, 540)});
+    REQUIRE(arctic.Matches(0x123456, ADSB::Source::ADSB1090, 0, 856000000, 600000000));
+    REQUIRE(!arctic.Matches(0x123456, ADSB::Source::ADSB1090, 0, 856000000, 900000000));
+
+    // The tracker delivers exactly the updates the filter matches
+    struct Counter : ADSB::IListener
+    {
+        void OnChanged(ADSB::IAirCraft const& a) override
+        {
+            count++;
+            matched += filter.Matches(a.Addr(), a.SourceId(), a.Altitude(), a.Lat1E7(), a.Lon1E7()) ? 1 : 0;
+        }
+        void OnDeviceStatusChanged(ADSB::Source /* source */, bool /* available */) override {}
+        void OnDataLost(ADSB::Source /* source */, uint64_t /* droppedSamples */) override {}
+
+        ADSB::AircraftFilter filter;
+        size_t               count{};
+        size_t               matched{};
+    };
+
+    ModeSGenerator generator({.seconds = 2, .aircraft = 50, .messagesPerSecond = 500, .snrSpreadDb = 0});
+    auto           data = generator.Generate();
+    Selector       selector;
+    auto           replay = [&](ADSB::SubscriptionFilter const* subscription, Counter& counter) {
+        auto trafficManager = std::make_shared<ADSB::TrafficManager>();
+        trafficManager->SetListener(&counter);
+        auto handler = ADSB::test::TryCreateADSB1090Handler(trafficManager, &selector, ADSB::Source::ADSB1090);
+        if (subscription != nullptr) { dynamic_cast<ADSB::IDataProvider&>(*handler).SetFilter(*subscription); }
+        handler->HandleData(data);
+    };
+
+    ADSB::SubscriptionFilter nearby{.box = box, .minAltitude = 1000, .maxAltitude = 20000};
+    Counter                  all;
+    Counter                  filtered;
+    all.filter = ADSB::AircraftFilter(nearby);
+    replay(nullptr, all);
+    replay(&nearby, filtered);
+    REQUIRE(all.matched > 0);
+    REQUIRE(all.matched < all.count);
+    REQUIRE(filtered.count == all.matched);
+
+    // Replayed faster than real time, so every aircraft is delivered once
+    ADSB::SubscriptionFilter throttled{.minInterval = std::chrono::seconds{60}};
+    Counter                  once;
+    replay(&throttled, once);
+    REQUIRE(once.count == generator.Fleet().size());
+}
+
+TEST_CASE("CoalescingQueue", "[1090]")
+{
+    // The consumer reads a little now and then and never catches up. One event per key waits, the newest
+    ADSB::CoalescingQueue<uint64_t> queue(4);
+    std::array<uint64_t, 4>         read{};
+    std::map<uint64_t, uint64_t>    latest;
+    auto                            consume = [&](size_t count) {
+        for (auto value : std::span(read).first(queue.Read(std::span(read).first(count)))) { latest[value % 16] = value; }
+    };
+    for (uint64_t value = 0; value < 10000; value++)
+    {
+        queue.Push(value, value % 16);
+        REQUIRE(queue.Waiting() <= 16);
+        if (value % 7 == 0) { consume(2); }
+    }
+    while (queue.Waiting() > 0 || !queue.Empty())
+    {
+        queue.Drain();
+        consume(read.size());
+    }
+    for (uint64_t key = 0; key < 16; key++) { REQUIRE(latest[key] == 10000 - 16 + key); }
+}
+
+TEST_CASE("BroadcastCoalescing", "[1090]")
+{
+    // A stream nobody reads. Device status waits once per source and alerts once per aircraft, lost samples add up
+    auto trafficManager = std::make_shared<ADSB::TrafficManager>();
+    auto queue          = std::make_shared<ADSB::TrafficManager::EventQueue>(2);
+    trafficManager->AddStream(queue, {});
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        trafficManager->NotifyDeviceStatus(ADSB::Source::ADSB1090, i % 2 == 0);
+        trafficManager->NotifyDataLost(ADSB::Source::ADSB1090, 10);
+        trafficManager->NotifyDataLost(ADSB::Source::UAT978, 1);
+    }
+    // Device status and the lost samples of each source behind the two events in the ring
+    REQUIRE(queue->Waiting() == 3);
+
+    // Two aircraft close to ownship climbing in and out of the proximity band, alerting on and off
+    auto now                   = std::chrono::system_clock::now();
+    trafficManager->bufferTime = now;
+    ADSB::AirCraftImpl ownship{};
+    ownship.lat1E7   = 470000000;
+    ownship.lon1E7   = 80000000;
+    ownship.altitude = 10000;
+    ownship.speed    = 300;
+    ownship.track    = 90;
+    ownship.seen     = now;
+    trafficManager->proximity.SetOwnship(ownship);
+    for (uint32_t i = 0; i < 1000; i++)
+    {
+        for (uint32_t addr : {0x4b1234u, 0x4b5678u})
+        {
+            auto& traffic    = trafficManager->FindOrCreate(addr);
+            traffic.lat1E7   = ownship.lat1E7 + 100;
+            traffic.lon1E7   = ownship.lon1E7;
+            traffic.speed    = 300;
+            traffic.track    = 90;
+            traffic.altitude = i % 2 == 0 ? 10200 : 12000;
+            trafficManager->NotifyChanged(traffic);
+        }
+    }
+    // Plus the update and the alert of each aircraft
+    REQUIRE(queue->Waiting() == 7);
+
+    std::map<ADSB::Source, uint64_t>         dropped;
+    std::map<ADSB::Source, bool>             available;
+    std::map<uint32_t, ADSB::ProximityLevel> alerts;
+    std::array<ADSB::ListenerEvent, 2>       read{};
+    while (queue->Waiting() > 0 || !queue->Empty())
+    {
+        queue->Drain();
+        for (auto const& event : std::span(read).first(queue->Read(read)))
+        {
+            if (event.kind == ADSB::ListenerEvent::Kind::DataLost) { dropped[event.sourceId] += event.droppedSamples; }
+            if (event.kind == ADSB::ListenerEvent::Kind::DeviceStatus) { available[event.sourceId] = event.available; }
+            if (event.kind == ADSB::ListenerEvent::Kind::Proximity) { alerts[event.alert.addr] = event.alert.level; }
+        }
+    }
+    REQUIRE(dropped[ADSB::Source::ADSB1090] == 10000);
+    REQUIRE(dropped[ADSB::Source::UAT978] == 1000);
+    REQUIRE(!available[ADSB::Source::ADSB1090]);
+    REQUIRE(alerts.size() == 2);
+    for (auto const& [addr, level] : alerts) { REQUIRE(level == ADSB::ProximityLevel::None); }
+}
+
+TEST_CASE("ListenerFanOut", "[1090]")
+{
+    struct Recorder : ADSB::IListener
+    {
+        void OnChanged(ADSB::IAirCraft const& a) override
+        {
+            while (held) { std::this_thread::yield(); }
+            last[a.Addr()] = fmt::format("{}", a);
+            count++;
+        }
+        void OnDeviceStatusChanged(ADSB::Source /* source */, bool /* available */) override {}
+        void OnDataLost(ADSB::Source /* source */, uint64_t /* droppedSamples */) override {}
+
+        std::atomic<bool>                         held{false};
+        std::atomic<size_t>                       count{};
+        std::unordered_map<uint32_t, std::string> last;
+    };
+
+    ModeSGenerator generator({.seconds = 2, .aircraft = 50, .messagesPerSecond = 500, .snrSpreadDb = 0});
+    auto           data = generator.Generate();
+    Selector       selector;
+    auto           trafficManager = std::make_shared<ADSB::TrafficManager>();
+    auto           handler        = ADSB::test::TryCreateADSB1090Handler(trafficManager, &selector, ADSB::Source::ADSB1090);
+    auto&          provider       = dynamic_cast<ADSB::IDataProvider&>(*handler);
+
+    // A display on the decode thread, a logger keeping up and an uplink that stalls until decoding is done
+    Recorder display;
+    Recorder logger;
+    Recorder uplink;
+    uplink.held = true;
+    trafficManager->SetListener(&display);
+    provider.AddListener(logger, {.delivery = ADSB::ListenerOptions::Delivery::Queued, .queueCapacity = 1u << 16u});
+    provider.AddListener(uplink, {.delivery = ADSB::ListenerOptions::Delivery::Queued, .queueCapacity = 4});
+    handler->HandleData(data);
+    uplink.held = false;
+
+    // Updates held back by the full queue go out with the next buffer, as the handler flushes after each
+    auto coalesced = provider.GetStats().coalescedUpdates;
+    auto deadline  = std::chrono::steady_clock::now() + std::chrono::seconds{10};
+    while ((logger.count < display.count || uplink.count + coalesced < display.count) && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        trafficManager->Flush();
+    }
+    REQUIRE(display.count > generator.Fleet().size());
+    REQUIRE(logger.count == display.count);
+    REQUIRE(coalesced > 0);
+    REQUIRE(uplink.count + coalesced == display.count);
+    // What the stalled listener missed were older states, every aircraft ends where the display has it
+    REQUIRE(logger.last == display.last);
+    REQUIRE(uplink.last == display.last);
+
+    provider.RemoveListener(logger);
+    provider.RemoveListener(uplink);
+    auto logged = logger.count.load();
+    handler->HandleData(data);
+    REQUIRE(logger.count == logged);
+}
+
+// Fire and forget coroutine, enough to drive an UpdateStream from a test
+struct Task
+{
+    struct promise_type
+    {
+        Task               get_return_object() { return {}; }
+        std::suspend_never initial_suspend() { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void               return_void() {}
+        void               unhandled_exception() { std::terminate(); }
+    };
+};
+
+TEST_CASE("UpdateStream", "[1090]")
+{
+    ModeSGenerator generator({.seconds = 2, .aircraft = 50, .messagesPerSecond = 500, .snrSpreadDb = 0});
+    auto           data = generator.Generate();
+    Selector       selector;
+    auto           trafficManager = std::make_shared<ADSB::TrafficManager>();
+    auto           handler        = ADSB::test::TryCreateADSB1090Handler(trafficManager, &selector, ADSB::Source::ADSB1090);
+    auto&          provider       = dynamic_cast<ADSB::IDataProvider&>(*handler);
+
+    struct Reader
+    {
+        size_t                                    count{};
+        std::unordered_map<uint32_t, std::string> last;
+        bool                                      done{};
+    };
+    auto take = [](Reader& reader, std::span<ADSB::UpdateStream::Update const> updates) {
+        for (auto const& update : updates)
+        {
+            reader.last[update.aircraft.Addr()] = fmt::format("{}", static_cast<ADSB::IAirCraft const&>(update.aircraft));
+        }
+        reader.count += updates.size();
+    };
+
+    // An event loop: the producer hands the suspended reader over and the loop resumes it
+    std::vector<std::coroutine_handle<>> ready;
+    auto awaited = provider.OpenStream({.queueCapacity = 1u << 16u, .schedule = [&](std::coroutine_handle<> h) { ready.push_back(h); }});
+    auto polled  = provider.OpenStream({.queueCapacity = 4});
+    auto run     = [&]() {
+        while (!ready.empty()) { std::exchange(ready, {}).front().resume(); }
+    };
+
+    Reader coroutine;
+    Reader poller;
+    auto   read = [](ADSB::UpdateStream& stream, Reader& reader, auto const& take) -> Task {
+        std::array<ADSB::UpdateStream::Update, 64> batch;
+        while (auto n = co_await stream.Read(batch)) { take(reader, std::span(batch).first(n)); }
+        reader.done = true;
+    };
+    read(*awaited, coroutine, take);
+    REQUIRE(coroutine.count == 0);
+
+    Listener display;
+    trafficManager->SetListener(&display);
+    handler->HandleData(data);
+    run();
+    REQUIRE(coroutine.count == display.messages.size());
+    REQUIRE(coroutine.last == display.status);
+
+    // Polled without blocking, a small queue keeps the newest state of each aircraft
+    std::array<ADSB::UpdateStream::Update, 16> batch;
+    while (auto n = polled->TryRead(batch))
+    {
+        take(poller, std::span(batch).first(n));
+        trafficManager->Flush();
+    }
+    REQUIRE(poller.count + provider.GetStats().coalescedUpdates == display.messages.size());
+    REQUIRE(poller.last == display.status);
+
+    awaited->Close();
+    run();
+    REQUIRE(coroutine.done);
+
+    // Closed while an update waits for the loop to resume the reader: the update is read first
+    Reader closing;
+    auto   late = provider.OpenStream({.schedule = [&](std::coroutine_handle<> h) { ready.push_back(h); }});
+    read(*late, closing, take);
+    trafficManager->NotifyDeviceStatus(ADSB::Source::ADSB1090, true);
+    late->Close();
+    run();
+    REQUIRE(closing.count == 1);
+    REQUIRE(closing.done);
+
+    // Without a schedule the reader resumes on the data handler thread, where it may change the filter.
+    // The stream ends with the provider
+    Reader inlined;
+    auto   direct   = provider.OpenStream({});
+    auto   refilter = [](ADSB::IDataProvider& source, ADSB::UpdateStream& stream, Reader& reader) -> Task {
+        std::array<ADSB::UpdateStream::Update, 64> updates;
+        while (auto n = co_await stream.Read(updates))
+        {
+            source.SetFilter({});
+            reader.count += n;
+        }
+        reader.done = true;
+    };
+    refilter(provider, *direct, inlined);
+    auto delivered = display.messages.size();
+    handler->HandleData(data);
+    REQUIRE(inlined.count == display.messages.size() - delivered);
+    REQUIRE(!inlined.done);
+    handler.reset();
+    trafficManager.reset();
+    REQUIRE(inlined.done);
+}
+
+TEST_CASE("SpatialIndex", "[1090]")
+{
+    // Random traffic around a hub, across the antimeridian and near a pole, checked against a linear scan
+    std::mt19937                         rng(42);
+    std::vector<ADSB::SpatialIndex::Hit> all;
+    ADSB::SpatialIndex                   index;
+    auto                                 add = [&](double lat, double lon, double spread, size_t n) {
+        std::uniform_real_distribution<double> d(-spread, spread);
+        for (size_t i = 0; i < n; i++)
+        {
+            auto wrap = [](double x) { return x > 180 ? x - 360 : (x < -180 ? x + 360 : x); };
+            auto la   = std::clamp(lat + d(rng), -90., 90.);
+            all.push_back({.addr   = static_cast<uint32_t>(all.size() + 1),
+                           .lat1E7 = static_cast<int32_t>(std::lround(la * ADSB::IAirCraft::LatLonPrecision)),
+                           .lon1E7 = static_cast<int32_t>(std::lround(wrap(lon + d(rng)) * ADSB::IAirCraft::LatLonPrecision))});
+        }
+    };
+    add(47.45, -122.31, 3, 400);
+    add(0, 180, 2, 100);
+    add(88, 0, 3, 100);
+    auto start = std::chrono::system_clock::now();
+    for (auto const& h : all) { index.Update(h.addr, 0, 0, start); }    // Then moved to where they are
+    for (auto const& h : all) { index.Update(h.addr, h.lat1E7, h.lon1E7, start); }
+    REQUIRE(index.Size() == all.size());
+
+    auto addrs = [](std::vector<ADSB::SpatialIndex::Hit> const& hits) {
+        std::vector<uint32_t> out;
+        for (auto const& h : hits) { out.push_back(h.addr); }
+        std::ranges::sort(out);
+        return out;
+    };
+    std::vector<ADSB::SpatialIndex::Hit> hits;
+    for (auto [lat, lon, radius] : {std::tuple{47.45, -122.31, 40.}, {0., 179.9, 90.}, {89., 100., 200.}, {10., 10., 50.}})
+    {
+        std::vector<ADSB::SpatialIndex::Hit> expected;
+        for (auto h : all)
+        {
+            h.distanceNm = ADSB::SpatialIndex::DistanceNm(lat, lon, h.lat1E7, h.lon1E7);
+            if (h.distanceNm <= radius) { expected.push_back(h); }
+        }
+        index.Around(lat, lon, radius, hits);
+        REQUIRE(addrs(hits) == addrs(expected));
+        REQUIRE(std::ranges::is_sorted(hits, {}, &ADSB::SpatialIndex::Hit::distanceNm));
+
+        auto box = ADSB::SubscriptionFilter::BoundingBox::Around(lat, lon, radius);
+        expected.clear();
+        ADSB::AircraftFilter filter({.box = box});
+        std::ranges::copy_if(all, std::back_inserter(expected), [&](auto const& h) {
+            return filter.Matches(h.addr, ADSB::Source::ADSB1090, 0, h.lat1E7, h.lon1E7);
+        });
+        index.Within(box, hits);
+        REQUIRE(addrs(hits) == addrs(expected));
+
+        // Points clamped to the pole tie, so distances are compared
+        std::vector<double> nearest;
+        for (auto const& h : all) { nearest.push_back(ADSB::SpatialIndex::DistanceNm(lat, lon, h.lat1E7, h.lon1E7)); }
+        std::ranges::sort(nearest);
+        index.Nearest(lat, lon, 5, hits);
+        REQUIRE(hits.size() == 5);
+        for (size_t i = 0; i < hits.size(); i++) { REQUIRE(hits[i].distanceNm == nearest[i]); }
+    }
+
+    // Aircraft that left coverage are skipped by age, or removed
+    auto later = start + std::chrono::minutes{5};
+    index.Update(all[0].addr, all[0].lat1E7, all[0].lon1E7, later);
+    index.Around(47.45, -122.31, 400, hits, later);
+    REQUIRE(addrs(hits) == std::vector<uint32_t>{all[0].addr});
+    index.Nearest(47.45, -122.31, 5, hits, later);
+    REQUIRE(addrs(hits) == std::vector<uint32_t>{all[0].addr});
+    index.Within(ADSB::SubscriptionFilter::BoundingBox::Around(47.45, -122.31, 400), hits, later);
+    REQUIRE(addrs(hits) == std::vector<uint32_t>{all[0].addr});
+    REQUIRE(index.Remove(all[0].addr));
+    REQUIRE(!index.Remove(all[0].addr));
+    index.Around(47.45, -122.31, 400, hits, later);
+    REQUIRE(hits.empty());
+    REQUIRE(index.Size() == all.size() - 1);
+
+    // The tracker keeps the index in step with decoded positions
+    ModeSGenerator generator({.seconds = 2, .aircraft = 50, .messagesPerSecond = 500, .snrSpreadDb = 0});
+    auto           data = generator.Generate();
+    Selector       selector;
+    auto           trafficManager = std::make_shared<ADSB::TrafficManager>();
+    auto           handler        = ADSB::test::TryCreateADSB1090Handler(trafficManager, &selector, ADSB::Source::ADSB1090);
+    Listener       listener;
+    trafficManager->SetListener(&listener);
+    handler->HandleData(data);
+    size_t located = 0;
+    for (auto const& [addr, a] : trafficManager->aircrafts)
+    {
+        if (a->lat1E7 == 0 && a->lon1E7 == 0) { continue; }
+        located++;
+        auto lat = a->lat1E7 / ADSB::IAirCraft::LatLonPrecision;
+        auto lon = a->lon1E7 / ADSB::IAirCraft::LatLonPrecision;
+        trafficManager->positions.Nearest(lat, lon, 1, hits);
+        REQUIRE(hits.at(0).distanceNm == 0);
+    }
+    REQUIRE(located > 0);
+    REQUIRE(trafficManager->positions.Size() == located);
+}
+
+TEST_CASE("Proximity", "[1090]")
+{
+    struct Recorder : ADSB::IListener
+    {
+        void OnChanged(ADSB::IAirCraft const& /* a */) override {}
+        void OnDeviceStatusChanged(ADSB::Source /* source */, bool /* available */) override {}
+        void OnDataLost(ADSB::Source /* source */, uint64_t /* droppedSamples */) override {}
+        void OnProximity(ADSB::ProximityAlert const& alert) override { alerts.push_back(alert); }
+
+        std::vector<ADSB::ProximityAlert> alerts;
+    };
+
+    auto     trafficManager = std::make_shared<ADSB::TrafficManager>();
+    Recorder recorder;
+    trafficManager->SetListener(&recorder);
+    auto now                   = std::chrono::system_clock::now();
+    trafficManager->bufferTime = now;
+
+    // Ownship eastbound at 300 kt, traffic westbound at 300 kt, east of it at 200 ft above
+    auto nmEast = [](double nm) {
+        return static_cast<int32_t>(std::lround((8.0 + (nm / (60 * std::cos(47.0 * std::numbers::pi / 180)))) * 1E7));
+    };
+    ADSB::AirCraftImpl ownship{};
+    ownship.lat1E7   = 470000000;
+    ownship.lon1E7   = 80000000;
+    ownship.altitude = 10000;
+    ownship.speed    = 300;
+    ownship.track    = 90;
+    ownship.seen     = now;
+    auto& traffic    = trafficManager->FindOrCreate(0x4b1234);
+    traffic.lat1E7   = ownship.lat1E7;
+    traffic.lon1E7   = nmEast(5);
+    traffic.altitude = 10200;
+    traffic.speed    = 300;
+    traffic.track    = 270;
+
+    // Nothing to compare with before ownship is known
+    trafficManager->NotifyChanged(traffic);
+    REQUIRE(recorder.alerts.empty());
+
+    trafficManager->proximity.SetOwnship(ownship);
+    // 10 NM apart closing at 600 kt meet in 60 s, past the 40 s lookahead
+    traffic.lon1E7 = nmEast(10);
+    trafficManager->NotifyChanged(traffic);
+    REQUIRE(recorder.alerts.empty());
+
+    // 5 NM apart meet in 30 s
+    traffic.lon1E7 = nmEast(5);
+    trafficManager->NotifyChanged(traffic);
+    REQUIRE(recorder.alerts.size() == 1);
+    REQUIRE(recorder.alerts[0].addr == traffic.addr);
+    REQUIRE(recorder.alerts[0].level == ADSB::ProximityLevel::Conflict);
+    REQUIRE(std::abs(recorder.alerts[0].rangeNm - 5) < 0.05);
+    REQUIRE(recorder.alerts[0].cpaNm < 0.01);
+    REQUIRE(recorder.alerts[0].cpaAltitudeDiffFt == 200);
+    REQUIRE(std::abs(recorder.alerts[0].timeToCpaSeconds - 30) < 0.5);
+
+    // Unchanged level, no new alert
+    traffic.lon1E7 = nmEast(4.5);
+    trafficManager->NotifyChanged(traffic);
+    REQUIRE(recorder.alerts.size() == 1);
+
+    // Turned away and faster than ownship, still close
+    traffic.track = 90;
+    traffic.speed = 400;
+    trafficManager->NotifyChanged(traffic);
+    REQUIRE(recorder.alerts.size() == 2);
+    REQUIRE(recorder.alerts[1].level == ADSB::ProximityLevel::Proximate);
+    REQUIRE(recorder.alerts[1].timeToCpaSeconds == 0);
+
+    // Climbed out of the proximate band
+    traffic.altitude = 12000;
+    trafficManager->NotifyChanged(traffic);
+    REQUIRE(recorder.alerts.size() == 3);
+    REQUIRE(recorder.alerts[2].level == ADSB::ProximityLevel::None);
+
+    // Thresholds wide enough for the same geometry to be a conflict
+    trafficManager->proximity.SetConfig({.verticalFt = 3000});
+    trafficManager->NotifyChanged(traffic);
+    REQUIRE(recorder.alerts.size() == 3);
+    traffic.track = 270;
+    trafficManager->NotifyChanged(traffic);
+    REQUIRE(recorder.alerts.size() == 4);
+    REQUIRE(recorder.alerts[3].level == ADSB::ProximityLevel::Conflict);
+
+    // Traffic without altitude or velocity yet isn't taken as at sea level or standing still
+    ADSB::AirCraftImpl climbing{};
+    climbing.addr   = 0x4b5678;
+    climbing.lat1E7 = ownship.lat1E7;
+    climbing.lon1E7 = nmEast(0.5);
+    trafficManager->NotifyChanged(climbing);
+    climbing.altitude = 10000;
+    trafficManager->NotifyChanged(climbing);
+    REQUIRE(recorder.alerts.size() == 4);
+
+    // Ownship moved away, the alert is over without another update of the traffic
+    ownship.lon1E7 = nmEast(-50);
+    trafficManager->proximity.SetOwnship(ownship);
+    trafficManager->Flush();
+    REQUIRE(recorder.alerts.size() == 5);
+    REQUIRE(recorder.alerts[4].addr == traffic.addr);
+    REQUIRE(recorder.alerts[4].level == ADSB::ProximityLevel::None);
+    REQUIRE(recorder.alerts[4].rangeNm > 50);
+
+    // Traffic that stops reporting is cleared once stale
+    ownship.lon1E7 = 80000000;
+    trafficManager->proximity.SetOwnship(ownship);
+    trafficManager->NotifyChanged(traffic);
+    REQUIRE(recorder.alerts.size() == 6);
+    trafficManager->bufferTime = now + std::chrono::seconds{10};
+    trafficManager->Flush();
+    REQUIRE(recorder.alerts.size() == 6);
+    trafficManager->bufferTime = now + std::chrono::seconds{30};
+    trafficManager->Flush();
+    REQUIRE(recorder.alerts.size() == 7);
+    REQUIRE(recorder.alerts[6].level == ADSB::ProximityLevel::None);
+}
+
+TEST_CASE("TrackHistory", "[1090]")
+{
+    // A climbing turn across the antimeridian, recorded into two blocks per aircraft
+    ADSB::TrackHistory                      history;
+    std::vector<ADSB::TrackHistory::Sample> recorded;
+    auto                                    start = std::chrono::system_clock::time_point{std::chrono::milliseconds{1700000000123}};
+    std::mt19937                            rng(7);
+    std::uniform_int_distribution<int32_t>  jitter(-500, 500);
+    history.Record(0x123456, {.time = start});
+    REQUIRE(history.Size() == 0);
+    history.Configure(2 * ADSB::TrackHistory::BlockBytes);
+    for (int32_t i = 0; i < 200; i++)
+    {
+        auto lon = int64_t{1799000000} + (i * 20000) + jitter(rng);
+        recorded.push_back({.time     = start + std::chrono::milliseconds{(i * 1000) + jitter(rng)},
+                            .lat1E7   = 520000000 - (i * 15000) + jitter(rng),
+                            .lon1E7   = static_cast<int32_t>(lon > 1800000000 ? lon - 3600000000 : lon),
+                            .altitude = 3000 + (i * 25)});
+        history.Record(0xabcdef, recorded.back());
+    }
+    history.Record(0x123456, {.time = start, .lat1E7 = 1, .lon1E7 = 2, .altitude = 3});
+
+    // The newest samples, without a gap and exactly as recorded
+    std::vector<ADSB::TrackHistory::Sample> trail;
+    auto count = history.Visit(0xabcdef, [&](ADSB::TrackHistory::Sample const& s) { trail.push_back(s); });
+    REQUIRE(count == trail.size());
+    REQUIRE(trail.size() > 2 * (ADSB::TrackHistory::BlockBytes / 20));
+    REQUIRE(trail.size() < recorded.size());
+    auto equal = [](ADSB::TrackHistory::Sample const& a, ADSB::TrackHistory::Sample const& b) {
+        return std::tie(a.time, a.lat1E7, a.lon1E7, a.altitude) == std::tie(b.time, b.lat1E7, b.lon1E7, b.altitude);
+    };
+    REQUIRE(std::ranges::equal(trail, std::span(recorded).last(trail.size()), equal));
+    REQUIRE(history.Visit(0x123456, [](auto const& s) { REQUIRE(s.altitude == 3); }) == 1);
+    REQUIRE(history.Visit(0x654321, [](auto const&) {}) == 0);
+
+    // Decoded positions land in the provider's history
+    ModeSGenerator generator({.seconds = 5, .aircraft = 20, .messagesPerSecond = 400, .snrSpreadDb = 0});
+    auto           data = generator.Generate();
+    Selector       selector;
+    auto           trafficManager = std::make_shared<ADSB::TrafficManager>();
+    auto           handler        = ADSB::test::TryCreateADSB1090Handler(trafficManager, &selector, ADSB::Source::ADSB1090);
+    auto&          provider       = dynamic_cast<ADSB::IDataProvider&>(*handler);
+    struct : ADSB::IListener
+    {
+        void OnChanged(ADSB::IAirCraft const& /* a */) override {}
+        void OnDeviceStatusChanged(ADSB::Source /* source */, bool /* available */) override {}
+        void OnDataLost(ADSB::Source /* source */, uint64_t /* droppedSamples */) override {}
+    } listener;
+    trafficManager->SetListener(&listener);
+    provider.SetTrackHistory(1024);
+    handler->HandleData(data);
+    REQUIRE(provider.History().Size() == trafficManager->positions.Size());
+    for (auto const& [addr, a] : trafficManager->aircrafts)
+    {
+        if (a->lat1E7 == 0 && a->lon1E7 == 0) { continue; }
+        ADSB::TrackHistory::Sample last{};
+        REQUIRE(provider.History().Visit(addr, [&](ADSB::TrackHistory::Sample const& s) { last = s; }) > 1);
+        REQUIRE(last.lat1E7 == a->lat1E7);
+        REQUIRE(last.lon1E7 == a->lon1E7);
+    }
+}
+
+TEST_CASE("BulkDecoder", "[1090]")
+{
+    ModeSGenerator generator({.seconds = 3, .aircraft = 50, .messagesPerSecond = 1000});
+    auto           fpath = std::filesystem::temp_directory_path() / "libadsb_bulkdecoder_1090.bin";
+    {
+        auto data = generator.Generate();
+        std::ofstream(fpath, std::ios::binary).write(reinterpret_cast<char const*>(data.data()), static_cast<std::streamsize>(data.size()));
+    }
+    {
+        IQFileSource source(fpath, IQFileSource::Config{.bufferLength = RTLSDR::BufferLength});
+        Selector     selector;
+        Listener     serial;
+        auto         serialManager = std::make_shared<ADSB::TrafficManager>();
+        serialManager->SetListener(&serial);
+        auto handler = ADSB::test::TryCreateADSB1090Handler(serialManager, &selector, ADSB::Source::ADSB1090);
+        auto iq      = source.Data();    // Replay leaves out the partial buffer at the end, the bulk decoder doesn't
+        for (size_t offset = 0; offset < iq.size(); offset += RTLSDR::BufferLength)
+        {
+            handler->HandleData(iq.subspan(offset, std::min(RTLSDR::BufferLength, iq.size() - offset)));
+        }
+
+        // Chunks of ~1 s, the same updates come out in the same order
+        Listener              bulk;
+        auto                  bulkManager = std::make_shared<ADSB::TrafficManager>();
+        std::vector<uint64_t> samples;
+        bulkManager->SetListener(&bulk);
+        bulkManager->history.Configure(1024);
+        auto        start = std::chrono::system_clock::time_point{std::chrono::seconds{1700000000}};
+        BulkDecoder decoder({.chunkSamples = size_t{1} << 21, .marginSamples = size_t{1} << 19, .threads = 2, .start = start});
+        auto        totals = decoder.Run(source, bulkManager, [&](ADSB::DemodulatedFrame const& f) { samples.push_back(f.sample); });
+        REQUIRE(totals.chunks == 3);
+        REQUIRE(totals.frames == samples.size());
+        REQUIRE(std::ranges::is_sorted(samples));
+        REQUIRE(!bulk.messages.empty());
+        REQUIRE(bulk.messages == serial.messages);
+
+        // Positions are stamped with the capture's time, not the replay's
+        size_t stamped = 0;
+        for (auto const& [addr, a] : bulkManager->aircrafts)
+        {
+            stamped += bulkManager->history.Visit(addr, [&](ADSB::TrackHistory::Sample const& s) {
+                REQUIRE(s.time >= start);
+                REQUIRE(s.time <= start + std::chrono::seconds{4});
+            });
+        }
+        REQUIRE(stamped > 0);
+    }
+    std::filesystem::remove(fpath);
+}
+
+TEST_CASE("OverflowPolicy", "[rtlsdr]")
+{
+    static constexpr size_t BufferLength = RTLSDR::BufferAlignment;
+    static constexpr size_t BufferCount  = 4;
+
+    Selector             selector;
+    std::vector<uint8_t> data(BufferLength * (BufferCount + 2));
+    for (auto policy : {RTLSDR::OverflowPolicy::DropNewest, RTLSDR::OverflowPolicy::DropOldest})
+    {
+        // Nothing consumes, so everything past the usable slots (count - 1) overflows
+        RTLSDR rtlsdr(&selector,
+                      RTLSDR::InvalidDeviceIndex,
+                      RTLSDR::Config{.bufferLength = BufferLength, .bufferCount = BufferCount, .overflowPolicy = policy});
+        rtlsdr.OnDataAvailable(data);
+        auto stats = rtlsdr.GetOverflowStats();
+        REQUIRE(stats.overruns == 3);
+        REQUIRE(stats.droppedBuffers == 3);
+        REQUIRE(stats.droppedSamples == 3 * BufferLength / 2);
+    }
 }
 
 static void RunTestWithFile(std::filesystem::path const& fpath)
@@ -117,11 +1152,132 @@ static void RunTestWithFile(std::filesystem::path const& fpath)
     auto     mgr = std::make_shared<ADSB::TrafficManager>();
     mgr->SetListener(&listener);
     Selector selector;
-    auto     handler = creator(mgr, &selector, ADSB::Source::UAT978);
-    BufferedFileRead(fpath, 1, [&](auto const& buf) { handler->HandleData(buf); });
+    auto     handler = creator(mgr, &selector, ADSB::Source::UAT978, ADSB::HandlerConfig{});
+    IQFileSource source(fpath, IQFileSource::Config{.bufferLength = RTLSDR::BufferLength});
+    source.Replay([&](auto const& buf) { handler->HandleData(buf); });
     TestCommon::CheckResource<TestCommon::StrFormat>(listener.messages, fpath.filename().stem().string());
 }
 
+TEST_CASE("IQFileSource", "[rtlsdr]")
+{
+    static constexpr size_t BufferLength = 4096;
+
+    auto fpath = std::filesystem::temp_directory_path() / "libadsb_iqfilesource.dat";
+    {
+        std::vector<char> data((BufferLength * 3) + 100, 'x');
+        std::ofstream(fpath, std::ios::binary).write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+    {
+        IQFileSource source(fpath, IQFileSource::Config{.bufferLength = BufferLength});
+        REQUIRE(source.BufferCount() == 3);
+        std::vector<uint8_t const*> buffers;
+        REQUIRE(source.Replay([&](std::span<uint8_t const> const& buf) {
+            REQUIRE(buf.size() == BufferLength);
+            buffers.push_back(buf.data());
+        }) == 3);
+        // Spans point straight into the mapping
+        REQUIRE(buffers.front() == source.Data().data());
+        REQUIRE(buffers.back() == source.Data().data() + (2 * BufferLength));
+
+        // 3 buffers of 2048 samples at 2 MS/s x 2 take ~1.5ms
+        IQFileSource paced(fpath,
+                           IQFileSource::Config{
+                               .bufferLength = BufferLength, .sampleRate = 2000000, .pacing = IQFileSource::Pacing::RealTime, .speed = 2});
+        auto start = std::chrono::steady_clock::now();
+        REQUIRE(paced.Replay([](auto const& /* buf */) {}) == 3);
+        REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::microseconds{1536});
+    }
+    std::filesystem::remove(fpath);
+}
+
+TEST_CASE("IQRecorder", "[rtlsdr]")
+{
+    static constexpr size_t BufferLength = 3000;    // Deliberately not a multiple of the I/O alignment
+    static constexpr size_t BufferCount  = 5;
+
+    auto dir = std::filesystem::temp_directory_path() / "libadsb_iqrecorder";
+    std::filesystem::remove_all(dir);
+    std::vector<uint8_t> expected;
+    {
+        // Rotate after every 2 buffers
+        IQRecorder recorder(IQRecorder::Config{.directory    = dir,
+                                               .frequency    = 978000000,
+                                               .bufferLength = BufferLength,
+                                               .queueLength  = BufferCount,
+                                               .maxFileBytes = BufferLength * 2});
+        for (size_t i = 0; i < BufferCount; i++)
+        {
+            std::vector<uint8_t> buffer(BufferLength, static_cast<uint8_t>(i));
+            REQUIRE(recorder.Record(buffer));
+            expected.insert(expected.end(), buffer.begin(), buffer.end());
+        }
+    }
+
+    std::vector<std::filesystem::path> files;
+    for (auto const& entry : std::filesystem::directory_iterator(dir)) { files.push_back(entry.path()); }
+    std::ranges::sort(files);    // Same second rotations get _1, _2 ... suffixes
+    REQUIRE(files.size() == 3);
+    REQUIRE(files.front().filename().string().starts_with("rtlsdr_978_"));
+
+    std::vector<uint8_t> actual;
+    for (auto const& file : files)
+    {
+        IQFileSource source(file, IQFileSource::Config{.bufferLength = BufferLength});
+        actual.insert(actual.end(), source.Data().begin(), source.Data().end());
+    }
+    REQUIRE(actual == expected);
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("IQCapture", "[rtlsdr]")
+{
+    static constexpr size_t BufferLength = 8192;
+    static constexpr size_t BufferCount  = 6;
+
+    // Near-noise samples with a strong burst in the middle
+    std::vector<uint8_t> expected(BufferLength * BufferCount);
+    uint32_t             seed = 1;
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        seed        = (seed * 1103515245u) + 12345u;
+        expected[i] = static_cast<uint8_t>(125u + ((seed >> 16u) % 6u));
+        if (i > 20000 && i < 22000) { expected[i] = static_cast<uint8_t>(i * 37u); }
+    }
+
+    auto dir = std::filesystem::temp_directory_path() / "libadsb_iqcapture";
+    std::filesystem::remove_all(dir);
+    {
+        IQRecorder recorder(IQRecorder::Config{.directory    = dir,
+                                               .frequency    = 1090000000,
+                                               .bufferLength = BufferLength,
+                                               .queueLength  = BufferCount,
+                                               .compress     = true,
+                                               .sampleRate   = 2000000});
+        for (size_t i = 0; i < BufferCount; i++)
+        {
+            REQUIRE(recorder.Record(std::span<uint8_t const>(expected).subspan(i * BufferLength, BufferLength)));
+        }
+    }
+    auto fpath = std::filesystem::directory_iterator(dir)->path();
+    REQUIRE(fpath.extension() == ".iqz");
+    REQUIRE(std::filesystem::file_size(fpath) < expected.size() / 2);
+
+    // Replay with buffers that straddle chunks
+    IQFileSource source(fpath, IQFileSource::Config{.bufferLength = BufferLength * 3 / 2, .sampleRate = 0});
+    REQUIRE(source.IsCompressed());
+    REQUIRE(source.SampleRate() == 2000000);
+    REQUIRE(source.Chunks().size() == BufferCount);
+    REQUIRE(source.Chunks()[1].header.firstSample == BufferLength / 2);
+    REQUIRE(source.Chunks()[1].header.frequency == 1090000000);
+    REQUIRE(source.Chunks()[1].header.timestampNs >= source.Chunks()[0].header.timestampNs);
+
+    std::vector<uint8_t> actual;
+    REQUIRE(source.Replay([&](std::span<uint8_t const> const& buf) { actual.insert(actual.end(), buf.begin(), buf.end()); })
+            == BufferCount * 2 / 3);
+    REQUIRE(actual == expected);
+    std::filesystem::remove_all(dir);
+}
+
 TEST_CASE("TestEnv", "[1090]")
 {
     auto* dirpathstr = getenv("RTLSDR_TEST_TRACE_DIR");
@@ -145,3 +1301,238 @@ TEST_CASE("TestEnv", "[1090]")
         RunTestWithFile(fpath);
     }
 }
+
+struct FISBListener : ADSB::FISB::IProductListener
+{
+    void OnNexradBlock(ADSB::FISB::Apdu const& /* apdu */, ADSB::FISB::NexradBlock const& /* block */) override { nexradCount++; }
+    void OnText(ADSB::FISB::Apdu const& apdu, std::string_view const& text) override
+    {
+        REQUIRE(apdu.productId == ADSB::FISB::ProductId::GenericText);
+        texts.emplace_back(text);
+        if (unsubscribeFrom != nullptr) { unsubscribeFrom->Unsubscribe(*this); }
+    }
+    void OnApdu(ADSB::FISB::Apdu const& apdu) override
+    {
+        apduCount++;
+        last = apdu;
+    }
+
+    size_t                   nexradCount{};
+    size_t                   apduCount{};
+    ADSB::FISB::Apdu         last{};    // Of OnApdu, its payload is gone
+    std::vector<std::string> texts;
+    ADSB::UATUplinkDecoder*  unsubscribeFrom{};
+};
+
+static std::vector<uint8_t> EncodeDlac(std::string_view const& text)
+{
+    static constexpr std::string_view DlacCharset
+        = "\x03"
+          "ABCDEFGHIJKLMNOPQRSTUVWXYZ\x1a\t\x1e\n| !\"#$%&'()*+,-./0123456789:;<=>?";
+    std::vector<uint8_t> codes;
+    for (auto c : text) { codes.push_back(static_cast<uint8_t>(DlacCharset.find(c))); }
+    while (codes.size() % 4 != 0) { codes.push_back(0); }
+    std::vector<uint8_t> packed;
+    for (size_t i = 0; i < codes.size(); i += 4)
+    {
+        packed.push_back(static_cast<uint8_t>((codes[i] << 2) | (codes[i + 1] >> 4)));
+        packed.push_back(static_cast<uint8_t>(((codes[i + 1] & 0x0f) << 4) | (codes[i + 2] >> 2)));
+        packed.push_back(static_cast<uint8_t>(((codes[i + 2] & 0x03) << 6) | codes[i + 3]));
+    }
+    return packed;
+}
+
+TEST_CASE("FISBUplink", "[978]")
+{
+    std::vector<uint8_t> frame(ADSB::UATUplinkDecoder::FrameBytes);
+    frame[6] = 0x20;    // Application data valid
+
+    auto   text     = EncodeDlac("METAR KSEA 121853Z\x1eTAF KSEA 1218\x03");
+    size_t apduSize = 4 + text.size();
+    auto*  info     = frame.data() + ADSB::UATUplinkDecoder::HeaderBytes;
+    info[0]         = static_cast<uint8_t>(apduSize >> 1);
+    info[1]         = static_cast<uint8_t>((apduSize & 1) << 7);
+    info[2]         = static_cast<uint8_t>((ADSB::FISB::ProductId::GenericText >> 6) & 0x1f);
+    info[3]         = static_cast<uint8_t>((ADSB::FISB::ProductId::GenericText & 0x3f) << 2);
+    info[4]         = static_cast<uint8_t>((18 << 2) | (53 >> 4));
+    info[5]         = static_cast<uint8_t>((53 & 0x0f) << 4);
+    std::ranges::copy(text, info + 6);
+
+    FISBListener           listener;
+    ADSB::UATUplinkDecoder decoder;
+    decoder.HandleFrame(frame, 0);
+    REQUIRE(listener.texts.empty());
+
+    decoder.Subscribe(ADSB::FISB::ProductId::NexradCONUS, listener);
+    decoder.HandleFrame(frame, 0);
+    REQUIRE(listener.texts.empty());
+
+    decoder.Subscribe(ADSB::FISB::ProductId::GenericText, listener);
+    decoder.HandleFrame(frame, 0);
+    REQUIRE(listener.texts == std::vector<std::string>{"METAR KSEA 121853Z", "TAF KSEA 1218"});
+    REQUIRE(listener.nexradCount == 0);
+    REQUIRE(listener.apduCount == 0);
+
+    decoder.Unsubscribe(listener);
+    decoder.HandleFrame(frame, 0);
+    REQUIRE(listener.texts.size() == 2);
+
+    // Once per APDU however many subscriptions match, and free to unsubscribe from the callback
+    decoder.Subscribe(ADSB::FISB::ProductId::GenericText, listener);
+    decoder.Subscribe(ADSB::FISB::ProductId::AllProducts, listener);
+    listener.unsubscribeFrom = &decoder;
+    decoder.HandleFrame(frame, 0);
+    REQUIRE(listener.texts.size() == 4);
+    decoder.HandleFrame(frame, 0);
+    REQUIRE(listener.texts.size() == 4);
+
+    REQUIRE_THROWS_AS(decoder.Subscribe(ADSB::FISB::ProductId::Max + 1, listener), std::invalid_argument);
+}
+
+TEST_CASE("FISBUplinkTime", "[978]")
+{
+    // Time option 3: month, day, hours, minutes and seconds, the 6 bit seconds split 3 + 3 over two bytes
+    static constexpr uint16_t ProductId = 8;
+    std::vector<uint8_t>      frame(ADSB::UATUplinkDecoder::FrameBytes);
+    frame[6] = 0x20;    // Application data valid
+
+    size_t apduSize = 6 + 2;
+    auto*  info     = frame.data() + ADSB::UATUplinkDecoder::HeaderBytes;
+    info[0]         = static_cast<uint8_t>(apduSize >> 1);
+    info[1]         = static_cast<uint8_t>((apduSize & 1) << 7);
+    info[2]         = static_cast<uint8_t>((ProductId >> 6) & 0x1f);
+    info[3]         = static_cast<uint8_t>(((ProductId & 0x3f) << 2) | 0x01);
+    info[4]         = static_cast<uint8_t>(0x80 | (10 << 3) | (19 >> 2));
+    info[5]         = static_cast<uint8_t>(((19 & 0x03) << 6) | (18 << 1) | (53 >> 5));
+    info[6]         = static_cast<uint8_t>(((53 & 0x1f) << 3) | (47 >> 3));
+    info[7]         = static_cast<uint8_t>((47 & 0x07) << 5);
+
+    FISBListener           listener;
+    ADSB::UATUplinkDecoder decoder;
+    decoder.Subscribe(ProductId, listener);
+    decoder.HandleFrame(frame, 0);
+    REQUIRE(listener.apduCount == 1);
+    REQUIRE(listener.last.productId == ProductId);
+    REQUIRE(listener.last.monthDayValid);
+    REQUIRE(listener.last.secondsValid);
+    REQUIRE(listener.last.month == 10);
+    REQUIRE(listener.last.day == 19);
+    REQUIRE(listener.last.hours == 18);
+    REQUIRE(listener.last.minutes == 53);
+    REQUIRE(listener.last.seconds == 47);
+}
+
+TEST_CASE("UATGenerator", "[978]")
+{
+    UATGenerator generator({.seconds = 1, .aircraft = 20, .messagesPerSecond = 200, .snrSpreadDb = 0, .byteErrorRate = 0.3});
+    auto         data = generator.Generate();
+    REQUIRE(data.size() == generator.Samples() * 2);
+
+    std::vector<uint8_t> blocks;
+    generator.Generate([&](std::span<uint8_t const> const& bytes) { blocks.insert(blocks.end(), bytes.begin(), bytes.end()); }, 1000);
+    REQUIRE(blocks == data);
+
+    // Every codeword as sent without errors is a Reed-Solomon codeword for the dump978 parameters: it
+    // vanishes at a^120.. with a bitwise GF(256) multiply independent of the generator's log tables
+    auto multiply = [](unsigned a, unsigned b) {
+        unsigned product = 0;
+        for (; b != 0; b >>= 1u)
+        {
+            if ((b & 1u) != 0) { product ^= a; }
+            a <<= 1u;
+            if ((a & 0x100u) != 0) { a ^= 0x187u; }
+        }
+        return product;
+    };
+    auto isCodeword = [&](std::vector<uint8_t> const& codeword, size_t parityBytes) {
+        unsigned root = 1;
+        for (size_t i = 0; i < 120; i++) { root = multiply(root, 2); }
+        for (size_t i = 0; i < parityBytes; i++, root = multiply(root, 2))
+        {
+            unsigned syndrome = 0;
+            for (auto byte : codeword) { syndrome = multiply(syndrome, root) ^ byte; }
+            if (syndrome != 0) { return false; }
+        }
+        return true;
+    };
+
+    size_t clean     = 0;
+    size_t corrupted = 0;
+    size_t uplinks   = 0;
+    for (auto const& t : generator.Transmissions())
+    {
+        if (t.byteErrors > 0)
+        {
+            corrupted++;
+            continue;
+        }
+        clean++;
+        if (t.type == UATGenerator::FrameType::Basic)
+        {
+            REQUIRE(t.coded.size() == UATGenerator::BasicBytes);
+            REQUIRE(isCodeword(t.coded, UATGenerator::BasicBytes - UATGenerator::BasicDataBytes));
+        }
+        else if (t.type == UATGenerator::FrameType::Long)
+        {
+            REQUIRE(t.coded.size() == UATGenerator::LongBytes);
+            REQUIRE(isCodeword(t.coded, UATGenerator::LongBytes - UATGenerator::LongDataBytes));
+        }
+        else
+        {
+            uplinks++;
+            REQUIRE(t.coded.size() == UATGenerator::UplinkBytes);
+            for (size_t b = 0; b < UATGenerator::UplinkBlocks; b++)
+            {
+                std::vector<uint8_t> block(UATGenerator::BlockBytes);
+                for (size_t i = 0; i < block.size(); i++) { block[i] = t.coded[(i * UATGenerator::UplinkBlocks) + b]; }
+                REQUIRE(isCodeword(block, UATGenerator::BlockBytes - UATGenerator::BlockDataBytes));
+            }
+        }
+    }
+    REQUIRE(clean > 0);
+    REQUIRE(corrupted > 0);
+    REQUIRE(uplinks > 0);
+
+    Selector selector;
+    Listener listener;
+    auto     trafficManager = std::make_shared<ADSB::TrafficManager>();
+    trafficManager->SetListener(&listener);
+    auto handler = ADSB::test::TryCreateUAT978Handler(trafficManager, &selector, ADSB::Source::UAT978);
+    for (size_t offset = 0; offset < data.size(); offset += RTLSDR::BufferLength)
+    {
+        handler->HandleData(std::span<uint8_t const>(data).subspan(offset, std::min(RTLSDR::BufferLength, data.size() - offset)));
+    }
+
+    // Every injected error is within what the FEC corrects, so everything sent in the clear is decoded.
+    // Overlapped frames may or may not be, but nothing is decoded that wasn't sent
+    size_t clearDownlinks = 0;
+    size_t clearUplinks   = 0;
+    size_t clearFixed     = 0;
+    size_t downlinks      = 0;
+    for (auto const& t : generator.Transmissions())
+    {
+        downlinks += t.type != UATGenerator::FrameType::Uplink ? 1 : 0;
+        if (t.overlapped) { continue; }
+        (t.type == UATGenerator::FrameType::Uplink ? clearUplinks : clearDownlinks)++;
+        clearFixed += t.byteErrors > 0 ? 1 : 0;
+    }
+    auto stats = dynamic_cast<ADSB::IDataProvider&>(*handler).GetStats();
+    REQUIRE(clearUplinks > 0);
+    REQUIRE(clearFixed > 0);
+    REQUIRE(stats.downlinkFrames >= clearDownlinks);
+    REQUIRE(stats.downlinkFrames <= downlinks);
+    REQUIRE(stats.uplinkFrames >= clearUplinks);
+    REQUIRE(stats.uplinkFrames <= uplinks);
+    REQUIRE(stats.fixed >= clearFixed);
+
+    // Long frames carry the callsign
+    auto const& fleet = generator.Fleet();
+    for (auto const& t : generator.Transmissions())
+    {
+        if (t.overlapped || t.type != UATGenerator::FrameType::Long) { continue; }
+        auto aircraft = std::ranges::find(fleet, t.addr, &UATGenerator::Aircraft::addr);
+        REQUIRE(trafficManager->aircrafts.contains(t.addr));
+        auto callsign = trafficManager->aircrafts.at(t.addr)->FlightNumber();
+        REQUIRE(callsign.substr(0, 7) == std::string_view(aircraft->callsign.data(), 7));
+    }
+}
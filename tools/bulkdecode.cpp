@@ -0,0 +1,113 @@
+// Decodes a capture on every core (BulkDecoder.h) and prints the aircraft seen, optionally with every
+// demodulated frame in sample order.
+//
+//  bulkdecode --in capture_1090.bin [--band 1090|978] [--frames frames.csv] [--threads 0] [--chunk <samples>]
+//             [--margin <samples>] [--start <unix seconds>]
+//
+// The band defaults to 978 for files with 978 in their name, like the test traces. --start is when the
+// capture began, tracked positions are stamped from it (default: now).
+#include "BulkDecoder.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+namespace
+{
+// The tracker needs a listener, the final state is read from the traffic manager
+struct CountingListener : ADSB::IListener
+{
+    void OnChanged(ADSB::IAirCraft const& /* a */) override { updates++; }
+    void OnDeviceStatusChanged(ADSB::Source /* source */, bool /* available */) override {}
+    void OnDataLost(ADSB::Source /* source */, uint64_t /* droppedSamples */) override {}
+
+    uint64_t updates{};
+};
+}    // namespace
+
+int main(int argc, char* argv[])
+try
+{
+    BulkDecoder::Config           config;
+    std::string                   in;
+    std::string                   frames;
+    std::string                   band;
+    std::vector<std::string_view> args(argv + 1, argv + argc);    // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    for (size_t i = 0; i + 1 < args.size(); i += 2)
+    {
+        auto name  = args[i];
+        auto value = std::string(args[i + 1]);
+        if (name == "--in") { in = value; }
+        else if (name == "--band") { band = value; }
+        else if (name == "--frames") { frames = value; }
+        else if (name == "--threads") { config.threads = static_cast<unsigned>(std::stoul(value)); }
+        else if (name == "--chunk") { config.chunkSamples = std::stoull(value); }
+        else if (name == "--margin") { config.marginSamples = std::stoull(value); }
+        else if (name == "--start") { config.start = std::chrono::system_clock::time_point{std::chrono::seconds{std::stoll(value)}}; }
+        else
+        {
+            in.clear();
+            break;
+        }
+    }
+    if (in.empty() || args.size() % 2 != 0 || (!band.empty() && band != "1090" && band != "978"))
+    {
+        std::cerr << "Usage: bulkdecode --in <capture> [--band 1090|978] [--frames <csv>] [--threads <n>] [--chunk <samples>]\n"
+                     "                  [--margin <samples>] [--start <unix seconds>]\n";
+        return 1;
+    }
+    if (band.empty()) { band = std::filesystem::path(in).filename().string().find("978") != std::string::npos ? "978" : "1090"; }
+    config.band = band == "978" ? BulkDecoder::Band::UAT978 : BulkDecoder::Band::ADSB1090;
+
+    IQFileSource     source(in, IQFileSource::Config{.sampleRate = band == "978" ? 2083334u : 2000000u});
+    BulkDecoder      decoder(config);
+    CountingListener listener;
+    auto             trafficManager = std::make_shared<ADSB::TrafficManager>();
+    trafficManager->SetListener(&listener);
+
+    BulkDecoder::Totals totals;
+    if (frames.empty()) { totals = decoder.Run(source, trafficManager); }
+    else
+    {
+        std::ofstream csv(frames);
+        if (!csv) { throw std::runtime_error("Cannot write " + frames); }
+        csv << "sample,address,uplink,corrected,signal_dbfs,frame\n";
+        totals = decoder.Run(source, trafficManager, [&](ADSB::DemodulatedFrame const& frame) {
+            csv << frame.sample << ',' << std::hex << std::setfill('0') << std::setw(6) << frame.addr << std::dec << ','
+                << int{frame.uplink} << ',' << frame.corrected << ',' << std::fixed << std::setprecision(1) << frame.signalLevel << ','
+                << std::hex;
+            for (auto byte : frame.bytes) { csv << std::setw(2) << int{byte}; }
+            csv << std::dec << std::setfill(' ') << '\n';
+        });
+    }
+
+    for (auto const& [addr, a] : trafficManager->aircrafts)
+    {
+        std::cout << std::hex << std::setfill('0') << std::setw(6) << addr << std::dec << std::setfill(' ') << ' '
+                  << std::string_view(a->callsign.data(), a->callsign.size()) << std::fixed << std::setprecision(4) << std::setw(10)
+                  << (a->lat1E7 / ADSB::IAirCraft::LatLonPrecision) << std::setw(10) << (a->lon1E7 / ADSB::IAirCraft::LatLonPrecision)
+                  << std::setw(7) << a->altitude << std::setw(5) << a->speed << '\n';
+    }
+    auto seconds = std::chrono::duration<double>(totals.elapsed).count();
+    std::cerr << totals.frames << " frames (" << totals.duplicates << " duplicates dropped), " << listener.updates << " updates, "
+              << trafficManager->aircrafts.size() << " aircraft from " << totals.samples << " samples in " << totals.chunks << " chunks, "
+              << std::setprecision(2) << seconds << " s (" << (static_cast<double>(totals.samples) / source.SampleRate() / seconds)
+              << "x real time)\n";
+    return 0;
+} catch (std::exception const& ex)
+{
+    std::cerr << "bulkdecode: " << ex.what() << '\n';
+    return 1;
+}
@@ -0,0 +1,81 @@
+// Writes a synthetic 1090 MHz capture (rtl_sdr format, replayable with IQFileSource or RTLSDR_TEST_TRACE_FILE)
+// and the list of transmitted messages for scoring a decoder against.
+//
+//  modesgen --out capture_1090.bin [--truth capture_1090.csv] [--rate 2000000] [--seconds 10] [--aircraft 200]
+//           [--messages 5000] [--df11 0.3] [--snr 20] [--snr-spread 6] [--noise 3] [--overlap 0] [--phase 0]
+//           [--bit-errors 0] [--two-bit-errors 0] [--seed 1]
+#include "ModeSGenerator.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+int main(int argc, char* argv[])
+try
+{
+    ModeSGenerator::Config        config;
+    std::string                   out;
+    std::string                   truth;
+    std::vector<std::string_view> args(argv + 1, argv + argc);    // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    for (size_t i = 0; i + 1 < args.size(); i += 2)
+    {
+        auto name  = args[i];
+        auto value = std::string(args[i + 1]);
+        if (name == "--out") { out = value; }
+        else if (name == "--truth") { truth = value; }
+        else if (name == "--rate") { config.sampleRate = static_cast<uint32_t>(std::stoul(value)); }
+        else if (name == "--seconds") { config.seconds = std::stod(value); }
+        else if (name == "--aircraft") { config.aircraft = static_cast<uint32_t>(std::stoul(value)); }
+        else if (name == "--messages") { config.messagesPerSecond = std::stod(value); }
+        else if (name == "--df11") { config.df11Fraction = std::stod(value); }
+        else if (name == "--snr") { config.snrDb = std::stod(value); }
+        else if (name == "--snr-spread") { config.snrSpreadDb = std::stod(value); }
+        else if (name == "--noise") { config.noiseSigma = std::stod(value); }
+        else if (name == "--overlap") { config.overlapRate = std::stod(value); }
+        else if (name == "--phase") { config.maxPhaseOffset = std::stod(value); }
+        else if (name == "--bit-errors") { config.singleBitErrorRate = std::stod(value); }
+        else if (name == "--two-bit-errors") { config.twoBitErrorRate = std::stod(value); }
+        else if (name == "--seed") { config.seed = static_cast<uint32_t>(std::stoul(value)); }
+        else
+        {
+            out.clear();
+            break;
+        }
+    }
+    if (out.empty() || args.size() % 2 != 0)
+    {
+        std::cerr << "Usage: modesgen --out <file> [--truth <csv>] [--rate <S/s>] [--seconds <s>] [--aircraft <n>] [--messages <per s>]\n"
+                     "                [--df11 <fraction>] [--snr <dB>] [--snr-spread <dB>] [--noise <sigma>] [--overlap <fraction>]\n"
+                     "                [--phase <samples>] [--bit-errors <fraction>] [--two-bit-errors <fraction>] [--seed <n>]\n";
+        return 1;
+    }
+
+    ModeSGenerator generator(config);
+    std::ofstream  iq(out, std::ios::binary);
+    if (!iq) { throw std::runtime_error("Cannot write " + out); }
+    generator.Generate([&](std::span<uint8_t const> const& bytes) {
+        iq.write(reinterpret_cast<char const*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));    // NOLINT
+    });
+    if (!truth.empty())
+    {
+        std::ofstream csv(truth);
+        if (!csv) { throw std::runtime_error("Cannot write " + truth); }
+        generator.WriteTruthCsv(csv);
+    }
+    std::cout << generator.Transmissions().size() << " messages from " << config.aircraft << " aircraft in " << generator.Samples()
+              << " samples\n";
+    return 0;
+} catch (std::exception const& ex)
+{
+    std::cerr << "modesgen: " << ex.what() << '\n';
+    return 1;
+}
@@ -0,0 +1,80 @@
+// Writes a synthetic 978 MHz UAT capture (rtl_sdr format at 2.083334 MS/s, replayable with IQFileSource or
+// RTLSDR_TEST_TRACE_FILE when the file name contains 978) and the list of transmitted frames.
+//
+//  uatgen --out capture_978.bin [--truth capture_978.csv] [--seconds 1] [--aircraft 50] [--messages 200]
+//         [--long 0.5] [--uplinks 4] [--snr 20] [--snr-spread 6] [--noise 3] [--offset 0]
+//         [--byte-errors 0] [--max-byte-errors 4] [--seed 1]
+#include "UATGenerator.h"
+
+SUPPRESS_WARNINGS_START
+SUPPRESS_STL_WARNINGS
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+SUPPRESS_WARNINGS_END
+
+int main(int argc, char* argv[])
+try
+{
+    UATGenerator::Config          config;
+    std::string                   out;
+    std::string                   truth;
+    std::vector<std::string_view> args(argv + 1, argv + argc);    // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+    for (size_t i = 0; i + 1 < args.size(); i += 2)
+    {
+        auto name  = args[i];
+        auto value = std::string(args[i + 1]);
+        if (name == "--out") { out = value; }
+        else if (name == "--truth") { truth = value; }
+        else if (name == "--seconds") { config.seconds = std::stod(value); }
+        else if (name == "--aircraft") { config.aircraft = static_cast<uint32_t>(std::stoul(value)); }
+        else if (name == "--messages") { config.messagesPerSecond = std::stod(value); }
+        else if (name == "--long") { config.longFraction = std::stod(value); }
+        else if (name == "--uplinks") { config.uplinksPerSecond = std::stod(value); }
+        else if (name == "--snr") { config.snrDb = std::stod(value); }
+        else if (name == "--snr-spread") { config.snrSpreadDb = std::stod(value); }
+        else if (name == "--noise") { config.noiseSigma = std::stod(value); }
+        else if (name == "--offset") { config.frequencyOffsetHz = std::stod(value); }
+        else if (name == "--byte-errors") { config.byteErrorRate = std::stod(value); }
+        else if (name == "--max-byte-errors") { config.maxByteErrors = static_cast<uint32_t>(std::stoul(value)); }
+        else if (name == "--seed") { config.seed = static_cast<uint32_t>(std::stoul(value)); }
+        else
+        {
+            out.clear();
+            break;
+        }
+    }
+    if (out.empty() || args.size() % 2 != 0)
+    {
+        std::cerr << "Usage: uatgen --out <file> [--truth <csv>] [--seconds <s>] [--aircraft <n>] [--messages <per s>]\n"
+                     "              [--long <fraction>] [--uplinks <per s>] [--snr <dB>] [--snr-spread <dB>] [--noise <sigma>]\n"
+                     "              [--offset <Hz>] [--byte-errors <fraction>] [--max-byte-errors <n>] [--seed <n>]\n";
+        return 1;
+    }
+
+    UATGenerator  generator(config);
+    std::ofstream iq(out, std::ios::binary);
+    if (!iq) { throw std::runtime_error("Cannot write " + out); }
+    generator.Generate([&](std::span<uint8_t const> const& bytes) {
+        iq.write(reinterpret_cast<char const*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));    // NOLINT
+    });
+    if (!truth.empty())
+    {
+        std::ofstream csv(truth);
+        if (!csv) { throw std::runtime_error("Cannot write " + truth); }
+        generator.WriteTruthCsv(csv);
+    }
+    std::cout << generator.Transmissions().size() << " frames from " << config.aircraft << " aircraft in " << generator.Samples()
+              << " samples\n";
+    return 0;
+} catch (std::exception const& ex)
+{
+    std::cerr << "uatgen: " << ex.what() << '\n';
+    return 1;
+}
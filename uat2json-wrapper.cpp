@@ -11,8 +11,20 @@ extern "C"
 #include <algorithm>
 #include <iostream>
 
-void dump_raw_message(char /*updown*/, uint8_t* data, int /*len*/, int /*rs_errors*/)    // NOLINT
+static constexpr char UplinkFrame = '+';
+
+void dump_raw_message(char updown, uint8_t* data, int len, int rsErrors)    // NOLINT
 {
+    if (updown == UplinkFrame)
+    {
+        // Ground uplink (FIS-B/TIS-B). Not an ADS-B MDB
+        auto* sink = *ADSB::GetThreadLocalUATFrameSink();
+        if (sink != nullptr && len >= UPLINK_FRAME_DATA_BYTES) { sink->OnUplinkFrame({data, static_cast<size_t>(len)}, rsErrors); }
+        return;
+    }
+    auto* sink = *ADSB::GetThreadLocalUATFrameSink();
+    if (sink != nullptr && !sink->OnDownlinkFrame({data, static_cast<size_t>(len)}, rsErrors)) { return; }
+
     struct uat_adsb_mdb mdb{};
 
     uat_decode_adsb_mdb(data, &mdb);
@@ -93,6 +105,8 @@ void dump_raw_message(char /*updown*/, uint8_t* data, int /*len*/, int /*rs_erro
         case ALT_INVALID:
         default: break;
         }
+        // After the altitude, which goes into the track history with the position
+        if (mdb.position_valid) { manager->UpdatePosition(aircraft); }
         /*
         if (mdb->dimensions_valid)
             fprintf(to,